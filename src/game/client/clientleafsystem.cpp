@@ -19,6 +19,7 @@
 #include "engine/IStaticPropMgr.h"
 #include "engine/ivdebugoverlay.h"
 #include "vstdlib/jobthread.h"
+#include "tier0/fasttimer.h"
 #include "tier1/utllinkedlist.h"
 #include "datacache/imdlcache.h"
 #include "view.h"
@@ -33,6 +34,7 @@ static ConVar cl_drawleaf("cl_drawleaf", "-1", FCVAR_CHEAT );
 static ConVar r_PortalTestEnts( "r_PortalTestEnts", "1", FCVAR_CHEAT, "Clip entities against portal frustums." );
 static ConVar r_portalsopenall( "r_portalsopenall", "0", FCVAR_CHEAT, "Open all portals" );
 static ConVar cl_threaded_client_leaf_system("cl_threaded_client_leaf_system", "0"  );
+static ConVar cl_leafsystem_stats( "cl_leafsystem_stats", "0", FCVAR_CHEAT, "Show the time spent building renderable lists for each view." );
 
 
 DEFINE_FIXEDSIZE_ALLOCATOR( CClientRenderablesList, 1, CUtlMemoryPool::GROW_SLOW );
@@ -292,6 +294,14 @@ private:
 		ClientRenderHandle_t handle;
 	};
 
+	// Time spent in BuildRenderablesList, for cl_leafsystem_stats
+	struct BuildListStats_t
+	{
+		float	m_flAvgMs;
+		int		m_nLeaves;
+		int		m_nRenderables;		// Render list entries, not counting each leaf's fake entries
+	};
+
 	// Stores data associated with each leaf.
 	CUtlVector< ClientLeaf_t >	m_Leaf;
 
@@ -324,6 +334,8 @@ private:
 	int	m_ShadowEnum;
 
 	CTSList<EnumResultList_t> m_DeferredInserts;
+
+	BuildListStats_t m_BuildListStats[ VIEW_ID_COUNT ];
 };
 
 
@@ -438,6 +450,7 @@ void CalcRenderableWorldSpaceAABB_Fast( IClientRenderable *pRenderable, Vector &
 //-----------------------------------------------------------------------------
 CClientLeafSystem::CClientLeafSystem() : m_DrawStaticProps(true), m_DrawSmallObjects(true)
 {
+	memset( m_BuildListStats, 0, sizeof( m_BuildListStats ) );
 	// Set up the bi-directional lists...
 	m_RenderablesInLeaf.Init( FirstRenderableInLeaf, FirstLeafInRenderable );
 	m_ShadowsInLeaf.Init( FirstShadowInLeaf, FirstLeafInShadow ); 
@@ -1819,6 +1832,9 @@ void CClientLeafSystem::BuildRenderablesList( const SetupRenderInfo_t &info )
 	CClientRenderablesList::CEntry *pTranslucentEntries = info.m_pRenderList->m_RenderGroups[RENDER_GROUP_TRANSLUCENT_ENTITY];
 	int &nTranslucentEntries = info.m_pRenderList->m_RenderGroupCounts[RENDER_GROUP_TRANSLUCENT_ENTITY];
 
+	CFastTimer timer;
+	timer.Start();
+
 	for( int i = 0; i < leafCount; i++ )
 	{
 		int nTranslucent = nTranslucentEntries;
@@ -1833,4 +1849,30 @@ void CClientLeafSystem::BuildRenderablesList( const SetupRenderInfo_t &info )
 			SortEntities( vecRenderOrigin, vecRenderForward, &pTranslucentEntries[nTranslucent], nNewTranslucent );
 		}
 	}
+
+	timer.End();
+
+	if ( cl_leafsystem_stats.GetBool() && info.m_nViewID >= 0 && info.m_nViewID < VIEW_ID_COUNT )
+	{
+		int nRenderables = 0;
+		for ( int i = 0; i < RENDER_GROUP_COUNT; i++ )
+		{
+			const CClientRenderablesList::CEntry *pEntries = info.m_pRenderList->m_RenderGroups[i];
+			for ( int j = 0; j < info.m_pRenderList->m_RenderGroupCounts[i]; j++ )
+			{
+				if ( pEntries[j].m_pRenderable )
+				{
+					nRenderables++;
+				}
+			}
+		}
+
+		BuildListStats_t &stats = m_BuildListStats[ info.m_nViewID ];
+		stats.m_flAvgMs = stats.m_flAvgMs * 0.9f + timer.GetDuration().GetMillisecondsF() * 0.1f;
+		stats.m_nLeaves = leafCount;
+		stats.m_nRenderables = nRenderables;
+
+		engine->Con_NPrintf( 12 + info.m_nViewID, "view %d: BuildRenderablesList %6.3f ms (%d leaves, %d renderables)", 
+			info.m_nViewID, stats.m_flAvgMs, stats.m_nLeaves, stats.m_nRenderables );
+	}
 }
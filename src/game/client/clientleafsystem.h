@@ -81,11 +81,13 @@ struct SetupRenderInfo_t
 	int m_nRenderFrame;
 	int m_nDetailBuildFrame;	// The "render frame" for detail objects
 	float m_flRenderDistSq;
+	int m_nViewID;				// view_id_t of the view being set up
 	bool m_bDrawDetailObjects : 1;
 	bool m_bDrawTranslucentObjects : 1;
 
 	SetupRenderInfo_t()
 	{
+		m_nViewID = -1;
 		m_bDrawDetailObjects = true;
 		m_bDrawTranslucentObjects = true;
 	}
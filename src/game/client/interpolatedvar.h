@@ -262,6 +262,20 @@ struct CInterpolatedVarEntryBase
 		count = 0;
 	}
 
+	// Temporaries (the hermite time fixup) use stack storage instead of allocating
+	// every interpolation. Detach before the entry goes out of scope.
+	void AttachValue( Type *pStorage, int maxCount )
+	{
+		Assert( !value );
+		value = pStorage;
+		count = maxCount;
+	}
+	void DetachValue()
+	{
+		value = NULL;
+		count = 0;
+	}
+
 	float		changetime;
 	int			count;
 	Type *		value;
@@ -297,6 +311,12 @@ struct CInterpolatedVarEntryBase<Type, false>
 
 	void DeleteEntry() {}
 
+	void AttachValue( Type *pStorage, int maxCount )
+	{
+		Assert(maxCount==1);
+	}
+	void DetachValue() {}
+
 	float		changetime;
 	Type		value;
 };
@@ -1434,7 +1454,7 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Interpolate_Hermite(
 	CDisableRangeChecks disableRangeChecks; 
 
 	CInterpolatedVarEntry fixup;
-	fixup.Init(m_nMaxCount);
+	fixup.AttachValue( IS_ARRAY ? (Type*)_alloca( sizeof(Type) * m_nMaxCount ) : NULL, m_nMaxCount );
 	TimeFixup_Hermite( fixup, prev, start, end );
 
 	for( int i = 0; i < m_nMaxCount; i++ )
@@ -1455,6 +1475,8 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Interpolate_Hermite(
 		// skyrocket it off into la-la land).
 		Lerp_Clamp( out[i] );
 	}
+
+	fixup.DetachValue();
 }
 
 template< typename Type, bool IS_ARRAY >
@@ -1473,7 +1495,7 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Derivative_Hermite(
 	CDisableRangeChecks disableRangeChecks; 
 
 	CInterpolatedVarEntry fixup;
-	fixup.value = (Type*)_alloca( sizeof(Type) * m_nMaxCount );
+	fixup.AttachValue( IS_ARRAY ? (Type*)_alloca( sizeof(Type) * m_nMaxCount ) : NULL, m_nMaxCount );
 	TimeFixup_Hermite( fixup, prev, start, end );
 
 	float divisor = 1.0f / (end->changetime - start->changetime);
@@ -1484,6 +1506,8 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Derivative_Hermite(
 		out[i] = Derivative_Hermite( frac, prev->GetValue()[i], start->GetValue()[i], end->GetValue()[i] );
 		out[i] *= divisor;
 	}
+
+	fixup.DetachValue();
 }
 
 
@@ -1496,7 +1520,7 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Derivative_Hermite_Smoot
 	CInterpolatedVarEntry *d )
 {
 	CInterpolatedVarEntry fixup;
-	fixup.Init(m_nMaxCount);
+	fixup.AttachValue( IS_ARRAY ? (Type*)_alloca( sizeof(Type) * m_nMaxCount ) : NULL, m_nMaxCount );
 	TimeFixup_Hermite( fixup, b, c, d );
 	for ( int i=0; i < m_nMaxCount; i++ )
 	{
@@ -1504,6 +1528,8 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Derivative_Hermite_Smoot
 		Type curVel  = (d->GetValue()[i] - c->GetValue()[i]) / (d->changetime - c->changetime);
 		out[i] = Lerp( frac, prevVel, curVel );
 	}
+
+	fixup.DetachValue();
 }
 
 
@@ -10,6 +10,8 @@
 #pragma once
 #endif
 
+#include "mathlib/ssemath.h"
+
 
 template <class T>
 inline T LoopingLerp( float flPercent, T flFrom, T flTo )
@@ -57,6 +59,30 @@ inline T Lerp_Hermite( float t, const T& p0, const T& p1, const T& p2 )
 }
 
 
+// Same weights and order of operations as the generic version, one lane per component.
+template<>
+inline Vector Lerp_Hermite<Vector>( float t, const Vector& p0, const Vector& p1, const Vector& p2 )
+{
+	fltx4 v0 = LoadUnaligned3SIMD( p0.Base() );
+	fltx4 v1 = LoadUnaligned3SIMD( p1.Base() );
+	fltx4 v2 = LoadUnaligned3SIMD( p2.Base() );
+	fltx4 d1 = SubSIMD( v1, v0 );
+	fltx4 d2 = SubSIMD( v2, v1 );
+
+	float tSqr = t*t;
+	float tCube = t*tSqr;
+
+	fltx4 out = MulSIMD( v1, ReplicateX4( 2*tCube-3*tSqr+1 ) );
+	out = AddSIMD( out, MulSIMD( v2, ReplicateX4( -2*tCube+3*tSqr ) ) );
+	out = AddSIMD( out, MulSIMD( d1, ReplicateX4( tCube-2*tSqr+t ) ) );
+	out = AddSIMD( out, MulSIMD( d2, ReplicateX4( tCube-tSqr ) ) );
+
+	Vector output;
+	StoreUnaligned3SIMD( output.Base(), out );
+	return output;
+}
+
+
 template <class T>
 inline T Derivative_Hermite( float t, const T& p0, const T& p1, const T& p2 )
 {
@@ -9,6 +9,7 @@
 #include "beam_shared.h"
 #include "ndebugoverlay.h"
 #include "filters.h"
+#include "beamsensor.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -30,9 +31,12 @@ class CEnvBeam : public CBeam
 public:
 	DECLARE_CLASS( CEnvBeam, CBeam );
 
+	CEnvBeam();
+
 	void	Spawn( void );
 	void	Precache( void );
 	void	Activate( void );
+	void	UpdateOnRemove( void );
 
 	void	StrikeThink( void );
 	void	UpdateThink( void );
@@ -89,6 +93,12 @@ public:
 	string_t		m_iszDecal;
 
 	COutputEvent	m_OnTouchedByEntity;
+
+	// Not saved; a new sensor is made on the next think and starts out dirty
+	BeamSensorHandle_t	m_hBeamSensor;
+	trace_t		m_DamageTrace;
+	bool		m_bDamageTraceValid;
+	bool		m_bTouchTraceHit;
 };
 
 LINK_ENTITY_TO_CLASS( env_beam, CEnvBeam );
@@ -130,6 +140,27 @@ END_DATADESC()
 
 
 
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CEnvBeam::CEnvBeam()
+{
+	m_hBeamSensor = BEAMSENSOR_INVALID_HANDLE;
+	m_bDamageTraceValid = false;
+	m_bTouchTraceHit = false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CEnvBeam::UpdateOnRemove( void )
+{
+	BeamSensor_Destroy( m_hBeamSensor );
+	BaseClass::UpdateOnRemove();
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -326,6 +357,8 @@ void CEnvBeam::TurnOff( void )
 
 	SetNextThink( TICK_NEVER_THINK );
 	SetThink( NULL );
+
+	BeamSensor_Destroy( m_hBeamSensor );
 }
 
 
@@ -551,12 +584,29 @@ bool CEnvBeam::PassesTouchFilters(CBaseEntity *pOther)
 //-----------------------------------------------------------------------------
 void CEnvBeam::UpdateThink( void )
 {
+	if ( m_hBeamSensor == BEAMSENSOR_INVALID_HANDLE )
+	{
+		m_hBeamSensor = BeamSensor_Create( this, MASK_SOLID | MASK_SHOT );
+	}
+
+	// Traces below stand until something near the beam changes. The sensor is
+	// cleaned before they run so that whatever our damage moves still dirties it.
+	bool bRetest = BeamSensor_NeedsRetest( m_hBeamSensor, GetAbsStartPos(), GetAbsEndPos() );
+	if ( bRetest )
+	{
+		BeamSensor_SetResult( m_hBeamSensor, 1.0f );
+		m_bDamageTraceValid = false;
+	}
+
 	// Apply damage every 1/10th of a second.
 	if ( ( m_flDamage > 0 ) && ( gpGlobals->curtime >= m_flFireTime + 0.1 ) )
 	{
-		trace_t tr;
-		UTIL_TraceLine( GetAbsStartPos(), GetAbsEndPos(), MASK_SOLID, NULL, COLLISION_GROUP_NONE, &tr );
-		BeamDamage( &tr );
+		if ( !m_bDamageTraceValid )
+		{
+			UTIL_TraceLine( GetAbsStartPos(), GetAbsEndPos(), MASK_SOLID, NULL, COLLISION_GROUP_NONE, &m_DamageTrace );
+			m_bDamageTraceValid = true;
+		}
+		BeamDamage( &m_DamageTrace );
 		// BeamDamage calls RelinkBeam, so no need to call it again.
 	}
 	else
@@ -564,7 +614,9 @@ void CEnvBeam::UpdateThink( void )
 		RelinkBeam();
 	}
 
-	if( m_TouchType != touch_none )
+	// Something that failed the touch filters may pass them later, so only a
+	// clear beam can skip the touch trace
+	if( m_TouchType != touch_none && ( bRetest || m_bTouchTraceHit ) )
 	{
 		trace_t tr;
 		Ray_t ray;
@@ -581,6 +633,7 @@ void CEnvBeam::UpdateThink( void )
 			enginetrace->TraceRay( ray, MASK_SHOT, &traceFilter, &tr );
 		}
 
+		m_bTouchTraceHit = ( tr.fraction != 1.0 );
 		if( tr.fraction != 1.0 && PassesTouchFilters( tr.m_pEnt ) )
 		{
 			m_OnTouchedByEntity.FireOutput( tr.m_pEnt, this, 0 );
@@ -34,6 +34,25 @@ BEGIN_DATADESC( CEnvLaser )
 END_DATADESC()
 
 
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CEnvLaser::CEnvLaser()
+{
+	m_hBeamSensor = BEAMSENSOR_INVALID_HANDLE;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CEnvLaser::UpdateOnRemove( void )
+{
+	BeamSensor_Destroy( m_hBeamSensor );
+	BaseClass::UpdateOnRemove();
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -183,6 +202,8 @@ void CEnvLaser::TurnOff( void )
 
 	SetNextThink( TICK_NEVER_THINK );
 	SetThink( NULL );
+
+	BeamSensor_Destroy( m_hBeamSensor );
 }
 
 
@@ -240,10 +261,19 @@ void CEnvLaser::StrikeThink( void )
 		vecFireAt = pEnd->GetAbsOrigin();
 	}
 
-	trace_t tr;
+	if ( m_hBeamSensor == BEAMSENSOR_INVALID_HANDLE )
+	{
+		m_hBeamSensor = BeamSensor_Create( this, MASK_SOLID );
+	}
+
+	// The last trace stands until something near the beam changes
+	if ( BeamSensor_NeedsRetest( m_hBeamSensor, GetAbsOrigin(), vecFireAt ) )
+	{
+		UTIL_TraceLine( GetAbsOrigin(), vecFireAt, MASK_SOLID, NULL, COLLISION_GROUP_NONE, &m_LastTrace );
+		BeamSensor_SetResult( m_hBeamSensor, m_LastTrace.fraction );
+	}
 
-	UTIL_TraceLine( GetAbsOrigin(), vecFireAt, MASK_SOLID, NULL, COLLISION_GROUP_NONE, &tr );
-	FireAtPoint( tr );
+	FireAtPoint( m_LastTrace );
 	SetNextThink( gpGlobals->curtime );
 }
 
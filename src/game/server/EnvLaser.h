@@ -14,6 +14,7 @@
 #include "baseentity.h"
 #include "beam_shared.h"
 #include "entityoutput.h"
+#include "beamsensor.h"
 
 
 class CSprite;
@@ -23,9 +24,12 @@ class CEnvLaser : public CBeam
 {
 	DECLARE_CLASS( CEnvLaser, CBeam );
 public:
+	CEnvLaser();
+
 	void	Spawn( void );
 	void	Precache( void );
 	bool	KeyValue( const char *szKeyName, const char *szValue );
+	void	UpdateOnRemove( void );
 
 	void	TurnOn( void );
 	void	TurnOff( void );
@@ -46,6 +50,10 @@ public:
 	Vector  m_firePosition;
 
 	float	m_flStartFrame;
+
+	// Not saved; a new sensor is made on the next think and starts out dirty
+	BeamSensorHandle_t	m_hBeamSensor;
+	trace_t	m_LastTrace;
 };
 
 #endif // ENVLASER_H
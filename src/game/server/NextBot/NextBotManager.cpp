@@ -14,6 +14,7 @@
 #endif
 
 #include "SharedFunctorUtils.h"
+#include "frameprofiler.h"
 //#include "../../common/blackbox_helper.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -307,6 +308,8 @@ static int g_nBlockedSlides;
 
 void NextBotManager::Update( void )
 {
+	FRAMEPROF_SCOPE( FRAMEPROF_NEXTBOT );
+
 	// do lightweight upkeep every tick
 	for( int u=m_botList.Head(); u != m_botList.InvalidIndex(); u = m_botList.Next( u ) )
 	{
@@ -31,6 +31,30 @@ ConVar NextBotAllowGapJumping( "nb_allow_gap_jumping", "1", FCVAR_CHEAT );
 
 ConVar NextBotDebugClimbing( "nb_debug_climbing", "0", FCVAR_CHEAT );
 
+ConVar NextBotFeelerCache( "nb_feeler_cache", "1", FCVAR_CHEAT, "Reuse avoid and climb feeler traces that only touched the world" );
+ConVar NextBotFeelerCacheLookAhead( "nb_feeler_cache_look_ahead", "48", FCVAR_CHEAT, "How far past its end a feeler is swept, so later feelers further along can reuse it" );
+ConVar NextBotFeelerCacheTolerance( "nb_feeler_cache_tolerance", "1", FCVAR_CHEAT, "How far a feeler may drift sideways from a cached sweep and still reuse it" );
+
+// [0] is for bots standing still, [1] for bots on the move
+static int s_feelerTracesIssued[2] = { 0, 0 };
+static int s_feelerTracesServed[2] = { 0, 0 };
+
+CON_COMMAND_F( nb_feeler_cache_stats, "Show how many path follower feeler traces were traced vs served from the cache, and reset the counts", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	static const char *names[2] = { "Idle", "Moving" };
+	for( int i=0; i<2; ++i )
+	{
+		int total = s_feelerTracesIssued[i] + s_feelerTracesServed[i];
+		Msg( "%s feeler traces: %d issued, %d served from cache (%.1f%%)\n", names[i], s_feelerTracesIssued[i], s_feelerTracesServed[i], total ? 100.0f * s_feelerTracesServed[i] / total : 0.0f );
+
+		s_feelerTracesIssued[i] = 0;
+		s_feelerTracesServed[i] = 0;
+	}
+}
+
 
 //--------------------------------------------------------------------------------------------------------------
 /**
@@ -49,6 +73,9 @@ PathFollower::PathFollower( void )
 
 	// was 10.0f for L4D - need a better solution here (MSB 5/15/09)
 	m_goalTolerance = 25.0f;
+
+	m_feelerCacheCount = 0;
+	m_feelerCacheNext = 0;
 }
 
 
@@ -866,6 +893,169 @@ CBaseEntity *PathFollower::FindBlocker( INextBot *bot )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Finds any entity the given filter would hit inside a swept feeler volume
+ */
+class CFeelerBlockerEnum : public IPartitionEnumerator
+{
+public:
+	CFeelerBlockerEnum( ITraceFilter *filter, unsigned int mask )
+	{
+		m_filter = filter;
+		m_mask = mask;
+		m_found = false;
+	}
+
+	virtual IterationRetval_t EnumElement( IHandleEntity *pHandleEntity )
+	{
+		CBaseEntity *entity = EntityFromEntityHandle( pHandleEntity );
+		if ( !entity || entity->IsWorld() || !m_filter->ShouldHitEntity( pHandleEntity, m_mask ) )
+			return ITERATION_CONTINUE;
+
+		m_found = true;
+		return ITERATION_STOP;
+	}
+
+	ITraceFilter *m_filter;
+	unsigned int m_mask;
+	bool m_found;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if the given point is within the feeler's tolerance of the line through its sweep on every
+ * axis, and how far along the sweep it lies (0 at the start, 1 at the end)
+ */
+static bool IsAlongFeeler( const Vector &from, const Vector &to, float tolerance, const Vector &point, float *along )
+{
+	Vector sweep = to - from;
+	float lengthSq = sweep.LengthSqr();
+	if ( lengthSq < 0.0001f )
+		return false;
+
+	*along = DotProduct( point - from, sweep ) / lengthSq;
+
+	Vector offset = point - ( from + *along * sweep );
+	return fabs( offset.x ) <= tolerance && fabs( offset.y ) <= tolerance && fabs( offset.z ) <= tolerance;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Hull trace for the avoid and climb feelers. On a miss the feeler is swept further ahead, with its hull
+ * widened by a tolerance. A later feeler that starts and ends inside that clear sweep must be clear too,
+ * so as the bot walks along its heading the result is handed back without tracing, as long as no entity
+ * the filter cares about has since moved into it. Feelers that hit something are always traced.
+ */
+void PathFollower::TraceFeeler( ILocomotion *mover, const Vector &from, const Vector &to, const Vector &hullMin, const Vector &hullMax, unsigned int mask, ITraceFilter *filter, trace_t *result )
+{
+	if ( !NextBotFeelerCache.GetBool() )
+	{
+		mover->TraceHull( from, to, hullMin, hullMax, mask, filter, result );
+		return;
+	}
+
+	int moving = ( mover->GetGroundSpeed() > 1.0f ) ? 1 : 0;
+	bool isNearBlocked = false;
+
+	for( int c=0; c<m_feelerCacheCount; ++c )
+	{
+		FeelerTrace &cached = m_feelerCache[c];
+
+		if ( cached.m_mask != mask || cached.m_hullMin != hullMin || cached.m_hullMax != hullMax )
+		{
+			continue;
+		}
+
+		float alongFrom, alongTo;
+		if ( !IsAlongFeeler( cached.m_from, cached.m_to, cached.m_tolerance, from, &alongFrom ) ||
+			 !IsAlongFeeler( cached.m_from, cached.m_to, cached.m_tolerance, to, &alongTo ) ||
+			 alongFrom < 0.0f || alongTo < alongFrom )
+		{
+			continue;
+		}
+
+		if ( cached.m_isBlocked )
+		{
+			// we're heading into something we already know about - don't sweep past it again
+			if ( alongFrom <= 1.0f )
+			{
+				isNearBlocked = true;
+			}
+			continue;
+		}
+
+		if ( alongTo > 1.0f )
+		{
+			continue;
+		}
+
+		// the world doesn't move, but something else may have stepped into the feeler
+		Ray_t ray;
+		ray.Init( from, to, hullMin, hullMax );
+		CFeelerBlockerEnum blockers( filter, mask );
+		partition->EnumerateElementsAlongRay( PARTITION_ENGINE_SOLID_EDICTS, ray, false, &blockers );
+		if ( blockers.m_found )
+		{
+			break;
+		}
+
+		*result = cached.m_result;
+		result->startpos = from;
+		result->endpos = to;
+
+		++s_feelerTracesServed[ moving ];
+		return;
+	}
+
+	float lookAhead = NextBotFeelerCacheLookAhead.GetFloat();
+	Vector direction = to - from;
+	float length = direction.NormalizeInPlace();
+
+	if ( isNearBlocked || lookAhead <= 0.0f || length < 0.01f )
+	{
+		mover->TraceHull( from, to, hullMin, hullMax, mask, filter, result );
+		++s_feelerTracesIssued[ moving ];
+		return;
+	}
+
+	float tolerance = MAX( NextBotFeelerCacheTolerance.GetFloat(), 0.0f );
+	Vector widen( tolerance, tolerance, tolerance );
+	Vector sweepTo = to + lookAhead * direction;
+
+	trace_t sweep;
+	mover->TraceHull( from, sweepTo, hullMin - widen, hullMax + widen, mask, filter, &sweep );
+	++s_feelerTracesIssued[ moving ];
+
+	FeelerTrace &slot = m_feelerCache[ m_feelerCacheNext ];
+	slot.m_from = from;
+	slot.m_hullMin = hullMin;
+	slot.m_hullMax = hullMax;
+	slot.m_mask = mask;
+	slot.m_tolerance = tolerance;
+	slot.m_isBlocked = ( sweep.fraction < 1.0f || sweep.startsolid );
+	slot.m_to = sweepTo;
+	slot.m_result = sweep;
+
+	m_feelerCacheNext = ( m_feelerCacheNext + 1 ) % FEELER_CACHE_SIZE;
+	m_feelerCacheCount = MIN( m_feelerCacheCount + 1, (int)FEELER_CACHE_SIZE );
+
+	if ( !slot.m_isBlocked )
+	{
+		// the widened, lengthened sweep is clear, so this feeler inside it is too
+		*result = sweep;
+		result->startpos = from;
+		result->endpos = to;
+		return;
+	}
+
+	mover->TraceHull( from, to, hullMin, hullMax, mask, filter, result );
+	++s_feelerTracesIssued[ moving ];
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Do reflex avoidance movements of very nearby obstacles.
@@ -949,7 +1139,7 @@ Vector PathFollower::Avoid( INextBot *bot, const Vector &goalPos, const Vector &
 	float leftAvoid = 0.0f;
 
 	NextBotTraversableTraceFilter traverseFilter( bot );
-	mover->TraceHull( m_leftFrom, m_leftTo, m_hullMin, m_hullMax, mask, &traverseFilter, &result );
+	TraceFeeler( mover, m_leftFrom, m_leftTo, m_hullMin, m_hullMax, mask, &traverseFilter, &result );
 	if ( result.fraction < 1.0f || result.startsolid )
 	{
 		// if this sensor is starting in a solid, set fraction to emulate being against a wall
@@ -985,7 +1175,7 @@ Vector PathFollower::Avoid( INextBot *bot, const Vector &goalPos, const Vector &
 	m_isRightClear = true;
 	float rightAvoid = 0.0f;
 
-	mover->TraceHull( m_rightFrom, m_rightTo, m_hullMin, m_hullMax, mask, &traverseFilter, &result );
+	TraceFeeler( mover, m_rightFrom, m_rightTo, m_hullMin, m_hullMax, mask, &traverseFilter, &result );
 	if ( result.fraction < 1.0f || result.startsolid )
 	{
 		// if this sensor is starting in a solid, set fraction to emulate being against a wall
@@ -1330,7 +1520,7 @@ bool PathFollower::Climbing( INextBot *bot, const Path::Segment *goal, const Vec
 	// backed-up feet position for the ledge finding traces.
 	Vector feet( mover->GetFeet() );
 	Vector ceiling( feet + Vector( 0, 0, mover->GetMaxJumpHeight() ) );
-	mover->TraceHull( feet, ceiling,
+	TraceFeeler( mover, feet, ceiling,
 		skipStepHeightHullMin, skipStepHeightHullMax, mask, &filter, &result );
 	ceilingFraction = result.fraction;
 	bool isBackupTraceUsed = false;
@@ -1340,7 +1530,7 @@ bool PathFollower::Climbing( INextBot *bot, const Path::Segment *goal, const Vec
 		const float backupDistance = hullWidth * 0.25f;	// The IsPotentiallyTraversable check this replaces uses a 1/4 hull width trace
 		Vector backupFeet( feet - climbDirection * backupDistance );
 		Vector backupCeiling( backupFeet + Vector( 0, 0, mover->GetMaxJumpHeight() ) );
-		mover->TraceHull( backupFeet, backupCeiling,
+		TraceFeeler( mover, backupFeet, backupCeiling,
 			skipStepHeightHullMin, skipStepHeightHullMax, mask, &filter, &backupTrace );
 		if ( !backupTrace.startsolid && backupTrace.fraction > ceilingFraction )
 		{
@@ -1369,9 +1559,9 @@ bool PathFollower::Climbing( INextBot *bot, const Path::Segment *goal, const Vec
 
 	Vector ledgePos = feet;	// to be computed below
 
-	mover->TraceHull( feet, 
-					  feet + climbDirection * ledgeLookAheadRange, 
-					  skipStepHeightHullMin, climbHullMax, mask, &filter, &result );
+	TraceFeeler( mover, feet, 
+				 feet + climbDirection * ledgeLookAheadRange, 
+				 skipStepHeightHullMin, climbHullMax, mask, &filter, &result );
 
 	if ( bot->IsDebugging( NEXTBOT_PATH ) && NextBotDebugClimbing.GetBool() )
 	{
@@ -79,6 +79,24 @@ private:
 	CBaseEntity *FindBlocker( INextBot *bot );		// if entity is returned, it is blocking us from continuing along our path
 
 	float m_goalTolerance;
+
+	// feeler sweeps lengthened ahead along the feeler and widened by a tolerance. Any later feeler that
+	// lies inside a clear sweep is clear too, so it is answered without tracing as long as nothing moves in
+	struct FeelerTrace
+	{
+		Vector m_from, m_to;				// ends of the widened, lengthened sweep
+		Vector m_hullMin, m_hullMax;		// hull of the feeler that asked, before widening
+		unsigned int m_mask;
+		float m_tolerance;					// how far the hull was widened on each axis
+		bool m_isBlocked;					// the sweep hit something, so it can't answer for anything
+		trace_t m_result;					// the clear trace, for handing back
+	};
+	enum { FEELER_CACHE_SIZE = 8 };
+	FeelerTrace m_feelerCache[ FEELER_CACHE_SIZE ];
+	int m_feelerCacheCount;
+	int m_feelerCacheNext;
+
+	void TraceFeeler( ILocomotion *mover, const Vector &from, const Vector &to, const Vector &hullMin, const Vector &hullMax, unsigned int mask, ITraceFilter *filter, trace_t *result );
 };
 
 
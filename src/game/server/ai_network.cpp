@@ -102,6 +102,11 @@ public:
 // PERFORMANCE: Tune this number
 #define MAX_NEAR_NODES	10			// Trace to 10 nodes at most
 
+// Node grid cells are at least this wide, and grow on very large maps to keep
+// the grid within AI_NODE_GRID_MAX_DIM cells a side
+#define AI_NODE_GRID_CELL_SIZE	256.0f
+#define AI_NODE_GRID_MAX_DIM	256
+
 //-----------------------------------------------------------------------------
 
 CAI_Network::CAI_Network()
@@ -117,6 +122,11 @@ CAI_Network::CAI_Network()
 		m_NearestCache[node].expiration	= FLT_MIN;
 	}
 
+	m_bNodeGridValid		= false;
+	m_flNodeGridCellSize	= AI_NODE_GRID_CELL_SIZE;
+	m_nNodeGridCols			= 0;
+	m_nNodeGridRows			= 0;
+
 #ifdef AI_NODE_TREE
 	m_pNodeTree = NULL;
 #endif
@@ -190,6 +200,71 @@ int	CAI_Network::FindBSSmallest(CVarBitVec *bitString, float *float_array, int a
 	return winIndex;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Buckets every node by the XY grid cell its origin falls in
+//-----------------------------------------------------------------------------
+
+void CAI_Network::RebuildNodeGrid()
+{
+	m_bNodeGridValid = false;
+	m_NodeGridCellStart.RemoveAll();
+	m_NodeGridNodes.RemoveAll();
+
+	// wc_edit can move nodes around at will, so it always does a full scan
+	if ( !m_iNumNodes || engine->IsInEditMode() )
+		return;
+
+	Vector2D mins( FLT_MAX, FLT_MAX ), maxs( -FLT_MAX, -FLT_MAX );
+	for ( int node = 0; node < m_iNumNodes; node++ )
+	{
+		const Vector &origin = m_pAInode[node]->GetOrigin();
+		mins.x = MIN( mins.x, origin.x );
+		mins.y = MIN( mins.y, origin.y );
+		maxs.x = MAX( maxs.x, origin.x );
+		maxs.y = MAX( maxs.y, origin.y );
+	}
+
+	float flExtent = MAX( maxs.x - mins.x, maxs.y - mins.y );
+	m_flNodeGridCellSize = MAX( AI_NODE_GRID_CELL_SIZE, flExtent / ( AI_NODE_GRID_MAX_DIM - 1 ) );
+	m_vNodeGridMins = mins;
+	m_nNodeGridCols = (int)( ( maxs.x - mins.x ) / m_flNodeGridCellSize ) + 1;
+	m_nNodeGridRows = (int)( ( maxs.y - mins.y ) / m_flNodeGridCellSize ) + 1;
+
+	int nCells = m_nNodeGridCols * m_nNodeGridRows;
+	CUtlVector<int> nodeCells;
+	nodeCells.SetCount( m_iNumNodes );
+
+	// Count the nodes in each cell, then turn the counts into start offsets
+	m_NodeGridCellStart.SetCount( nCells + 1 );
+	memset( m_NodeGridCellStart.Base(), 0, m_NodeGridCellStart.Count() * sizeof(int) );
+
+	for ( int node = 0; node < m_iNumNodes; node++ )
+	{
+		const Vector &origin = m_pAInode[node]->GetOrigin();
+		int col = (int)( ( origin.x - mins.x ) / m_flNodeGridCellSize );
+		int row = (int)( ( origin.y - mins.y ) / m_flNodeGridCellSize );
+		nodeCells[node] = row * m_nNodeGridCols + col;
+		m_NodeGridCellStart[ nodeCells[node] + 1 ]++;
+	}
+
+	for ( int cell = 0; cell < nCells; cell++ )
+	{
+		m_NodeGridCellStart[cell + 1] += m_NodeGridCellStart[cell];
+	}
+
+	// Fill in node order so each cell lists its nodes by ascending ID
+	CUtlVector<int> cellFill;
+	cellFill.CopyArray( m_NodeGridCellStart.Base(), nCells );
+
+	m_NodeGridNodes.SetCount( m_iNumNodes );
+	for ( int node = 0; node < m_iNumNodes; node++ )
+	{
+		m_NodeGridNodes[ cellFill[ nodeCells[node] ]++ ] = node;
+	}
+
+	m_bNodeGridValid = true;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Build a list of nearby nodes sorted by distance
 // Input  : &list - 
@@ -206,39 +281,61 @@ int CAI_Network::ListNodesInBox( CNodeList &list, int maxListCount, const Vector
 	
 	// NOTE: maxListCount must be > 0 or this will crash
 	bool full = false;
-	float flClosest = 1000000.0 * 1000000;
-	int closest = 0;
 
-// UNDONE: Store the nodes in a tree and query the tree instead of the entire list!!!
-	for ( int node = 0; node < m_iNumNodes; node++ )
+	if ( !m_bNodeGridValid )
 	{
-		CAI_Node *pNode = m_pAInode[node];
-		const Vector &origin = pNode->GetOrigin();
-		// in box?
-		if ( origin.x < mins.x || origin.x > maxs.x ||
-			 origin.y < mins.y || origin.y > maxs.y ||
-			 origin.z < mins.z || origin.z > maxs.z )
-			continue;
-
-		if ( !pFilter->NodeIsValid(*pNode) )
-			continue;
+		RebuildNodeGrid();
+	}
 
-		float flDist = pFilter->NodeDistanceSqr(*pNode);
+	// Only the grid cells the box overlaps are visited when the grid is up,
+	// otherwise every node is
+	int nCells = 1;
+	int colMin = 0, colMax = 0, rowMin = 0;
+	if ( m_bNodeGridValid )
+	{
+		colMin = clamp( (int)floor( ( mins.x - m_vNodeGridMins.x ) / m_flNodeGridCellSize ), 0, m_nNodeGridCols - 1 );
+		colMax = clamp( (int)floor( ( maxs.x - m_vNodeGridMins.x ) / m_flNodeGridCellSize ), 0, m_nNodeGridCols - 1 );
+		rowMin = clamp( (int)floor( ( mins.y - m_vNodeGridMins.y ) / m_flNodeGridCellSize ), 0, m_nNodeGridRows - 1 );
+		int rowMax = clamp( (int)floor( ( maxs.y - m_vNodeGridMins.y ) / m_flNodeGridCellSize ), 0, m_nNodeGridRows - 1 );
+		nCells = ( colMax - colMin + 1 ) * ( rowMax - rowMin + 1 );
+	}
 
-		if ( flDist < flClosest )
+	for ( int cell = 0; cell < nCells; cell++ )
+	{
+		int iFirst = 0, iLast = m_iNumNodes;
+		if ( m_bNodeGridValid )
 		{
-			closest = node;
-			flClosest = flDist;
+			int nCols = colMax - colMin + 1;
+			int iCell = ( rowMin + cell / nCols ) * m_nNodeGridCols + colMin + cell % nCols;
+			iFirst = m_NodeGridCellStart[iCell];
+			iLast = m_NodeGridCellStart[iCell + 1];
 		}
 
-		if ( !full || (flDist < result.ElementAtHead().dist) )
+		for ( int i = iFirst; i < iLast; i++ )
 		{
-			if ( full )
-				result.RemoveAtHead();
+			int node = ( m_bNodeGridValid ) ? m_NodeGridNodes[i] : i;
+			CAI_Node *pNode = m_pAInode[node];
+			const Vector &origin = pNode->GetOrigin();
+			// in box?
+			if ( origin.x < mins.x || origin.x > maxs.x ||
+				 origin.y < mins.y || origin.y > maxs.y ||
+				 origin.z < mins.z || origin.z > maxs.z )
+				continue;
 
-			result.Insert( AI_NearNode_t(node, flDist) );
-	
-			full = (result.Count() == maxListCount);
+			if ( !pFilter->NodeIsValid(*pNode) )
+				continue;
+
+			float flDist = pFilter->NodeDistanceSqr(*pNode);
+
+			if ( !full || (flDist < result.ElementAtHead().dist) )
+			{
+				if ( full )
+					result.RemoveAtHead();
+
+				result.Insert( AI_NearNode_t(node, flDist) );
+		
+				full = (result.Count() == maxListCount);
+			}
 		}
 	}
 	
@@ -533,6 +630,7 @@ CAI_Node *CAI_Network::AddNode( const Vector &origin, float yaw )
 	}
 
 	m_pAInode[m_iNumNodes] = new CAI_Node( m_iNumNodes, origin, yaw );
+	m_bNodeGridValid = false;
 
 #ifdef AI_NODE_TREE
 	if ( !m_pNodeTree )
@@ -127,6 +127,10 @@ public:
 	}
 	
 	CAI_Node**		AccessNodes() const	{ return m_pAInode; }
+
+	// Rebuilds the spatial grid used to find nodes near a point. Call after
+	// node origins have been loaded or adjusted; AddNode marks it stale.
+	void			RebuildNodeGrid();
 	
 private:
 	friend class CAI_NetworkManager;
@@ -143,7 +147,7 @@ private:
 
 	enum
 	{
-		NEARNODE_CACHE_SIZE = 32,
+		NEARNODE_CACHE_SIZE = 128,
 		NEARNODE_CACHE_LIFE = 10,
 	};
 
@@ -167,6 +171,16 @@ private:
 	NearNodeCache_T		m_NearestCache[NEARNODE_CACHE_SIZE];	// Cache of nearest nodes
 	int					m_iNearestCacheNext;					// Oldest record in the cache
 
+	// Uniform XY grid over node origins. Cell i holds
+	// m_NodeGridNodes[ m_NodeGridCellStart[i] ] up to m_NodeGridCellStart[i+1]
+	bool				m_bNodeGridValid;
+	Vector2D			m_vNodeGridMins;
+	float				m_flNodeGridCellSize;
+	int					m_nNodeGridCols;
+	int					m_nNodeGridRows;
+	CUtlVector<int>		m_NodeGridCellStart;
+	CUtlVector<int>		m_NodeGridNodes;
+
 #ifdef AI_NODE_TREE
 	ISpatialPartition * m_pNodeTree;
 	CUtlVector<int>		m_GatheredNodes;
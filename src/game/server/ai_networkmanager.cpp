@@ -710,6 +710,8 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 		DevMsg( "\n** Should run \"Check For Problems\" on the VMF then verify dynamic links\n" );
 #endif
 
+	m_pNetwork->RebuildNodeGrid();
+
 	gm_fNetworksLoaded = true;
 	CAI_DynamicLink::gm_bInitialized = false;
 }
@@ -1123,6 +1125,10 @@ void CAI_NetworkManager::DelayedInit( void )
 	// --------------------------------------------
 	CAI_DynamicLink::InitDynamicLinks();
 	FixupHints();
+
+	// A freshly built graph may have had node origins adjusted since the
+	// grid was last built
+	m_pNetwork->RebuildNodeGrid();
 	
 	GetEditOps()->OnInit();
 
@@ -21,6 +21,7 @@
 #include "ai_dynamiclink.h"
 #include "ai_hint.h"
 #include "bitstring.h"
+#include "tier1/utlpriorityqueue.h"
 
 //@todo: bad dependency!
 #include "ai_navigator.h"
@@ -272,6 +273,118 @@ int CAI_Pathfinder::NearestNodeToPoint( const Vector &vecOrigin )
 	return GetNetwork()->NearestNodeToPoint( GetOuter(), vecOrigin );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Per-node search state for FindBestPath, kept between searches.
+//			Each search bumps the generation, and a node whose stamp is from
+//			an older search reads as unvisited, so nothing is cleared up front
+//			and a search only touches the nodes it actually reaches.
+//-----------------------------------------------------------------------------
+
+struct AI_PathfindNode_t
+{
+	unsigned	generation;
+	float		g;
+	float		f;
+	bool		bOpen;
+};
+
+struct AI_PathfindOpen_t
+{
+	float		f;
+	int			iNode;
+};
+
+class CAI_PathfindScratch
+{
+public:
+	CAI_PathfindScratch()
+	 :	m_Open( 0, 0, OpenIsLowerPriority ),
+		m_Generation( 0 )
+	{
+	}
+
+	void BeginSearch( int nNodes )
+	{
+		if ( m_Nodes.Count() < nNodes )
+		{
+			int nOld = m_Nodes.Count();
+			m_Nodes.SetCount( nNodes );
+			m_Parents.SetCount( nNodes );
+			for ( int i = nOld; i < nNodes; i++ )
+			{
+				m_Nodes[i].generation = 0;
+			}
+		}
+
+		if ( ++m_Generation == 0 )
+		{
+			// Wrapped, old stamps could now look current
+			for ( int i = 0; i < m_Nodes.Count(); i++ )
+			{
+				m_Nodes[i].generation = 0;
+			}
+			m_Generation = 1;
+		}
+
+		m_Open.RemoveAll();
+	}
+
+	bool IsVisited( int iNode ) const	{ return m_Nodes[iNode].generation == m_Generation; }
+	float GetG( int iNode ) const		{ return m_Nodes[iNode].g; }
+	int *GetParents()					{ return m_Parents.Base(); }
+
+	void Open( int iNode, int iParent, float g, float h )
+	{
+		AI_PathfindNode_t &node = m_Nodes[iNode];
+		node.generation = m_Generation;
+		node.g = g;
+		node.f = g + h;
+		node.bOpen = true;
+		m_Parents[iNode] = iParent;
+
+		// An improved node is pushed again rather than moved up the heap,
+		// the entry left behind is skipped when it surfaces
+		AI_PathfindOpen_t entry = { node.f, iNode };
+		m_Open.Insert( entry );
+	}
+
+	// Removes and returns the open node with the lowest f, NO_NODE once the
+	// open set is empty
+	int PopSmallest()
+	{
+		while ( m_Open.Count() )
+		{
+			AI_PathfindOpen_t entry = m_Open.ElementAtHead();
+			m_Open.RemoveAtHead();
+
+			AI_PathfindNode_t &node = m_Nodes[entry.iNode];
+			if ( node.bOpen && node.f == entry.f )
+			{
+				node.bOpen = false;
+				return entry.iNode;
+			}
+		}
+		return NO_NODE;
+	}
+
+private:
+	// Equal f goes to the lower node index, as the old linear scan did, so
+	// the same route comes out
+	static bool OpenIsLowerPriority( const AI_PathfindOpen_t &lhs, const AI_PathfindOpen_t &rhs )
+	{
+		if ( lhs.f != rhs.f )
+			return ( lhs.f > rhs.f );
+		return ( lhs.iNode > rhs.iNode );
+	}
+
+	CUtlVector<AI_PathfindNode_t>			m_Nodes;
+	CUtlVector<int>							m_Parents;
+	CUtlPriorityQueue<AI_PathfindOpen_t>	m_Open;
+	unsigned								m_Generation;
+};
+
+static CAI_PathfindScratch g_PathfindScratch;
+
 //-----------------------------------------------------------------------------
 // Purpose: Build a path between two nodes
 //-----------------------------------------------------------------------------
@@ -290,36 +403,18 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 	int nNodes = GetNetwork()->NumNodes();
 	CAI_Node **pAInode = GetNetwork()->AccessNodes();
 
-	CVarBitVec	openBS(nNodes);
-	CVarBitVec	closeBS(nNodes);
-
 	// ------------- INITIALIZE ------------------------
-	float* nodeG = (float *)stackalloc( nNodes * sizeof(float) );
-	float* nodeH = (float *)stackalloc( nNodes * sizeof(float) );
-	float* nodeF = (float *)stackalloc( nNodes * sizeof(float) );
-	int*   nodeP = (int *)stackalloc( nNodes * sizeof(int) );		// Node parent 
+	CAI_PathfindScratch &scratch = g_PathfindScratch;
+	scratch.BeginSearch( nNodes );
 
-	for (int node=0;node<nNodes;node++)
-	{
-		nodeG[node] = FLT_MAX;
-		nodeP[node] = -1;
-	}
+	const Vector &vecEnd = pAInode[endID]->GetPosition(GetHullType());
 
-	nodeG[startID] = 0;
-
-	nodeH[startID] = 0.1*(pAInode[startID]->GetPosition(GetHullType())-pAInode[endID]->GetPosition(GetHullType())).Length(); // Don't want to over estimate
-	nodeF[startID] = nodeG[startID] + nodeH[startID];
-
-	openBS.Set(startID);
-	closeBS.Set( startID );
+	scratch.Open( startID, NO_NODE, 0, 0.1*(pAInode[startID]->GetPosition(GetHullType())-vecEnd).Length() ); // Don't want to over estimate
 
 	// --------------- FIND BEST PATH ------------------
-	while (!openBS.IsAllClear()) 
+	int smallestID;
+	while ( (smallestID = scratch.PopSmallest()) != NO_NODE ) 
 	{
-		int smallestID = CAI_Network::FindBSSmallest(&openBS,nodeF,nNodes);
-	
-		openBS.Clear(smallestID);
-
 		CAI_Node *pSmallestNode = pAInode[smallestID];
 		
 		if (GetOuter()->IsUnusableNode(smallestID, pSmallestNode->GetHint()))
@@ -327,10 +422,12 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 
 		if (smallestID == endID) 
 		{
-			AI_Waypoint_t* route = MakeRouteFromParents(&nodeP[0], endID);
+			AI_Waypoint_t* route = MakeRouteFromParents(scratch.GetParents(), endID);
 			return route;
 		}
 
+		float smallestG = scratch.GetG( smallestID );
+
 		// Check this if the node is immediately in the path after the startNode 
 		// that it isn't blocked
 		for (int link=0; link < pSmallestNode->NumLinks();link++) 
@@ -351,17 +448,11 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 			if ( dist == FLT_MAX )
 				continue;
 
-			float new_g  = nodeG[smallestID] + dist;
+			float new_g  = smallestG + dist;
 
-			if ( !closeBS.IsBitSet(testID) || (new_g < nodeG[testID]) ) 
+			if ( !scratch.IsVisited(testID) || (new_g < scratch.GetG(testID)) ) 
 			{
-				nodeP[testID] = smallestID;
-				nodeG[testID] = new_g;
-				nodeH[testID] = (pAInode[testID]->GetPosition(GetHullType())-pAInode[endID]->GetPosition(GetHullType())).Length();
-				nodeF[testID] = nodeG[testID] + nodeH[testID];
-
-				closeBS.Set( testID );
-				openBS.Set( testID );
+				scratch.Open( testID, smallestID, new_g, (r2-vecEnd).Length() );
 			}
 		}
 	}
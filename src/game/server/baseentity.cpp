@@ -63,6 +63,7 @@
 #include "tier1/utlstring.h"
 #include "utlhashtable.h"
 #include "vscript_server.h"
+#include "beamsensor.h"
 
 #if defined( TF_DLL )
 #include "tf_gamerules.h"
@@ -462,6 +463,9 @@ CBaseEntity::~CBaseEntity( )
 
 	VPhysicsDestroyObject();
 
+	// Anything tracing through where we were has to look again
+	BeamSensor_EntityChanged( this );
+
 	if ( m_hScriptInstance )
 	{
 		g_pScriptVM->RemoveInstance( m_hScriptInstance );
@@ -5293,7 +5297,7 @@ void CBaseEntity::PrecacheModelComponents( int nModelIndex )
 	// particles
 	{
 		// Check keyvalues for auto-emitting particles
-		KeyValues *pModelKeyValues = new KeyValues("");
+		KeyValues *pModelKeyValues = KeyValues::CreateArenaBacked( "" );
 		KeyValues::AutoDelete autodelete_pModelKeyValues( pModelKeyValues );
 		if ( pModelKeyValues->LoadFromBuffer( modelinfo->GetModelName( pModel ), modelinfo->GetModelKeyValueText( pModel ) ) )
 		{
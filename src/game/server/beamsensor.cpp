@@ -0,0 +1,379 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Beam sensors. A sensor watches the segment its owner traces every
+//			think. The collision code reports every bounds change it hands to
+//			the spatial partition; a sensor is only re-traced once the swept
+//			bounds (old and new) of such a change overlap its segment.
+//
+//			There are never more than a few dozen sensors, so a change is
+//			checked against all of them rather than maintaining partition
+//			lists for the segments.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "beamsensor.h"
+#include "collisionutils.h"
+#include "igamesystem.h"
+#include "utllinkedlist.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar beamsensor_enable( "beamsensor_enable", "1", FCVAR_NONE, "Skip beam/tripmine traces while nothing has moved near the beam." );
+
+// Same bloat CCollisionProperty::UpdatePartition uses for the partition bounds
+#define BEAMSENSOR_TOLERANCE	1.0f
+
+struct BeamSensor_t
+{
+	EHANDLE		m_hOwner;
+	int			m_fContentsMask;
+	Vector		m_vecStart;			// segment as last requested
+	Vector		m_vecEnd;
+	Vector		m_vecWatchDelta;	// part of the segment that was traced up to the hit
+	Vector		m_vecWatchMins;		// bounds of the watched part, bloated
+	Vector		m_vecWatchMaxs;
+	bool		m_bDirty;
+	bool		m_bOccupied;		// an animating entity overlaps a hitbox sensor
+};
+
+struct BeamSensorEntityBounds_t
+{
+	CBaseHandle	m_hEntity;			// the bounds are only valid for this entity
+	Vector		m_vecMins;
+	Vector		m_vecMaxs;
+};
+
+
+//-----------------------------------------------------------------------------
+// Sensor registry
+//-----------------------------------------------------------------------------
+class CBeamSensorSystem : public CAutoGameSystem
+{
+public:
+	CBeamSensorSystem() : CAutoGameSystem( "CBeamSensorSystem" )
+	{
+		m_nTraces = 0;
+		m_nSkipped = 0;
+	}
+
+	virtual void LevelShutdownPostEntity()
+	{
+		Assert( m_Sensors.Count() == 0 );
+		m_Sensors.Purge();
+		for ( int i = 0; i < NUM_ENT_ENTRIES; i++ )
+		{
+			m_EntityBounds[i].m_hEntity.Term();
+		}
+	}
+
+	BeamSensorHandle_t Create( CBaseEntity *pOwner, int fContentsMask );
+	void Destroy( BeamSensorHandle_t hSensor );
+	bool NeedsRetest( BeamSensorHandle_t hSensor, const Vector &vecStart, const Vector &vecEnd );
+	void SetResult( BeamSensorHandle_t hSensor, float flFraction );
+	void Invalidate( BeamSensorHandle_t hSensor );
+
+	void EntityMoved( CBaseEntity *pEntity, const Vector &vecMins, const Vector &vecMaxs );
+	void EntityChanged( CBaseEntity *pEntity );
+
+	void ReportStats( bool bReset );
+
+private:
+	BeamSensorEntityBounds_t *GetEntityBounds( CBaseEntity *pEntity );
+	void DirtySensorsInBox( const Vector &vecMins, const Vector &vecMaxs );
+	bool IsSegmentOccupied( const BeamSensor_t &sensor );
+
+	CUtlLinkedList< BeamSensor_t, BeamSensorHandle_t > m_Sensors;
+
+	// Mirrors the bounds each entity last gave the spatial partition; a trace
+	// can only hit an entity inside those. Indexed by entity handle slot so
+	// server-only entities without an edict are covered too.
+	BeamSensorEntityBounds_t m_EntityBounds[NUM_ENT_ENTRIES];
+
+	CThreadFastMutex m_Mutex;
+	int m_nTraces;
+	int m_nSkipped;
+};
+
+static CBeamSensorSystem g_BeamSensors;
+
+
+//-----------------------------------------------------------------------------
+// Creation, destruction
+//-----------------------------------------------------------------------------
+BeamSensorHandle_t CBeamSensorSystem::Create( CBaseEntity *pOwner, int fContentsMask )
+{
+	AUTO_LOCK( m_Mutex );
+
+	BeamSensorHandle_t hSensor = m_Sensors.AddToTail();
+	BeamSensor_t &sensor = m_Sensors[hSensor];
+	sensor.m_hOwner = pOwner;
+	sensor.m_fContentsMask = fContentsMask;
+	sensor.m_vecStart = sensor.m_vecEnd = pOwner->GetAbsOrigin();
+	sensor.m_vecWatchDelta.Init();
+	sensor.m_vecWatchMins = sensor.m_vecWatchMaxs = sensor.m_vecStart;
+	sensor.m_bDirty = true;
+	sensor.m_bOccupied = false;
+	return hSensor;
+}
+
+void CBeamSensorSystem::Destroy( BeamSensorHandle_t hSensor )
+{
+	AUTO_LOCK( m_Mutex );
+
+	if ( m_Sensors.IsValidIndex( hSensor ) )
+	{
+		m_Sensors.Remove( hSensor );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Does the owner have to trace its segment this think?
+//-----------------------------------------------------------------------------
+bool CBeamSensorSystem::NeedsRetest( BeamSensorHandle_t hSensor, const Vector &vecStart, const Vector &vecEnd )
+{
+	if ( !m_Sensors.IsValidIndex( hSensor ) )
+		return true;
+
+	{
+		AUTO_LOCK( m_Mutex );
+		BeamSensor_t &sensor = m_Sensors[hSensor];
+		if ( sensor.m_vecStart != vecStart || sensor.m_vecEnd != vecEnd )
+		{
+			sensor.m_vecStart = vecStart;
+			sensor.m_vecEnd = vecEnd;
+			sensor.m_bDirty = true;
+		}
+
+		if ( sensor.m_bDirty || sensor.m_bOccupied || !beamsensor_enable.GetBool() )
+		{
+			++m_nTraces;
+			return true;
+		}
+	}
+
+	// Moves are handed to the partition lazily, right before the next query;
+	// flush them now so the ones that would have shown up in the trace are seen.
+	UpdateDirtySpatialPartitionEntities();
+
+	AUTO_LOCK( m_Mutex );
+	if ( m_Sensors[hSensor].m_bDirty )
+	{
+		++m_nTraces;
+		return true;
+	}
+
+	++m_nSkipped;
+	return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// The owner traced the segment; watch the part that was traced
+//-----------------------------------------------------------------------------
+void CBeamSensorSystem::SetResult( BeamSensorHandle_t hSensor, float flFraction )
+{
+	if ( !m_Sensors.IsValidIndex( hSensor ) )
+		return;
+
+	{
+		AUTO_LOCK( m_Mutex );
+		BeamSensor_t &sensor = m_Sensors[hSensor];
+		sensor.m_vecWatchDelta = ( sensor.m_vecEnd - sensor.m_vecStart ) * clamp( flFraction, 0.0f, 1.0f );
+		Vector vecWatchEnd = sensor.m_vecStart + sensor.m_vecWatchDelta;
+		VectorMin( sensor.m_vecStart, vecWatchEnd, sensor.m_vecWatchMins );
+		VectorMax( sensor.m_vecStart, vecWatchEnd, sensor.m_vecWatchMaxs );
+		sensor.m_vecWatchMins -= Vector( BEAMSENSOR_TOLERANCE, BEAMSENSOR_TOLERANCE, BEAMSENSOR_TOLERANCE );
+		sensor.m_vecWatchMaxs += Vector( BEAMSENSOR_TOLERANCE, BEAMSENSOR_TOLERANCE, BEAMSENSOR_TOLERANCE );
+		sensor.m_bOccupied = false;
+		sensor.m_bDirty = false;
+	}
+
+	// Done after cleaning the sensor: the query flushes pending moves, which
+	// must still be able to dirty it
+	if ( m_Sensors[hSensor].m_fContentsMask & CONTENTS_HITBOX )
+	{
+		bool bOccupied = IsSegmentOccupied( m_Sensors[hSensor] );
+		AUTO_LOCK( m_Mutex );
+		m_Sensors[hSensor].m_bOccupied = bOccupied;
+	}
+}
+
+void CBeamSensorSystem::Invalidate( BeamSensorHandle_t hSensor )
+{
+	AUTO_LOCK( m_Mutex );
+
+	if ( m_Sensors.IsValidIndex( hSensor ) )
+	{
+		m_Sensors[hSensor].m_bDirty = true;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Hitboxes animate without the entity's partition bounds changing, so a
+// hitbox sensor can't be trusted while an animating entity overlaps it
+//-----------------------------------------------------------------------------
+bool CBeamSensorSystem::IsSegmentOccupied( const BeamSensor_t &sensor )
+{
+	Ray_t ray;
+	ray.Init( sensor.m_vecStart, sensor.m_vecEnd );
+
+	CBaseEntity *pList[16];
+	int nCount = UTIL_EntitiesAlongRay( pList, ARRAYSIZE( pList ), ray, 0 );
+	if ( nCount == ARRAYSIZE( pList ) )
+		return true;
+
+	for ( int i = 0; i < nCount; i++ )
+	{
+		if ( pList[i] != sensor.m_hOwner.Get() && pList[i]->GetBaseAnimating() )
+			return true;
+	}
+	return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Collision hooks
+//-----------------------------------------------------------------------------
+BeamSensorEntityBounds_t *CBeamSensorSystem::GetEntityBounds( CBaseEntity *pEntity )
+{
+	const CBaseHandle &hEntity = pEntity->GetRefEHandle();
+	if ( !hEntity.IsValid() )
+		return NULL;
+	return &m_EntityBounds[hEntity.GetEntryIndex()];
+}
+
+void CBeamSensorSystem::DirtySensorsInBox( const Vector &vecMins, const Vector &vecMaxs )
+{
+	FOR_EACH_LL( m_Sensors, i )
+	{
+		BeamSensor_t &sensor = m_Sensors[i];
+		if ( sensor.m_bDirty )
+			continue;
+
+		if ( !IsBoxIntersectingBox( vecMins, vecMaxs, sensor.m_vecWatchMins, sensor.m_vecWatchMaxs ) )
+			continue;
+
+		if ( IsBoxIntersectingRay( vecMins, vecMaxs, sensor.m_vecStart, sensor.m_vecWatchDelta, BEAMSENSOR_TOLERANCE ) )
+		{
+			sensor.m_bDirty = true;
+		}
+	}
+}
+
+void CBeamSensorSystem::EntityMoved( CBaseEntity *pEntity, const Vector &vecMins, const Vector &vecMaxs )
+{
+	BeamSensorEntityBounds_t *pBounds = GetEntityBounds( pEntity );
+
+	if ( m_Sensors.Count() )
+	{
+		AUTO_LOCK( m_Mutex );
+
+		// Anything between the old and the new bounds may now trace differently.
+		// Without old bounds, at least catch the entity moving into a beam.
+		Vector vecSweptMins = vecMins;
+		Vector vecSweptMaxs = vecMaxs;
+		if ( pBounds && pBounds->m_hEntity == pEntity->GetRefEHandle() )
+		{
+			VectorMin( vecSweptMins, pBounds->m_vecMins, vecSweptMins );
+			VectorMax( vecSweptMaxs, pBounds->m_vecMaxs, vecSweptMaxs );
+		}
+		DirtySensorsInBox( vecSweptMins, vecSweptMaxs );
+	}
+
+	// Each entity only ever updates its own slot
+	if ( pBounds )
+	{
+		pBounds->m_hEntity = pEntity->GetRefEHandle();
+		pBounds->m_vecMins = vecMins;
+		pBounds->m_vecMaxs = vecMaxs;
+	}
+}
+
+void CBeamSensorSystem::EntityChanged( CBaseEntity *pEntity )
+{
+	if ( !m_Sensors.Count() )
+		return;
+
+	BeamSensorEntityBounds_t *pBounds = GetEntityBounds( pEntity );
+
+	AUTO_LOCK( m_Mutex );
+
+	// An entity that never made it into the partition can't have been traced
+	if ( pBounds && pBounds->m_hEntity == pEntity->GetRefEHandle() )
+	{
+		DirtySensorsInBox( pBounds->m_vecMins, pBounds->m_vecMaxs );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Stats
+//-----------------------------------------------------------------------------
+void CBeamSensorSystem::ReportStats( bool bReset )
+{
+	int nTotal = m_nTraces + m_nSkipped;
+	Msg( "%d beam sensors: %d traces, %d skipped (%.1f%%)\n", m_Sensors.Count(), m_nTraces, m_nSkipped,
+		nTotal ? 100.0f * m_nSkipped / nTotal : 0.0f );
+
+	if ( bReset )
+	{
+		m_nTraces = 0;
+		m_nSkipped = 0;
+	}
+}
+
+CON_COMMAND( report_beamsensor_stats, "Reports how many beam/tripmine traces were skipped. Pass 'reset' to clear the counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_BeamSensors.ReportStats( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) );
+}
+
+
+//-----------------------------------------------------------------------------
+// Public interface
+//-----------------------------------------------------------------------------
+BeamSensorHandle_t BeamSensor_Create( CBaseEntity *pOwner, int fContentsMask )
+{
+	return g_BeamSensors.Create( pOwner, fContentsMask );
+}
+
+void BeamSensor_Destroy( BeamSensorHandle_t &hSensor )
+{
+	if ( hSensor != BEAMSENSOR_INVALID_HANDLE )
+	{
+		g_BeamSensors.Destroy( hSensor );
+		hSensor = BEAMSENSOR_INVALID_HANDLE;
+	}
+}
+
+bool BeamSensor_NeedsRetest( BeamSensorHandle_t hSensor, const Vector &vecStart, const Vector &vecEnd )
+{
+	return g_BeamSensors.NeedsRetest( hSensor, vecStart, vecEnd );
+}
+
+void BeamSensor_SetResult( BeamSensorHandle_t hSensor, float flFraction )
+{
+	g_BeamSensors.SetResult( hSensor, flFraction );
+}
+
+void BeamSensor_Invalidate( BeamSensorHandle_t hSensor )
+{
+	g_BeamSensors.Invalidate( hSensor );
+}
+
+void BeamSensor_EntityMoved( CBaseEntity *pEntity, const Vector &vecMins, const Vector &vecMaxs )
+{
+	g_BeamSensors.EntityMoved( pEntity, vecMins, vecMaxs );
+}
+
+void BeamSensor_EntityChanged( CBaseEntity *pEntity )
+{
+	g_BeamSensors.EntityChanged( pEntity );
+}
@@ -0,0 +1,52 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Beam sensors. Lets tripmines and lasers that trace the same
+//			segment every think skip the trace while nothing that could
+//			change its result has been added, removed or moved near it.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef BEAMSENSOR_H
+#define BEAMSENSOR_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+class CBaseEntity;
+
+typedef unsigned short BeamSensorHandle_t;
+#define BEAMSENSOR_INVALID_HANDLE	((BeamSensorHandle_t)~0)
+
+//-----------------------------------------------------------------------------
+// A sensor starts out dirty. Each think the owner asks whether its segment
+// needs to be re-traced; if so it traces and reports the result back, which
+// cleans the sensor until an entity's partition bounds change near it.
+//
+// fContentsMask is the mask the owner traces with. Masks including
+// CONTENTS_HITBOX keep the sensor dirty while an animating entity overlaps
+// the segment, since hitboxes move without touching the partition.
+//-----------------------------------------------------------------------------
+BeamSensorHandle_t BeamSensor_Create( CBaseEntity *pOwner, int fContentsMask );
+void BeamSensor_Destroy( BeamSensorHandle_t &hSensor );
+
+// Sets the segment about to be traced. Returns true if it must be traced again
+// (the sensor is dirty, the segment changed or sensors are disabled)
+bool BeamSensor_NeedsRetest( BeamSensorHandle_t hSensor, const Vector &vecStart, const Vector &vecEnd );
+
+// Reports the trace of the segment. Anything past flFraction can't change the
+// result, so only the traced part of the segment is watched from now on
+void BeamSensor_SetResult( BeamSensorHandle_t hSensor, float flFraction );
+
+// Forces a retest on the next think
+void BeamSensor_Invalidate( BeamSensorHandle_t hSensor );
+
+//-----------------------------------------------------------------------------
+// Hooks from the collision code. EntityMoved is called with the bounds that
+// were just handed to the spatial partition; EntityChanged when the entity's
+// solidity or collision rules changed, or it is being deleted.
+//-----------------------------------------------------------------------------
+void BeamSensor_EntityMoved( CBaseEntity *pEntity, const Vector &vecMins, const Vector &vecMaxs );
+void BeamSensor_EntityChanged( CBaseEntity *pEntity );
+
+#endif // BEAMSENSOR_H
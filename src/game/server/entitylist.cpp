@@ -133,12 +133,46 @@ struct simthinkentry_t
 	unsigned short	unused0;
 	int				nextThinkTick;
 };
+
+ConVar sv_simthink_wheel( "sv_simthink_wheel", "1", FCVAR_NONE, "Use the think timing wheel to find entities that think or simulate each tick (0 = scan the whole list)." );
+
+// Entities that only think are also filed in a timing wheel keyed by their next
+// think tick, so a tick only touches the entities that are due:
+//  - the active list holds entries due now (simulating entities, and thinkers
+//    whose tick has arrived but that haven't rescheduled yet)
+//  - level 0 has one bucket per tick of the current 256 tick block
+//  - level 1 has one bucket per block for the next 63 blocks
+//  - anything further out waits in an overflow list, rescanned every 64 blocks
+// Entries are linked through arrays indexed by entinfo index, so rescheduling
+// is O(1). The list order of m_simThinkList still decides the run order.
+#define SIMTHINK_WHEEL0_BITS	8
+#define SIMTHINK_WHEEL0_SIZE	(1<<SIMTHINK_WHEEL0_BITS)
+#define SIMTHINK_WHEEL1_BITS	6
+#define SIMTHINK_WHEEL1_SIZE	(1<<SIMTHINK_WHEEL1_BITS)
+
+enum
+{
+	SIMTHINK_LIST_WHEEL0	= 0,
+	SIMTHINK_LIST_WHEEL1	= SIMTHINK_LIST_WHEEL0 + SIMTHINK_WHEEL0_SIZE,
+	SIMTHINK_LIST_OVERFLOW	= SIMTHINK_LIST_WHEEL1 + SIMTHINK_WHEEL1_SIZE,
+	SIMTHINK_LIST_ACTIVE,
+	SIMTHINK_LIST_COUNT,
+
+	SIMTHINK_LIST_NONE = 0xFFFF,
+};
+
+static int __cdecl SimThinkPositionCompare( const unsigned short *pLeft, const unsigned short *pRight )
+{
+	return (int)*pLeft - (int)*pRight;
+}
+
 class CSimThinkManager : public IEntityListener
 {
 public:
 	CSimThinkManager()
 	{
 		Clear();
+		ResetStats();
 	}
 	void Clear()
 	{
@@ -146,7 +180,13 @@ public:
 		for ( int i = 0; i < ARRAYSIZE(m_entinfoIndex); i++ )
 		{
 			m_entinfoIndex[i] = 0xFFFF;
+			m_wheelList[i] = SIMTHINK_LIST_NONE;
+		}
+		for ( int i = 0; i < SIMTHINK_LIST_COUNT; i++ )
+		{
+			m_wheelHead[i] = 0xFFFF;
 		}
+		m_wheelTick = -1;
 	}
 	void LevelInitPreEntity()
 	{
@@ -175,6 +215,7 @@ public:
 		if ( listHandle != 0xFFFF )
 		{
 			Assert(m_simThinkList[listHandle].entEntry == index);
+			WheelUnlink( index );
 			m_simThinkList.FastRemove( listHandle );
 			m_entinfoIndex[index] = 0xFFFF;
 			
@@ -192,24 +233,40 @@ public:
 
 	int ListCopy( CBaseEntity *pList[], int listMax )
 	{
+		if ( !sv_simthink_wheel.GetBool() )
+			return ListCopyLinear( pList, listMax );
+
+		WheelAdvance( gpGlobals->tickcount );
+
 		int count = MIN(listMax, ListCount());
-		int out = 0;
-		for ( int i = 0; i < count; i++ )
+		int scanned = 0;
+
+		// gather everything due, then put it back in list order
+		CUtlVectorFixedGrowable<unsigned short, 256> due;
+		for ( int entry = m_wheelHead[SIMTHINK_LIST_ACTIVE]; entry != 0xFFFF; entry = m_wheelNext[entry] )
 		{
-			// only copy out entities that will simulate or think this frame
-			if ( m_simThinkList[i].nextThinkTick <= gpGlobals->tickcount )
+			scanned++;
+			int listHandle = m_entinfoIndex[entry];
+			Assert( m_simThinkList[listHandle].nextThinkTick <= gpGlobals->tickcount );
+			if ( listHandle < count )
 			{
-				Assert(m_simThinkList[i].nextThinkTick>=0);
-				int entinfoIndex = m_simThinkList[i].entEntry;
-				const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
-				pList[out] = (CBaseEntity *)pInfo->m_pEntity;
-				Assert(m_simThinkList[i].nextThinkTick==0 || pList[out]->GetFirstThinkTick()==m_simThinkList[i].nextThinkTick);
-				Assert( gEntList.IsEntityPtr( pList[out] ) );
-				out++;
+				due.AddToTail( listHandle );
 			}
 		}
+		due.Sort( SimThinkPositionCompare );
 
-		return out;
+		for ( int i = 0; i < due.Count(); i++ )
+		{
+			int entinfoIndex = m_simThinkList[due[i]].entEntry;
+			const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
+			pList[i] = (CBaseEntity *)pInfo->m_pEntity;
+			Assert(m_simThinkList[due[i]].nextThinkTick==0 || pList[i]->GetFirstThinkTick()==m_simThinkList[due[i]].nextThinkTick);
+			Assert( gEntList.IsEntityPtr( pList[i] ) );
+		}
+
+		UpdateStats( scanned + m_wheelMoved, due.Count() );
+		m_wheelMoved = 0;
+		return due.Count();
 	}
 
 	void EntityChanged( CBaseEntity *pEntity )
@@ -255,12 +312,207 @@ public:
 					m_simThinkList[m_entinfoIndex[index]].nextThinkTick = 0;
 				}
 			}
+
+			WheelUnlink( index );
+			WheelInsert( index, m_simThinkList[m_entinfoIndex[index]].nextThinkTick );
+		}
+	}
+
+	void ResetStats()
+	{
+		m_wheelMoved = 0;
+		m_statTicks = 0;
+		m_statScanned = 0;
+		m_statRun = 0;
+		m_statListed = 0;
+		m_lastScanned = m_lastRun = m_lastListed = 0;
+	}
+
+	void ReportStats()
+	{
+		Msg( "Sim/think list: %d entities, %s\n", ListCount(), sv_simthink_wheel.GetBool() ? "timing wheel" : "linear scan" );
+		Msg( "  last tick: %d scanned, %d run (of %d listed)\n", m_lastScanned, m_lastRun, m_lastListed );
+		if ( m_statTicks )
+		{
+			Msg( "  %d ticks: %.1f scanned, %.1f run per tick (of %.1f listed)\n", m_statTicks,
+				(float)m_statScanned / m_statTicks, (float)m_statRun / m_statTicks, (float)m_statListed / m_statTicks );
 		}
 	}
 
 private:
+	int ListCopyLinear( CBaseEntity *pList[], int listMax )
+	{
+		int count = MIN(listMax, ListCount());
+		int out = 0;
+		for ( int i = 0; i < count; i++ )
+		{
+			// only copy out entities that will simulate or think this frame
+			if ( m_simThinkList[i].nextThinkTick <= gpGlobals->tickcount )
+			{
+				Assert(m_simThinkList[i].nextThinkTick>=0);
+				int entinfoIndex = m_simThinkList[i].entEntry;
+				const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
+				pList[out] = (CBaseEntity *)pInfo->m_pEntity;
+				Assert(m_simThinkList[i].nextThinkTick==0 || pList[out]->GetFirstThinkTick()==m_simThinkList[i].nextThinkTick);
+				Assert( gEntList.IsEntityPtr( pList[out] ) );
+				out++;
+			}
+		}
+
+		UpdateStats( count, out );
+		return out;
+	}
+
+	void UpdateStats( int scanned, int run )
+	{
+		m_lastScanned = scanned;
+		m_lastRun = run;
+		m_lastListed = ListCount();
+		m_statTicks++;
+		m_statScanned += scanned;
+		m_statRun += run;
+		m_statListed += m_lastListed;
+	}
+
+	void WheelLink( int index, int list )
+	{
+		Assert( m_wheelList[index] == SIMTHINK_LIST_NONE );
+		m_wheelList[index] = list;
+		m_wheelPrev[index] = 0xFFFF;
+		m_wheelNext[index] = m_wheelHead[list];
+		if ( m_wheelHead[list] != 0xFFFF )
+		{
+			m_wheelPrev[m_wheelHead[list]] = index;
+		}
+		m_wheelHead[list] = index;
+	}
+
+	void WheelUnlink( int index )
+	{
+		int list = m_wheelList[index];
+		if ( list == SIMTHINK_LIST_NONE )
+			return;
+
+		if ( m_wheelPrev[index] != 0xFFFF )
+		{
+			m_wheelNext[m_wheelPrev[index]] = m_wheelNext[index];
+		}
+		else
+		{
+			m_wheelHead[list] = m_wheelNext[index];
+		}
+		if ( m_wheelNext[index] != 0xFFFF )
+		{
+			m_wheelPrev[m_wheelNext[index]] = m_wheelPrev[index];
+		}
+		m_wheelList[index] = SIMTHINK_LIST_NONE;
+	}
+
+	void WheelInsert( int index, int tick )
+	{
+		// not placed yet; WheelAdvance() files everything on its first run
+		if ( m_wheelTick < 0 )
+		{
+			WheelLink( index, SIMTHINK_LIST_OVERFLOW );
+			return;
+		}
+
+		if ( tick <= m_wheelTick )
+		{
+			WheelLink( index, SIMTHINK_LIST_ACTIVE );
+			return;
+		}
+
+		int block = tick >> SIMTHINK_WHEEL0_BITS;
+		int currentBlock = m_wheelTick >> SIMTHINK_WHEEL0_BITS;
+		if ( block == currentBlock )
+		{
+			WheelLink( index, SIMTHINK_LIST_WHEEL0 + (tick & (SIMTHINK_WHEEL0_SIZE-1)) );
+		}
+		else if ( block - currentBlock < SIMTHINK_WHEEL1_SIZE )
+		{
+			WheelLink( index, SIMTHINK_LIST_WHEEL1 + (block & (SIMTHINK_WHEEL1_SIZE-1)) );
+		}
+		else
+		{
+			WheelLink( index, SIMTHINK_LIST_OVERFLOW );
+		}
+	}
+
+	// Re-files every entry of a list against the current wheel tick
+	void WheelRefile( int list )
+	{
+		int entry = m_wheelHead[list];
+		m_wheelHead[list] = 0xFFFF;
+		while ( entry != 0xFFFF )
+		{
+			int next = m_wheelNext[entry];
+			m_wheelList[entry] = SIMTHINK_LIST_NONE;
+			WheelInsert( entry, m_simThinkList[m_entinfoIndex[entry]].nextThinkTick );
+			m_wheelMoved++;
+			entry = next;
+		}
+	}
+
+	void WheelRebuild( int tick )
+	{
+		for ( int i = 0; i < SIMTHINK_LIST_COUNT; i++ )
+		{
+			m_wheelHead[i] = 0xFFFF;
+		}
+		m_wheelTick = tick;
+		for ( int i = 0; i < m_simThinkList.Count(); i++ )
+		{
+			int index = m_simThinkList[i].entEntry;
+			m_wheelList[index] = SIMTHINK_LIST_NONE;
+			WheelInsert( index, m_simThinkList[i].nextThinkTick );
+		}
+		m_wheelMoved += m_simThinkList.Count();
+	}
+
+	void WheelAdvance( int tick )
+	{
+		// first run, tick count reset, or a jump past the wheel: start over
+		if ( m_wheelTick < 0 || tick < m_wheelTick || tick - m_wheelTick >= (SIMTHINK_WHEEL0_SIZE << SIMTHINK_WHEEL1_BITS) )
+		{
+			WheelRebuild( tick );
+			return;
+		}
+
+		while ( m_wheelTick < tick )
+		{
+			m_wheelTick++;
+			if ( !(m_wheelTick & (SIMTHINK_WHEEL0_SIZE-1)) )
+			{
+				int block = m_wheelTick >> SIMTHINK_WHEEL0_BITS;
+				if ( !(block & (SIMTHINK_WHEEL1_SIZE-1)) )
+				{
+					WheelRefile( SIMTHINK_LIST_OVERFLOW );
+				}
+				WheelRefile( SIMTHINK_LIST_WHEEL1 + (block & (SIMTHINK_WHEEL1_SIZE-1)) );
+			}
+			WheelRefile( SIMTHINK_LIST_WHEEL0 + (m_wheelTick & (SIMTHINK_WHEEL0_SIZE-1)) );
+		}
+	}
+
 	unsigned short m_entinfoIndex[NUM_ENT_ENTRIES];
 	CUtlVector<simthinkentry_t>	m_simThinkList;
+
+	// timing wheel links, by entinfo index
+	unsigned short m_wheelList[NUM_ENT_ENTRIES];
+	unsigned short m_wheelNext[NUM_ENT_ENTRIES];
+	unsigned short m_wheelPrev[NUM_ENT_ENTRIES];
+	unsigned short m_wheelHead[SIMTHINK_LIST_COUNT];
+	int m_wheelTick;
+	int m_wheelMoved;
+
+	int m_lastScanned;
+	int m_lastRun;
+	int m_lastListed;
+	int m_statTicks;
+	int64 m_statScanned;
+	int64 m_statRun;
+	int64 m_statListed;
 };
 
 CSimThinkManager g_SimThinkManager;
@@ -280,6 +532,19 @@ void SimThink_EntityChanged( CBaseEntity *pEntity )
 	g_SimThinkManager.EntityChanged( pEntity );
 }
 
+CON_COMMAND( report_simthink_stats, "Entities scanned vs run by the sim/think list per tick. Usage: report_simthink_stats [reset]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_SimThinkManager.ReportStats();
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		g_SimThinkManager.ResetStats();
+	}
+}
+
 static CBaseEntityClassList *s_pClassLists = NULL;
 CBaseEntityClassList::CBaseEntityClassList()
 {
@@ -0,0 +1,337 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Continuous per-tick server frame profiler.
+//
+//			Scopes add their cycles into per-scope totals with interlocked
+//			adds, so CheckTransmit and other work running on the engine's
+//			worker threads can be timed without a lock. At the start of each
+//			tick the totals of the last tick are folded into log-linear
+//			histograms, and every sv_frameprof_interval seconds one CSV row
+//			per scope is appended to sv_frameprof_file.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "frameprofiler.h"
+#include "filesystem.h"
+#include <time.h>
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+static void FrameProfilerChanged( IConVar *var, const char *pOldValue, float flOldValue );
+
+ConVar sv_frameprof( "sv_frameprof", "0", 0, "Record per-tick timings of the main server frame scopes and write them to sv_frameprof_file.", FrameProfilerChanged );
+ConVar sv_frameprof_interval( "sv_frameprof_interval", "60", 0, "Seconds of ticks summarized in each sv_frameprof row.", true, 1.0f, false, 0.0f );
+ConVar sv_frameprof_file( "sv_frameprof_file", "frameprof.csv", 0, "CSV file the frame profiler appends to, relative to the mod directory." );
+
+bool g_bFrameProfilerEnabled = false;
+
+static const char *s_pszFrameProfScopeNames[FRAMEPROF_SCOPE_COUNT] =
+{
+	"GameFrame",
+	"Physics_RunThinkFunctions",
+	"PlayerMovement",
+	"NextBot",
+	"CLagCompensationManager",
+	"CheckTransmit",
+};
+
+// Log-linear buckets over microseconds: the first FRAMEPROF_SUB_BUCKETS are
+// exact, after that each power of two is split into FRAMEPROF_SUB_BUCKETS.
+// Percentiles read back from them are within 12.5% of the real value.
+#define FRAMEPROF_SUB_BUCKET_BITS	3
+#define FRAMEPROF_SUB_BUCKETS		( 1 << FRAMEPROF_SUB_BUCKET_BITS )
+#define FRAMEPROF_BUCKETS			( FRAMEPROF_SUB_BUCKETS * 30 )
+
+static int BucketForMicroseconds( uint32 nMicroseconds )
+{
+	if ( nMicroseconds < FRAMEPROF_SUB_BUCKETS )
+		return nMicroseconds;
+
+	int nHighBit = FRAMEPROF_SUB_BUCKET_BITS;
+	while ( nMicroseconds >> ( nHighBit + 1 ) )
+	{
+		nHighBit++;
+	}
+
+	int nShift = nHighBit - FRAMEPROF_SUB_BUCKET_BITS;
+	int iBucket = ( ( nShift + 1 ) << FRAMEPROF_SUB_BUCKET_BITS ) + ( ( nMicroseconds >> nShift ) & ( FRAMEPROF_SUB_BUCKETS - 1 ) );
+	return MIN( iBucket, FRAMEPROF_BUCKETS - 1 );
+}
+
+// Largest value that lands in a bucket
+static uint32 BucketUpperBound( int iBucket )
+{
+	if ( iBucket < FRAMEPROF_SUB_BUCKETS )
+		return iBucket;
+
+	int nShift = ( iBucket >> FRAMEPROF_SUB_BUCKET_BITS ) - 1;
+	uint32 nMantissa = FRAMEPROF_SUB_BUCKETS + ( iBucket & ( FRAMEPROF_SUB_BUCKETS - 1 ) );
+	return ( ( nMantissa + 1 ) << nShift ) - 1;
+}
+
+struct FrameProfHistogram_t
+{
+	void Reset()
+	{
+		memset( m_nBuckets, 0, sizeof( m_nBuckets ) );
+		m_nTicks = 0;
+		m_nTotal = 0;
+		m_nMax = 0;
+	}
+
+	void Add( uint32 nMicroseconds )
+	{
+		m_nBuckets[ BucketForMicroseconds( nMicroseconds ) ]++;
+		m_nTicks++;
+		m_nTotal += nMicroseconds;
+		m_nMax = MAX( m_nMax, nMicroseconds );
+	}
+
+	uint32 Percentile( float flPercentile ) const
+	{
+		if ( !m_nTicks )
+			return 0;
+
+		int nRank = (int)ceil( m_nTicks * flPercentile );
+		int nSeen = 0;
+		for ( int i = 0; i < FRAMEPROF_BUCKETS; i++ )
+		{
+			nSeen += m_nBuckets[i];
+			if ( nSeen >= nRank )
+				return MIN( BucketUpperBound( i ), m_nMax );
+		}
+		return m_nMax;
+	}
+
+	int		m_nBuckets[FRAMEPROF_BUCKETS];
+	int		m_nTicks;
+	uint64	m_nTotal;
+	uint32	m_nMax;
+};
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Folds the scope totals into histograms once per tick and writes
+//			them out every sv_frameprof_interval seconds.
+//-----------------------------------------------------------------------------
+class CFrameProfiler : public CAutoGameSystemPerFrame
+{
+public:
+	CFrameProfiler() : CAutoGameSystemPerFrame( "CFrameProfiler" ), m_bCapturing( false )
+	{
+		memset( (void*)m_nTickCycles, 0, sizeof( m_nTickCycles ) );
+		Reset();
+	}
+
+	virtual void FrameUpdatePreEntityThink();
+	virtual void LevelShutdownPreEntity();
+
+	void AddCycles( FrameProfScope_t scope, int64 nCycles )
+	{
+		ThreadInterlockedExchangeAdd64( &m_nTickCycles[scope], nCycles );
+	}
+
+	void Reset();
+	void Print();
+	void Write();
+
+	void BeginCapture();
+	void EndCapture();
+	bool IsCapturing() const { return m_bCapturing; }
+
+private:
+	void GetPlayerCounts( int &nHumans, int &nBots );
+
+	bool					m_bCapturing;		// Benchmark capture, not cut into intervals
+
+	// Bumped with 64 bit interlocked adds, which need 8 byte alignment even in 32 bit builds
+	ALIGN8 int64 volatile	m_nTickCycles[FRAMEPROF_SCOPE_COUNT] ALIGN8_POST;
+	FrameProfHistogram_t	m_Histograms[FRAMEPROF_SCOPE_COUNT];
+	int						m_nOverruns;		// Ticks whose GameFrame alone took longer than a tick
+	double					m_flIntervalStart;
+};
+
+static CFrameProfiler g_FrameProfiler;
+
+void FrameProfiler_AddCycles( FrameProfScope_t scope, int64 nCycles )
+{
+	g_FrameProfiler.AddCycles( scope, nCycles );
+}
+
+void FrameProfiler_BeginCapture()
+{
+	g_FrameProfiler.BeginCapture();
+}
+
+void FrameProfiler_EndCapture()
+{
+	g_FrameProfiler.EndCapture();
+}
+
+void CFrameProfiler::BeginCapture()
+{
+	m_bCapturing = true;
+	g_bFrameProfilerEnabled = true;
+	Reset();
+}
+
+void CFrameProfiler::EndCapture()
+{
+	if ( !m_bCapturing )
+		return;
+
+	Print();
+	m_bCapturing = false;
+	g_bFrameProfilerEnabled = sv_frameprof.GetBool();
+	Reset();
+}
+
+void CFrameProfiler::Reset()
+{
+	for ( int i = 0; i < FRAMEPROF_SCOPE_COUNT; i++ )
+	{
+		ThreadInterlockedExchange64( &m_nTickCycles[i], 0 );
+		m_Histograms[i].Reset();
+	}
+	m_nOverruns = 0;
+	m_flIntervalStart = Plat_FloatTime();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Everything timed since the last call belongs to the previous tick:
+//			its GameFrame and the CheckTransmits of the snapshot that followed.
+//-----------------------------------------------------------------------------
+void CFrameProfiler::FrameUpdatePreEntityThink()
+{
+	if ( !g_bFrameProfilerEnabled )
+		return;
+
+	for ( int i = 0; i < FRAMEPROF_SCOPE_COUNT; i++ )
+	{
+		CCycleCount cycles;
+		cycles.Init( (uint64)ThreadInterlockedExchange64( &m_nTickCycles[i], 0 ) );
+
+		uint32 nMicroseconds = cycles.GetMicroseconds();
+		m_Histograms[i].Add( nMicroseconds );
+
+		if ( i == FRAMEPROF_GAMEFRAME && nMicroseconds > gpGlobals->interval_per_tick * 1000000.0f )
+		{
+			m_nOverruns++;
+		}
+	}
+
+	if ( !m_bCapturing && Plat_FloatTime() - m_flIntervalStart >= sv_frameprof_interval.GetFloat() )
+	{
+		Write();
+		Reset();
+	}
+}
+
+void CFrameProfiler::LevelShutdownPreEntity()
+{
+	// Don't let an interval straddle two maps
+	if ( g_bFrameProfilerEnabled && !m_bCapturing )
+	{
+		Write();
+		Reset();
+	}
+}
+
+void CFrameProfiler::GetPlayerCounts( int &nHumans, int &nBots )
+{
+	nHumans = nBots = 0;
+	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+	{
+		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
+		if ( !pPlayer || !pPlayer->IsConnected() )
+			continue;
+
+		if ( pPlayer->IsBot() )
+		{
+			nBots++;
+		}
+		else
+		{
+			nHumans++;
+		}
+	}
+}
+
+void CFrameProfiler::Write()
+{
+	if ( !m_Histograms[FRAMEPROF_GAMEFRAME].m_nTicks )
+		return;
+
+	const char *pszFile = sv_frameprof_file.GetString();
+	FileHandle_t hFile = filesystem->Open( pszFile, "a", "MOD" );
+	if ( hFile == FILESYSTEM_INVALID_HANDLE )
+	{
+		Warning( "sv_frameprof: couldn't open %s for writing\n", pszFile );
+		return;
+	}
+
+	if ( filesystem->Size( hFile ) == 0 )
+	{
+		filesystem->FPrintf( hFile, "time,map,humans,bots,tickrate,scope,ticks,overruns,mean_us,p50_us,p99_us,max_us\n" );
+	}
+
+	int nHumans, nBots;
+	GetPlayerCounts( nHumans, nBots );
+
+	long nTime = (long)time( NULL );
+	int nTickRate = (int)( 1.0f / gpGlobals->interval_per_tick + 0.5f );
+
+	for ( int i = 0; i < FRAMEPROF_SCOPE_COUNT; i++ )
+	{
+		const FrameProfHistogram_t &histogram = m_Histograms[i];
+		filesystem->FPrintf( hFile, "%ld,%s,%d,%d,%d,%s,%d,%d,%u,%u,%u,%u\n",
+			nTime, STRING( gpGlobals->mapname ), nHumans, nBots, nTickRate,
+			s_pszFrameProfScopeNames[i], histogram.m_nTicks, m_nOverruns,
+			histogram.m_nTicks ? (uint32)( histogram.m_nTotal / histogram.m_nTicks ) : 0,
+			histogram.Percentile( 0.5f ), histogram.Percentile( 0.99f ), histogram.m_nMax );
+	}
+
+	filesystem->Close( hFile );
+}
+
+void CFrameProfiler::Print()
+{
+	double flSeconds = Plat_FloatTime() - m_flIntervalStart;
+	Msg( "%d ticks over %.1f seconds, %d over budget\n", m_Histograms[FRAMEPROF_GAMEFRAME].m_nTicks, flSeconds, m_nOverruns );
+	Msg( "%-28s %9s %9s %9s %9s\n", "scope", "mean us", "p50 us", "p99 us", "max us" );
+
+	for ( int i = 0; i < FRAMEPROF_SCOPE_COUNT; i++ )
+	{
+		const FrameProfHistogram_t &histogram = m_Histograms[i];
+		Msg( "%-28s %9u %9u %9u %9u\n", s_pszFrameProfScopeNames[i],
+			histogram.m_nTicks ? (uint32)( histogram.m_nTotal / histogram.m_nTicks ) : 0,
+			histogram.Percentile( 0.5f ), histogram.Percentile( 0.99f ), histogram.m_nMax );
+	}
+}
+
+static void FrameProfilerChanged( IConVar *var, const char *pOldValue, float flOldValue )
+{
+	ConVarRef frameprof( var );
+	if ( frameprof.GetBool() == g_bFrameProfilerEnabled || g_FrameProfiler.IsCapturing() )
+		return;
+
+	g_bFrameProfilerEnabled = frameprof.GetBool();
+	g_FrameProfiler.Reset();
+}
+
+CON_COMMAND( sv_frameprof_print, "Show the frame profiler's current interval." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( !g_bFrameProfilerEnabled )
+	{
+		Msg( "sv_frameprof is off\n" );
+		return;
+	}
+
+	g_FrameProfiler.Print();
+}
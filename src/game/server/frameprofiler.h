@@ -0,0 +1,74 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Continuous per-tick server frame profiler. Times a few top level
+//			scopes every tick and periodically appends their p50/p99/max to
+//			a CSV file, so tick overruns can be matched against player count
+//			and map without attaching a profiler.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/fasttimer.h"
+
+enum FrameProfScope_t
+{
+	FRAMEPROF_GAMEFRAME = 0,
+	FRAMEPROF_PHYSICS_THINK,
+	FRAMEPROF_PLAYER_MOVEMENT,
+	FRAMEPROF_NEXTBOT,
+	FRAMEPROF_LAG_COMPENSATION,
+	FRAMEPROF_CHECK_TRANSMIT,
+
+	FRAMEPROF_SCOPE_COUNT
+};
+
+extern bool g_bFrameProfilerEnabled;
+
+// Adds time to a scope for the current tick. Safe to call from any thread.
+void FrameProfiler_AddCycles( FrameProfScope_t scope, int64 nCycles );
+
+// Profiles from now on regardless of sv_frameprof and without cutting the
+// ticks into sv_frameprof_interval rows. EndCapture prints what was captured.
+void FrameProfiler_BeginCapture();
+void FrameProfiler_EndCapture();
+
+//-----------------------------------------------------------------------------
+// Times the enclosing block into a frame profiler scope. Scopes may overlap
+// (player movement runs inside the think functions), each is totalled on its
+// own. Costs a bool test while the profiler is off.
+//-----------------------------------------------------------------------------
+class CFrameProfScope
+{
+public:
+	CFrameProfScope( FrameProfScope_t scope ) : m_Scope( scope ), m_bTiming( g_bFrameProfilerEnabled )
+	{
+		if ( m_bTiming )
+		{
+			m_Timer.Start();
+		}
+	}
+
+	~CFrameProfScope()
+	{
+		if ( m_bTiming )
+		{
+			m_Timer.End();
+			FrameProfiler_AddCycles( m_Scope, m_Timer.GetDuration().GetLongCycles() );
+		}
+	}
+
+private:
+	CFastTimer			m_Timer;
+	FrameProfScope_t	m_Scope;
+	bool				m_bTiming;
+};
+
+#define FRAMEPROF_SCOPE( scope )	CFrameProfScope frameProfScope( scope )
+
+#endif // FRAMEPROFILER_H
@@ -88,6 +88,8 @@
 #endif
 #include "tier3/tier3.h"
 #include "serverbenchmark_base.h"
+#include "frameprofiler.h"
+#include "usercmd_replay.h"
 #include "querycache.h"
 #include "player_voice_listener.h"
 
@@ -1197,6 +1199,7 @@ ConVar  trace_report( "trace_report", "0" );
 void CServerGameDLL::GameFrame( bool simulating )
 {
 	VPROF( "CServerGameDLL::GameFrame" );
+	FRAMEPROF_SCOPE( FRAMEPROF_GAMEFRAME );
 
 	// Don't run frames until fully restored
 	if ( g_InRestore )
@@ -2479,6 +2482,8 @@ inline void CServerNetworkProperty::CheckTransmit( CCheckTransmitInfo *pInfo )
 
 void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned short *pEdictIndices, int nEdicts )
 {
+	FRAMEPROF_SCOPE( FRAMEPROF_CHECK_TRANSMIT );
+
 	// NOTE: for speed's sake, this assumes that all networkables are CBaseEntities and that the edict list
 	// is consecutive in memory. If either of these things change, then this routine needs to change, but
 	// ideally we won't be calling any virtual from this routine. This speedy routine was added as an
@@ -2723,6 +2728,11 @@ void CServerGameClients::ClientActive( edict_t *pEdict, bool bLoadGame )
 	CSoundEnvelopeController::GetController().CheckLoopingSoundsForPlayer( pPlayer );
 	SceneManager_ClientActive( pPlayer );
 
+	if ( UserCmdReplay_IsRecording() )
+	{
+		UserCmdReplay_RecordJoin( pPlayer );
+	}
+
 	#if defined( TF_DLL )
 		Assert( pPlayer );
 		if ( pPlayer && !pPlayer->IsFakeClient() && !pPlayer->IsHLTV() && !pPlayer->IsReplay() )
@@ -2766,6 +2776,11 @@ void CServerGameClients::ClientDisconnect( edict_t *pEdict )
 	CBasePlayer *player = ( CBasePlayer * )CBaseEntity::Instance( pEdict );
 	if ( player )
 	{
+		if ( UserCmdReplay_IsRecording() )
+		{
+			UserCmdReplay_RecordDisconnect( player );
+		}
+
 		if ( !g_fGameOver )
 		{
 			player->SetMaxSpeed( 0.0f );
@@ -2832,6 +2847,12 @@ void CServerGameClients::ClientPutInServer( edict_t *pEntity, const char *player
 void CServerGameClients::ClientCommand( edict_t *pEntity, const CCommand &args )
 {
 	CBasePlayer *pPlayer = ToBasePlayer( GetContainingEntity( pEntity ) );
+
+	if ( UserCmdReplay_IsRecording() )
+	{
+		UserCmdReplay_RecordClientCommand( pPlayer, args );
+	}
+
 	::ClientCommand( pPlayer, args );
 }
 
@@ -3095,6 +3116,11 @@ float CServerGameClients::ProcessUsercmds( edict_t *player, bf_read *buf, int nu
 	MDLCACHE_CRITICAL_SECTION();
 	pPlayer->ProcessUsercmds( cmds, numcmds, totalcmds, dropped_packets, paused );
 
+	if ( UserCmdReplay_IsRecording() )
+	{
+		UserCmdReplay_RecordUsercmds( pPlayer, cmds, numcmds, totalcmds, dropped_packets, paused );
+	}
+
 	return TICK_INTERVAL;
 }
 
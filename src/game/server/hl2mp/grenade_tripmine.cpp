@@ -49,6 +49,7 @@ CTripmineGrenade::CTripmineGrenade()
 	m_vecEnd.Init();
 	m_posOwner.Init();
 	m_angleOwner.Init();
+	m_hBeamSensor = BEAMSENSOR_INVALID_HANDLE;
 }
 
 void CTripmineGrenade::Spawn( void )
@@ -105,6 +106,13 @@ void CTripmineGrenade::Precache( void )
 }
 
 
+void CTripmineGrenade::UpdateOnRemove( void )
+{
+	BeamSensor_Destroy( m_hBeamSensor );
+	BaseClass::UpdateOnRemove();
+}
+
+
 void CTripmineGrenade::WarningThink( void  )
 {
 	// set to power up
@@ -135,6 +143,7 @@ void CTripmineGrenade::KillBeam( void )
 		UTIL_Remove( m_pBeam );
 		m_pBeam = NULL;
 	}
+	BeamSensor_Destroy( m_hBeamSensor );
 }
 
 
@@ -200,10 +209,24 @@ void CTripmineGrenade::BeamBreakThink( void  )
 		}
 	}
 
+	if ( m_hBeamSensor == BEAMSENSOR_INVALID_HANDLE )
+	{
+		m_hBeamSensor = BeamSensor_Create( this, MASK_SOLID );
+	}
+
+	// Nothing that could block the beam has changed since the last trace,
+	// so it would come out the same and not trip us.
+	if ( m_pBeam && !BeamSensor_NeedsRetest( m_hBeamSensor, GetAbsOrigin(), m_vecEnd ) )
+	{
+		SetNextThink( gpGlobals->curtime + 0.05f );
+		return;
+	}
+
 	trace_t tr;
 
 	// NOT MASK_SHOT because we want only simple hit boxes
 	UTIL_TraceLine( GetAbsOrigin(), m_vecEnd, MASK_SOLID, this, COLLISION_GROUP_NONE, &tr );
+	BeamSensor_SetResult( m_hBeamSensor, tr.fraction );
 
 	// ALERT( at_console, "%f : %f\n", tr.flFraction, m_flBeamLength );
 
@@ -12,6 +12,7 @@
 #endif
 
 #include "basegrenade_shared.h"
+#include "beamsensor.h"
 
 class CBeam;
 
@@ -24,6 +25,7 @@ public:
 	CTripmineGrenade();
 	void Spawn( void );
 	void Precache( void );
+	void UpdateOnRemove( void );
 
 #if 0 // FIXME: OnTakeDamage_Alive() is no longer called now that base grenade derives from CBaseAnimating
 	int OnTakeDamage_Alive( const CTakeDamageInfo &info );
@@ -50,6 +52,8 @@ private:
 	Vector		m_posOwner;
 	Vector		m_angleOwner;
 
+	BeamSensorHandle_t	m_hBeamSensor;	// not saved, recreated on the next think
+
 	DECLARE_DATADESC();
 };
 
@@ -66,7 +66,7 @@ void FinishClientPutInServer( CHL2MP_Player *pPlayer )
 	const ConVar *hostname = cvar->FindVar( "hostname" );
 	const char *title = (hostname) ? hostname->GetString() : "MESSAGE OF THE DAY";
 
-	KeyValues *data = new KeyValues("data");
+	KeyValues *data = KeyValues::CreateArenaBacked( "data" );
 	data->SetString( "title", title );		// info panel title
 	data->SetString( "type", "1" );			// show userdata from stringtable entry
 	data->SetString( "msg",	"motd" );		// use this stringtable entry
@@ -19,6 +19,8 @@
 #include "world.h"
 #include "toolframework/iserverenginetools.h"
 #include "vscript_server.h"
+#include "checksum_crc.h"
+#include "tier1/utlsymbollarge.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -33,8 +35,8 @@ struct HierarchicalSpawnMapData_t
 static CStringRegistry *g_pClassnameSpawnPriority = NULL;
 extern edict_t *g_pForceAttachEdict;
 
-// creates an entity by string name, but does not spawn it
-CBaseEntity *CreateEntityByName( const char *className, int iForceEdictIndex )
+// creates an entity from a factory the caller already looked up, but does not spawn it
+static CBaseEntity *CreateEntityByFactory( const char *className, IEntityFactory *pFactory, int iForceEdictIndex )
 {
 	if ( iForceEdictIndex != -1 )
 	{
@@ -43,7 +45,7 @@ CBaseEntity *CreateEntityByName( const char *className, int iForceEdictIndex )
 			Error( "CreateEntityByName( %s, %d ) - CreateEdict failed.", className, iForceEdictIndex );
 	}
 
-	IServerNetworkable *pNetwork = EntityFactoryDictionary()->Create( className );
+	IServerNetworkable *pNetwork = EntityFactoryDictionary()->Create( className, pFactory );
 	g_pForceAttachEdict = NULL;
 
 	if ( !pNetwork )
@@ -60,6 +62,12 @@ CBaseEntity *CreateEntityByName( const char *className, int iForceEdictIndex )
 	return pEntity;
 }
 
+// creates an entity by string name, but does not spawn it
+CBaseEntity *CreateEntityByName( const char *className, int iForceEdictIndex )
+{
+	return CreateEntityByFactory( className, EntityFactoryDictionary()->FindFactory( className ), iForceEdictIndex );
+}
+
 CBaseNetworkable *CreateNetworkableByName( const char *className )
 {
 	IServerNetworkable *pNetwork = EntityFactoryDictionary()->Create( className );
@@ -310,6 +318,162 @@ void SpawnAllEntities( int nEntities, HierarchicalSpawn_t *pSpawnList, bool bAct
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: The entity lump, tokenised once. Each entity keeps its classname
+//			resolved to a factory and its keyvalues as pooled strings, so map
+//			load and every round restart spawn from here instead of re-parsing
+//			the text. Rebuilt whenever it's handed a different lump.
+//-----------------------------------------------------------------------------
+class CMapEntityTable
+{
+public:
+	struct Entity_t
+	{
+		int				m_nDataOffset;		// just past the entity's opening brace
+		int				m_nEndOffset;		// where its keys end, at the closing brace
+		const char		*m_pszClassName;
+		IEntityFactory	*m_pFactory;		// NULL if nothing is linked to the classname
+		int				m_nFirstKeyValue;
+		int				m_nKeyValues;
+	};
+
+	CMapEntityTable() : m_nLength( -1 ), m_CRC( 0 ) {}
+
+	void Build( const char *pMapData );
+
+	int Count() const { return m_Entities.Count(); }
+	const Entity_t &operator[]( int i ) const { return m_Entities[i]; }
+
+	// Key, value string pairs of an entity
+	const char * const *GetKeyValues( const Entity_t &ent ) const { return m_KeyValues.Base() + ent.m_nFirstKeyValue * 2; }
+
+private:
+	const char *PoolString( const char *pszValue ) { return m_Strings.AddString( pszValue ).String(); }
+
+	int							m_nLength;
+	CRC32_t						m_CRC;
+	CUtlVector< Entity_t >		m_Entities;
+	CUtlVector< const char * >	m_KeyValues;
+	CUtlSymbolTableLarge		m_Strings;
+};
+
+static CMapEntityTable g_MapEntityTable;
+
+void CMapEntityTable::Build( const char *pMapData )
+{
+	int nLength = Q_strlen( pMapData );
+	CRC32_t crc = CRC32_ProcessSingleBuffer( pMapData, nLength );
+	if ( nLength == m_nLength && crc == m_CRC )
+		return;
+
+	VPROF( "CMapEntityTable::Build" );
+
+	m_nLength = nLength;
+	m_CRC = crc;
+	m_Entities.RemoveAll();
+	m_KeyValues.RemoveAll();
+	m_Strings.RemoveAll();
+
+	// Classnames are pooled, so each distinct one is resolved once
+	CUtlMap< const char *, IEntityFactory * > factories( DefLessFunc( const char * ) );
+
+	char token[MAPKEY_MAXLENGTH];
+	char keyName[MAPKEY_MAXLENGTH];
+	char value[MAPKEY_MAXLENGTH];
+
+	const char *pData = pMapData;
+	while ( ( pData = MapEntity_ParseToken( pData, token ) ) != NULL )
+	{
+		if (token[0] != '{')
+		{
+			Error( "MapEntity_ParseAllEntities: found %s when expecting {", token);
+			continue;
+		}
+
+		if ( !MapEntity_ExtractValue( pData, "classname", value ) )
+		{
+			Error( "classname missing from entity!\n" );
+		}
+
+		Entity_t &ent = m_Entities[ m_Entities.AddToTail() ];
+		ent.m_nDataOffset = pData - pMapData;
+		ent.m_pszClassName = PoolString( value );
+		ent.m_nFirstKeyValue = m_KeyValues.Count() / 2;
+
+		unsigned short iFactory = factories.Find( ent.m_pszClassName );
+		if ( iFactory == factories.InvalidIndex() )
+		{
+			iFactory = factories.Insert( ent.m_pszClassName, EntityFactoryDictionary()->FindFactory( ent.m_pszClassName ) );
+		}
+		ent.m_pFactory = factories[iFactory];
+
+		CEntityMapData entData( (char*)pData );
+		if ( entData.GetFirstKey( keyName, value ) )
+		{
+			do 
+			{
+				m_KeyValues.AddToTail( PoolString( keyName ) );
+				m_KeyValues.AddToTail( PoolString( value ) );
+			} 
+			while ( entData.GetNextKey( keyName, value ) );
+		}
+
+		ent.m_nKeyValues = m_KeyValues.Count() / 2 - ent.m_nFirstKeyValue;
+
+		pData = entData.CurrentBufferPosition();
+		if ( !pData )
+		{
+			// Truncated lump, GetNextKey already complained
+			m_Entities.RemoveMultipleFromTail( 1 );
+			break;
+		}
+		ent.m_nEndOffset = pData - pMapData;
+
+		pData = MapEntity_SkipToNextEntity( pData, token );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Creates and parses an entity from the entity table.
+// Input  : pEntity - Receives the newly constructed entity, NULL on failure.
+//			pMapData - The entity lump the table was built from.
+//-----------------------------------------------------------------------------
+static void MapEntity_ParseTableEntity( CBaseEntity *&pEntity, const char *pMapData, const CMapEntityTable::Entity_t &ent, IMapEntityFilter *pFilter )
+{
+	CEntityMapData entData( (char*)pMapData + ent.m_nDataOffset );
+	entData.SetParsedKeyValues( g_MapEntityTable.GetKeyValues( ent ), ent.m_nKeyValues, (char*)pMapData + ent.m_nEndOffset );
+
+	const char *className = ent.m_pszClassName;
+
+	pEntity = NULL;
+	if ( !pFilter || pFilter->ShouldCreateEntity( className ) )
+	{
+		//
+		// Construct via the LINK_ENTITY_TO_CLASS factory.
+		//
+		if ( pFilter )
+		{
+			pEntity = pFilter->CreateNextEntity( className );
+		}
+		else
+		{
+			pEntity = CreateEntityByFactory( className, ent.m_pFactory, -1 );
+		}
+
+		//
+		// Set up keyvalues.
+		//
+		if (pEntity != NULL)
+		{
+			pEntity->ParseMapData(&entData);
+		}
+		else
+		{
+			Warning("Can't init %s\n", className);
+		}
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Only called on BSP load. Parses and spawns all the entities in the BSP.
 // Input  : pMapData - Pointer to the entity data block to parse.
@@ -324,50 +488,36 @@ void MapEntity_ParseAllEntities(const char *pMapData, IMapEntityFilter *pFilter,
 	CUtlVector< CPointTemplate* > pPointTemplates;
 	int nEntities = 0;
 
-	char szTokenBuffer[MAPKEY_MAXLENGTH];
-
 	// Allow the tools to spawn different things
 	if ( serverenginetools )
 	{
 		pMapData = serverenginetools->GetEntityData( pMapData );
 	}
 
+	g_MapEntityTable.Build( pMapData );
+
 	//  Loop through all entities in the map data, creating each.
-	for ( ; true; pMapData = MapEntity_SkipToNextEntity(pMapData, szTokenBuffer) )
+	for ( int iEntity = 0; iEntity < g_MapEntityTable.Count(); iEntity++ )
 	{
-		//
-		// Parse the opening brace.
-		//
-		char token[MAPKEY_MAXLENGTH];
-		pMapData = MapEntity_ParseToken( pMapData, token );
-
-		//
-		// Check to see if we've finished or not.
-		//
-		if (!pMapData)
-			break;
-
-		if (token[0] != '{')
-		{
-			Error( "MapEntity_ParseAllEntities: found %s when expecting {", token);
-			continue;
-		}
+		const CMapEntityTable::Entity_t &ent = g_MapEntityTable[iEntity];
 
 		//
-		// Parse the entity and add it to the spawn list.
+		// Parse the entity and add it to the spawn list. pCurMapData/pEndMapData
+		// bracket its text exactly as re-parsing the lump would have.
 		//
 		CBaseEntity *pEntity;
-		const char *pCurMapData = pMapData;
-		pMapData = MapEntity_ParseEntity(pEntity, pMapData, pFilter);
+		const char *pCurMapData = pMapData + ent.m_nDataOffset;
+		const char *pEndMapData = pMapData + ent.m_nEndOffset;
+		MapEntity_ParseTableEntity(pEntity, pMapData, ent, pFilter);
 		if (pEntity == NULL)
 			continue;
 
 		if (pEntity->IsTemplate())
 		{
 			// It's a template entity. Squirrel away its keyvalue text so that we can
-			// recreate the entity later via a spawner. pMapData points at the '}'
+			// recreate the entity later via a spawner. pEndMapData points at the '}'
 			// so we must add one to include it in the string.
-			Templates_Add(pEntity, pCurMapData, (pMapData - pCurMapData) + 2);
+			Templates_Add(pEntity, pCurMapData, (pEndMapData - pCurMapData) + 2);
 
 			// Remove the template entity so that it does not show up in FindEntityXXX searches.
 			UTIL_Remove(pEntity);
@@ -436,7 +586,7 @@ void MapEntity_ParseAllEntities(const char *pMapData, IMapEntityFilter *pFilter,
 			pSpawnList[nEntities].m_pDeferredParent = NULL;
 
 			pSpawnMapData[nEntities].m_pMapData = pCurMapData;
-			pSpawnMapData[nEntities].m_iMapDataLength = (pMapData - pCurMapData) + 2;
+			pSpawnMapData[nEntities].m_iMapDataLength = (pEndMapData - pCurMapData) + 2;
 			nEntities++;
 		}
 	}
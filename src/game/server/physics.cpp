@@ -93,6 +93,63 @@ ConVar phys_timescale( "phys_timescale", "1", 0, "Scale time for physics", Times
 ConVar phys_dontprintint( "phys_dontprintint", "1", FCVAR_NONE, "Don't print inter-penetration warnings." );
 #endif
 
+//-----------------------------------------------------------------------------
+// Collision filter pair cache
+//-----------------------------------------------------------------------------
+enum
+{
+	PAIRFILTER_NEVER		= 0x01,		// never collide, whatever the physics objects are doing
+	PAIRFILTER_AIMOVE0		= 0x02,		// entity 0 is an AI mover (only hits moveable objects)
+	PAIRFILTER_AIMOVE1		= 0x04,
+	PAIRFILTER_NOT_SOLID0	= 0x08,		// entity 0 is FSOLID_NOT_SOLID (only hits vphysics triggers)
+	PAIRFILTER_NOT_SOLID1	= 0x10,
+	PAIRFILTER_REJECT_SOLID	= 0x20,		// trigger or collision group rules reject the pair
+};
+
+ConVar phys_collisionfilter_cache( "phys_collisionfilter_cache", "1", FCVAR_NONE, "Cache per entity pair collision filter decisions until either entity's collision rules change." );
+
+class CCollisionFilterCache
+{
+public:
+	CCollisionFilterCache() { Clear(); ResetStats(); }
+
+	unsigned int GetPairFilter( CBaseEntity *pEntity0, CBaseEntity *pEntity1 );
+	void EntityRulesChanged( int iEntity ) { m_nRulesStamp[iEntity] = ++m_nNextStamp; }
+	void CountUncached() { m_nUncached++; }
+
+	void Clear();
+	void ResetStats();
+	void ReportStats();
+
+private:
+	enum
+	{
+		CACHE_BITS = 12,
+		CACHE_SIZE = 1 << CACHE_BITS,
+	};
+
+	struct entry_t
+	{
+		unsigned int	hEntity0;
+		unsigned int	hEntity1;
+		unsigned int	stamp0;
+		unsigned int	stamp1;
+		unsigned int	pairFilter;
+	};
+
+	entry_t			m_entries[CACHE_SIZE];
+	unsigned int	m_nRulesStamp[NUM_ENT_ENTRIES];
+	unsigned int	m_nNextStamp;
+
+	int64			m_nHits;
+	int64			m_nMisses;
+	int64			m_nStale;
+	int64			m_nUncached;
+};
+
+static CCollisionFilterCache g_CollisionFilterCache;
+static unsigned int ComputeEntityPairFilter( CBaseEntity *pEntity0, CBaseEntity *pEntity1 );
+
 #ifdef PORTAL
 	CPortal_CollisionEvent g_Collisions;
 #else
@@ -231,6 +288,7 @@ void CPhysicsHook::LevelInitPreEntity()
 	{
 	g_EntityCollisionHash = physics->CreateObjectPairHash();
 	}
+	g_CollisionFilterCache.Clear();
 	factorylist_t factories;
 	FactoryList_Retrieve( factories );
 	physenv->SetDebugOverlay( factories.engineFactory );
@@ -511,15 +569,11 @@ int CCollisionEvent::ShouldCollide_2( IPhysicsObject *pObj0, IPhysicsObject *pOb
 	if ( pEntity0->ForceVPhysicsCollide( pEntity1 ) || pEntity1->ForceVPhysicsCollide( pEntity0 ) )
 		return 1;
 
-	if ( pEntity0->edict() && pEntity1->edict() )
-	{
-		// don't collide with your owner
-		if ( pEntity0->GetOwnerEntity() == pEntity1 || pEntity1->GetOwnerEntity() == pEntity0 )
-			return 0;
-	}
-
+	unsigned int pairFilter;
 	if ( pEntity0->GetMoveParent() || pEntity1->GetMoveParent() )
 	{
+		// Root parents can change without either entity changing its own
+		// collision rules, so hierarchy pairs are never cached
 		CBaseEntity *pParent0 = pEntity0->GetRootMoveParent();
 		CBaseEntity *pParent1 = pEntity1->GetRootMoveParent();
 		
@@ -538,6 +592,68 @@ int CCollisionEvent::ShouldCollide_2( IPhysicsObject *pObj0, IPhysicsObject *pOb
 			if ( g_EntityCollisionHash->IsObjectPairInHash( p0, p1 ) )
 				return 0;
 		}
+
+		pairFilter = ComputeEntityPairFilter( pEntity0, pEntity1 );
+		g_CollisionFilterCache.CountUncached();
+	}
+	else
+	{
+		pairFilter = g_CollisionFilterCache.GetPairFilter( pEntity0, pEntity1 );
+	}
+
+	if ( pairFilter & PAIRFILTER_NEVER )
+		return 0;
+
+	// AI movers don't collide with the world/static/pinned objects or other AI movers
+	if ( ( (pairFilter & PAIRFILTER_AIMOVE0) && !pObj1->IsMoveable() ) ||
+		( (pairFilter & PAIRFILTER_AIMOVE1) && !pObj0->IsMoveable() ) )
+		return 0;
+
+	// two objects under shadow control should not collide.  The AI will figure it out
+	if ( pObj0->GetShadowController() && pObj1->GetShadowController() )
+		return 0;
+
+	// not solid doesn't collide with anything
+	if ( pairFilter & (PAIRFILTER_NOT_SOLID0|PAIRFILTER_NOT_SOLID1) )
+	{
+		// might be a vphysics trigger, collide with everything but "not solid"
+		if ( pObj0->IsTrigger() && !(pairFilter & PAIRFILTER_NOT_SOLID1) )
+			return 1;
+		if ( pObj1->IsTrigger() && !(pairFilter & PAIRFILTER_NOT_SOLID0) )
+			return 1;
+
+		return 0;
+	}
+
+	if ( pairFilter & PAIRFILTER_REJECT_SOLID )
+		return 0;
+
+	// check contents
+	if ( !(pObj0->GetContents() & pEntity1->PhysicsSolidMaskForEntity()) || !(pObj1->GetContents() & pEntity0->PhysicsSolidMaskForEntity()) )
+		return 0;
+
+	if ( g_EntityCollisionHash->IsObjectPairInHash( pGameData0, pGameData1 ) )
+		return 0;
+
+	if ( g_EntityCollisionHash->IsObjectPairInHash( pObj0, pObj1 ) )
+		return 0;
+
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The part of the collision filter that only depends on the two
+//			entities' collision rules (owner, solid, solid flags, move type,
+//			collision group). Anything that changes these calls
+//			CollisionRulesChanged(), which is what the pair cache keys on.
+//-----------------------------------------------------------------------------
+static unsigned int ComputeEntityPairFilter( CBaseEntity *pEntity0, CBaseEntity *pEntity1 )
+{
+	if ( pEntity0->edict() && pEntity1->edict() )
+	{
+		// don't collide with your owner
+		if ( pEntity0->GetOwnerEntity() == pEntity1 || pEntity1->GetOwnerEntity() == pEntity0 )
+			return PAIRFILTER_NEVER;
 	}
 
 	int solid0 = pEntity0->GetSolid();
@@ -572,57 +688,139 @@ int CCollisionEvent::ShouldCollide_2( IPhysicsObject *pObj0, IPhysicsObject *pOb
 		}
 	}
 
-	// AI movers don't collide with the world/static/pinned objects or other AI movers
-	if ( (aiMove0 && !pObj1->IsMoveable()) ||
-		(aiMove1 && !pObj0->IsMoveable()) ||
-		(aiMove0 && aiMove1) )
-		return 0;
-
-	// two objects under shadow control should not collide.  The AI will figure it out
-	if ( pObj0->GetShadowController() && pObj1->GetShadowController() )
-		return 0;
+	// AI movers don't collide with other AI movers; whether they hit the other
+	// object depends on its motion state, which is checked per query
+	if ( aiMove0 && aiMove1 )
+		return PAIRFILTER_NEVER;
 
 	// BRJ 1/24/03
 	// You can remove the assert if it's problematic; I *believe* this condition
 	// should be met, but I'm not sure.
 	//Assert ( (solid0 != SOLID_NONE) && (solid1 != SOLID_NONE) );
 	if ( (solid0 == SOLID_NONE) || (solid1 == SOLID_NONE) )
-		return 0;
+		return PAIRFILTER_NEVER;
 
-	// not solid doesn't collide with anything
+	unsigned int pairFilter = 0;
+	if ( aiMove0 )
+		pairFilter |= PAIRFILTER_AIMOVE0;
+	if ( aiMove1 )
+		pairFilter |= PAIRFILTER_AIMOVE1;
+
+	// not solid doesn't collide with anything but vphysics triggers
 	if ( (nSolidFlags0|nSolidFlags1) & FSOLID_NOT_SOLID )
 	{
-		// might be a vphysics trigger, collide with everything but "not solid"
-		if ( pObj0->IsTrigger() && !(nSolidFlags1 & FSOLID_NOT_SOLID) )
-			return 1;
-		if ( pObj1->IsTrigger() && !(nSolidFlags0 & FSOLID_NOT_SOLID) )
-			return 1;
-
-		return 0;
+		if ( nSolidFlags0 & FSOLID_NOT_SOLID )
+			pairFilter |= PAIRFILTER_NOT_SOLID0;
+		if ( nSolidFlags1 & FSOLID_NOT_SOLID )
+			pairFilter |= PAIRFILTER_NOT_SOLID1;
+		return pairFilter;
 	}
-	
+
 	if ( (nSolidFlags0 & FSOLID_TRIGGER) && 
 		!(solid1 == SOLID_VPHYSICS || solid1 == SOLID_BSP || movetype1 == MOVETYPE_VPHYSICS) )
-		return 0;
+		return pairFilter | PAIRFILTER_REJECT_SOLID;
 
 	if ( (nSolidFlags1 & FSOLID_TRIGGER) && 
 		!(solid0 == SOLID_VPHYSICS || solid0 == SOLID_BSP || movetype0 == MOVETYPE_VPHYSICS) )
-		return 0;
+		return pairFilter | PAIRFILTER_REJECT_SOLID;
 
 	if ( !g_pGameRules->ShouldCollide( pEntity0->GetCollisionGroup(), pEntity1->GetCollisionGroup() ) )
-		return 0;
+		return pairFilter | PAIRFILTER_REJECT_SOLID;
 
-	// check contents
-	if ( !(pObj0->GetContents() & pEntity1->PhysicsSolidMaskForEntity()) || !(pObj1->GetContents() & pEntity0->PhysicsSolidMaskForEntity()) )
-		return 0;
+	return pairFilter;
+}
 
-	if ( g_EntityCollisionHash->IsObjectPairInHash( pGameData0, pGameData1 ) )
-		return 0;
+//-----------------------------------------------------------------------------
+// Purpose: Direct-mapped cache of ComputeEntityPairFilter() results, keyed by
+//			the two entity handles (index + serial) and validated against a
+//			per-entity stamp that CollisionRulesChanged() bumps.
+//-----------------------------------------------------------------------------
+unsigned int CCollisionFilterCache::GetPairFilter( CBaseEntity *pEntity0, CBaseEntity *pEntity1 )
+{
+	const CBaseHandle &handle0 = pEntity0->GetRefEHandle();
+	const CBaseHandle &handle1 = pEntity1->GetRefEHandle();
+	if ( !phys_collisionfilter_cache.GetBool() || !handle0.IsValid() || !handle1.IsValid() )
+	{
+		m_nUncached++;
+		return ComputeEntityPairFilter( pEntity0, pEntity1 );
+	}
 
-	if ( g_EntityCollisionHash->IsObjectPairInHash( pObj0, pObj1 ) )
-		return 0;
+	unsigned int h0 = handle0.ToInt();
+	unsigned int h1 = handle1.ToInt();
+	unsigned int nStamp0 = m_nRulesStamp[ handle0.GetEntryIndex() ];
+	unsigned int nStamp1 = m_nRulesStamp[ handle1.GetEntryIndex() ];
 
-	return 1;
+	unsigned int nSlot = ( ( h0 * 0x9E3779B1 ) ^ ( h1 * 0x85EBCA6B ) ) >> ( 32 - CACHE_BITS );
+	entry_t &entry = m_entries[nSlot];
+	if ( entry.hEntity0 == h0 && entry.hEntity1 == h1 )
+	{
+		if ( entry.stamp0 == nStamp0 && entry.stamp1 == nStamp1 )
+		{
+			m_nHits++;
+			return entry.pairFilter;
+		}
+		m_nStale++;
+	}
+	else
+	{
+		m_nMisses++;
+	}
+
+	entry.hEntity0 = h0;
+	entry.hEntity1 = h1;
+	entry.stamp0 = nStamp0;
+	entry.stamp1 = nStamp1;
+	entry.pairFilter = ComputeEntityPairFilter( pEntity0, pEntity1 );
+	return entry.pairFilter;
+}
+
+void CCollisionFilterCache::Clear()
+{
+	for ( int i = 0; i < CACHE_SIZE; i++ )
+	{
+		m_entries[i].hEntity0 = m_entries[i].hEntity1 = INVALID_EHANDLE_INDEX;
+	}
+	memset( m_nRulesStamp, 0, sizeof(m_nRulesStamp) );
+	m_nNextStamp = 0;
+}
+
+void CCollisionFilterCache::ResetStats()
+{
+	m_nHits = m_nMisses = m_nStale = m_nUncached = 0;
+}
+
+void CCollisionFilterCache::ReportStats()
+{
+	int64 nTotal = m_nHits + m_nMisses + m_nStale + m_nUncached;
+	Msg( "Collision filter pair cache (%s)\n", phys_collisionfilter_cache.GetBool() ? "enabled" : "disabled" );
+	Msg( "  %lld queries: %lld hits, %lld misses, %lld invalidated, %lld uncached\n",
+		(long long)nTotal, (long long)m_nHits, (long long)m_nMisses, (long long)m_nStale, (long long)m_nUncached );
+	if ( nTotal )
+	{
+		Msg( "  hit rate %.1f%%\n", 100.0 * (double)m_nHits / (double)nTotal );
+	}
+}
+
+void PhysCollisionRulesChanged( CBaseEntity *pEntity )
+{
+	const CBaseHandle &handle = pEntity->GetRefEHandle();
+	if ( handle.IsValid() )
+	{
+		g_CollisionFilterCache.EntityRulesChanged( handle.GetEntryIndex() );
+	}
+}
+
+CON_COMMAND( phys_collisionfilter_stats, "Reports collision filter pair cache hit rates. Usage: phys_collisionfilter_stats [reset]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_CollisionFilterCache.ReportStats();
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		g_CollisionFilterCache.ResetStats();
+	}
 }
 
 bool FindMaxContact( IPhysicsObject *pObject, float minForce, IPhysicsObject **pOtherObject, Vector *contactPos, Vector *pForce )
@@ -129,6 +129,8 @@ void PhysTeleportConstrainedEntity( CBaseEntity *pTeleportSource, IPhysicsObject
 
 void PhysGetListOfPenetratingEntities( CBaseEntity *pSearch, CUtlVector<CBaseEntity *> &list );
 bool PhysShouldCollide( IPhysicsObject *pObj0, IPhysicsObject *pObj1 );
+// Invalidates cached collision filter decisions involving this entity
+void PhysCollisionRulesChanged( CBaseEntity *pEntity );
 
 // returns true when processing a callback - so we can defer things that can't be done inside a callback
 bool PhysIsInCallback();
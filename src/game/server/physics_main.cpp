@@ -37,6 +37,7 @@
 #include "vphysicsupdateai.h"
 #include "tier0/vcrmode.h"
 #include "pushentity.h"
+#include "frameprofiler.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -2030,6 +2031,7 @@ void Physics_SimulateEntity( CBaseEntity *pEntity )
 void Physics_RunThinkFunctions( bool simulating )
 {
 	VPROF( "Physics_RunThinkFunctions");
+	FRAMEPROF_SCOPE( FRAMEPROF_PHYSICS_THINK );
 
 	g_bTestMoveTypeStepSimulation = sv_teststepsimulation.GetBool();
 
@@ -69,6 +69,7 @@
 #include "dt_utlvector_send.h"
 #include "vote_controller.h"
 #include "ai_speech.h"
+#include "usercmd_replay.h"
 
 #if defined USES_ECON_ITEMS
 #include "econ_wearable.h"
@@ -3564,7 +3565,11 @@ void CBasePlayer::ProcessUsercmds( CUserCmd *cmds, int numcmds, int totalcmds,
 			pCmd->MakeInert();
 		}
 
-		if ( sv_usercmd_custom_random_seed.GetBool() )
+		if ( UserCmdReplay_IsReplaying() )
+		{
+			// Replayed commands carry the seed they were given when recorded
+		}
+		else if ( sv_usercmd_custom_random_seed.GetBool() )
 		{
 			float fltTimeNow = float( Plat_FloatTime() * 1000.0 );
 			pCmd->server_random_seed = *reinterpret_cast<int*>( (char*)&fltTimeNow );
@@ -3640,7 +3645,7 @@ void CBasePlayer::ProcessUsercmds( CUserCmd *cmds, int numcmds, int totalcmds,
 //-----------------------------------------------------------------------------
 bool CBasePlayer::IsUserCmdDataValid( CUserCmd *pCmd )
 {
-	if ( IsBot() || IsFakeClient() )
+	if ( ( IsBot() || IsFakeClient() ) && !UserCmdReplay_IsReplayPlayer( this ) )
 		return true;
 
 	// Maximum difference between client's and server's tick_count
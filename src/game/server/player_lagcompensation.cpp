@@ -13,6 +13,8 @@
 #include "utllinkedlist.h"
 #include "BaseAnimatingOverlay.h"
 #include "tier0/vprof.h"
+#include "frameprofiler.h"
+#include "usercmd_replay.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -253,6 +255,7 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 	m_flTeleportDistanceSqr = sv_lagcompensation_teleport_dist.GetFloat() * sv_lagcompensation_teleport_dist.GetFloat();
 
 	VPROF_BUDGET( "FrameUpdatePostEntityThink", "CLagCompensationManager" );
+	FRAMEPROF_SCOPE( FRAMEPROF_LAG_COMPENSATION );
 
 	// remove all records before that time:
 	int flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat();
@@ -364,13 +367,14 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 	if ( !player->m_bLagCompensation		// Player not wanting lag compensation
 		 || (gpGlobals->maxClients <= 1)	// no lag compensation in single player
 		 || !sv_unlag.GetBool()				// disabled by server admin
-		 || player->IsBot() 				// not for bots
+		 || ( player->IsBot() && !UserCmdReplay_IsReplayPlayer( player ) )	// not for bots, replayed clients are
 		 || player->IsObserver()			// not for spectators
 		)
 		return;
 
 	// NOTE: Put this here so that it won't show up in single player mode.
 	VPROF_BUDGET( "StartLagCompensation", VPROF_BUDGETGROUP_OTHER_NETWORKING );
+	FRAMEPROF_SCOPE( FRAMEPROF_LAG_COMPENSATION );
 	Q_memset( m_RestoreData, 0, sizeof( m_RestoreData ) );
 	Q_memset( m_ChangeData, 0, sizeof( m_ChangeData ) );
 
@@ -768,6 +772,7 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 void CLagCompensationManager::FinishLagCompensation( CBasePlayer *player )
 {
 	VPROF_BUDGET_FLAGS( "FinishLagCompensation", VPROF_BUDGETGROUP_OTHER_NETWORKING, BUDGETFLAG_CLIENT|BUDGETFLAG_SERVER );
+	FRAMEPROF_SCOPE( FRAMEPROF_LAG_COMPENSATION );
 
 	m_pCurrentPlayer = NULL;
 
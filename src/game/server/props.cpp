@@ -330,7 +330,7 @@ void CBaseProp::CalculateBlockLOS( void )
 //-----------------------------------------------------------------------------
 int CBaseProp::ParsePropData( void )
 {
-	KeyValues *modelKeyValues = new KeyValues("");
+	KeyValues *modelKeyValues = KeyValues::CreateArenaBacked( "" );
 	if ( !modelKeyValues->LoadFromBuffer( modelinfo->GetModelName( GetModel() ), modelinfo->GetModelKeyValueText( GetModel() ) ) )
 	{
 		modelKeyValues->deleteThis();
@@ -2039,7 +2039,7 @@ void CDynamicProp::CreateBoneFollowers()
 	if ( m_BoneFollowerManager.GetNumBoneFollowers() )
 		return;
 
-	KeyValues *modelKeyValues = new KeyValues("");
+	KeyValues *modelKeyValues = KeyValues::CreateArenaBacked( "" );
 	if ( modelKeyValues->LoadFromBuffer( modelinfo->GetModelName( GetModel() ), modelinfo->GetModelKeyValueText( GetModel() ) ) )
 	{
 		// Do we have a bone follower section?
@@ -2814,7 +2814,7 @@ void CPhysicsProp::OnPhysGunDrop( CBasePlayer *pPhysGunUser, PhysGunDrop_t Reaso
 //-----------------------------------------------------------------------------
 bool CPhysicsProp::GetPropDataAngles( const char *pKeyName, QAngle &vecAngles )
 {
-	KeyValues *modelKeyValues = new KeyValues("");
+	KeyValues *modelKeyValues = KeyValues::CreateArenaBacked( "" );
 	if ( modelKeyValues->LoadFromBuffer( modelinfo->GetModelName( GetModel() ), modelinfo->GetModelKeyValueText( GetModel() ) ) )
 	{
 		KeyValues *pkvPropData = modelKeyValues->FindKey( "physgun_interactions" );
@@ -2839,7 +2839,7 @@ bool CPhysicsProp::GetPropDataAngles( const char *pKeyName, QAngle &vecAngles )
 //-----------------------------------------------------------------------------
 float CPhysicsProp::GetCarryDistanceOffset( void )
 {
-	KeyValues *modelKeyValues = new KeyValues("");
+	KeyValues *modelKeyValues = KeyValues::CreateArenaBacked( "" );
 	if ( modelKeyValues->LoadFromBuffer( modelinfo->GetModelName( GetModel() ), modelinfo->GetModelKeyValueText( GetModel() ) ) )
 	{
 		KeyValues *pkvPropData = modelKeyValues->FindKey( "physgun_interactions" );
@@ -0,0 +1,262 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per-SendTable send proxy instrumentation.
+//
+//			When enabled, every var proxy reachable from a ServerClass is routed
+//			through a thunk that counts calls and cycles for the owning SendTable.
+//			Tables are marked by whether every path to them goes through
+//			SPROP_PROXY_ALWAYS_YES datatables, i.e. whether their props are the
+//			same for all recipients.
+//
+//			This only measures. Proxy results are not cached: the engine already
+//			runs var proxies once per changed entity per snapshot and shares the
+//			packed result between clients. The remaining repeats come from
+//			baseline encodes, which the game DLL can't see, so a replay cache
+//			can't be invalidated reliably from here.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "sendproxy.h"
+#include "server_class.h"
+#include "tier0/fasttimer.h"
+#include "tier1/utlhashtable.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+//-----------------------------------------------------------------------------
+// Instrumented props and tables
+//-----------------------------------------------------------------------------
+struct SendProxyEntry_t
+{
+	SendProp		*m_pProp;
+	SendVarProxyFn	m_pfnProxy;		// The proxy the prop was declared with
+	int				m_iTable;
+};
+
+// The counters are bumped with 64 bit interlocked ops, which need them 8 byte aligned
+struct ALIGN8 SendTableProxyStats_t
+{
+	int64 volatile	m_nCalls;
+	int64 volatile	m_nCycles;
+	SendTable		*m_pTable;
+	int				m_nProps;
+	bool			m_bRecipientIndependent;	// Only reached through SPROP_PROXY_ALWAYS_YES datatables
+} ALIGN8_POST;
+
+static CUtlVector< SendProxyEntry_t >		s_ProxyEntries;
+static CUtlVector< SendTableProxyStats_t >	s_TableStats;
+static CUtlHashtable< const SendProp *, int >	s_ProxyEntryLookup;
+static bool									s_bStatsEnabled = false;
+static bool									s_bInstalled = false;
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Installed in place of every instrumented var proxy.
+//-----------------------------------------------------------------------------
+static void SendProxy_Instrumented( const SendProp *pProp, const void *pStruct, const void *pData, DVariant *pOut, int iElement, int objectID )
+{
+	UtlHashHandle_t h = s_ProxyEntryLookup.Find( pProp );
+	Assert( h != s_ProxyEntryLookup.InvalidHandle() );
+	const SendProxyEntry_t &entry = s_ProxyEntries[ s_ProxyEntryLookup.Element( h ) ];
+	SendTableProxyStats_t &stats = s_TableStats[ entry.m_iTable ];
+
+	if ( s_bStatsEnabled )
+	{
+		CFastTimer timer;
+		timer.Start();
+		entry.m_pfnProxy( pProp, pStruct, pData, pOut, iElement, objectID );
+		timer.End();
+
+		ThreadInterlockedIncrement64( &stats.m_nCalls );
+		ThreadInterlockedExchangeAdd64( &stats.m_nCycles, timer.GetDuration().GetLongCycles() );
+	}
+	else
+	{
+		entry.m_pfnProxy( pProp, pStruct, pData, pOut, iElement, objectID );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Gathers the var props of a table and everything it includes.
+//-----------------------------------------------------------------------------
+static void CollectSendProxies_r( SendTable *pTable, bool bRecipientIndependent, CUtlMap< SendTable *, int > &tableIndices )
+{
+	int iTable;
+	unsigned short iMap = tableIndices.Find( pTable );
+	if ( iMap != tableIndices.InvalidIndex() )
+	{
+		// Already walked; a table reached through a recipient proxy anywhere is
+		// recipient dependent everywhere.
+		iTable = tableIndices[iMap];
+		if ( bRecipientIndependent || !s_TableStats[iTable].m_bRecipientIndependent )
+			return;
+
+		s_TableStats[iTable].m_bRecipientIndependent = false;
+	}
+	else
+	{
+		iTable = s_TableStats.AddToTail();
+		tableIndices.Insert( pTable, iTable );
+
+		SendTableProxyStats_t &stats = s_TableStats[iTable];
+		stats.m_pTable = pTable;
+		stats.m_nCalls = stats.m_nCycles = 0;
+		stats.m_nProps = 0;
+		stats.m_bRecipientIndependent = bRecipientIndependent;
+
+		for ( int i = 0; i < pTable->GetNumProps(); i++ )
+		{
+			SendProp *pProp = pTable->GetProp( i );
+			if ( pProp->IsExcludeProp() || pProp->GetType() == DPT_DataTable || !pProp->GetProxyFn() )
+				continue;
+
+			int iEntry = s_ProxyEntries.AddToTail();
+			SendProxyEntry_t &entry = s_ProxyEntries[iEntry];
+			entry.m_pProp = pProp;
+			entry.m_pfnProxy = pProp->GetProxyFn();
+			entry.m_iTable = iTable;
+
+			s_ProxyEntryLookup.Insert( pProp, iEntry );
+			s_TableStats[iTable].m_nProps++;
+		}
+	}
+
+	for ( int i = 0; i < pTable->GetNumProps(); i++ )
+	{
+		SendProp *pProp = pTable->GetProp( i );
+		if ( pProp->GetType() != DPT_DataTable || !pProp->GetDataTable() )
+			continue;
+
+		bool bAlwaysYes = ( pProp->GetFlags() & SPROP_PROXY_ALWAYS_YES ) != 0;
+		CollectSendProxies_r( pProp->GetDataTable(), bRecipientIndependent && bAlwaysYes, tableIndices );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Swaps the thunk in or out depending on whether stats are on.
+//			Only ever called from the main thread between frames.
+//-----------------------------------------------------------------------------
+static void UpdateSendProxyInstrumentation()
+{
+	bool bWant = s_bStatsEnabled;
+	if ( bWant == s_bInstalled )
+		return;
+
+	if ( bWant && s_ProxyEntries.Count() == 0 )
+	{
+		CUtlMap< SendTable *, int > tableIndices( DefLessFunc( SendTable * ) );
+		for ( ServerClass *pClass = g_pServerClassHead; pClass; pClass = pClass->m_pNext )
+		{
+			CollectSendProxies_r( pClass->m_pTable, true, tableIndices );
+		}
+	}
+
+	for ( int i = 0; i < s_ProxyEntries.Count(); i++ )
+	{
+		SendProxyEntry_t &entry = s_ProxyEntries[i];
+		entry.m_pProp->SetProxyFn( bWant ? SendProxy_Instrumented : entry.m_pfnProxy );
+	}
+
+	s_bInstalled = bWant;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Dumps per-table proxy cost, most expensive first.
+//-----------------------------------------------------------------------------
+static int __cdecl SendTableStatsSort( const int *a, const int *b )
+{
+	int64 nCyclesA = s_TableStats[*a].m_nCycles;
+	int64 nCyclesB = s_TableStats[*b].m_nCycles;
+	if ( nCyclesA != nCyclesB )
+		return ( nCyclesA > nCyclesB ) ? -1 : 1;
+
+	int64 nCallsA = s_TableStats[*a].m_nCalls;
+	int64 nCallsB = s_TableStats[*b].m_nCalls;
+	if ( nCallsA != nCallsB )
+		return ( nCallsA > nCallsB ) ? -1 : 1;
+
+	return 0;
+}
+
+static void DumpSendProxyStats()
+{
+	CUtlVector< int > sorted;
+	sorted.EnsureCapacity( s_TableStats.Count() );
+	for ( int i = 0; i < s_TableStats.Count(); i++ )
+	{
+		if ( s_TableStats[i].m_nCalls )
+			sorted.AddToTail( i );
+	}
+	sorted.Sort( SendTableStatsSort );
+
+	Msg( "%-40s %6s %12s %10s %s\n", "SendTable", "props", "calls", "msec", "recipients" );
+
+	int64 nTotalCalls = 0, nTotalCycles = 0;
+	for ( int i = 0; i < sorted.Count(); i++ )
+	{
+		const SendTableProxyStats_t &stats = s_TableStats[ sorted[i] ];
+		CCycleCount cycles;
+		cycles.Init( (uint64)stats.m_nCycles );
+
+		Msg( "%-40s %6d %12lld %10.2f %s\n",
+			stats.m_pTable->GetName(),
+			stats.m_nProps,
+			(long long)stats.m_nCalls,
+			cycles.GetMillisecondsF(),
+			stats.m_bRecipientIndependent ? "all" : "filtered" );
+
+		nTotalCalls += stats.m_nCalls;
+		nTotalCycles += stats.m_nCycles;
+	}
+
+	CCycleCount totalCycles;
+	totalCycles.Init( (uint64)nTotalCycles );
+	Msg( "%d tables, %lld proxy calls, %.2f msec in proxies\n",
+		sorted.Count(), (long long)nTotalCalls, totalCycles.GetMillisecondsF() );
+}
+
+CON_COMMAND( sv_sendproxy_stats, "Per-SendTable send proxy stats. Usage: sv_sendproxy_stats <start|stop|reset|dump>" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	const char *pCmd = ( args.ArgC() > 1 ) ? args[1] : "dump";
+
+	if ( !Q_stricmp( pCmd, "start" ) )
+	{
+		s_bStatsEnabled = true;
+		UpdateSendProxyInstrumentation();
+	}
+	else if ( !Q_stricmp( pCmd, "stop" ) )
+	{
+		s_bStatsEnabled = false;
+		UpdateSendProxyInstrumentation();
+	}
+	else if ( !Q_stricmp( pCmd, "reset" ) )
+	{
+		for ( int i = 0; i < s_TableStats.Count(); i++ )
+		{
+			SendTableProxyStats_t &stats = s_TableStats[i];
+			stats.m_nCalls = stats.m_nCycles = 0;
+		}
+	}
+	else if ( !Q_stricmp( pCmd, "dump" ) )
+	{
+		if ( !s_bInstalled && s_TableStats.Count() == 0 )
+		{
+			Msg( "No send proxy stats collected. Use 'sv_sendproxy_stats start' first.\n" );
+			return;
+		}
+		DumpSendProxyStats();
+	}
+	else
+	{
+		Msg( "Usage: sv_sendproxy_stats <start|stop|reset|dump>\n" );
+	}
+}
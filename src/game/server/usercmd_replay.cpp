@@ -0,0 +1,710 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Usercmd record and replay benchmark.
+//
+//			sv_usercmd_record <file> records, from the next map load on, the
+//			usercmds (with the server seeds they were given) and the client
+//			commands of every client. sv_usercmd_replay <file> loads the map
+//			the recording was made on, joins a fake client for every client
+//			at the tick it connected and feeds it the recorded traffic with
+//			the server in benchmark mode. Replay players are lag compensated
+//			like the clients they stand in for, with the recorded tick_counts
+//			moved to the replay's ticks. At the end it reports
+//			the tick time distribution from the frame profiler and a CRC of
+//			the entity state, which has to match run against run.
+//
+//			Only client traffic is recorded. Bots, NPCs and everything else
+//			the map spawns have to reproduce themselves from the same seed.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "usercmd_replay.h"
+#include "usercmd.h"
+#include "client.h"
+#include "frameprofiler.h"
+#include "filesystem.h"
+#include "checksum_crc.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/bitbuf.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define USERCMD_REPLAY_MAGIC		( ( 'D' << 24 ) | ( 'M' << 16 ) | ( 'C' << 8 ) | 'U' )
+#define USERCMD_REPLAY_VERSION		2
+#define USERCMD_REPLAY_SEED			1111
+
+// Same as CMD_MAXBACKUP in gameinterface.cpp
+#define USERCMD_REPLAY_MAXCMDS		64
+
+// Generous upper bound of a delta coded usercmd
+#define USERCMD_REPLAY_MAXCMDBYTES	128
+
+enum UserCmdReplayRecord_t
+{
+	REPLAYREC_JOIN = 0,			// name
+	REPLAYREC_LEAVE,
+	REPLAYREC_USERCMDS,			// numcmds, totalcmds, dropped packets, paused, lag compensation, lerp time, server seeds,
+								// delta coded cmds with tick_count relative to the first tick of the recording
+	REPLAYREC_CLIENTCOMMAND,	// command line
+	REPLAYREC_END,
+};
+
+static double UserCmdReplay_Time()
+{
+	// Benchmark mode fakes Plat_FloatTime
+	bool bOld = Plat_IsInBenchmarkMode();
+	Plat_SetBenchmarkMode( false );
+	double flRet = Plat_FloatTime();
+	Plat_SetBenchmarkMode( bOld );
+
+	return flRet;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: CRC of the state of every entity, to tell whether two replays of
+//			the same recording simulated the same game.
+//-----------------------------------------------------------------------------
+static CRC32_t UserCmdReplay_EntityStateCRC()
+{
+	CRC32_t crc;
+	CRC32_Init( &crc );
+
+	for ( CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity; pEntity = gEntList.NextEnt( pEntity ) )
+	{
+		if ( pEntity->IsMarkedForDeletion() )
+			continue;
+
+		const char *pszClassname = pEntity->GetClassname();
+		CRC32_ProcessBuffer( &crc, pszClassname, Q_strlen( pszClassname ) );
+
+		int nState[6];
+		nState[0] = pEntity->entindex();
+		nState[1] = pEntity->GetHealth();
+		nState[2] = pEntity->GetFlags();
+		nState[3] = pEntity->GetTeamNumber();
+		nState[4] = pEntity->GetMoveType();
+		nState[5] = pEntity->GetSolid();
+		CRC32_ProcessBuffer( &crc, nState, sizeof( nState ) );
+
+		CRC32_ProcessBuffer( &crc, &pEntity->GetAbsOrigin(), sizeof( Vector ) );
+		CRC32_ProcessBuffer( &crc, &pEntity->GetAbsAngles(), sizeof( QAngle ) );
+		CRC32_ProcessBuffer( &crc, &pEntity->GetAbsVelocity(), sizeof( Vector ) );
+	}
+
+	CRC32_Final( &crc );
+	return crc;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+class CUserCmdReplay : public CAutoGameSystemPerFrame
+{
+public:
+	CUserCmdReplay() : CAutoGameSystemPerFrame( "CUserCmdReplay" ), m_State( REPLAYSTATE_NONE ), m_Buffer( 0, 0, 0 )
+	{
+		m_szFile[0] = 0;
+		m_szMapName[0] = 0;
+	}
+
+	virtual void LevelInitPostEntity();
+	virtual void LevelShutdownPreEntity();
+	virtual void FrameUpdatePreEntityThink();
+
+	void RequestRecord( const char *pszFile );
+	void StopRecord();
+	void RequestReplay( const char *pszFile, bool bQuit );
+
+	bool IsRecording() const { return m_State == REPLAYSTATE_RECORDING; }
+	bool IsReplaying() const { return m_State == REPLAYSTATE_REPLAYING; }
+	bool IsReplayPlayer( const CBasePlayer *pPlayer ) const;
+
+	void RecordJoin( CBasePlayer *pPlayer );
+	void RecordUsercmds( CBasePlayer *pPlayer, const CUserCmd *cmds, int numcmds, int totalcmds, int dropped_packets, bool paused );
+	void RecordClientCommand( CBasePlayer *pPlayer, const CCommand &args );
+	void RecordDisconnect( CBasePlayer *pPlayer );
+
+private:
+	enum ReplayState_t
+	{
+		REPLAYSTATE_NONE,
+		REPLAYSTATE_RECORD_PENDING,		// Starts with the next map
+		REPLAYSTATE_RECORDING,
+		REPLAYSTATE_REPLAY_PENDING,		// Waiting for the recorded map to load
+		REPLAYSTATE_REPLAYING,
+	};
+
+	int CurrentTick() const { return m_nStartTick < 0 ? 0 : gpGlobals->tickcount - m_nStartTick; }
+	bool BeginRecord( CBasePlayer *pPlayer, int nType );
+
+	void StartReplay();
+	bool ReplayRecord( int nType, int iSlot );
+	void FinishReplay();
+
+	ReplayState_t	m_State;
+	CUtlBuffer		m_Buffer;
+	char			m_szFile[MAX_PATH];
+	char			m_szMapName[MAX_MAP_NAME];
+	int				m_nSeed;
+	int				m_nStartTick;		// -1 until the first tick of the map
+	bool			m_bQuit;
+	double			m_flStartTime;
+
+	// Recording: clients that have connected since the recording started.
+	// Replay: the fake client standing in for each recorded client.
+	bool			m_bJoined[MAX_PLAYERS + 1];
+	EHANDLE			m_hReplayPlayers[MAX_PLAYERS + 1];
+};
+
+static CUserCmdReplay g_UserCmdReplay;
+
+bool UserCmdReplay_IsRecording()
+{
+	return g_UserCmdReplay.IsRecording();
+}
+
+bool UserCmdReplay_IsReplaying()
+{
+	return g_UserCmdReplay.IsReplaying();
+}
+
+bool UserCmdReplay_IsReplayPlayer( const CBasePlayer *pPlayer )
+{
+	return g_UserCmdReplay.IsReplayPlayer( pPlayer );
+}
+
+void UserCmdReplay_RecordJoin( CBasePlayer *pPlayer )
+{
+	g_UserCmdReplay.RecordJoin( pPlayer );
+}
+
+void UserCmdReplay_RecordUsercmds( CBasePlayer *pPlayer, const CUserCmd *cmds, int numcmds, int totalcmds, int dropped_packets, bool paused )
+{
+	g_UserCmdReplay.RecordUsercmds( pPlayer, cmds, numcmds, totalcmds, dropped_packets, paused );
+}
+
+void UserCmdReplay_RecordClientCommand( CBasePlayer *pPlayer, const CCommand &args )
+{
+	g_UserCmdReplay.RecordClientCommand( pPlayer, args );
+}
+
+void UserCmdReplay_RecordDisconnect( CBasePlayer *pPlayer )
+{
+	g_UserCmdReplay.RecordDisconnect( pPlayer );
+}
+
+
+//-----------------------------------------------------------------------------
+// Recording
+//-----------------------------------------------------------------------------
+void CUserCmdReplay::RequestRecord( const char *pszFile )
+{
+	if ( m_State == REPLAYSTATE_RECORDING )
+	{
+		StopRecord();
+	}
+
+	Q_strncpy( m_szFile, pszFile, sizeof( m_szFile ) );
+	Q_DefaultExtension( m_szFile, ".ucmd", sizeof( m_szFile ) );
+	m_State = REPLAYSTATE_RECORD_PENDING;
+
+	Msg( "Recording to %s starts with the next map load\n", m_szFile );
+}
+
+void CUserCmdReplay::StopRecord()
+{
+	if ( m_State == REPLAYSTATE_RECORD_PENDING )
+	{
+		m_State = REPLAYSTATE_NONE;
+		return;
+	}
+
+	if ( m_State != REPLAYSTATE_RECORDING )
+		return;
+
+	m_Buffer.PutUnsignedChar( REPLAYREC_END );
+	m_Buffer.PutInt( CurrentTick() );
+	m_Buffer.PutUnsignedChar( 0 );
+
+	if ( filesystem->WriteFile( m_szFile, "MOD", m_Buffer ) )
+	{
+		Msg( "Recorded %d ticks of client traffic to %s (%d bytes)\n", CurrentTick(), m_szFile, m_Buffer.TellPut() );
+	}
+	else
+	{
+		Warning( "Couldn't write %s\n", m_szFile );
+	}
+
+	m_Buffer.Purge();
+	m_State = REPLAYSTATE_NONE;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Clients are joined when they go active, so their fake clients
+//			spawn on the same tick during the replay. Bots aren't recorded.
+//-----------------------------------------------------------------------------
+void CUserCmdReplay::RecordJoin( CBasePlayer *pPlayer )
+{
+	if ( m_State != REPLAYSTATE_RECORDING || !pPlayer || pPlayer->IsFakeClient() )
+		return;
+
+	int iSlot = pPlayer->entindex();
+	Assert( iSlot > 0 && iSlot <= MAX_PLAYERS );
+	if ( m_bJoined[iSlot] )
+		return;
+
+	m_bJoined[iSlot] = true;
+	m_Buffer.PutUnsignedChar( REPLAYREC_JOIN );
+	m_Buffer.PutInt( CurrentTick() );
+	m_Buffer.PutUnsignedChar( iSlot );
+	m_Buffer.PutString( pPlayer->GetPlayerName() );
+}
+
+bool CUserCmdReplay::BeginRecord( CBasePlayer *pPlayer, int nType )
+{
+	int iSlot = pPlayer->entindex();
+	Assert( iSlot > 0 && iSlot <= MAX_PLAYERS );
+
+	if ( !m_bJoined[iSlot] )
+		return false;
+
+	m_Buffer.PutUnsignedChar( nType );
+	m_Buffer.PutInt( CurrentTick() );
+	m_Buffer.PutUnsignedChar( iSlot );
+	return true;
+}
+
+void CUserCmdReplay::RecordUsercmds( CBasePlayer *pPlayer, const CUserCmd *cmds, int numcmds, int totalcmds, int dropped_packets, bool paused )
+{
+	if ( m_State != REPLAYSTATE_RECORDING || totalcmds <= 0 || totalcmds > USERCMD_REPLAY_MAXCMDS )
+		return;
+
+	if ( m_nStartTick < 0 )
+	{
+		m_nStartTick = gpGlobals->tickcount;
+	}
+
+	if ( !BeginRecord( pPlayer, REPLAYREC_USERCMDS ) )
+		return;
+
+	m_Buffer.PutInt( numcmds );
+	m_Buffer.PutInt( totalcmds );
+	m_Buffer.PutInt( dropped_packets );
+	m_Buffer.PutUnsignedChar( paused );
+
+	// Lag compensation rewinds by these, fake clients don't have the client's cvars
+	m_Buffer.PutUnsignedChar( pPlayer->m_bLagCompensation );
+	m_Buffer.PutFloat( pPlayer->m_fLerpTime );
+
+	// Delta coded the same way the client sent them
+	unsigned char data[ USERCMD_REPLAY_MAXCMDS * USERCMD_REPLAY_MAXCMDBYTES ];
+	bf_write buf( "CUserCmdReplay::RecordUsercmds", data, sizeof( data ) );
+
+	CUserCmd relative[ USERCMD_REPLAY_MAXCMDS ];
+	CUserCmd cmdNull;
+	const CUserCmd *from = &cmdNull;
+	for ( int i = totalcmds - 1; i >= 0; i-- )
+	{
+		relative[i] = cmds[i];
+		relative[i].tick_count -= m_nStartTick;
+
+		m_Buffer.PutInt( cmds[i].server_random_seed );
+		WriteUsercmd( &buf, &relative[i], from );
+		from = &relative[i];
+	}
+
+	Assert( !buf.IsOverflowed() );
+	m_Buffer.PutInt( buf.GetNumBytesWritten() );
+	m_Buffer.Put( data, buf.GetNumBytesWritten() );
+}
+
+void CUserCmdReplay::RecordClientCommand( CBasePlayer *pPlayer, const CCommand &args )
+{
+	if ( m_State != REPLAYSTATE_RECORDING || !pPlayer )
+		return;
+
+	if ( BeginRecord( pPlayer, REPLAYREC_CLIENTCOMMAND ) )
+	{
+		m_Buffer.PutString( args.GetCommandString() );
+	}
+}
+
+void CUserCmdReplay::RecordDisconnect( CBasePlayer *pPlayer )
+{
+	if ( m_State != REPLAYSTATE_RECORDING || !pPlayer || !m_bJoined[pPlayer->entindex()] )
+		return;
+
+	m_Buffer.PutUnsignedChar( REPLAYREC_LEAVE );
+	m_Buffer.PutInt( CurrentTick() );
+	m_Buffer.PutUnsignedChar( pPlayer->entindex() );
+	m_bJoined[pPlayer->entindex()] = false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Replay
+//-----------------------------------------------------------------------------
+void CUserCmdReplay::RequestReplay( const char *pszFile, bool bQuit )
+{
+	if ( m_State == REPLAYSTATE_RECORDING )
+	{
+		StopRecord();
+	}
+
+	Q_strncpy( m_szFile, pszFile, sizeof( m_szFile ) );
+	Q_DefaultExtension( m_szFile, ".ucmd", sizeof( m_szFile ) );
+
+	m_Buffer.Purge();
+	if ( !filesystem->ReadFile( m_szFile, "MOD", m_Buffer ) )
+	{
+		Warning( "Couldn't read %s\n", m_szFile );
+		m_State = REPLAYSTATE_NONE;
+		return;
+	}
+
+	if ( m_Buffer.GetInt() != USERCMD_REPLAY_MAGIC || m_Buffer.GetInt() != USERCMD_REPLAY_VERSION )
+	{
+		Warning( "%s isn't a usercmd recording of this version\n", m_szFile );
+		m_Buffer.Purge();
+		m_State = REPLAYSTATE_NONE;
+		return;
+	}
+
+	m_Buffer.GetString( m_szMapName );
+	float flTickInterval = m_Buffer.GetFloat();
+	m_nSeed = m_Buffer.GetInt();
+
+	if ( fabs( flTickInterval - gpGlobals->interval_per_tick ) > 1e-6f )
+	{
+		Warning( "%s was recorded at %.1f ticks per second, this server runs %.1f\n", m_szFile, 1.0f / flTickInterval, 1.0f / gpGlobals->interval_per_tick );
+	}
+
+	m_bQuit = bQuit;
+	m_State = REPLAYSTATE_REPLAY_PENDING;
+
+	engine->ServerCommand( UTIL_VarArgs( "map %s\n", m_szMapName ) );
+}
+
+void CUserCmdReplay::StartReplay()
+{
+	m_nStartTick = gpGlobals->tickcount;
+	m_flStartTime = UserCmdReplay_Time();
+
+	engine->SetDedicatedServerBenchmarkMode( true );	// Run 1 tick per frame and ignore all timing stuff.
+	FrameProfiler_BeginCapture();
+
+	ConVarRef sv_benchmark_autovprofrecord( "sv_benchmark_autovprofrecord" );
+	if ( sv_benchmark_autovprofrecord.IsValid() && sv_benchmark_autovprofrecord.GetBool() )
+	{
+		engine->ServerCommand( "vprof_record_start usercmd_replay\n" );
+		engine->ServerExecute();
+	}
+
+	Msg( "Replaying %s\n", m_szFile );
+}
+
+bool CUserCmdReplay::IsReplayPlayer( const CBasePlayer *pPlayer ) const
+{
+	if ( m_State != REPLAYSTATE_REPLAYING || !pPlayer )
+		return false;
+
+	for ( int i = 1; i <= MAX_PLAYERS; i++ )
+	{
+		if ( m_hReplayPlayers[i].Get() == pPlayer )
+			return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Applies one record. Returns false once the recording is over.
+//-----------------------------------------------------------------------------
+bool CUserCmdReplay::ReplayRecord( int nType, int iSlot )
+{
+	if ( iSlot > MAX_PLAYERS )
+		return false;
+
+	CBasePlayer *pPlayer = ToBasePlayer( m_hReplayPlayers[iSlot].Get() );
+
+	switch ( nType )
+	{
+	case REPLAYREC_JOIN:
+		{
+			char szName[MAX_PLAYER_NAME_LENGTH];
+			m_Buffer.GetString( szName );
+
+			edict_t *pEdict = engine->CreateFakeClient( szName );
+			pPlayer = pEdict ? ToBasePlayer( CBaseEntity::Instance( pEdict ) ) : NULL;
+			if ( !pPlayer )
+			{
+				Warning( "Couldn't create a fake client for %s\n", szName );
+				return true;
+			}
+
+			pPlayer->ClearFlags();
+			pPlayer->AddFlag( FL_CLIENT | FL_FAKECLIENT );
+			m_hReplayPlayers[iSlot] = pPlayer;
+		}
+		return true;
+
+	case REPLAYREC_LEAVE:
+		if ( pPlayer )
+		{
+			engine->ServerCommand( UTIL_VarArgs( "kickid %d\n", engine->GetPlayerUserId( pPlayer->edict() ) ) );
+			m_hReplayPlayers[iSlot] = NULL;
+		}
+		return true;
+
+	case REPLAYREC_USERCMDS:
+		{
+			int numcmds = m_Buffer.GetInt();
+			int totalcmds = m_Buffer.GetInt();
+			int dropped_packets = m_Buffer.GetInt();
+			bool paused = m_Buffer.GetUnsignedChar() != 0;
+			bool bLagCompensation = m_Buffer.GetUnsignedChar() != 0;
+			float flLerpTime = m_Buffer.GetFloat();
+			if ( totalcmds <= 0 || totalcmds > USERCMD_REPLAY_MAXCMDS )
+				return false;
+
+			int nSeeds[USERCMD_REPLAY_MAXCMDS];
+			for ( int i = totalcmds - 1; i >= 0; i-- )
+			{
+				nSeeds[i] = m_Buffer.GetInt();
+			}
+
+			unsigned char data[ USERCMD_REPLAY_MAXCMDS * USERCMD_REPLAY_MAXCMDBYTES ];
+			int nBytes = m_Buffer.GetInt();
+			if ( nBytes < 0 || nBytes > (int)sizeof( data ) )
+				return false;
+			m_Buffer.Get( data, nBytes );
+
+			CUserCmd cmds[ USERCMD_REPLAY_MAXCMDS ];
+			CUserCmd cmdNull;
+			CUserCmd *from = &cmdNull;
+			bf_read buf( "CUserCmdReplay::ReplayRecord", data, nBytes );
+			for ( int i = totalcmds - 1; i >= 0; i-- )
+			{
+				ReadUsercmd( &buf, &cmds[i], from );
+				from = &cmds[i];
+			}
+
+			// Only rebase once the whole batch is decoded, they're delta coded against each other
+			for ( int i = 0; i < totalcmds; i++ )
+			{
+				cmds[i].server_random_seed = nSeeds[i];
+				cmds[i].tick_count += m_nStartTick;
+			}
+
+			if ( pPlayer )
+			{
+				pPlayer->m_bLagCompensation = bLagCompensation;
+				pPlayer->m_fLerpTime = flLerpTime;
+				pPlayer->ProcessUsercmds( cmds, numcmds, totalcmds, dropped_packets, paused );
+			}
+		}
+		return true;
+
+	case REPLAYREC_CLIENTCOMMAND:
+		{
+			char szCommand[512];		// CCommand::MaxCommandLength()
+			m_Buffer.GetString( szCommand );
+
+			CCommand args;
+			if ( pPlayer && args.Tokenize( szCommand ) )
+			{
+				::ClientCommand( pPlayer, args );
+			}
+		}
+		return true;
+
+	case REPLAYREC_END:
+	default:
+		return false;
+	}
+}
+
+void CUserCmdReplay::FinishReplay()
+{
+	double flRunTime = UserCmdReplay_Time() - m_flStartTime;
+	int nTicks = CurrentTick();
+	CRC32_t crc = UserCmdReplay_EntityStateCRC();
+
+	ConVarRef sv_benchmark_autovprofrecord( "sv_benchmark_autovprofrecord" );
+	if ( sv_benchmark_autovprofrecord.IsValid() && sv_benchmark_autovprofrecord.GetBool() )
+	{
+		engine->ServerCommand( "vprof_record_stop\n" );
+		engine->ServerExecute();
+	}
+
+	Warning( "------------------ USERCMD REPLAY RESULTS ------------------\n" );
+	Warning( "Recording           : %s (%s)\n", m_szFile, m_szMapName );
+	Warning( "Total time          : %.2f seconds\n", flRunTime );
+	Warning( "Num ticks simulated : %d\n", nTicks );
+	Warning( "Ticks per second    : %.2f\n", flRunTime > 0 ? nTicks / flRunTime : 0.0 );
+	Warning( "Entity state CRC    : %08x\n", crc );
+	Warning( "------------------------------------------------------------\n" );
+	FrameProfiler_EndCapture();
+
+	engine->SetDedicatedServerBenchmarkMode( false );
+	m_Buffer.Purge();
+	m_State = REPLAYSTATE_NONE;
+
+	if ( m_bQuit )
+	{
+		// For the build scripts, like sv_benchmark
+		FileHandle_t fh = filesystem->Open( "usercmd_replay_results.txt", "wt", "DEFAULT_WRITE_PATH" );
+		if ( fh )
+		{
+			filesystem->FPrintf( fh, "usercmd_replay := %.2f\n", flRunTime );
+			filesystem->FPrintf( fh, "usercmd_replay_ticks := %d\n", nTicks );
+			filesystem->FPrintf( fh, "usercmd_replay_crc := %08x\n", crc );
+			filesystem->Close( fh );
+		}
+
+		engine->ServerCommand( "quit\n" );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Game system hooks
+//-----------------------------------------------------------------------------
+void CUserCmdReplay::LevelInitPostEntity()
+{
+	m_nStartTick = -1;
+	memset( m_bJoined, 0, sizeof( m_bJoined ) );
+	for ( int i = 0; i <= MAX_PLAYERS; i++ )
+	{
+		m_hReplayPlayers[i] = NULL;
+	}
+
+	if ( m_State == REPLAYSTATE_RECORD_PENDING )
+	{
+		Q_strncpy( m_szMapName, STRING( gpGlobals->mapname ), sizeof( m_szMapName ) );
+		m_nSeed = USERCMD_REPLAY_SEED;
+
+		m_Buffer.Purge();
+		m_Buffer.PutInt( USERCMD_REPLAY_MAGIC );
+		m_Buffer.PutInt( USERCMD_REPLAY_VERSION );
+		m_Buffer.PutString( m_szMapName );
+		m_Buffer.PutFloat( gpGlobals->interval_per_tick );
+		m_Buffer.PutInt( m_nSeed );
+
+		RandomSeed( m_nSeed );
+		m_State = REPLAYSTATE_RECORDING;
+		Msg( "Recording client traffic to %s\n", m_szFile );
+	}
+	else if ( m_State == REPLAYSTATE_REPLAY_PENDING )
+	{
+		if ( Q_stricmp( m_szMapName, STRING( gpGlobals->mapname ) ) )
+		{
+			Warning( "%s was recorded on %s, not replaying it on %s\n", m_szFile, m_szMapName, STRING( gpGlobals->mapname ) );
+			m_Buffer.Purge();
+			m_State = REPLAYSTATE_NONE;
+			return;
+		}
+
+		RandomSeed( m_nSeed );
+		m_State = REPLAYSTATE_REPLAYING;
+	}
+}
+
+void CUserCmdReplay::LevelShutdownPreEntity()
+{
+	if ( m_State == REPLAYSTATE_RECORDING )
+	{
+		StopRecord();
+	}
+	else if ( m_State == REPLAYSTATE_REPLAYING )
+	{
+		Warning( "Map ended before the replay of %s did\n", m_szFile );
+		FinishReplay();
+	}
+}
+
+void CUserCmdReplay::FrameUpdatePreEntityThink()
+{
+	if ( m_State == REPLAYSTATE_RECORDING )
+	{
+		if ( m_nStartTick < 0 )
+		{
+			m_nStartTick = gpGlobals->tickcount;
+		}
+		return;
+	}
+
+	if ( m_State != REPLAYSTATE_REPLAYING )
+		return;
+
+	if ( m_nStartTick < 0 )
+	{
+		StartReplay();
+	}
+
+	// Commands are only queued here, they run in Physics_RunThinkFunctions
+	// like they would have for a real client whose packets came in this tick.
+	int nTick = CurrentTick();
+	while ( m_Buffer.GetBytesRemaining() > 0 )
+	{
+		int nPos = m_Buffer.TellGet();
+		int nType = m_Buffer.GetUnsignedChar();
+		int nRecordTick = m_Buffer.GetInt();
+		int iSlot = m_Buffer.GetUnsignedChar();
+
+		if ( nRecordTick > nTick )
+		{
+			m_Buffer.SeekGet( CUtlBuffer::SEEK_HEAD, nPos );
+			return;
+		}
+
+		if ( !ReplayRecord( nType, iSlot ) )
+			break;
+	}
+
+	FinishReplay();
+}
+
+
+//-----------------------------------------------------------------------------
+// Commands
+//-----------------------------------------------------------------------------
+CON_COMMAND( sv_usercmd_record, "Record the usercmds and client commands of all clients from the next map load on. Arguments: <filename>" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: sv_usercmd_record <filename>\n" );
+		return;
+	}
+
+	g_UserCmdReplay.RequestRecord( args[1] );
+}
+
+CON_COMMAND( sv_usercmd_record_stop, "Stop recording usercmds and write the recording." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_UserCmdReplay.StopRecord();
+}
+
+CON_COMMAND( sv_usercmd_replay, "Load the map of a usercmd recording and replay it through fake clients as a benchmark. Arguments: <filename> [quit]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: sv_usercmd_replay <filename> [quit]\n" );
+		return;
+	}
+
+	g_UserCmdReplay.RequestReplay( args[1], args.ArgC() > 2 && !Q_stricmp( args[2], "quit" ) );
+}
@@ -0,0 +1,34 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Records the usercmd and client command traffic of every client
+//			and replays it later through fake clients, so a server side
+//			change can be benchmarked against the exact same game.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef USERCMD_REPLAY_H
+#define USERCMD_REPLAY_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+class CBasePlayer;
+class CUserCmd;
+class CCommand;
+
+bool UserCmdReplay_IsRecording();
+bool UserCmdReplay_IsReplaying();
+
+// Fake clients standing in for recorded clients. These are lag compensated and
+// have their usercmds validated like the clients they replay.
+bool UserCmdReplay_IsReplayPlayer( const CBasePlayer *pPlayer );
+
+// Hooks from CServerGameClients. cmds must already have been through
+// CBasePlayer::ProcessUsercmds so the recording keeps their server seeds.
+void UserCmdReplay_RecordJoin( CBasePlayer *pPlayer );
+void UserCmdReplay_RecordUsercmds( CBasePlayer *pPlayer, const CUserCmd *cmds, int numcmds, int totalcmds, int dropped_packets, bool paused );
+void UserCmdReplay_RecordClientCommand( CBasePlayer *pPlayer, const CCommand &args );
+void UserCmdReplay_RecordDisconnect( CBasePlayer *pPlayer );
+
+#endif // USERCMD_REPLAY_H
@@ -27,6 +27,7 @@
 #include "iservervehicle.h"
 #include "te_effect_dispatch.h"
 #include "utldict.h"
+#include "utlhashtable.h"
 #include "collisionutils.h"
 #include "movevars_shared.h"
 #include "inetchannelinfo.h"
@@ -77,12 +78,17 @@ public:
 	virtual IServerNetworkable *Create( const char *pClassName );
 	virtual void Destroy( const char *pClassName, IServerNetworkable *pNetworkable );
 	virtual const char *GetCannonicalName( const char *pClassName );
+	virtual IServerNetworkable *Create( const char *pClassName, IEntityFactory *pFactory );
 	void ReportEntitySizes();
 
 private:
 	IEntityFactory *FindFactory( const char *pClassName );
 public:
 	CUtlDict< IEntityFactory *, unsigned short > m_Factories;
+
+private:
+	// Hashed index of m_Factories, looked up for every entity created
+	CUtlHashtable< const char *, IEntityFactory *, CaselessStringHashFunctor, CaselessStringEqualFunctor > m_FactoryHash;
 };
 
 //-----------------------------------------------------------------------------
@@ -124,6 +130,27 @@ CON_COMMAND( dump_entity_sizes, "Print sizeof(entclass)" )
 }
 
 
+//-----------------------------------------------------------------------------
+// Heap vs arena KeyValues allocations made by the game DLL
+//-----------------------------------------------------------------------------
+CON_COMMAND( kv_alloc_stats, "Print KeyValues allocation counters for the game DLL. 'kv_alloc_stats reset' clears them." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		KeyValues::ResetAllocStats();
+		return;
+	}
+
+	KeyValues::AllocStats_t stats;
+	KeyValues::GetAllocStats( stats );
+	Msg( "KeyValues heap:  %d nodes, %d values\n", stats.m_nHeapNodes, stats.m_nHeapValues );
+	Msg( "KeyValues arena: %d trees, %d nodes, %d values, %d blocks\n", stats.m_nArenaTrees, stats.m_nArenaNodes, stats.m_nArenaValues, stats.m_nArenaBlocks );
+}
+
+
 //-----------------------------------------------------------------------------
 // Constructor
 //-----------------------------------------------------------------------------
@@ -137,10 +164,10 @@ CEntityFactoryDictionary::CEntityFactoryDictionary() : m_Factories( true, 0, 128
 //-----------------------------------------------------------------------------
 IEntityFactory *CEntityFactoryDictionary::FindFactory( const char *pClassName )
 {
-	unsigned short nIndex = m_Factories.Find( pClassName );
-	if ( nIndex == m_Factories.InvalidIndex() )
+	UtlHashHandle_t h = m_FactoryHash.Find( pClassName );
+	if ( h == m_FactoryHash.InvalidHandle() )
 		return NULL;
-	return m_Factories[nIndex];
+	return m_FactoryHash.Element( h );
 }
 
 
@@ -150,7 +177,10 @@ IEntityFactory *CEntityFactoryDictionary::FindFactory( const char *pClassName )
 void CEntityFactoryDictionary::InstallFactory( IEntityFactory *pFactory, const char *pClassName )
 {
 	Assert( FindFactory( pClassName ) == NULL );
-	m_Factories.Insert( pClassName, pFactory );
+	unsigned short nIndex = m_Factories.Insert( pClassName, pFactory );
+
+	// Key on the dictionary's copy of the name, it lives as long as the factory does
+	m_FactoryHash.Insert( m_Factories.GetElementName( nIndex ), pFactory );
 }
 
 
@@ -159,7 +189,14 @@ void CEntityFactoryDictionary::InstallFactory( IEntityFactory *pFactory, const c
 //-----------------------------------------------------------------------------
 IServerNetworkable *CEntityFactoryDictionary::Create( const char *pClassName )
 {
-	IEntityFactory *pFactory = FindFactory( pClassName );
+	return Create( pClassName, FindFactory( pClassName ) );
+}
+
+//-----------------------------------------------------------------------------
+// Instantiate something using a factory the caller already looked up
+//-----------------------------------------------------------------------------
+IServerNetworkable *CEntityFactoryDictionary::Create( const char *pClassName, IEntityFactory *pFactory )
+{
 	if ( !pFactory )
 	{
 		Warning("Attempted to create unknown entity type %s!\n", pClassName );
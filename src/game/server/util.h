@@ -100,6 +100,7 @@ public:
 	virtual void Destroy( const char *pClassName, IServerNetworkable *pNetworkable ) = 0;
 	virtual IEntityFactory *FindFactory( const char *pClassName ) = 0;
 	virtual const char *GetCannonicalName( const char *pClassName ) = 0;
+	virtual IServerNetworkable *Create( const char *pClassName, IEntityFactory *pFactory ) = 0;	// pFactory from FindFactory, may be NULL
 };
 
 IEntityFactoryDictionary *EntityFactoryDictionary();
@@ -16,6 +16,7 @@
 #include "checksum_crc.h"
 #include "tier0/icommandline.h"
 #include "util_shared.h"
+#include "tier1/utldict.h"
 
 #if defined( TF_CLIENT_DLL ) || defined( TF_DLL )
 #include "tf_shareddefs.h"
@@ -55,6 +56,46 @@ void ClearModelSoundsCache();
 
 #endif // !CLIENT_DLL
 
+#if defined( HL2MP )
+void ClearFootStepSoundsCache();
+#endif
+
+//-----------------------------------------------------------------------------
+// Script sound lookup counts. Any call that only has a sound name has to find
+// its script entry by name, callers holding an HSOUNDSCRIPTHANDLE don't. The
+// per-name counts show which call sites are worth converting to handles.
+//-----------------------------------------------------------------------------
+#if defined( CLIENT_DLL )
+static ConVar soundemitter_countlookups( "cl_soundemitter_countlookups", "0", 0, "Count script sound lookups by name for cl_soundemitter_lookups" );
+#else
+static ConVar soundemitter_countlookups( "sv_soundemitter_countlookups", "0", 0, "Count script sound lookups by name for sv_soundemitter_lookups" );
+#endif
+
+static int s_nSoundLookupsByName = 0;
+static int s_nSoundLookupsByHandle = 0;
+static CUtlDict< int, int > s_SoundLookupsByName;
+
+static void CountScriptSoundLookup( const char *soundname, bool bByName )
+{
+	if ( !bByName )
+	{
+		++s_nSoundLookupsByHandle;
+		return;
+	}
+
+	++s_nSoundLookupsByName;
+
+	if ( soundemitter_countlookups.GetBool() && soundname )
+	{
+		int i = s_SoundLookupsByName.Find( soundname );
+		if ( i == s_SoundLookupsByName.InvalidIndex() )
+		{
+			i = s_SoundLookupsByName.Insert( soundname, 0 );
+		}
+		s_SoundLookupsByName[i]++;
+	}
+}
+
 void WaveTrace( char const *wavname, char const *funcname )
 {
 	if ( IsX360() && !IsDebug() )
@@ -237,6 +278,9 @@ public:
 	void ReloadSoundEntriesInList( IFileList *pFilesToReload )
 	{
 		soundemitterbase->ReloadSoundEntriesInList( pFilesToReload );
+#if defined( HL2MP )
+		ClearFootStepSoundsCache();
+#endif
 	}
 
 	virtual void TraceEmitSound( char const *fmt, ... )
@@ -333,6 +377,10 @@ public:
 	virtual void LevelShutdownPostEntity()
 	{
 		soundemitterbase->ClearSoundOverrides();
+#if defined( HL2MP )
+		// Handles resolved against this level's overrides are stale now
+		ClearFootStepSoundsCache();
+#endif
 
 #if !defined( CLIENT_DLL )
 		FinishLog();
@@ -346,6 +394,9 @@ public:
 		FinishLog();
 #endif
 		soundemitterbase->Flush();
+#if defined( HL2MP )
+		ClearFootStepSoundsCache();
+#endif
 	}
 		
 	void InternalPrecacheWaves( int soundIndex )
@@ -449,6 +500,13 @@ public:
 public:
 
 	void EmitSoundByHandle( IRecipientFilter& filter, int entindex, const EmitSound_t & ep, HSOUNDSCRIPTHANDLE& handle )
+	{
+		CountScriptSoundLookup( ep.m_pSoundName, handle == SOUNDEMITTER_INVALID_HANDLE );
+		InternalEmitSoundByHandle( filter, entindex, ep, handle );
+	}
+
+private:
+	void InternalEmitSoundByHandle( IRecipientFilter& filter, int entindex, const EmitSound_t & ep, HSOUNDSCRIPTHANDLE& handle )
 	{
 		// Pull data from parameters
 		CSoundParameters params;
@@ -548,6 +606,7 @@ public:
 #endif
 	}
 
+public:
 	void EmitSound( IRecipientFilter& filter, int entindex, const EmitSound_t & ep )
 	{
 		VPROF( "CSoundEmitterSystem::EmitSound (calls engine)" );
@@ -611,6 +670,7 @@ public:
 			return;
 		}
 
+		CountScriptSoundLookup( ep.m_pSoundName, ep.m_hSoundScriptHandle == SOUNDEMITTER_INVALID_HANDLE );
 		if ( ep.m_hSoundScriptHandle == SOUNDEMITTER_INVALID_HANDLE )
 		{
 			ep.m_hSoundScriptHandle = (HSOUNDSCRIPTHANDLE)soundemitterbase->GetSoundIndex( ep.m_pSoundName );
@@ -619,7 +679,7 @@ public:
 		if ( ep.m_hSoundScriptHandle == -1 )
 			return;
 
-		EmitSoundByHandle( filter, entindex, ep, ep.m_hSoundScriptHandle );
+		InternalEmitSoundByHandle( filter, entindex, ep, ep.m_hSoundScriptHandle );
 	}
 
 	void EmitCloseCaption( IRecipientFilter& filter, int entindex, bool fromplayer, char const *token, CUtlVector< Vector >& originlist, float duration, bool warnifmissing /*= false*/ )
@@ -793,6 +853,7 @@ public:
 		// Pull data from parameters
 		CSoundParameters params;
 
+		CountScriptSoundLookup( soundname, true );
 		if ( !soundemitterbase->GetParametersForSound( soundname, params, GENDER_NONE ) )
 		{
 			return;
@@ -846,6 +907,7 @@ public:
 
 	void StopSoundByHandle( int entindex, const char *soundname, HSOUNDSCRIPTHANDLE& handle )
 	{
+		CountScriptSoundLookup( soundname, handle == SOUNDEMITTER_INVALID_HANDLE );
 		if ( handle == SOUNDEMITTER_INVALID_HANDLE )
 		{
 			handle = (HSOUNDSCRIPTHANDLE)soundemitterbase->GetSoundIndex( soundname );
@@ -881,12 +943,7 @@ public:
 
 	void StopSound( int entindex, const char *soundname )
 	{
-		HSOUNDSCRIPTHANDLE handle = (HSOUNDSCRIPTHANDLE)soundemitterbase->GetSoundIndex( soundname );
-		if ( handle == SOUNDEMITTER_INVALID_HANDLE )
-		{
-			return;
-		}
-
+		HSOUNDSCRIPTHANDLE handle = SOUNDEMITTER_INVALID_HANDLE;
 		StopSoundByHandle( entindex, soundname, handle );
 	}
 
@@ -997,6 +1054,50 @@ CON_COMMAND_F( sv_soundemitter_flush, "Flushes the sounds.txt system (server onl
 	S_SoundEmitterSystemFlush( );
 }
 
+static int __cdecl SoundLookupCountCompare( const unsigned short *pLeft, const unsigned short *pRight )
+{
+	return s_SoundLookupsByName[*pRight] - s_SoundLookupsByName[*pLeft];
+}
+
+#if defined( CLIENT_DLL )
+CON_COMMAND( cl_soundemitter_lookups, "Show script sound lookups by name and by handle since the last call (client only)" )
+#else
+CON_COMMAND( sv_soundemitter_lookups, "Show script sound lookups by name and by handle since the last call (server only)" )
+#endif
+{
+#if !defined( CLIENT_DLL )
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+#endif
+
+	Msg( "%d script sound lookups by name, %d by handle\n", s_nSoundLookupsByName, s_nSoundLookupsByHandle );
+
+	CUtlVector< unsigned short > sorted;
+	for ( int i = s_SoundLookupsByName.First(); i != s_SoundLookupsByName.InvalidIndex(); i = s_SoundLookupsByName.Next( i ) )
+	{
+		sorted.AddToTail( i );
+	}
+
+	if ( sorted.Count() )
+	{
+		qsort( sorted.Base(), sorted.Count(), sizeof( unsigned short ), (int (__cdecl *)(const void *, const void *))SoundLookupCountCompare );
+
+		int nShow = MIN( sorted.Count(), 25 );
+		for ( int i = 0; i < nShow; i++ )
+		{
+			Msg( "  %6d  %s\n", s_SoundLookupsByName[sorted[i]], s_SoundLookupsByName.GetElementName( sorted[i] ) );
+		}
+	}
+	else if ( !soundemitter_countlookups.GetBool() )
+	{
+		Msg( "Set %s 1 to count lookups per sound name\n", soundemitter_countlookups.GetName() );
+	}
+
+	s_nSoundLookupsByName = 0;
+	s_nSoundLookupsByHandle = 0;
+	s_SoundLookupsByName.Purge();
+}
+
 #if !defined(_RETAIL)
 
 #if !defined( CLIENT_DLL ) 
@@ -1130,14 +1231,15 @@ void CBaseEntity::EmitSound( const char *soundname, float soundtime /*= 0.0f*/,
 	//VPROF( "CBaseEntity::EmitSound" );
 	VPROF_BUDGET( "CBaseEntity::EmitSound", _T( "CBaseEntity::EmitSound" ) );
 
-	CPASAttenuationFilter filter( this, soundname );
-
 	EmitSound_t params;
 	params.m_pSoundName = soundname;
 	params.m_flSoundTime = soundtime;
 	params.m_pflSoundDuration = duration;
 	params.m_bWarnOnDirectWaveReference = true;
 
+	// Resolve the script entry once, for both the attenuation and the emit
+	CPASAttenuationFilter filter( this, soundname, params.m_hSoundScriptHandle );
+
 	EmitSound( filter, entindex(), params );
 }
 
@@ -1330,12 +1432,14 @@ void CBaseEntity::StopSound( int iEntIndex, int iChannel, const char *pSample )
 
 soundlevel_t CBaseEntity::LookupSoundLevel( const char *soundname )
 {
+	CountScriptSoundLookup( soundname, true );
 	return soundemitterbase->LookupSoundLevel( soundname );
 }
 
 
 soundlevel_t CBaseEntity::LookupSoundLevel( const char *soundname, HSOUNDSCRIPTHANDLE& handle )
 {
+	CountScriptSoundLookup( soundname, handle == SOUNDEMITTER_INVALID_HANDLE );
 	return soundemitterbase->LookupSoundLevelByHandle( soundname, handle );
 }
 
@@ -1414,6 +1518,7 @@ bool CBaseEntity::GetParametersForSound( const char *soundname, CSoundParameters
 {
 	gender_t gender = soundemitterbase->GetActorGender( actormodel );
 	
+	CountScriptSoundLookup( soundname, true );
 	return soundemitterbase->GetParametersForSound( soundname, params, gender );
 }
 
@@ -1421,6 +1526,7 @@ bool CBaseEntity::GetParametersForSound( const char *soundname, HSOUNDSCRIPTHAND
 {
 	gender_t gender = soundemitterbase->GetActorGender( actormodel );
 	
+	CountScriptSoundLookup( soundname, handle == SOUNDEMITTER_INVALID_HANDLE );
 	return soundemitterbase->GetParametersForSoundEx( soundname, handle, params, gender );
 }
 
@@ -2496,6 +2496,16 @@ void CBaseEntity::SetCollisionGroup( int collisionGroup )
 
 void CBaseEntity::CollisionRulesChanged()
 {
+#ifndef CLIENT_DLL
+	// the server caches collision filter decisions per entity pair until this is called
+	extern void PhysCollisionRulesChanged( CBaseEntity *pEntity );
+	PhysCollisionRulesChanged( this );
+
+	// and beam sensors assume traces against this entity still come out the same
+	extern void BeamSensor_EntityChanged( CBaseEntity *pEntity );
+	BeamSensor_EntityChanged( this );
+#endif
+
 	// ivp maintains state based on recent return values from the collision filter, so anything
 	// that can change the state that a collision filter will return (like m_Solid) needs to call RecheckCollisionFilter.
 	if ( VPhysicsGetObject() )
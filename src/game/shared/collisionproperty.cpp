@@ -24,6 +24,7 @@
 #include "baseanimating.h"
 #include "sendproxy.h"
 #include "hierarchy.h"
+#include "beamsensor.h"
 #endif
 
 #include "predictable_entity.h"
@@ -1331,6 +1332,9 @@ void CCollisionProperty::UpdateServerPartitionMask( )
 	if ( handle == PARTITION_INVALID_HANDLE )
 		return;
 
+	// Beams that traced against the old lists need to look again
+	BeamSensor_EntityChanged( m_pOuter );
+
 	// Remove it from whatever lists it may be in at the moment
 	// We'll re-add it below if we need to.
 	::partition->Remove( handle );
@@ -1429,10 +1433,16 @@ void CCollisionProperty::UpdatePartition( )
 				vecSurroundMins -= Vector( 1, 1, 1 );
 				vecSurroundMaxs += Vector( 1, 1, 1 );
 				::partition->ElementMoved( GetPartitionHandle(), vecSurroundMins,  vecSurroundMaxs );
+#ifndef CLIENT_DLL
+				BeamSensor_EntityMoved( m_pOuter, vecSurroundMins, vecSurroundMaxs );
+#endif
 			}
 			else
 			{
 				::partition->ElementMoved( GetPartitionHandle(), GetCollisionOrigin(),  GetCollisionOrigin() );
+#ifndef CLIENT_DLL
+				BeamSensor_EntityMoved( m_pOuter, GetCollisionOrigin(), GetCollisionOrigin() );
+#endif
 			}
 		}
 	}
@@ -10,20 +10,374 @@
 #include "utlhashtable.h"
 #include "igamesystem.h"
 #include "gamestringpool.h"
+#include "mapentities_shared.h"
 
+#include "tier0/fasttimer.h"
+#include "tier1/generichash.h"
 #include "tier1/stringpool.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+//-----------------------------------------------------------------------------
+// Purpose: Sharded, open addressed, case-insensitive string interning table.
+//
+//			Lookups never lock. Each shard publishes its slot array only after
+//			it has been filled, a slot's hash is written before its string, and
+//			slot arrays replaced by a grow are kept until FreeAll(), which only
+//			runs at level shutdown. Inserts lock the one shard they land in.
+//-----------------------------------------------------------------------------
+class CShardedStringPool
+{
+public:
+	CShardedStringPool();
+	~CShardedStringPool();
+
+	const char *Allocate( const char *pszValue );
+	const char *Find( const char *pszValue ) const;
+	void Remove( const char *pszValue, CUtlVector< const char * > &deferredDeleteList );
+
+	// Interns many strings, taking each shard lock once and growing each shard
+	// at most once.
+	void AllocateMany( const char * const *ppszValues, const char **ppszResults, int nCount );
+
+	void FreeAll();
+	int Count() const;
+	void GetStrings( CUtlVector< const char * > &strings ) const;
+
+private:
+	enum
+	{
+		SHARD_BITS = 4,
+		NUM_SHARDS = 1 << SHARD_BITS,
+		MIN_SLOTS = 64,
+	};
+
+	struct Slot_t
+	{
+		unsigned int			m_nHash;
+		const char * volatile	m_pszString;
+	};
+
+	struct SlotArray_t
+	{
+		unsigned int	m_nMask;
+		Slot_t			m_Slots[1];
+	};
+
+	struct Shard_t
+	{
+		SlotArray_t * volatile		m_pSlots;
+		int							m_nUsed;	// Live strings plus removed slots
+		int							m_nCount;	// Live strings
+		CThreadFastMutex			m_Mutex;
+		CUtlVector< SlotArray_t * >	m_Retired;
+	};
+
+	static unsigned int ShardIndex( unsigned int nHash )	{ return nHash >> ( 32 - SHARD_BITS ); }
+	static bool IsLive( const char *pszString )				{ return pszString && pszString != s_pszRemoved; }
+
+	static SlotArray_t *AllocSlotArray( int nSlots );
+	static const char *FindInShard( const Shard_t &shard, const char *pszValue, unsigned int nHash );
+
+	const char *AllocateLocked( Shard_t &shard, const char *pszValue, unsigned int nHash );
+	void ReserveLocked( Shard_t &shard, int nAdditional );
+
+	Shard_t m_Shards[NUM_SHARDS];
+
+	static const char s_szRemoved[1];
+	static const char * const s_pszRemoved;
+};
+
+const char CShardedStringPool::s_szRemoved[1] = { 0 };
+const char * const CShardedStringPool::s_pszRemoved = CShardedStringPool::s_szRemoved;
+
+CShardedStringPool::CShardedStringPool()
+{
+	for ( int i = 0; i < NUM_SHARDS; i++ )
+	{
+		m_Shards[i].m_pSlots = NULL;
+		m_Shards[i].m_nUsed = 0;
+		m_Shards[i].m_nCount = 0;
+	}
+}
+
+CShardedStringPool::~CShardedStringPool()
+{
+	FreeAll();
+}
+
+CShardedStringPool::SlotArray_t *CShardedStringPool::AllocSlotArray( int nSlots )
+{
+	Assert( IsPowerOfTwo( nSlots ) );
+	SlotArray_t *pArray = (SlotArray_t *)malloc( sizeof( SlotArray_t ) + ( nSlots - 1 ) * sizeof( Slot_t ) );
+	pArray->m_nMask = nSlots - 1;
+	memset( pArray->m_Slots, 0, nSlots * sizeof( Slot_t ) );
+	return pArray;
+}
+
+const char *CShardedStringPool::FindInShard( const Shard_t &shard, const char *pszValue, unsigned int nHash )
+{
+	const SlotArray_t *pArray = shard.m_pSlots;
+	if ( !pArray )
+		return NULL;
+
+	ThreadMemoryBarrier();
+
+	unsigned int nMask = pArray->m_nMask;
+	for ( unsigned int i = nHash & nMask; ; i = ( i + 1 ) & nMask )
+	{
+		const Slot_t &slot = pArray->m_Slots[i];
+		const char *pszString = slot.m_pszString;
+		if ( !pszString )
+			return NULL;
+
+		ThreadMemoryBarrier();
+
+		if ( slot.m_nHash == nHash && pszString != s_pszRemoved && !Q_stricmp( pszString, pszValue ) )
+			return pszString;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Makes room for nAdditional more strings, keeping the load at or
+//			below one half so probes stay short and always terminate.
+//-----------------------------------------------------------------------------
+void CShardedStringPool::ReserveLocked( Shard_t &shard, int nAdditional )
+{
+	SlotArray_t *pOld = shard.m_pSlots;
+	int nOldSlots = pOld ? pOld->m_nMask + 1 : 0;
+	if ( ( shard.m_nUsed + nAdditional ) * 2 <= nOldSlots )
+		return;
+
+	// Removed slots are dropped by the rehash, so size for live strings only
+	int nSlots = MIN_SLOTS;
+	while ( nSlots < ( shard.m_nCount + nAdditional ) * 2 )
+	{
+		nSlots <<= 1;
+	}
+
+	SlotArray_t *pNew = AllocSlotArray( nSlots );
+	unsigned int nMask = pNew->m_nMask;
+	for ( int i = 0; i < nOldSlots; i++ )
+	{
+		const Slot_t &slot = pOld->m_Slots[i];
+		if ( !IsLive( slot.m_pszString ) )
+			continue;
+
+		unsigned int j = slot.m_nHash & nMask;
+		while ( pNew->m_Slots[j].m_pszString )
+		{
+			j = ( j + 1 ) & nMask;
+		}
+		pNew->m_Slots[j] = slot;
+	}
+
+	// Publish only after the new array is complete; readers may still be
+	// probing the old one, so it lives until FreeAll().
+	ThreadMemoryBarrier();
+	shard.m_pSlots = pNew;
+	shard.m_nUsed = shard.m_nCount;
+	if ( pOld )
+	{
+		shard.m_Retired.AddToTail( pOld );
+	}
+}
+
+const char *CShardedStringPool::AllocateLocked( Shard_t &shard, const char *pszValue, unsigned int nHash )
+{
+	const char *pszString = FindInShard( shard, pszValue, nHash );
+	if ( pszString )
+		return pszString;
+
+	ReserveLocked( shard, 1 );
+
+	char *pszNew = strdup( pszValue );
+
+	SlotArray_t *pArray = shard.m_pSlots;
+	unsigned int nMask = pArray->m_nMask;
+	unsigned int i = nHash & nMask;
+	while ( pArray->m_Slots[i].m_pszString )
+	{
+		i = ( i + 1 ) & nMask;
+	}
+
+	pArray->m_Slots[i].m_nHash = nHash;
+	ThreadMemoryBarrier();
+	pArray->m_Slots[i].m_pszString = pszNew;
+
+	shard.m_nUsed++;
+	shard.m_nCount++;
+	return pszNew;
+}
+
+const char *CShardedStringPool::Find( const char *pszValue ) const
+{
+	unsigned int nHash = HashStringCaseless( pszValue );
+	return FindInShard( m_Shards[ ShardIndex( nHash ) ], pszValue, nHash );
+}
+
+const char *CShardedStringPool::Allocate( const char *pszValue )
+{
+	unsigned int nHash = HashStringCaseless( pszValue );
+	Shard_t &shard = m_Shards[ ShardIndex( nHash ) ];
+
+	const char *pszString = FindInShard( shard, pszValue, nHash );
+	if ( pszString )
+		return pszString;
+
+	AUTO_LOCK( shard.m_Mutex );
+	return AllocateLocked( shard, pszValue, nHash );
+}
+
+void CShardedStringPool::AllocateMany( const char * const *ppszValues, const char **ppszResults, int nCount )
+{
+	CUtlVector< unsigned int > hashes;
+	CUtlVector< int > order;
+	hashes.SetCount( nCount );
+	order.SetCount( nCount );
+
+	// Bucket the inputs by shard with a counting sort
+	int nShardCounts[NUM_SHARDS + 1] = {};
+	for ( int i = 0; i < nCount; i++ )
+	{
+		hashes[i] = HashStringCaseless( ppszValues[i] );
+		nShardCounts[ ShardIndex( hashes[i] ) + 1 ]++;
+	}
+	for ( int i = 0; i < NUM_SHARDS; i++ )
+	{
+		nShardCounts[i + 1] += nShardCounts[i];
+	}
+
+	int nShardFill[NUM_SHARDS];
+	memcpy( nShardFill, nShardCounts, sizeof( nShardFill ) );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		order[ nShardFill[ ShardIndex( hashes[i] ) ]++ ] = i;
+	}
+
+	for ( int s = 0; s < NUM_SHARDS; s++ )
+	{
+		int nFirst = nShardCounts[s];
+		int nLast = nShardCounts[s + 1];
+		if ( nFirst == nLast )
+			continue;
+
+		Shard_t &shard = m_Shards[s];
+		AUTO_LOCK( shard.m_Mutex );
+
+		// Upper bound; duplicates just leave the shard a little roomier
+		ReserveLocked( shard, nLast - nFirst );
+
+		for ( int i = nFirst; i < nLast; i++ )
+		{
+			int iValue = order[i];
+			ppszResults[iValue] = AllocateLocked( shard, ppszValues[iValue], hashes[iValue] );
+		}
+	}
+}
+
+void CShardedStringPool::Remove( const char *pszValue, CUtlVector< const char * > &deferredDeleteList )
+{
+	unsigned int nHash = HashStringCaseless( pszValue );
+	Shard_t &shard = m_Shards[ ShardIndex( nHash ) ];
+
+	AUTO_LOCK( shard.m_Mutex );
+
+	SlotArray_t *pArray = shard.m_pSlots;
+	if ( !pArray )
+		return;
+
+	unsigned int nMask = pArray->m_nMask;
+	for ( unsigned int i = nHash & nMask; pArray->m_Slots[i].m_pszString; i = ( i + 1 ) & nMask )
+	{
+		Slot_t &slot = pArray->m_Slots[i];
+		const char *pszString = slot.m_pszString;
+		if ( slot.m_nHash == nHash && pszString != s_pszRemoved && !Q_stricmp( pszString, pszValue ) )
+		{
+			// Readers may be holding the string, so the caller frees it later
+			deferredDeleteList.AddToTail( pszString );
+			slot.m_pszString = s_pszRemoved;
+			shard.m_nCount--;
+			return;
+		}
+	}
+}
+
+void CShardedStringPool::FreeAll()
+{
+	for ( int s = 0; s < NUM_SHARDS; s++ )
+	{
+		Shard_t &shard = m_Shards[s];
+		AUTO_LOCK( shard.m_Mutex );
+
+		SlotArray_t *pArray = shard.m_pSlots;
+		if ( pArray )
+		{
+			for ( unsigned int i = 0; i <= pArray->m_nMask; i++ )
+			{
+				if ( IsLive( pArray->m_Slots[i].m_pszString ) )
+				{
+					free( (void *)pArray->m_Slots[i].m_pszString );
+				}
+			}
+			free( pArray );
+		}
+
+		for ( int i = 0; i < shard.m_Retired.Count(); i++ )
+		{
+			free( shard.m_Retired[i] );
+		}
+		shard.m_Retired.Purge();
+
+		shard.m_pSlots = NULL;
+		shard.m_nUsed = 0;
+		shard.m_nCount = 0;
+	}
+}
+
+int CShardedStringPool::Count() const
+{
+	int nCount = 0;
+	for ( int s = 0; s < NUM_SHARDS; s++ )
+	{
+		nCount += m_Shards[s].m_nCount;
+	}
+	return nCount;
+}
+
+void CShardedStringPool::GetStrings( CUtlVector< const char * > &strings ) const
+{
+	for ( int s = 0; s < NUM_SHARDS; s++ )
+	{
+		const SlotArray_t *pArray = m_Shards[s].m_pSlots;
+		if ( !pArray )
+			continue;
+
+		for ( unsigned int i = 0; i <= pArray->m_nMask; i++ )
+		{
+			const char *pszString = pArray->m_Slots[i].m_pszString;
+			if ( IsLive( pszString ) )
+			{
+				strings.AddToTail( pszString );
+			}
+		}
+	}
+}
+
+static int __cdecl GameStringSort( const char * const *a, const char * const *b )
+{
+	return Q_stricmp( *a, *b );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: The actual storage for pooled per-level strings
 //-----------------------------------------------------------------------------
-class CGameStringPool : public CStringPool,	public CBaseGameSystem
+class CGameStringPool : public CShardedStringPool,	public CBaseGameSystem
 {
 	virtual char const *Name() { return "CGameStringPool"; }
 
-	virtual void LevelShutdownPostEntity() 
+	virtual void LevelShutdownPostEntity()
 	{
 		Cleanup();
 	}
@@ -40,9 +394,10 @@ public:
 		PurgeDeferredDeleteList();
 		PurgeKeyLookupCache();
 	}
-	
+
 	void PurgeDeferredDeleteList()
 	{
+		AUTO_LOCK( m_DeferredDeleteMutex );
 		for ( int i = 0; i < m_DeferredDeleteList.Count(); ++ i )
 		{
 			free( ( void * )m_DeferredDeleteList[ i ] );
@@ -52,31 +407,33 @@ public:
 
 	void PurgeKeyLookupCache()
 	{
+		AUTO_LOCK( m_KeyLookupMutex );
 		m_KeyLookupCache.Purge();
 	}
 
 	void Dump( void )
 	{
-		for ( int i = m_Strings.FirstInorder(); i != m_Strings.InvalidIndex(); i = m_Strings.NextInorder(i) )
+		CUtlVector< const char * > strings;
+		GetStrings( strings );
+		strings.Sort( GameStringSort );
+
+		for ( int i = 0; i < strings.Count(); i++ )
 		{
-			DevMsg( "  %d (0x%p) : %s\n", i, m_Strings[i], m_Strings[i] );
+			DevMsg( "  %d (0x%p) : %s\n", i, strings[i], strings[i] );
 		}
 		DevMsg( "\n" );
-		DevMsg( "Size:  %d items\n", m_Strings.Count() );
+		DevMsg( "Size:  %d items\n", strings.Count() );
 	}
 
 	void Remove( const char *pszValue )
 	{
-		int i = m_Strings.Find( pszValue );
-		if ( i != m_Strings.InvalidIndex() )
-		{
-			m_DeferredDeleteList.AddToTail( m_Strings[ i ] );
-			m_Strings.RemoveAt( i );
-		}
+		AUTO_LOCK( m_DeferredDeleteMutex );
+		CShardedStringPool::Remove( pszValue, m_DeferredDeleteList );
 	}
 
 	const char *AllocateWithKey(const char *string, const void* key)
 	{
+		AUTO_LOCK( m_KeyLookupMutex );
 		const char * &cached = m_KeyLookupCache[ m_KeyLookupCache.Insert( key, NULL ) ];
 		if ( cached == NULL )
 		{
@@ -86,8 +443,10 @@ public:
 	}
 
 private:
+	CThreadFastMutex m_DeferredDeleteMutex;
 	CUtlVector< const char * > m_DeferredDeleteList;
 
+	CThreadFastMutex m_KeyLookupMutex;
 	CUtlHashtable< const void*, const char* > m_KeyLookupCache;
 };
 
@@ -135,7 +494,7 @@ void PurgeDeferredPooledStrings()
 
 #if !defined(CLIENT_DLL) && !defined( GC )
 //------------------------------------------------------------------------------
-// Purpose: 
+// Purpose:
 //------------------------------------------------------------------------------
 void CC_DumpGameStringTable( void )
 {
@@ -145,4 +504,92 @@ void CC_DumpGameStringTable( void )
 	g_GameStringPool.Dump();
 }
 static ConCommand dumpgamestringtable("dumpgamestringtable", CC_DumpGameStringTable, "Dump the contents of the game string table to the console.", FCVAR_CHEAT);
+
+//------------------------------------------------------------------------------
+// Purpose: Interns every token of the current map's entity lump into scratch
+//			pools, comparing the sharded pool (one at a time and in bulk) with
+//			the old single CStringPool.
+//------------------------------------------------------------------------------
+void CC_BenchmarkGameStringPool( const CCommand &args )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	const char *pMapData = engine->GetMapEntitiesString();
+	if ( !pMapData )
+	{
+		Msg( "No map loaded.\n" );
+		return;
+	}
+
+	int nPasses = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 20;
+
+	CUtlStringList tokens;
+	char token[MAPKEY_MAXLENGTH];
+	while ( ( pMapData = MapEntity_ParseToken( pMapData, token ) ) != NULL )
+	{
+		if ( token[0] && Q_strcmp( token, "{" ) && Q_strcmp( token, "}" ) )
+		{
+			tokens.CopyAndAddToTail( token );
+		}
+	}
+
+	const char **ppszTokens = (const char **)tokens.Base();
+	int nTokens = tokens.Count();
+
+	CUtlVector< const char * > results;
+	results.SetCount( nTokens );
+
+	CFastTimer timer;
+	double flOld = 0, flSingle = 0, flBulk = 0, flFind = 0;
+	int nUnique = 0;
+	for ( int nPass = 0; nPass < nPasses; nPass++ )
+	{
+		{
+			CStringPool oldPool;
+			timer.Start();
+			for ( int i = 0; i < nTokens; i++ )
+			{
+				oldPool.Allocate( ppszTokens[i] );
+			}
+			timer.End();
+			flOld += timer.GetDuration().GetMillisecondsF();
+		}
+
+		{
+			CShardedStringPool pool;
+			timer.Start();
+			for ( int i = 0; i < nTokens; i++ )
+			{
+				pool.Allocate( ppszTokens[i] );
+			}
+			timer.End();
+			flSingle += timer.GetDuration().GetMillisecondsF();
+
+			timer.Start();
+			for ( int i = 0; i < nTokens; i++ )
+			{
+				pool.Find( ppszTokens[i] );
+			}
+			timer.End();
+			flFind += timer.GetDuration().GetMillisecondsF();
+		}
+
+		{
+			CShardedStringPool pool;
+			timer.Start();
+			pool.AllocateMany( ppszTokens, results.Base(), nTokens );
+			timer.End();
+			flBulk += timer.GetDuration().GetMillisecondsF();
+			nUnique = pool.Count();
+		}
+	}
+
+	Msg( "%s: %d tokens, %d unique, %d passes (msec per pass)\n", STRING( gpGlobals->mapname ), nTokens, nUnique, nPasses );
+	Msg( "  CStringPool allocate:  %8.3f\n", flOld / nPasses );
+	Msg( "  sharded allocate:      %8.3f\n", flSingle / nPasses );
+	Msg( "  sharded bulk allocate: %8.3f\n", flBulk / nPasses );
+	Msg( "  sharded find:          %8.3f\n", flFind / nPasses );
+}
+static ConCommand benchmarkgamestringpool("benchmark_gamestringpool", CC_BenchmarkGameStringPool, "Time interning the current map's entity lump strings. Usage: benchmark_gamestringpool [passes]", FCVAR_CHEAT);
 #endif
@@ -203,6 +203,7 @@ CHL2MPRules::CHL2MPRules()
 	m_bHeardAllPlayersReady = false;
 	m_bAwaitingReadyRestart = false;
 	m_bChangelevelDone = false;
+	m_hRelocationSound = SOUNDEMITTER_INVALID_HANDLE;
 
 #endif
 }
@@ -533,7 +534,7 @@ void CHL2MPRules::ManageObjectRelocation( void )
 						if ( shouldReset )
 						{
 							pObject->Teleport( &vSpawOrigin, &vSpawnAngles, NULL );
-							pObject->EmitSound( "AlyxEmp.Charge" );
+							pObject->EmitSound( "AlyxEmp.Charge", m_hRelocationSound );
 
 							IPhysicsObject *pPhys = pObject->VPhysicsGetObject();
 
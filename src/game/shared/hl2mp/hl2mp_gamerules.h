@@ -166,6 +166,7 @@ private:
 
 #ifndef CLIENT_DLL
 	bool m_bChangelevelDone;
+	HSOUNDSCRIPTHANDLE m_hRelocationSound;
 #endif
 };
 
@@ -27,6 +27,35 @@ const char *g_ppszPlayerSoundPrefixNames[PLAYER_SOUNDS_MAX] =
 	"NPC_MetroPolice",
 };
 
+// Footstep script handles per player sound type, left then right. Filled in by
+// PrecacheFootStepSounds, or on first use where nothing precaches them. The
+// sound emitter clears them whenever its script indices can change.
+static HSOUNDSCRIPTHANDLE s_hFootStepSounds[PLAYER_SOUNDS_MAX][2] =
+{
+	{ SOUNDEMITTER_INVALID_HANDLE, SOUNDEMITTER_INVALID_HANDLE },
+	{ SOUNDEMITTER_INVALID_HANDLE, SOUNDEMITTER_INVALID_HANDLE },
+	{ SOUNDEMITTER_INVALID_HANDLE, SOUNDEMITTER_INVALID_HANDLE },
+};
+
+static const char *s_pszFootStepSuffix[2] =
+{
+	"RunFootstepLeft",
+	"RunFootstepRight",
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Forgets the resolved footstep handles. Called by the sound emitter
+//			on flush, script reload and level shutdown.
+//-----------------------------------------------------------------------------
+void ClearFootStepSoundsCache()
+{
+	for ( int i = 0; i < ARRAYSIZE( s_hFootStepSounds ); ++i )
+	{
+		s_hFootStepSounds[i][0] = SOUNDEMITTER_INVALID_HANDLE;
+		s_hFootStepSounds[i][1] = SOUNDEMITTER_INVALID_HANDLE;
+	}
+}
+
 const char *CHL2MP_Player::GetPlayerModelSoundPrefix( void )
 {
 	return g_ppszPlayerSoundPrefixNames[m_iPlayerSoundType];
@@ -39,13 +68,13 @@ void CHL2MP_Player::PrecacheFootStepSounds( void )
 
 	for ( i = 0; i < iFootstepSounds; ++i )
 	{
-		char szFootStepName[128];
-
-		Q_snprintf( szFootStepName, sizeof( szFootStepName ), "%s.RunFootstepLeft", g_ppszPlayerSoundPrefixNames[i] );
-		PrecacheScriptSound( szFootStepName );
+		for ( int nSide = 0; nSide < 2; ++nSide )
+		{
+			char szFootStepName[128];
 
-		Q_snprintf( szFootStepName, sizeof( szFootStepName ), "%s.RunFootstepRight", g_ppszPlayerSoundPrefixNames[i] );
-		PrecacheScriptSound( szFootStepName );
+			Q_snprintf( szFootStepName, sizeof( szFootStepName ), "%s.%s", g_ppszPlayerSoundPrefixNames[i], s_pszFootStepSuffix[nSide] );
+			s_hFootStepSounds[i][nSide] = PrecacheScriptSound( szFootStepName );
+		}
 	}
 }
 
@@ -84,19 +113,19 @@ void CHL2MP_Player::PlayStepSound( Vector &vecOrigin, surfacedata_t *psurface, f
 
 	m_Local.m_nStepside = !m_Local.m_nStepside;
 
-	char szStepSound[128];
+	int nSide = m_Local.m_nStepside ? 0 : 1;
+	HSOUNDSCRIPTHANDLE &hStepSound = s_hFootStepSounds[m_iPlayerSoundType][nSide];
 
-	if ( m_Local.m_nStepside )
-	{
-		Q_snprintf( szStepSound, sizeof( szStepSound ), "%s.RunFootstepLeft", g_ppszPlayerSoundPrefixNames[m_iPlayerSoundType] );
-	}
-	else
+	// Only build the name if the handle hasn't been resolved yet
+	char szStepSound[128];
+	szStepSound[0] = 0;
+	if ( hStepSound == SOUNDEMITTER_INVALID_HANDLE )
 	{
-		Q_snprintf( szStepSound, sizeof( szStepSound ), "%s.RunFootstepRight", g_ppszPlayerSoundPrefixNames[m_iPlayerSoundType] );
+		Q_snprintf( szStepSound, sizeof( szStepSound ), "%s.%s", g_ppszPlayerSoundPrefixNames[m_iPlayerSoundType], s_pszFootStepSuffix[nSide] );
 	}
 
 	CSoundParameters params;
-	if ( GetParametersForSound( szStepSound, params, NULL ) == false )
+	if ( GetParametersForSound( szStepSound, hStepSound, params, NULL ) == false )
 		return;
 
 	CRecipientFilter filter;
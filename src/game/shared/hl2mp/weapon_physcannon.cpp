@@ -67,6 +67,8 @@ ConVar player_throwforce( "player_throwforce", "1000", FCVAR_REPLICATED | FCVAR_
 #ifndef CLIENT_DLL
 extern ConVar hl2_normspeed;
 extern ConVar hl2_walkspeed;
+
+ConVar physcannon_cone_cache_ticks( "physcannon_cone_cache_ticks", "3", FCVAR_NONE, "Ticks to reuse a cone search result while the player's aim and position barely change (0 disables)." );
 #endif
 
 #ifdef CLIENT_DLL
@@ -945,6 +947,10 @@ CWeaponPhysCannon::CWeaponPhysCannon( void )
 	m_EffectState			= (int)EFFECT_NONE;
 	m_flLastDenySoundPlayed	= false;
 
+#ifndef CLIENT_DLL
+	m_nConeCacheTick		= -1;
+#endif
+
 #ifdef CLIENT_DLL
 	m_nOldEffectState		= EFFECT_NONE;
 	m_bOldOpen				= false;
@@ -1809,45 +1815,112 @@ CWeaponPhysCannon::FindObjectResult_t CWeaponPhysCannon::FindObject( void )
 	return OBJECT_NOT_FOUND;
 }
 
+//-----------------------------------------------------------------------------
+// Cone search candidates, nearest first
+//-----------------------------------------------------------------------------
+struct PhyscannonConeCandidate_t
+{
+	CBaseEntity	*pEntity;
+	float		flDist;
+	int			nIndex;		// order from the box query, so ties still go to the first one found
+};
+
+static int __cdecl ConeCandidateCompare( const void *elem1, const void *elem2 )
+{
+	const PhyscannonConeCandidate_t *pLeft = (const PhyscannonConeCandidate_t *)elem1;
+	const PhyscannonConeCandidate_t *pRight = (const PhyscannonConeCandidate_t *)elem2;
+
+	if ( pLeft->flDist != pRight->flDist )
+		return ( pLeft->flDist < pRight->flDist ) ? -1 : 1;
+
+	return pLeft->nIndex - pRight->nIndex;
+}
+
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 CBaseEntity *CWeaponPhysCannon::FindObjectInCone( const Vector &vecOrigin, const Vector &vecDir, float flCone )
 {
 	// Find the nearest physics-based item in a cone in front of me.
+	float flMaxDist = TraceLength() + 1.0;
+
+	// Reuse the last answer if we've hardly moved or turned since
+	int nCacheTicks = physcannon_cone_cache_ticks.GetInt();
+	if ( nCacheTicks > 0 && m_nConeCacheTick >= 0 && 
+		 gpGlobals->tickcount - m_nConeCacheTick <= nCacheTicks &&
+		 flCone == m_flConeCacheCone &&
+		 vecOrigin.DistToSqr( m_vecConeCacheOrigin ) < 1.0f &&
+		 DotProduct( vecDir, m_vecConeCacheDir ) > 0.9998f )
+	{
+		CBaseEntity *pCached = m_hConeCacheEntity.Get();
+		if ( !pCached )
+		{
+			if ( m_hConeCacheEntity.GetEntryIndex() == INVALID_EHANDLE_INDEX )
+				return NULL;
+		}
+		else if ( pCached->VPhysicsGetObject() )
+		{
+			// Still in the cone?
+			Vector los = ( pCached->WorldSpaceCenter() - vecOrigin );
+			float flDist = VectorNormalize( los );
+			if ( flDist < flMaxDist && DotProduct( los, vecDir ) > flCone )
+				return pCached;
+		}
+	}
+
 	CBaseEntity *list[256];
-	float flNearestDist = TraceLength() + 1.0;
-	Vector mins = vecOrigin - Vector( flNearestDist, flNearestDist, flNearestDist );
-	Vector maxs = vecOrigin + Vector( flNearestDist, flNearestDist, flNearestDist );
+	Vector mins = vecOrigin - Vector( flMaxDist, flMaxDist, flMaxDist );
+	Vector maxs = vecOrigin + Vector( flMaxDist, flMaxDist, flMaxDist );
 
-	CBaseEntity *pNearest = NULL;
+	// Cull to the cone first, then only trace until the nearest unoccluded one
+	PhyscannonConeCandidate_t candidates[ARRAYSIZE( list )];
+	int nCandidates = 0;
 
-	int count = UTIL_EntitiesInBox( list, 256, mins, maxs, 0 );
+	int count = UTIL_EntitiesInBox( list, ARRAYSIZE( list ), mins, maxs, 0 );
 	for( int i = 0 ; i < count ; i++ )
 	{
 		if ( !list[ i ]->VPhysicsGetObject() )
 			continue;
 
-		// Closer than other objects
 		Vector los = ( list[ i ]->WorldSpaceCenter() - vecOrigin );
 		float flDist = VectorNormalize( los );
-		if( flDist >= flNearestDist )
+		if( flDist >= flMaxDist )
 			continue;
 
 		// Cull to the cone
 		if ( DotProduct( los, vecDir ) <= flCone )
 			continue;
 
+		candidates[nCandidates].pEntity = list[ i ];
+		candidates[nCandidates].flDist = flDist;
+		candidates[nCandidates].nIndex = i;
+		++nCandidates;
+	}
+
+	if ( nCandidates > 1 )
+	{
+		qsort( candidates, nCandidates, sizeof( candidates[0] ), ConeCandidateCompare );
+	}
+
+	CBaseEntity *pNearest = NULL;
+	CTraceFilterNoOwnerTest filter( GetOwner(), COLLISION_GROUP_NONE );
+	for ( int i = 0; i < nCandidates; i++ )
+	{
 		// Make sure it isn't occluded!
 		trace_t tr;
-		CTraceFilterNoOwnerTest filter( GetOwner(), COLLISION_GROUP_NONE );
-		UTIL_TraceLine( vecOrigin, list[ i ]->WorldSpaceCenter(), MASK_SHOT|CONTENTS_GRATE, &filter, &tr );
-		if( tr.m_pEnt == list[ i ] )
+		UTIL_TraceLine( vecOrigin, candidates[i].pEntity->WorldSpaceCenter(), MASK_SHOT|CONTENTS_GRATE, &filter, &tr );
+		if( tr.m_pEnt == candidates[i].pEntity )
 		{
-			flNearestDist = flDist;
-			pNearest = list[ i ];
+			pNearest = candidates[i].pEntity;
+			break;
 		}
 	}
 
+	m_hConeCacheEntity = pNearest;
+	m_vecConeCacheOrigin = vecOrigin;
+	m_vecConeCacheDir = vecDir;
+	m_flConeCacheCone = flCone;
+	m_nConeCacheTick = gpGlobals->tickcount;
+
 	return pNearest;
 }
 
@@ -443,6 +443,15 @@ protected:
 	float	m_flRepuntObjectTime;
 	EHANDLE m_hLastPuntedObject;
 
+#ifndef CLIENT_DLL
+	// Last FindObjectInCone result, reused for a few ticks while the aim barely moves
+	EHANDLE	m_hConeCacheEntity;
+	Vector	m_vecConeCacheOrigin;
+	Vector	m_vecConeCacheDir;
+	float	m_flConeCacheCone;
+	int		m_nConeCacheTick;
+#endif
+
 private:
 	CWeaponPhysCannon( const CWeaponPhysCannon & );
 
@@ -220,9 +220,18 @@ bool CEntityMapData::ExtractValue( const char *keyName, char *value )
 	return MapEntity_ExtractValue( m_pEntData, keyName, value );
 }
 
+void CEntityMapData::SetParsedKeyValues( const char * const *ppKeyValues, int nKeyValues, char *pEntDataEnd )
+{
+	m_ppKeyValues = ppKeyValues;
+	m_nKeyValues = nKeyValues;
+	m_iCurrentKeyValue = 0;
+	m_pEntDataEnd = pEntDataEnd;
+}
+
 bool CEntityMapData::GetFirstKey( char *keyName, char *value )
 {
 	m_pCurrentKey = m_pEntData; // reset the status pointer
+	m_iCurrentKeyValue = 0;
 	return GetNextKey( keyName, value );
 }
 
@@ -233,6 +242,20 @@ const char *CEntityMapData::CurrentBufferPosition( void )
 
 bool CEntityMapData::GetNextKey( char *keyName, char *value )
 {
+	if ( m_ppKeyValues )
+	{
+		if ( m_iCurrentKeyValue >= m_nKeyValues )
+		{
+			m_pCurrentKey = m_pEntDataEnd;
+			return false;
+		}
+
+		Q_strncpy( keyName, m_ppKeyValues[ m_iCurrentKeyValue * 2 ], MAPKEY_MAXLENGTH );
+		Q_strncpy( value, m_ppKeyValues[ m_iCurrentKeyValue * 2 + 1 ], MAPKEY_MAXLENGTH );
+		m_iCurrentKeyValue++;
+		return true;
+	}
+
 	char token[MAPKEY_MAXLENGTH];
 
 	// parse key
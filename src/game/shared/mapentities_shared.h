@@ -25,9 +25,21 @@ private:
 	int		m_nEntDataSize;
 	char	*m_pCurrentKey;
 
+	// Key/value pairs already parsed out of m_pEntData, see SetParsedKeyValues
+	const char * const *m_ppKeyValues;
+	int		m_nKeyValues;
+	int		m_iCurrentKeyValue;
+	char	*m_pEntDataEnd;
+
 public:
 	explicit CEntityMapData( char *entBlock, int nEntBlockSize = -1 ) : 
-		m_pEntData(entBlock), m_nEntDataSize(nEntBlockSize), m_pCurrentKey(entBlock) {}
+		m_pEntData(entBlock), m_nEntDataSize(nEntBlockSize), m_pCurrentKey(entBlock),
+		m_ppKeyValues(NULL), m_nKeyValues(0), m_iCurrentKeyValue(0), m_pEntDataEnd(NULL) {}
+
+	// Serve GetFirstKey/GetNextKey from nKeyValues key, value pairs that were parsed
+	// from this block earlier instead of tokenising it again. pEntDataEnd is where
+	// the parser stopped after the last key (the block's closing brace).
+	void SetParsedKeyValues( const char * const *ppKeyValues, int nKeyValues, char *pEntDataEnd );
 
 	// find the keyName in the entdata and puts it's value into Value.  returns false if key is not found
 	bool ExtractValue( const char *keyName, char *Value );
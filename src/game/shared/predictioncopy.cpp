@@ -12,6 +12,8 @@
 #if defined( CLIENT_DLL )
 
 #include "igamesystem.h"
+#include "c_baseplayer.h"
+#include "tier0/fasttimer.h"
 
 #endif
 #include <memory.h>
@@ -21,6 +23,7 @@
 #include "predictioncopy.h"
 #include "engine/ivmodelinfo.h"
 #include "tier1/fmtstr.h"
+#include "tier1/utlmap.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -1009,13 +1012,167 @@ CPredictionCopy::difftype_t CPredictionCopy::CompareEHandle( EHANDLE *outvalue,
 	return IDENTICAL;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Compares/copies/describes the current field, which isn't embedded
+//-----------------------------------------------------------------------------
+void CPredictionCopy::CopyField( void *pOutputData, void const *pInputData )
+{
+	int fieldSize = m_pCurrentField->fieldSize;
+
+	// Assume we can report
+	m_bShouldReport = m_bReportErrors;
+	m_bShouldDescribe = true;
+
+	bool bShouldWatch = m_pWatchField == m_pCurrentField;
+
+	difftype_t difftype;
+
+	switch( m_pCurrentField->fieldType )
+	{
+	case FIELD_FLOAT:
+		{
+			difftype = CompareFloat( (float *)pOutputData, (float const *)pInputData, fieldSize );
+			CopyFloat( difftype, (float *)pOutputData, (float const *)pInputData, fieldSize );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeFloat( difftype, (float *)pOutputData, (float const *)pInputData, fieldSize );
+			if ( bShouldWatch ) WatchFloat( difftype, (float *)pOutputData, (float const *)pInputData, fieldSize );
+		}
+		break;
+
+	case FIELD_TIME:
+	case FIELD_TICK:
+		Assert( 0 );
+		break;
+
+	case FIELD_STRING:
+		{
+			difftype = CompareString( (char *)pOutputData, (char const*)pInputData );
+			CopyString( difftype, (char *)pOutputData, (char const*)pInputData );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeString( difftype,(char *)pOutputData, (char const*)pInputData );
+			if ( bShouldWatch ) WatchString( difftype,(char *)pOutputData, (char const*)pInputData );
+		}
+		break;
+
+	case FIELD_MODELINDEX:
+		Assert( 0 );
+		break;
+
+	case FIELD_MODELNAME:
+	case FIELD_SOUNDNAME:
+		Assert( 0 );
+		break;
+
+	case FIELD_CUSTOM:
+		Assert( 0 );
+		break;
+
+	case FIELD_CLASSPTR:
+	case FIELD_EDICT:
+		Assert( 0 );
+		break;
+
+	case FIELD_POSITION_VECTOR:
+		Assert( 0 );
+		break;
+
+	case FIELD_VECTOR:
+		{
+			difftype = CompareVector( (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
+			CopyVector( difftype, (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeVector( difftype, (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
+			if ( bShouldWatch ) WatchVector( difftype, (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
+		}
+		break;
+
+	case FIELD_QUATERNION:
+		{
+			difftype = CompareQuaternion( (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
+			CopyQuaternion( difftype, (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeQuaternion( difftype, (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
+			if ( bShouldWatch ) WatchQuaternion( difftype, (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
+		}
+		break;
+
+	case FIELD_COLOR32:
+		{
+			difftype = CompareData( 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
+			CopyData( difftype, 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeData( difftype, 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
+			if ( bShouldWatch ) WatchData( difftype, 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
+		}
+		break;
+
+	case FIELD_BOOLEAN:
+		{
+			difftype = CompareBool( (bool *)pOutputData, (bool const *)pInputData, fieldSize );
+			CopyBool( difftype, (bool *)pOutputData, (bool const *)pInputData, fieldSize );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeBool( difftype, (bool *)pOutputData, (bool const *)pInputData, fieldSize );
+			if ( bShouldWatch ) WatchBool( difftype, (bool *)pOutputData, (bool const *)pInputData, fieldSize );
+		}
+		break;
+
+	case FIELD_INTEGER:
+		{
+			difftype = CompareInt( (int *)pOutputData, (int const *)pInputData, fieldSize );
+			CopyInt( difftype, (int *)pOutputData, (int const *)pInputData, fieldSize );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeInt( difftype, (int *)pOutputData, (int const *)pInputData, fieldSize );
+			if ( bShouldWatch ) WatchInt( difftype, (int *)pOutputData, (int const *)pInputData, fieldSize );
+		}
+		break;
+
+	case FIELD_SHORT:
+		{
+			difftype = CompareShort( (short *)pOutputData, (short const *)pInputData, fieldSize );
+			CopyShort( difftype, (short *)pOutputData, (short const *)pInputData, fieldSize );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeShort( difftype, (short *)pOutputData, (short const *)pInputData, fieldSize );
+			if ( bShouldWatch ) WatchShort( difftype, (short *)pOutputData, (short const *)pInputData, fieldSize );
+		}
+		break;
+
+	case FIELD_CHARACTER:
+		{
+			difftype = CompareData( fieldSize, ((char *)pOutputData), (const char *)pInputData );
+			CopyData( difftype, fieldSize, ((char *)pOutputData), (const char *)pInputData );
+			
+			int valOut = *((char *)pOutputData);
+			int valIn  = *((const char *)pInputData);
+			
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeInt( difftype, &valOut, &valIn, fieldSize );
+			if ( bShouldWatch ) WatchData( difftype, fieldSize, ((char *)pOutputData), (const char *)pInputData );
+		}
+		break;
+	case FIELD_EHANDLE:
+		{
+			difftype = CompareEHandle( (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
+			CopyEHandle( difftype, (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
+			if ( m_bErrorCheck && m_bShouldDescribe ) DescribeEHandle( difftype, (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
+			if ( bShouldWatch ) WatchEHandle( difftype, (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
+		}
+		break;
+	case FIELD_FUNCTION:
+		{
+		Assert( 0 );
+		}
+		break;
+	case FIELD_VOID:
+		{
+			// Don't do anything, it's an empty data description
+		}
+		break;
+	default:
+		{
+			Warning( "Bad field type\n" );
+			Assert(0);
+		}
+		break;
+	}
+}
+
 void CPredictionCopy::CopyFields( int chain_count, datamap_t *pRootMap, typedescription_t *pFields, int fieldCount )
 {
 	int				i;
 	int				flags;
 	int				fieldOffsetSrc;
 	int				fieldOffsetDest;
-	int				fieldSize;
 
 	m_pCurrentMap = pRootMap;
 	if ( !m_pCurrentClassName )
@@ -1061,19 +1218,10 @@ void CPredictionCopy::CopyFields( int chain_count, datamap_t *pRootMap, typedesc
 
 		fieldOffsetDest = m_pCurrentField->fieldOffset[ m_nDestOffsetIndex ];
 		fieldOffsetSrc	= m_pCurrentField->fieldOffset[ m_nSrcOffsetIndex ];
-		fieldSize = m_pCurrentField->fieldSize;
 
 		pOutputData = (void *)((char *)m_pDest + fieldOffsetDest );
 		pInputData = (void const *)((char *)m_pSrc + fieldOffsetSrc );
 
-		// Assume we can report
-		m_bShouldReport = m_bReportErrors;
-		m_bShouldDescribe = true;
-
-		bool bShouldWatch = m_pWatchField == m_pCurrentField;
-
-		difftype_t difftype;
-
 		switch( m_pCurrentField->fieldType )
 		{
 		case FIELD_EMBEDDED:
@@ -1107,140 +1255,8 @@ void CPredictionCopy::CopyFields( int chain_count, datamap_t *pRootMap, typedesc
 				m_pSrc = saveSrc;
 			}
 			break;
-		case FIELD_FLOAT:
-			{
-				difftype = CompareFloat( (float *)pOutputData, (float const *)pInputData, fieldSize );
-				CopyFloat( difftype, (float *)pOutputData, (float const *)pInputData, fieldSize );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeFloat( difftype, (float *)pOutputData, (float const *)pInputData, fieldSize );
-				if ( bShouldWatch ) WatchFloat( difftype, (float *)pOutputData, (float const *)pInputData, fieldSize );
-			}
-			break;
-
-		case FIELD_TIME:
-		case FIELD_TICK:
-			Assert( 0 );
-			break;
-
-		case FIELD_STRING:
-			{
-				difftype = CompareString( (char *)pOutputData, (char const*)pInputData );
-				CopyString( difftype, (char *)pOutputData, (char const*)pInputData );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeString( difftype,(char *)pOutputData, (char const*)pInputData );
-				if ( bShouldWatch ) WatchString( difftype,(char *)pOutputData, (char const*)pInputData );
-			}
-			break;
-
-		case FIELD_MODELINDEX:
-			Assert( 0 );
-			break;
-
-		case FIELD_MODELNAME:
-		case FIELD_SOUNDNAME:
-			Assert( 0 );
-			break;
-
-		case FIELD_CUSTOM:
-			Assert( 0 );
-			break;
-
-		case FIELD_CLASSPTR:
-		case FIELD_EDICT:
-			Assert( 0 );
-			break;
-
-		case FIELD_POSITION_VECTOR:
-			Assert( 0 );
-			break;
-
-		case FIELD_VECTOR:
-			{
-				difftype = CompareVector( (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
-				CopyVector( difftype, (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeVector( difftype, (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
-				if ( bShouldWatch ) WatchVector( difftype, (Vector *)pOutputData, (Vector const *)pInputData, fieldSize );
-			}
-			break;
-
-		case FIELD_QUATERNION:
-			{
-				difftype = CompareQuaternion( (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
-				CopyQuaternion( difftype, (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeQuaternion( difftype, (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
-				if ( bShouldWatch ) WatchQuaternion( difftype, (Quaternion *)pOutputData, (Quaternion const *)pInputData, fieldSize );
-			}
-			break;
-
-		case FIELD_COLOR32:
-			{
-				difftype = CompareData( 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
-				CopyData( difftype, 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeData( difftype, 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
-				if ( bShouldWatch ) WatchData( difftype, 4*fieldSize, (char *)pOutputData, (const char *)pInputData );
-			}
-			break;
-
-		case FIELD_BOOLEAN:
-			{
-				difftype = CompareBool( (bool *)pOutputData, (bool const *)pInputData, fieldSize );
-				CopyBool( difftype, (bool *)pOutputData, (bool const *)pInputData, fieldSize );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeBool( difftype, (bool *)pOutputData, (bool const *)pInputData, fieldSize );
-				if ( bShouldWatch ) WatchBool( difftype, (bool *)pOutputData, (bool const *)pInputData, fieldSize );
-			}
-			break;
-
-		case FIELD_INTEGER:
-			{
-				difftype = CompareInt( (int *)pOutputData, (int const *)pInputData, fieldSize );
-				CopyInt( difftype, (int *)pOutputData, (int const *)pInputData, fieldSize );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeInt( difftype, (int *)pOutputData, (int const *)pInputData, fieldSize );
-				if ( bShouldWatch ) WatchInt( difftype, (int *)pOutputData, (int const *)pInputData, fieldSize );
-			}
-			break;
-
-		case FIELD_SHORT:
-			{
-				difftype = CompareShort( (short *)pOutputData, (short const *)pInputData, fieldSize );
-				CopyShort( difftype, (short *)pOutputData, (short const *)pInputData, fieldSize );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeShort( difftype, (short *)pOutputData, (short const *)pInputData, fieldSize );
-				if ( bShouldWatch ) WatchShort( difftype, (short *)pOutputData, (short const *)pInputData, fieldSize );
-			}
-			break;
-
-		case FIELD_CHARACTER:
-			{
-				difftype = CompareData( fieldSize, ((char *)pOutputData), (const char *)pInputData );
-				CopyData( difftype, fieldSize, ((char *)pOutputData), (const char *)pInputData );
-				
-				int valOut = *((char *)pOutputData);
-				int valIn  = *((const char *)pInputData);
-				
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeInt( difftype, &valOut, &valIn, fieldSize );
-				if ( bShouldWatch ) WatchData( difftype, fieldSize, ((char *)pOutputData), (const char *)pInputData );
-			}
-			break;
-		case FIELD_EHANDLE:
-			{
-				difftype = CompareEHandle( (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
-				CopyEHandle( difftype, (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
-				if ( m_bErrorCheck && m_bShouldDescribe ) DescribeEHandle( difftype, (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
-				if ( bShouldWatch ) WatchEHandle( difftype, (EHANDLE *)pOutputData, (EHANDLE const *)pInputData, fieldSize );
-			}
-			break;
-		case FIELD_FUNCTION:
-			{
-			Assert( 0 );
-			}
-			break;
-		case FIELD_VOID:
-			{
-				// Don't do anything, it's an empty data description
-			}
-			break;
 		default:
-			{
-				Warning( "Bad field type\n" );
-				Assert(0);
-			}
+			CopyField( pOutputData, pInputData );
 			break;
 		}
 	}
@@ -1394,6 +1410,295 @@ void CPredictionCopy::DetermineWatchField( const char *operation, int entindex,
 	m_pWatchField = FindFieldByName( pwatchvar.GetString(), dmap );
 }
 
+//-----------------------------------------------------------------------------
+// Compiled copy plans
+//
+// Copying a predicted entity walks its whole datamap chain, dispatching on
+// every field. When nothing needs to be described, reported or watched, the
+// walk only ever comes out to a fixed list of (dest, src, size) copies for a
+// given map, copy type and packing, so it's flattened once and adjacent
+// fields are merged into single memcpy/memcmp runs.
+//-----------------------------------------------------------------------------
+static ConVar cl_pred_compiledcopy( "cl_pred_compiledcopy", "1", 0, "Use flattened copy plans for prediction copies that don't describe or watch fields." );
+
+struct PredictionCopyField_t
+{
+	typedescription_t	*pField;
+	datamap_t			*pMap;
+	char const			*pClassName;
+	int					destOffset;
+	int					srcOffset;
+	int					size;
+};
+
+struct PredictionCopySpan_t
+{
+	int					destOffset;
+	int					srcOffset;
+	int					size;
+	int					firstField;		// fields covered by this run, for the compare fallback
+	int					fieldCount;
+};
+
+class CPredictionCopyPlan
+{
+public:
+	CPredictionCopyPlan() : m_bValid( true ) {}
+
+	static int __cdecl FieldCompare( const void *lhs, const void *rhs )
+	{
+		return ( (const PredictionCopyField_t *)lhs )->destOffset - ( (const PredictionCopyField_t *)rhs )->destOffset;
+	}
+
+	// Sorts fields by destination and merges the ones that are adjacent on both sides
+	static void BuildSpans( CUtlVector< PredictionCopyField_t > &fields, CUtlVector< PredictionCopySpan_t > &spans )
+	{
+		if ( fields.Count() )
+		{
+			qsort( fields.Base(), fields.Count(), sizeof( PredictionCopyField_t ), FieldCompare );
+		}
+
+		for ( int i = 0; i < fields.Count(); i++ )
+		{
+			const PredictionCopyField_t &field = fields[i];
+			if ( spans.Count() )
+			{
+				PredictionCopySpan_t &last = spans.Tail();
+				if ( last.destOffset + last.size == field.destOffset && 
+					 last.srcOffset + last.size == field.srcOffset )
+				{
+					last.size += field.size;
+					++last.fieldCount;
+					continue;
+				}
+			}
+
+			PredictionCopySpan_t &span = spans[ spans.AddToTail() ];
+			span.destOffset = field.destOffset;
+			span.srcOffset = field.srcOffset;
+			span.size = field.size;
+			span.firstField = i;
+			span.fieldCount = 1;
+		}
+	}
+
+	bool	m_bValid;		// false if the map can't be flattened, always use the datamap walk
+	CUtlVector< PredictionCopyField_t >	m_CopyFields;
+	CUtlVector< PredictionCopySpan_t >	m_CopySpans;
+	CUtlVector< PredictionCopyField_t >	m_CompareFields;	// same minus FTYPEDESC_NOERRORCHECK fields
+	CUtlVector< PredictionCopySpan_t >	m_CompareSpans;
+};
+
+// One plan per copy type and source/dest packing
+struct PredictionCopyPlanSet_t
+{
+	CPredictionCopyPlan	*m_pPlans[ 3 ][ TD_OFFSET_COUNT ][ TD_OFFSET_COUNT ];
+};
+
+class CPredictionCopyPlanCache
+{
+public:
+	CPredictionCopyPlanCache() : m_Plans( DefLessFunc( datamap_t * ) ) {}
+
+	~CPredictionCopyPlanCache()
+	{
+		FOR_EACH_MAP_FAST( m_Plans, i )
+		{
+			PredictionCopyPlanSet_t *pSet = m_Plans[i];
+			CPredictionCopyPlan **ppPlans = &pSet->m_pPlans[0][0][0];
+			for ( int j = 0; j < sizeof( pSet->m_pPlans ) / sizeof( ppPlans[0] ); j++ )
+			{
+				delete ppPlans[j];
+			}
+			delete pSet;
+		}
+	}
+
+	CPredictionCopyPlan *&Find( datamap_t *pMap, int type, int destOffsetIndex, int srcOffsetIndex )
+	{
+		unsigned short i = m_Plans.Find( pMap );
+		if ( i == m_Plans.InvalidIndex() )
+		{
+			PredictionCopyPlanSet_t *pSet = new PredictionCopyPlanSet_t;
+			memset( pSet, 0, sizeof( *pSet ) );
+			i = m_Plans.Insert( pMap, pSet );
+		}
+		return m_Plans[i]->m_pPlans[ type ][ destOffsetIndex ][ srcOffsetIndex ];
+	}
+
+private:
+	CUtlMap< datamap_t *, PredictionCopyPlanSet_t * > m_Plans;
+};
+
+static CPredictionCopyPlanCache g_PredictionCopyPlans;
+
+//-----------------------------------------------------------------------------
+// Purpose: Same walk as CopyFields, recording where each field would be copied
+//  instead of copying it. Returns false if the map can't be flattened.
+//-----------------------------------------------------------------------------
+bool CPredictionCopy::BuildPlan_R( CPredictionCopyPlan *pPlan, int chain_count, datamap_t *pMap, typedescription_t *pFields, int fieldCount, 
+	char const *pClassName, int destBase, int srcBase )
+{
+	for ( int i = 0; i < fieldCount; i++ )
+	{
+		typedescription_t *pField = &pFields[ i ];
+		int flags = pField->flags;
+
+		// Mark any subchains first
+		if ( pField->override_field != NULL )
+		{
+			pField->override_field->override_count = chain_count;
+		}
+
+		// Skip this field?
+		if ( pField->override_count == chain_count )
+			continue;
+
+		int destOffset = destBase + pField->fieldOffset[ m_nDestOffsetIndex ];
+		int srcOffset = srcBase + pField->fieldOffset[ m_nSrcOffsetIndex ];
+
+		if ( pField->fieldType == FIELD_EMBEDDED )
+		{
+			// Embedded pointers have to be followed per object
+			if ( ( flags & FTYPEDESC_PTR ) && ( m_nSrcOffsetIndex == PC_DATA_NORMAL || m_nDestOffsetIndex == PC_DATA_NORMAL ) )
+				return false;
+
+			if ( !BuildPlan_R( pPlan, chain_count, pMap, pField->td->dataDesc, pField->td->dataNumFields, pField->td->dataClassName, destOffset, srcOffset ) )
+				return false;
+			continue;
+		}
+
+		// Don't copy fields that are private to server or client
+		if ( flags & FTYPEDESC_PRIVATE )
+			continue;
+
+		// For PC_NON_NETWORKED_ONLYs skip any fields that are present in the network send tables
+		if ( m_nType == PC_NON_NETWORKED_ONLY && ( flags & FTYPEDESC_INSENDTABLE ) )
+			continue;
+
+		// For PC_NETWORKED_ONLYs skip any fields that are not present in the network send tables
+		if ( m_nType == PC_NETWORKED_ONLY && !( flags & FTYPEDESC_INSENDTABLE ) )
+			continue;
+
+		int size;
+		switch ( pField->fieldType )
+		{
+		case FIELD_FLOAT:		size = sizeof( float ) * pField->fieldSize; break;
+		case FIELD_VECTOR:		size = sizeof( Vector ) * pField->fieldSize; break;
+		case FIELD_QUATERNION:	size = sizeof( Quaternion ) * pField->fieldSize; break;
+		case FIELD_COLOR32:		size = 4 * pField->fieldSize; break;
+		case FIELD_BOOLEAN:		size = sizeof( bool ) * pField->fieldSize; break;
+		case FIELD_INTEGER:		size = sizeof( int ) * pField->fieldSize; break;
+		case FIELD_SHORT:		size = sizeof( short ) * pField->fieldSize; break;
+		case FIELD_CHARACTER:	size = pField->fieldSize; break;
+		case FIELD_EHANDLE:		size = sizeof( EHANDLE ) * pField->fieldSize; break;
+
+		case FIELD_VOID:
+			continue;
+
+		// Only as long as the string in it
+		case FIELD_STRING:
+			return false;
+
+		default:
+			// Not copied by CopyField either
+			Assert( 0 );
+			continue;
+		}
+
+		PredictionCopyField_t field;
+		field.pField = pField;
+		field.pMap = pMap;
+		field.pClassName = pClassName;
+		field.destOffset = destOffset;
+		field.srcOffset = srcOffset;
+		field.size = size;
+
+		pPlan->m_CopyFields.AddToTail( field );
+		if ( !( flags & FTYPEDESC_NOERRORCHECK ) )
+		{
+			pPlan->m_CompareFields.AddToTail( field );
+		}
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs the transfer from a compiled plan if this copy allows it
+// Output : false if the caller has to walk the datamap
+//-----------------------------------------------------------------------------
+bool CPredictionCopy::TransferCompiled( datamap_t *dmap )
+{
+	// Anything that gets described, reported or watched needs the field by field walk,
+	// as does comparing and copying in one pass (only differing fields get copied)
+	if ( m_pWatchField || m_bReportErrors || m_FieldCompareFunc || m_bPerformCopy == m_bErrorCheck )
+		return false;
+
+	if ( !cl_pred_compiledcopy.GetBool() )
+		return false;
+
+	Assert( m_nType >= PC_EVERYTHING && m_nType <= PC_NETWORKED_ONLY );
+	CPredictionCopyPlan *&pPlan = g_PredictionCopyPlans.Find( dmap, m_nType, m_nDestOffsetIndex, m_nSrcOffsetIndex );
+	if ( !pPlan )
+	{
+		pPlan = new CPredictionCopyPlan;
+
+		for ( datamap_t *pMap = dmap; pMap && pPlan->m_bValid; pMap = pMap->baseMap )
+		{
+			pPlan->m_bValid = BuildPlan_R( pPlan, g_nChainCount, pMap, pMap->dataDesc, pMap->dataNumFields, pMap->dataClassName, 0, 0 );
+		}
+
+		if ( pPlan->m_bValid )
+		{
+			CPredictionCopyPlan::BuildSpans( pPlan->m_CopyFields, pPlan->m_CopySpans );
+			CPredictionCopyPlan::BuildSpans( pPlan->m_CompareFields, pPlan->m_CompareSpans );
+		}
+		else
+		{
+			pPlan->m_CopyFields.Purge();
+			pPlan->m_CompareFields.Purge();
+		}
+	}
+
+	if ( !pPlan->m_bValid )
+		return false;
+
+	char *pDest = (char *)m_pDest;
+	char const *pSrc = (char const *)m_pSrc;
+
+	if ( m_bPerformCopy )
+	{
+		for ( int i = 0; i < pPlan->m_CopySpans.Count(); i++ )
+		{
+			const PredictionCopySpan_t &span = pPlan->m_CopySpans[i];
+			memcpy( pDest + span.destOffset, pSrc + span.srcOffset, span.size );
+		}
+		return true;
+	}
+
+	// Counting errors: identical runs have no differing fields (short of NaNs, which
+	// compare unequal to themselves), anything else is compared field by field as usual
+	for ( int i = 0; i < pPlan->m_CompareSpans.Count(); i++ )
+	{
+		const PredictionCopySpan_t &span = pPlan->m_CompareSpans[i];
+		if ( !memcmp( pDest + span.destOffset, pSrc + span.srcOffset, span.size ) )
+			continue;
+
+		for ( int j = span.firstField; j < span.firstField + span.fieldCount; j++ )
+		{
+			const PredictionCopyField_t &field = pPlan->m_CompareFields[j];
+			m_pCurrentField = field.pField;
+			m_pCurrentMap = field.pMap;
+			m_pCurrentClassName = field.pClassName;
+			CopyField( pDest + field.destOffset, (void const *)( pSrc + field.srcOffset ) );
+		}
+	}
+
+	m_pCurrentClassName = NULL;
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *operation - 
@@ -1412,6 +1717,9 @@ int CPredictionCopy::TransferData( const char *operation, int entindex, datamap_
 	
 	DetermineWatchField( operation, entindex, dmap );
 
+	if ( TransferCompiled( dmap ) )
+		return m_nErrorCount;
+
 	TransferData_R( g_nChainCount, dmap );
 
 	return m_nErrorCount;
@@ -2041,6 +2349,81 @@ CON_COMMAND_F( cl_pred_track, "<entindex> <fieldname>:  Track changes to entity
 	g_pChangeTracker->SetupTracking( ent, args[2] );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Times the save/restore copies prediction does on the local player
+//  every frame, with and without compiled copy plans
+//-----------------------------------------------------------------------------
+static void BenchmarkPredictionCopy( C_BaseEntity *ent, void *pPacked, int iterations, float &flSave, float &flRestore )
+{
+	datamap_t *dmap = ent->GetPredDescMap();
+
+	CFastTimer timer;
+	timer.Start();
+	for ( int i = 0; i < iterations; i++ )
+	{
+		CPredictionCopy copyHelper( PC_EVERYTHING, pPacked, PC_DATA_PACKED, ent, PC_DATA_NORMAL );
+		copyHelper.TransferData( "cl_pred_benchmark_copy", ent->entindex(), dmap );
+	}
+	timer.End();
+	flSave = timer.GetDuration().GetSeconds();
+
+	timer.Start();
+	for ( int i = 0; i < iterations; i++ )
+	{
+		CPredictionCopy copyHelper( PC_EVERYTHING, ent, PC_DATA_NORMAL, pPacked, PC_DATA_PACKED );
+		copyHelper.TransferData( "cl_pred_benchmark_copy", ent->entindex(), dmap );
+	}
+	timer.End();
+	flRestore = timer.GetDuration().GetSeconds();
+}
+
+CON_COMMAND_F( cl_pred_benchmark_copy, "[iterations]:  Time prediction save/restore copies of the local player.", FCVAR_CHEAT )
+{
+	int iterations = ( args.ArgC() >= 2 ) ? Q_atoi( args[1] ) : 10000;
+	iterations = MAX( iterations, 1 );
+
+	C_BasePlayer *pPlayer = C_BasePlayer::GetLocalPlayer();
+	if ( !pPlayer )
+	{
+		Msg( "cl_pred_benchmark_copy:  No local player\n" );
+		return;
+	}
+
+	datamap_t *dmap = pPlayer->GetPredDescMap();
+	if ( !dmap || !dmap->packed_offsets_computed )
+	{
+		Msg( "cl_pred_benchmark_copy:  %s has no packed prediction data yet\n", pPlayer->GetClassname() );
+		return;
+	}
+
+	// Restores copy back into the player, so start from its current state
+	byte *pPacked = new byte[ dmap->packed_size ];
+	memset( pPacked, 0, dmap->packed_size );
+	{
+		CPredictionCopy copyHelper( PC_EVERYTHING, pPacked, PC_DATA_PACKED, pPlayer, PC_DATA_NORMAL );
+		copyHelper.TransferData( "cl_pred_benchmark_copy", pPlayer->entindex(), dmap );
+	}
+
+	bool bWasCompiled = cl_pred_compiledcopy.GetBool();
+
+	float flSave[ 2 ], flRestore[ 2 ];
+	cl_pred_compiledcopy.SetValue( 1 );
+	BenchmarkPredictionCopy( pPlayer, pPacked, iterations, flSave[ 0 ], flRestore[ 0 ] );
+	cl_pred_compiledcopy.SetValue( 0 );
+	BenchmarkPredictionCopy( pPlayer, pPacked, iterations, flSave[ 1 ], flRestore[ 1 ] );
+	cl_pred_compiledcopy.SetValue( bWasCompiled );
+
+	delete[] pPacked;
+
+	Msg( "%s (%s, %d bytes packed), %d iterations:\n", dmap->dataClassName, pPlayer->GetClassname(), dmap->packed_size, iterations );
+	const char *pszLabels[ 2 ] = { "compiled", "datamap walk" };
+	for ( int i = 0; i < 2; i++ )
+	{
+		Msg( "  %-12s  save %10.0f copies/sec  restore %10.0f copies/sec\n", pszLabels[ i ],
+			iterations / MAX( flSave[ i ], 1e-6f ), iterations / MAX( flRestore[ i ], 1e-6f ) );
+	}
+}
+
 #endif
 
 #if defined( CLIENT_DLL ) && defined( COPY_CHECK_STRESSTEST )
@@ -41,6 +41,8 @@ enum
 #define PC_DATA_PACKED			true
 #define PC_DATA_NORMAL			false
 
+class CPredictionCopyPlan;
+
 typedef void ( *FN_FIELD_COMPARE )( const char *classname, const char *fieldname, const char *fieldtype,
 	bool networked, bool noterrorchecked, bool differs, bool withintolerance, const char *value );
 
@@ -132,6 +134,12 @@ private:
 	bool	CanCheck( void );
 
 	void	CopyFields( int chaincount, datamap_t *pMap, typedescription_t *pFields, int fieldCount );
+	void	CopyField( void *pOutputData, void const *pInputData );
+
+	// Flattened copy/compare of a whole datamap, used when nothing needs to be described or watched
+	bool	TransferCompiled( datamap_t *dmap );
+	bool	BuildPlan_R( CPredictionCopyPlan *pPlan, int chaincount, datamap_t *pMap, typedescription_t *pFields, int fieldCount, 
+				char const *pClassName, int destBase, int srcBase );
 
 private:
 
@@ -228,13 +228,18 @@ enum RayTraceLightingMode_t {
 };
 
 
+// rays queued per direction octant before the octant is sorted for coherence and traced 4 at a
+// time
+#define RAYSTREAM_BATCH_SIZE 64
+
 class RayStream
 {
 	friend class RayTracingEnvironment;
 
-	RayTracingSingleResult *PendingStreamOutputs[8][4];
+	RayTracingSingleResult *PendingStreamOutputs[8][RAYSTREAM_BATCH_SIZE];
 	int n_in_stream[8];
-	FourRays PendingRays[8];
+	Vector PendingOrigins[8][RAYSTREAM_BATCH_SIZE];
+	Vector PendingDeltas[8][RAYSTREAM_BATCH_SIZE];
 
 public:
 	RayStream(void)
@@ -330,7 +335,8 @@ public:
 					 
 	/// raytracing stream - lets you trace an array of rays by feeding them to this function.
 	/// results will not be returned until FinishStream is called. This function handles sorting
-	/// the rays by direction, tracing them 4 at a time, and de-interleaving the results.
+	/// the rays by direction, reordering them so that rays with nearby origins and directions
+	/// share a packet, tracing them 4 at a time, and de-interleaving the results.
 
 	void AddToRayStream(RayStream &s,
 						Vector const &start,Vector const &end,RayTracingSingleResult *rslt_out);
@@ -345,14 +351,6 @@ public:
 	int MakeLeafNode(int first_tri, int last_tri);
 
 
-	float CalculateCostsOfSplit(
-		int split_plane,int32 const *tri_list,int ntris,
-		Vector MinBound,Vector MaxBound, float &split_value,
-		int &nleft, int &nright, int &nboth);
-		
-	void RefineNode(int node_number,int32 const *tri_list,int ntris,
-						 Vector MinBound,Vector MaxBound, int depth);
-	
 	void CalculateTriangleListBounds(int32 const *tris,int ntris,
 									 Vector &minout, Vector &maxout);
 
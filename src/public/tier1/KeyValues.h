@@ -39,6 +39,7 @@ class CUtlBuffer;
 class Color;
 typedef void * FileHandle_t;
 class CKeyValuesGrowableStringTable;
+class CKeyValuesArena;
 
 //-----------------------------------------------------------------------------
 // Purpose: Simple recursive data access class
@@ -80,6 +81,30 @@ public:
 
 	KeyValues( const char *setName );
 
+	//	Arena-backed trees. The root returned here, every key created beneath it (FindKey
+	//	with bCreate, Set*, CreateKey, LoadFromBuffer, ReadAsBinary, #base and #include
+	//	merging) and all of their string values are carved out of one growable block.
+	//	deleteThis() on the root releases the whole tree without walking it; deleteThis()
+	//	on any other node of the tree is a no-op and its memory is reclaimed with the root.
+	//	Nodes from different trees (or from the heap) must never be linked together, debug
+	//	builds assert on it. As with the growable string table, don't hand an arena-backed
+	//	tree to another module that may delete it. MakeCopy() always returns a heap tree.
+	static KeyValues *CreateArenaBacked( const char *setName, int nInitialBlockSize = 0 );
+	bool IsArenaBacked() const { return m_bArenaNode != 0; }
+
+	// Allocation counters for this module, to compare heap and arena-backed usage
+	struct AllocStats_t
+	{
+		int m_nHeapNodes;			// KeyValues nodes allocated from the KeyValues system heap
+		int m_nHeapValues;			// string/wstring/uint64 value buffers allocated with new[]
+		int m_nArenaTrees;			// arena-backed roots created
+		int m_nArenaNodes;			// nodes carved out of an arena
+		int m_nArenaValues;			// value buffers carved out of an arena
+		int m_nArenaBlocks;			// blocks the arenas had to allocate
+	};
+	static void GetAllocStats( AllocStats_t &stats );
+	static void ResetAllocStats();
+
 	//
 	// AutoDelete class to automatically free the keyvalues.
 	// Simply construct it with the keyvalues you allocated and it will free them when falls out of scope.
@@ -266,8 +291,21 @@ public:
 	KeyValues* CreateKey( const char *keyName );
 
 private:
+	friend class CKeyValuesArena;
+
 	KeyValues( KeyValues& );	// prevent copy constructor being used
 
+	// placement construction, used by CKeyValuesArena
+	void *operator new( size_t iAllocSize, void *pMem ) { return pMem; }
+	void operator delete( void *pMem, void *pPlace ) {}
+
+	// node and value allocation honoring the owner of the tree (the heap, or an arena)
+	static KeyValues *AllocNode( CKeyValuesArena *pArena, const char *setName );
+	CKeyValuesArena *GetArena() const;
+	char *AllocValueString( int nBytes );
+	wchar_t *AllocValueWString( int nChars );
+	KeyValues *MakeCopyInArena( CKeyValuesArena *pArena ) const;
+
 	// prevent delete being called except through deleteThis()
 	~KeyValues();
 
@@ -330,7 +368,7 @@ private:
 	char	   m_iDataType;
 	char	   m_bHasEscapeSequences; // true, if while parsing this KeyValue, Escape Sequences are used (default false)
 	char	   m_bEvaluateConditionals; // true, if while parsing this KeyValue, conditionals blocks are evaluated (default true)
-	char	   unused[1];
+	char	   m_bArenaNode; // true, if this node lives in a CKeyValuesArena block rather than on the heap
 
 	KeyValues *m_pPeer;	// pointer to next key in list
 	KeyValues *m_pSub;	// pointer to Start of a new sub key list
@@ -2,6 +2,7 @@
 // $Id$
 
 #include "raytrace.h"
+#include <tier0/threadtools.h>
 #include <filesystem_tools.h>
 #include <cmdlib.h>
 #include <stdio.h>
@@ -622,12 +623,12 @@ void RayTracingEnvironment::CalculateTriangleListBounds(int32 const *tris,int nt
 }
 
 
-// Both the "quick" and regular kd tree building algorithms here use the "surface area heuristic":
-// the relative probability of hitting the "left" subvolume (Vl) from a split is equal to that
-// subvolume's surface area divided by its parent's surface area (Vp) : P(Vl | V)=SA(Vl)/SA(Vp).
-// The same holds for the right subvolume, Vp. Nl is the number of triangles in the left volume,
-// and Nr in the right volume. if Ct is the cost of traversing one tree node, and Ci is the cost of
-// intersection with the primitive, than the cost of splitting is estimated as:
+// The tree is built with the "surface area heuristic": the relative probability of hitting the
+// "left" subvolume (Vl) from a split is equal to that subvolume's surface area divided by its
+// parent's surface area (Vp) : P(Vl | V)=SA(Vl)/SA(Vp). The same holds for the right subvolume,
+// Vp. Nl is the number of triangles in the left volume, and Nr in the right volume. if Ct is the
+// cost of traversing one tree node, and Ci is the cost of intersection with the primitive, than
+// the cost of splitting is estimated as:
 //
 //    Ct+Ci*((SA(Vl)/SA(V))*Nl+(SA(Vr)/SA(V)*Nr)).
 // and the cost of not splitting is
@@ -636,250 +637,345 @@ void RayTracingEnvironment::CalculateTriangleListBounds(int32 const *tris,int nt
 //  This both provides a metric to minimize when computing how and where to split, and also a
 //  termination criterion.
 //
-// the "quick" method just splits down the middle, while the slow method splits at the best
-// discontinuity of the cost formula. The quick method splits along the longest axis ; the 
-// regular algorithm tries all 3 to find which one results in the minimum cost
-// 
-// both methods use the additional optimization of "growing" empty nodes - if the split results in
-// one side being devoid of triangles, the empty side is "grown" as much as possible.
+// Candidate splits are the edges of KDTREE_SAH_BINS equal bins along each axis. Binning the
+// triangle extents once per axis gives the left/right counts at every edge with a prefix sum,
+// so evaluating a node is linear in its triangle count instead of once per candidate.
 //
+// the builder also uses the optimization of "growing" empty nodes - splits right at the extents
+// of the node's triangles are tried too, so that empty space gets cut off as much as possible.
+//
+// Subtrees over KDTREE_PARALLEL_MIN_TRIS triangles are handed to another thread while one is
+// free. Each split only depends on the triangles under the node, so the tree comes out the same
+// however many threads build it.
 
 #define COST_OF_TRAVERSAL 75								// approximate #operations
 #define COST_OF_INTERSECTION 167							// approximate #operations
 
+#define KDTREE_SAH_BINS 32
+#define KDTREE_PARALLEL_MIN_TRIS 4096
 
-float RayTracingEnvironment::CalculateCostsOfSplit(
-	int split_plane,int32 const *tri_list,int ntris,
-	Vector MinBound,Vector MaxBound, float &split_value,
-	int &nleft, int &nright, int &nboth)
+struct KDBuildNode_t
 {
-	// determine the costs of splitting on a given axis, and label triangles with respect to
-	// that axis by storing the value in coordselect0. It will also return the number of
-	// tris in the left, right, and nboth groups, in order to facilitate memory
-	nleft=nboth=nright=0;
-	
-	// now, label each triangle. Since we have not converted the triangles into
-	// intersection fromat yet, we can use the CoordSelect0 field of each as a temp.
-	nleft=0;
-	nright=0;
-	nboth=0;
-	float min_coord=1.0e23,max_coord=-1.0e23;
-
-	for(int t=0;t<ntris;t++)
+	int m_nType;											// KDNODE_STATE_xxx
+	float m_flSplit;
+	KDBuildNode_t *m_pChildren[2];
+	CUtlVector<int32> m_Triangles;							// leaves only
+#ifdef DEBUG_RAYTRACE
+	Vector m_vecMins;
+	Vector m_vecMaxs;
+#endif
+};
+
+class CKDTreeBuilder
+{
+public:
+	CKDTreeBuilder( RayTracingEnvironment *pEnv );
+	~CKDTreeBuilder();
+
+	void Build( void );
+
+private:
+	struct BuildTask_t
+	{
+		CKDTreeBuilder *m_pBuilder;
+		KDBuildNode_t *m_pNode;
+		CUtlVector<int32> m_Triangles;
+		Vector m_vecMins;
+		Vector m_vecMaxs;
+		int m_nDepth;
+	};
+
+	static uintp BuildTaskThread( void *pParam );
+
+	void BuildNode( KDBuildNode_t *pNode, CUtlVector<int32> &tris, const Vector &MinBound,
+					const Vector &MaxBound, int depth );
+	float FindBestSplit( const CUtlVector<int32> &tris, const Vector &MinBound,
+						 const Vector &MaxBound, int &split_plane, float &split_value );
+	void MakeLeaf( KDBuildNode_t *pNode, CUtlVector<int32> &tris );
+	void Flatten( const KDBuildNode_t *pNode, int node_number );
+	void FreeNode( KDBuildNode_t *pNode );
+
+	RayTracingEnvironment *m_pEnv;
+	CUtlVector<Vector> m_TriMins;							// bounds of every triangle, read
+	CUtlVector<Vector> m_TriMaxs;							// only once the build starts
+	KDBuildNode_t *m_pRoot;
+	CInterlockedInt m_nFreeThreads;
+};
+
+CKDTreeBuilder::CKDTreeBuilder( RayTracingEnvironment *pEnv ) : m_pEnv( pEnv ), m_pRoot( NULL )
+{
+	m_nFreeThreads = GetCPUInformation()->m_nLogicalProcessors - 1;
+}
+
+CKDTreeBuilder::~CKDTreeBuilder()
+{
+	if ( m_pRoot )
+		FreeNode( m_pRoot );
+}
+
+void CKDTreeBuilder::FreeNode( KDBuildNode_t *pNode )
+{
+	if ( pNode->m_nType != KDNODE_STATE_LEAF )
+	{
+		FreeNode( pNode->m_pChildren[0] );
+		FreeNode( pNode->m_pChildren[1] );
+	}
+	delete pNode;
+}
+
+void CKDTreeBuilder::MakeLeaf( KDBuildNode_t *pNode, CUtlVector<int32> &tris )
+{
+	pNode->m_nType = KDNODE_STATE_LEAF;
+	pNode->m_Triangles.Swap( tris );
+}
+
+float CKDTreeBuilder::FindBestSplit( const CUtlVector<int32> &tris, const Vector &MinBound,
+									 const Vector &MaxBound, int &split_plane, float &split_value )
+{
+	int ntris = tris.Count();
+	float best_cost = 1.0e23;
+	float ISA = 1.0 / BoxSurfaceArea( MinBound, MaxBound );
+
+	for( int axis = 0; axis < 3; axis++ )
 	{
-		CacheOptimizedTriangle &tri=OptimizedTriangleList[tri_list[t]];
-		// determine max and min coordinate values for later optimization
-		for(int v=0;v<3;v++)
+		float lo = MinBound[axis];
+		float extent = MaxBound[axis] - lo;
+		if ( extent <= 0 )
+			continue;
+
+		// how many triangles start and end in each bin. a triangle is on the right of a split
+		// if its min is >= the split value and on the left if its max is <= it
+		int nStarts[KDTREE_SAH_BINS];
+		int nEnds[KDTREE_SAH_BINS];
+		memset( nStarts, 0, sizeof( nStarts ) );
+		memset( nEnds, 0, sizeof( nEnds ) );
+
+		float bin_scale = KDTREE_SAH_BINS / extent;
+		float min_coord = 1.0e23, max_coord = -1.0e23;
+		for( int t = 0; t < ntris; t++ )
+		{
+			float minc = m_TriMins[tris[t]][axis];
+			float maxc = m_TriMaxs[tris[t]][axis];
+			min_coord = min( min_coord, minc );
+			max_coord = max( max_coord, maxc );
+			nStarts[ clamp( (int)( ( minc - lo ) * bin_scale ), 0, KDTREE_SAH_BINS - 1 ) ]++;
+			nEnds[ clamp( (int)( ( maxc - lo ) * bin_scale ), 0, KDTREE_SAH_BINS - 1 ) ]++;
+		}
+
+		Vector LeftMaxes = MaxBound;
+		Vector RightMins = MinBound;
+
+		// the split right at the edge of the triangles leaves an empty node on the other side
+		float empty_splits[2] = { min_coord, max_coord };
+		for( int e = 0; e < 2; e++ )
 		{
-			min_coord = min( min_coord, tri.Vertex(v)[split_plane] );
-			max_coord = max( max_coord, tri.Vertex(v)[split_plane] );
+			float trial_splitvalue = empty_splits[e];
+			if ( ( trial_splitvalue <= MinBound[axis] ) || ( trial_splitvalue >= MaxBound[axis] ) )
+				continue;
+			LeftMaxes[axis] = trial_splitvalue;
+			RightMins[axis] = trial_splitvalue;
+			float SA = e ? BoxSurfaceArea( MinBound, LeftMaxes ) : BoxSurfaceArea( RightMins, MaxBound );
+			float trial_cost = COST_OF_TRAVERSAL + COST_OF_INTERSECTION * ( SA * ISA * ntris );
+			if ( trial_cost < best_cost )
+			{
+				best_cost = trial_cost;
+				split_plane = axis;
+				split_value = trial_splitvalue;
+			}
 		}
-		switch(tri.ClassifyAgainstAxisSplit(split_plane,split_value))
+
+		int nleft = 0;
+		int nright = ntris;
+		for( int b = 1; b < KDTREE_SAH_BINS; b++ )
 		{
-			case PLANECHECK_NEGATIVE:
-				nleft++;
-				tri.m_Data.m_GeometryData.m_nTmpData0 = PLANECHECK_NEGATIVE;
-				break;
-
-			case PLANECHECK_POSITIVE:
-				nright++;
-				tri.m_Data.m_GeometryData.m_nTmpData0 = PLANECHECK_POSITIVE;
-				break;
-
-			case PLANECHECK_STRADDLING:
-				nboth++;
-				tri.m_Data.m_GeometryData.m_nTmpData0 = PLANECHECK_STRADDLING;
-				break;
+			nleft += nEnds[b - 1];
+			nright -= nStarts[b - 1];
+			int nboth = ntris - nleft - nright;
+
+			float trial_splitvalue = lo + b * ( extent / KDTREE_SAH_BINS );
+			LeftMaxes[axis] = trial_splitvalue;
+			RightMins[axis] = trial_splitvalue;
+			float SA_L = BoxSurfaceArea( MinBound, LeftMaxes );
+			float SA_R = BoxSurfaceArea( RightMins, MaxBound );
+			float trial_cost = COST_OF_TRAVERSAL + COST_OF_INTERSECTION * ( nboth +
+				( SA_L * ISA * nleft ) + ( SA_R * ISA * nright ) );
+			if ( trial_cost < best_cost )
+			{
+				best_cost = trial_cost;
+				split_plane = axis;
+				split_value = trial_splitvalue;
+			}
 		}
 	}
-	// now, if the split resulted in one half being empty, "grow" the empty half
-	if (nleft && (nboth==0) && (nright==0))
-		split_value=max_coord;
-	if (nright && (nboth==0) && (nleft==0))
-		split_value=min_coord;
-
-	// now, perform surface area/cost check to determine whether this split was worth it
-	Vector LeftMins=MinBound;
-	Vector LeftMaxes=MaxBound;
-	Vector RightMins=MinBound;
-	Vector RightMaxes=MaxBound;
-	LeftMaxes[split_plane]=split_value;
-	RightMins[split_plane]=split_value;
-	float SA_L=BoxSurfaceArea(LeftMins,LeftMaxes);
-	float SA_R=BoxSurfaceArea(RightMins,RightMaxes);
-	float ISA=1.0/BoxSurfaceArea(MinBound,MaxBound);
-	float cost_of_split=COST_OF_TRAVERSAL+COST_OF_INTERSECTION*(nboth+
-		(SA_L*ISA*(nleft))+(SA_R*ISA*(nright)));
-	return cost_of_split;
+	return best_cost;
 }
 
-
-#define NEVER_SPLIT 0
-
-void RayTracingEnvironment::RefineNode(int node_number,int32 const *tri_list,int ntris,
-									   Vector MinBound,Vector MaxBound, int depth)
+uintp CKDTreeBuilder::BuildTaskThread( void *pParam )
 {
-	if (ntris<3)											// never split empty lists
-	{
-		// no point in continuing
-		OptimizedKDTree[node_number].Children=KDNODE_STATE_LEAF+(TriangleIndexList.Count()<<2);
-		OptimizedKDTree[node_number].SetNumberOfTrianglesInLeafNode(ntris);
+	BuildTask_t *pTask = (BuildTask_t *) pParam;
+	pTask->m_pBuilder->BuildNode( pTask->m_pNode, pTask->m_Triangles, pTask->m_vecMins,
+								  pTask->m_vecMaxs, pTask->m_nDepth );
+	return 0;
+}
 
+void CKDTreeBuilder::BuildNode( KDBuildNode_t *pNode, CUtlVector<int32> &tris,
+								const Vector &MinBound, const Vector &MaxBound, int depth )
+{
 #ifdef DEBUG_RAYTRACE
-		OptimizedKDTree[node_number].vecMins = MinBound;
-		OptimizedKDTree[node_number].vecMaxs = MaxBound;
+	pNode->m_vecMins = MinBound;
+	pNode->m_vecMaxs = MaxBound;
 #endif
+	int ntris = tris.Count();
+	if ( ntris < 3 )										// never split empty lists
+	{
+		MakeLeaf( pNode, tris );
+		return;
+	}
 
-		for(int t=0;t<ntris;t++)
-			TriangleIndexList.AddToTail(tri_list[t]);
+	int split_plane = 0;
+	float split_value = 0;
+	float best_cost = FindBestSplit( tris, MinBound, MaxBound, split_plane, split_value );
+	float cost_of_no_split = COST_OF_INTERSECTION * ntris;
+	if ( ( cost_of_no_split <= best_cost ) || ( depth > MAX_TREE_DEPTH ) )
+	{
+		// no benefit to splitting. just make this a leaf node
+		MakeLeaf( pNode, tris );
 		return;
 	}
 
-	float best_cost=1.0e23;
-	int best_nleft=0,best_nright=0,best_nboth=0;
-	float best_splitvalue=0;
-	int split_plane=0;
+	// its worth splitting! classify the same way CacheOptimizedTriangle::ClassifyAgainstAxisSplit does
+	BuildTask_t *pSides[2];
+	for( int i = 0; i < 2; i++ )
+	{
+		pSides[i] = new BuildTask_t;
+		pSides[i]->m_pBuilder = this;
+		pSides[i]->m_pNode = new KDBuildNode_t;
+		pSides[i]->m_Triangles.EnsureCapacity( ntris );
+		pSides[i]->m_vecMins = MinBound;
+		pSides[i]->m_vecMaxs = MaxBound;
+	}
+	pSides[0]->m_vecMaxs[split_plane] = split_value;
+	pSides[1]->m_vecMins[split_plane] = split_value;
 
-	int tri_skip=1+(ntris/10);								// don't try all trinagles as split
-															// points when there are a lot of them
-	for(int axis=0;axis<3;axis++)
+	int nleft = 0, nright = 0;
+	for( int t = 0; t < ntris; t++ )
 	{
-		for(int ts=-1;ts<ntris;ts+=tri_skip)
+		int32 tri = tris[t];
+		if ( m_TriMins[tri][split_plane] >= split_value )
 		{
-			for(int tv=0;tv<3;tv++)
-			{
-				int trial_nleft,trial_nright,trial_nboth;
-				float trial_splitvalue;
-				if (ts==-1)
-					trial_splitvalue=0.5*(MinBound[axis]+MaxBound[axis]);
-				else
-				{
-					// else, split at the triangle vertex if possible
-					CacheOptimizedTriangle &tri=OptimizedTriangleList[tri_list[ts]];
-					trial_splitvalue = tri.Vertex(tv)[axis];
-					if ((trial_splitvalue>MaxBound[axis]) || (trial_splitvalue<MinBound[axis]))
-						continue;							// don't try this vertex - not inside
-					
-				}
-//				printf("ts=%d tv=%d tp=%f\n",ts,tv,trial_splitvalue);
-				float trial_cost=
-					CalculateCostsOfSplit(axis,tri_list,ntris,MinBound,MaxBound,trial_splitvalue,
-										  trial_nleft,trial_nright, trial_nboth);
-// 				printf("try %d cost=%f nl=%d nr=%d nb=%d sp=%f\n",axis,trial_cost,trial_nleft,trial_nright, trial_nboth,
-// 					   trial_splitvalue);
-				if (trial_cost<best_cost)
-				{
-					split_plane=axis;
-					best_cost=trial_cost;
-					best_nleft=trial_nleft;
-					best_nright=trial_nright;
-					best_nboth=trial_nboth;
-					best_splitvalue=trial_splitvalue;
-					// save away the axis classification of each triangle
-					for(int t=0 ; t < ntris; t++)
-					{
-						CacheOptimizedTriangle &tri=OptimizedTriangleList[tri_list[t]];
-						tri.m_Data.m_GeometryData.m_nTmpData1 = tri.m_Data.m_GeometryData.m_nTmpData0;
-					}
-				}
-				if (ts==-1)
-					break;
-			}
+			pSides[1]->m_Triangles.AddToTail( tri );
+			nright++;
+		}
+		else if ( m_TriMaxs[tri][split_plane] <= split_value )
+		{
+			pSides[0]->m_Triangles.AddToTail( tri );
+			nleft++;
+		}
+		else
+		{
+			pSides[0]->m_Triangles.AddToTail( tri );
+			pSides[1]->m_Triangles.AddToTail( tri );
 		}
+	}
+	tris.Purge();
+
+	pNode->m_nType = split_plane;
+	pNode->m_flSplit = split_value;
+	if ( ( ntris < 20 ) && ( ( nleft == 0 ) || ( nright == 0 ) ) )
+		depth += 100;
+	for( int i = 0; i < 2; i++ )
+	{
+		pNode->m_pChildren[i] = pSides[i]->m_pNode;
+		pSides[i]->m_nDepth = depth + 1;
+	}
 
+	// now, recurse! the left side goes to another thread if it's big and one is free
+	ThreadHandle_t hThread = NULL;
+	if ( pSides[0]->m_Triangles.Count() >= KDTREE_PARALLEL_MIN_TRIS )
+	{
+		if ( --m_nFreeThreads >= 0 )
+			hThread = CreateSimpleThread( BuildTaskThread, pSides[0] );
+		if ( !hThread )
+			++m_nFreeThreads;
 	}
-	float cost_of_no_split=COST_OF_INTERSECTION*ntris;
-	if ( (cost_of_no_split<=best_cost) || NEVER_SPLIT || (depth>MAX_TREE_DEPTH))
+	if ( !hThread )
+		BuildTaskThread( pSides[0] );
+	BuildTaskThread( pSides[1] );
+
+	if ( hThread )
 	{
-		// no benefit to splitting. just make this a leaf node
-		OptimizedKDTree[node_number].Children=KDNODE_STATE_LEAF+(TriangleIndexList.Count()<<2);
-		OptimizedKDTree[node_number].SetNumberOfTrianglesInLeafNode(ntris);
+		ThreadJoin( hThread );
+		ReleaseThreadHandle( hThread );
+		++m_nFreeThreads;
+	}
+
+	delete pSides[0];
+	delete pSides[1];
+}
+
+void CKDTreeBuilder::Flatten( const KDBuildNode_t *pNode, int node_number )
+{
+	// same layout RefineNode always produced: children are allocated as a pair, then the whole
+	// left subtree is written before the right one
+	CacheOptimizedKDNode &node = m_pEnv->OptimizedKDTree[node_number];
 #ifdef DEBUG_RAYTRACE
-		OptimizedKDTree[node_number].vecMins = MinBound;
-		OptimizedKDTree[node_number].vecMaxs = MaxBound;
+	node.vecMins = pNode->m_vecMins;
+	node.vecMaxs = pNode->m_vecMaxs;
 #endif
-		for(int t=0;t<ntris;t++)
-			TriangleIndexList.AddToTail(tri_list[t]);
+	if ( pNode->m_nType == KDNODE_STATE_LEAF )
+	{
+		node.Children = KDNODE_STATE_LEAF + ( m_pEnv->TriangleIndexList.Count() << 2 );
+		node.SetNumberOfTrianglesInLeafNode( pNode->m_Triangles.Count() );
+		m_pEnv->TriangleIndexList.AddVectorToTail( pNode->m_Triangles );
+		return;
 	}
-	else
+
+	int left_child = m_pEnv->OptimizedKDTree.Count();
+	node.Children = pNode->m_nType + ( left_child << 2 );
+	node.SplittingPlaneValue = pNode->m_flSplit;
+
+	CacheOptimizedKDNode newnode;
+	m_pEnv->OptimizedKDTree.AddToTail( newnode );
+	m_pEnv->OptimizedKDTree.AddToTail( newnode );
+	Flatten( pNode->m_pChildren[0], left_child );
+	Flatten( pNode->m_pChildren[1], left_child + 1 );
+}
+
+void CKDTreeBuilder::Build( void )
+{
+	int ntris = m_pEnv->OptimizedTriangleList.Count();
+	CUtlVector<int32> root_triangle_list;
+	root_triangle_list.SetCount( ntris );
+	m_TriMins.SetCount( ntris );
+	m_TriMaxs.SetCount( ntris );
+	for( int t = 0; t < ntris; t++ )
 	{
-// 		printf("best split was %d at %f (mid=%f,n=%d, sk=%d)\n",split_plane,best_splitvalue,
-// 			   0.5*(MinBound[split_plane]+MaxBound[split_plane]),ntris,tri_skip);
-		// its worth splitting!
-		// we will achieve the splitting without sorting by using a selection algorithm.
-		int32 *new_triangle_list;
-		new_triangle_list=new int32[ntris];
-
-		// now, perform surface area/cost check to determine whether this split was worth it
-		Vector LeftMins=MinBound;
-		Vector LeftMaxes=MaxBound;
-		Vector RightMins=MinBound;
-		Vector RightMaxes=MaxBound;
-		LeftMaxes[split_plane]=best_splitvalue;
-		RightMins[split_plane]=best_splitvalue;
-		
-		int n_left_output=0;
-		int n_both_output=0;
-		int n_right_output=0;
-		for(int t=0;t<ntris;t++)
+		root_triangle_list[t] = t;
+		const CacheOptimizedTriangle &tri = m_pEnv->OptimizedTriangleList[t];
+		m_TriMins[t] = tri.Vertex( 0 );
+		m_TriMaxs[t] = tri.Vertex( 0 );
+		for( int v = 1; v < 3; v++ )
 		{
-			CacheOptimizedTriangle &tri=OptimizedTriangleList[tri_list[t]];
-			switch( tri.m_Data.m_GeometryData.m_nTmpData1 )
-			{
-				case PLANECHECK_NEGATIVE:
-//					printf("%d goes left\n",t);
-					new_triangle_list[n_left_output++]=tri_list[t];
-					break;
-				case PLANECHECK_POSITIVE:
-					n_right_output++;
-//					printf("%d goes right\n",t);
-					new_triangle_list[ntris-n_right_output]=tri_list[t];
-					break;
-				case PLANECHECK_STRADDLING:
-//					printf("%d goes both\n",t);
-					new_triangle_list[best_nleft+n_both_output]=tri_list[t];
-					n_both_output++;
-					break;
-
-					
-			}
+			VectorMin( tri.Vertex( v ), m_TriMins[t], m_TriMins[t] );
+			VectorMax( tri.Vertex( v ), m_TriMaxs[t], m_TriMaxs[t] );
 		}
-		int left_child=OptimizedKDTree.Count();
-		int right_child=left_child+1;
-// 		printf("node %d split on axis %d at %f, nl=%d nr=%d nb=%d lc=%d rc=%d\n",node_number,
-// 			   split_plane,best_splitvalue,best_nleft,best_nright,best_nboth,
-// 			   left_child,right_child);
-		OptimizedKDTree[node_number].Children=split_plane+(left_child<<2);
-		OptimizedKDTree[node_number].SplittingPlaneValue=best_splitvalue;
-#ifdef DEBUG_RAYTRACE
-		OptimizedKDTree[node_number].vecMins = MinBound;
-		OptimizedKDTree[node_number].vecMaxs = MaxBound;
-#endif
-		CacheOptimizedKDNode newnode;
-		OptimizedKDTree.AddToTail(newnode);
-		OptimizedKDTree.AddToTail(newnode);
-		// now, recurse!
-		if ( (ntris<20) && ((best_nleft==0) || (best_nright==0)) )
-			depth+=100;
-		RefineNode(left_child,new_triangle_list,best_nleft+best_nboth,LeftMins,LeftMaxes,depth+1);
-		RefineNode(right_child,new_triangle_list+best_nleft,best_nright+best_nboth,
-				   RightMins,RightMaxes,depth+1);
-		delete[] new_triangle_list;
-	}	
+	}
+	m_pEnv->CalculateTriangleListBounds( root_triangle_list.Base(), ntris, m_pEnv->m_MinBound,
+										 m_pEnv->m_MaxBound );
+
+	m_pRoot = new KDBuildNode_t;
+	BuildNode( m_pRoot, root_triangle_list, m_pEnv->m_MinBound, m_pEnv->m_MaxBound, 0 );
+
+	CacheOptimizedKDNode root{};
+	m_pEnv->OptimizedKDTree.AddToTail( root );
+	Flatten( m_pRoot, 0 );
 }
 
 
 void RayTracingEnvironment::SetupAccelerationStructure(void)
 {
-	CacheOptimizedKDNode root{};
-	OptimizedKDTree.AddToTail(root);
-	int32 *root_triangle_list=new int32[OptimizedTriangleList.Count()];
-	for(int t=0;t<OptimizedTriangleList.Count();t++)
-		root_triangle_list[t]=t;
-	CalculateTriangleListBounds(root_triangle_list,OptimizedTriangleList.Count(),m_MinBound,
-								m_MaxBound);
-	RefineNode(0,root_triangle_list,OptimizedTriangleList.Count(),m_MinBound,m_MaxBound,0);
-	delete[] root_triangle_list;
+	CKDTreeBuilder builder( this );
+	builder.Build();
 
 	// now, convert all triangles to "intersection format"
 	for(int i=0;i<OptimizedTriangleList.Count();i++)
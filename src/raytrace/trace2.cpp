@@ -303,25 +303,87 @@ static unsigned int GetSignMask(Vector const &v)
 }
 
 
+// spreads the low 10 bits of v out to every third bit
+static uint32 SpreadBits3(uint32 v)
+{
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+#define RAYSTREAM_ORIGIN_CELL 64.0f							// origins closer than this sort together
+
+// sort key that puts rays with nearby origins, and then similar directions, next to each
+// other. All the rays in one octant share direction signs, so the magnitudes are enough.
+static uint64 RayCoherenceKey(Vector const &start, Vector const &delta)
+{
+	uint32 ox=(uint32)(int)floor(start.x*(1.0f/RAYSTREAM_ORIGIN_CELL));
+	uint32 oy=(uint32)(int)floor(start.y*(1.0f/RAYSTREAM_ORIGIN_CELL));
+	uint32 oz=(uint32)(int)floor(start.z*(1.0f/RAYSTREAM_ORIGIN_CELL));
+	uint64 origin_key=SpreadBits3(ox)|(SpreadBits3(oy)<<1)|(SpreadBits3(oz)<<2);
+
+	float len=fabs(delta.x)+fabs(delta.y)+fabs(delta.z);
+	float scl=(len>0.0f)?63.0f/len:0.0f;
+	uint32 dir_key=((uint32)(fabs(delta.x)*scl)<<6)|(uint32)(fabs(delta.y)*scl);
+	return (origin_key<<12)|dir_key;
+}
+
 inline void RayTracingEnvironment::FlushStreamEntry(RayStream &s,int msk)
 {
 	assert(msk>=0);
 	assert(msk<8);
-	fltx4 tmax=s.PendingRays[msk].direction.length();
-	fltx4 scl=ReciprocalSaturateSIMD(tmax);
-	s.PendingRays[msk].direction*=scl;					// normalize
-	RayTracingResult tmpresult;
-	Trace4Rays(s.PendingRays[msk],Four_Zeros,tmax,msk,&tmpresult);
-	// now, write out results
-	for(int r=0;r<4;r++)
+	int cnt=s.n_in_stream[msk];
+
+	// reorder for coherence. the batch is small, so an insertion sort is fine
+	int order[RAYSTREAM_BATCH_SIZE];
+	uint64 keys[RAYSTREAM_BATCH_SIZE];
+	for(int i=0;i<cnt;i++)
 	{
-		RayTracingSingleResult *out=s.PendingStreamOutputs[msk][r];
-		out->ray_length=SubFloat( tmax, r );
-		out->surface_normal.x=tmpresult.surface_normal.X(r);
-		out->surface_normal.y=tmpresult.surface_normal.Y(r);
-		out->surface_normal.z=tmpresult.surface_normal.Z(r);
-		out->HitID=tmpresult.HitIds[r];
-		out->HitDistance=SubFloat( tmpresult.HitDistance, r );
+		uint64 key=RayCoherenceKey(s.PendingOrigins[msk][i],s.PendingDeltas[msk][i]);
+		int j=i;
+		for(;j>0 && keys[j-1]>key;j--)
+		{
+			keys[j]=keys[j-1];
+			order[j]=order[j-1];
+		}
+		keys[j]=key;
+		order[j]=i;
+	}
+
+	for(int base=0;base<cnt;base+=4)
+	{
+		// fill in unfilled entries of the last packet with dups of its first ray
+		FourRays rays;
+		int n_rays=min(4,cnt-base);
+		for(int r=0;r<4;r++)
+		{
+			int idx=order[base+((r<n_rays)?r:0)];
+			rays.origin.X(r)=s.PendingOrigins[msk][idx].x;
+			rays.origin.Y(r)=s.PendingOrigins[msk][idx].y;
+			rays.origin.Z(r)=s.PendingOrigins[msk][idx].z;
+			rays.direction.X(r)=s.PendingDeltas[msk][idx].x;
+			rays.direction.Y(r)=s.PendingDeltas[msk][idx].y;
+			rays.direction.Z(r)=s.PendingDeltas[msk][idx].z;
+		}
+		fltx4 tmax=rays.direction.length();
+		fltx4 scl=ReciprocalSaturateSIMD(tmax);
+		rays.direction*=scl;								// normalize
+		RayTracingResult tmpresult;
+		Trace4Rays(rays,Four_Zeros,tmax,msk,&tmpresult);
+		// now, write out results
+		for(int r=0;r<n_rays;r++)
+		{
+			RayTracingSingleResult *out=s.PendingStreamOutputs[msk][order[base+r]];
+			out->ray_length=SubFloat( tmax, r );
+			out->surface_normal.x=tmpresult.surface_normal.X(r);
+			out->surface_normal.y=tmpresult.surface_normal.Y(r);
+			out->surface_normal.z=tmpresult.surface_normal.Z(r);
+			out->HitID=tmpresult.HitIds[r];
+			out->HitDistance=SubFloat( tmpresult.HitDistance, r );
+		}
 	}
 	s.n_in_stream[msk]=0;
 }
@@ -336,41 +398,22 @@ void RayTracingEnvironment::AddToRayStream(RayStream &s,
 	assert(msk>=0);
 	assert(msk<8);
 	int pos=s.n_in_stream[msk];
-	assert(pos<4);
-	s.PendingRays[msk].origin.X(pos)=start.x;
-	s.PendingRays[msk].origin.Y(pos)=start.y;
-	s.PendingRays[msk].origin.Z(pos)=start.z;
-	s.PendingRays[msk].direction.X(pos)=delta.x;
-	s.PendingRays[msk].direction.Y(pos)=delta.y;
-	s.PendingRays[msk].direction.Z(pos)=delta.z;
+	assert(pos<RAYSTREAM_BATCH_SIZE);
+	s.PendingOrigins[msk][pos]=start;
+	s.PendingDeltas[msk][pos]=delta;
 	s.PendingStreamOutputs[msk][pos]=rslt_out;
-	if (pos==3)
+	s.n_in_stream[msk]++;
+	if (pos==RAYSTREAM_BATCH_SIZE-1)
 	{
 		FlushStreamEntry(s,msk);
 	}
-	else
-		s.n_in_stream[msk]++;
 }
 
 void RayTracingEnvironment::FinishRayStream(RayStream &s)
 {
 	for(int msk=0;msk<8;msk++)
 	{
-		int cnt=s.n_in_stream[msk];
-		if (cnt)
-		{
-			// fill in unfilled entries with dups of first
-			for(int c=cnt;c<4;c++)
-			{
-				s.PendingRays[msk].origin.X(c) = s.PendingRays[msk].origin.X(0);
-				s.PendingRays[msk].origin.Y(c) = s.PendingRays[msk].origin.Y(0);
-				s.PendingRays[msk].origin.Z(c) = s.PendingRays[msk].origin.Z(0);
-				s.PendingRays[msk].direction.X(c) = s.PendingRays[msk].direction.X(0);
-				s.PendingRays[msk].direction.Y(c) = s.PendingRays[msk].direction.Y(0);
-				s.PendingRays[msk].direction.Z(c) = s.PendingRays[msk].direction.Z(0);
-				s.PendingStreamOutputs[msk][c]=s.PendingStreamOutputs[msk][0];
-			}
+		if (s.n_in_stream[msk])
 			FlushStreamEntry(s,msk);
-		}
 	}
 }
@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include "tier0/dbg.h"
 #include "tier0/mem.h"
+#include "tier0/threadtools.h"
 #include "utlbuffer.h"
 #include "utlhash.h"
 #include "utlvector.h"
@@ -368,6 +369,233 @@ const char *KeyValues::GetStringForSymbolGrowable( int symbol )
 	return s_pGrowableStringTable->GetStringForSymbol( symbol );
 }
 
+//-----------------------------------------------------------------------------
+// Allocation counters. See KeyValues::AllocStats_t.
+//-----------------------------------------------------------------------------
+static CInterlockedInt s_nKVHeapNodes;
+static CInterlockedInt s_nKVHeapValues;
+static CInterlockedInt s_nKVArenaTrees;
+static CInterlockedInt s_nKVArenaNodes;
+static CInterlockedInt s_nKVArenaValues;
+static CInterlockedInt s_nKVArenaBlocks;
+
+void KeyValues::GetAllocStats( AllocStats_t &stats )
+{
+	stats.m_nHeapNodes = s_nKVHeapNodes;
+	stats.m_nHeapValues = s_nKVHeapValues;
+	stats.m_nArenaTrees = s_nKVArenaTrees;
+	stats.m_nArenaNodes = s_nKVArenaNodes;
+	stats.m_nArenaValues = s_nKVArenaValues;
+	stats.m_nArenaBlocks = s_nKVArenaBlocks;
+}
+
+void KeyValues::ResetAllocStats()
+{
+	s_nKVHeapNodes = 0;
+	s_nKVHeapValues = 0;
+	s_nKVArenaTrees = 0;
+	s_nKVArenaNodes = 0;
+	s_nKVArenaValues = 0;
+	s_nKVArenaBlocks = 0;
+}
+
+// Every arena node is preceded by a header holding its arena, so nodes can find their
+// allocator without growing KeyValues (its layout is shared with the engine).
+#define KEYVALUES_ARENA_ALIGN			8
+#define KEYVALUES_ARENA_NODE_HEADER		8
+#define KEYVALUES_ARENA_MIN_BLOCK		1024
+#define KEYVALUES_ARENA_MAX_BLOCK		( 64 * 1024 )
+
+COMPILE_TIME_ASSERT( sizeof( CKeyValuesArena * ) <= KEYVALUES_ARENA_NODE_HEADER );
+
+//-----------------------------------------------------------------------------
+// Purpose: Bump allocator backing an arena-backed KeyValues tree. The arena
+//	object itself lives at the start of its first block; Release() frees the
+//	blocks without touching the nodes inside them.
+//-----------------------------------------------------------------------------
+class CKeyValuesArena
+{
+public:
+	static CKeyValuesArena *Create( int nInitialBlockSize );
+	void Release();
+
+	void *Alloc( int nBytes );
+	KeyValues *AllocNode( const char *setName );
+
+	KeyValues *GetRoot() const { return m_pRoot; }
+	void SetRoot( KeyValues *pRoot ) { m_pRoot = pRoot; }
+
+private:
+	struct Block_t
+	{
+		Block_t *m_pNext;
+		int m_nSize;	// usable bytes after the (aligned) header
+		int m_nUsed;
+
+		char *Base() { return (char *)this + AlignValue( sizeof( Block_t ), KEYVALUES_ARENA_ALIGN ); }
+	};
+
+	static Block_t *AllocBlock( int nSize );
+
+	Block_t *m_pBlocks;		// newest block first, allocation happens from its tail
+	KeyValues *m_pRoot;
+	int m_nNextBlockSize;
+};
+
+CKeyValuesArena::Block_t *CKeyValuesArena::AllocBlock( int nSize )
+{
+	MEM_ALLOC_CREDIT();
+	Block_t *pBlock = (Block_t *)malloc( AlignValue( sizeof( Block_t ), KEYVALUES_ARENA_ALIGN ) + nSize );
+	pBlock->m_pNext = NULL;
+	pBlock->m_nSize = nSize;
+	pBlock->m_nUsed = 0;
+	++s_nKVArenaBlocks;
+	return pBlock;
+}
+
+CKeyValuesArena *CKeyValuesArena::Create( int nInitialBlockSize )
+{
+	int nSize = Clamp( nInitialBlockSize, KEYVALUES_ARENA_MIN_BLOCK, KEYVALUES_ARENA_MAX_BLOCK );
+	Block_t *pBlock = AllocBlock( nSize );
+
+	int nArenaSize = (int)AlignValue( sizeof( CKeyValuesArena ), KEYVALUES_ARENA_ALIGN );
+	CKeyValuesArena *pArena = (CKeyValuesArena *)pBlock->Base();
+	pBlock->m_nUsed = nArenaSize;
+
+	pArena->m_pBlocks = pBlock;
+	pArena->m_pRoot = NULL;
+	pArena->m_nNextBlockSize = Min( nSize * 2, KEYVALUES_ARENA_MAX_BLOCK );
+	return pArena;
+}
+
+void CKeyValuesArena::Release()
+{
+	// The arena lives in its own oldest block, so don't touch members once we start freeing
+	Block_t *pBlock = m_pBlocks;
+	while ( pBlock )
+	{
+		Block_t *pNext = pBlock->m_pNext;
+		free( pBlock );
+		pBlock = pNext;
+	}
+}
+
+void *CKeyValuesArena::Alloc( int nBytes )
+{
+	nBytes = AlignValue( nBytes, KEYVALUES_ARENA_ALIGN );
+
+	Block_t *pBlock = m_pBlocks;
+	if ( pBlock->m_nUsed + nBytes > pBlock->m_nSize )
+	{
+		if ( nBytes > m_nNextBlockSize / 2 )
+		{
+			// Big values get a block of their own, kept behind the current one so its tail stays usable
+			pBlock = AllocBlock( nBytes );
+			pBlock->m_pNext = m_pBlocks->m_pNext;
+			m_pBlocks->m_pNext = pBlock;
+		}
+		else
+		{
+			pBlock = AllocBlock( m_nNextBlockSize );
+			pBlock->m_pNext = m_pBlocks;
+			m_pBlocks = pBlock;
+			m_nNextBlockSize = Min( m_nNextBlockSize * 2, KEYVALUES_ARENA_MAX_BLOCK );
+		}
+	}
+
+	void *pMem = pBlock->Base() + pBlock->m_nUsed;
+	pBlock->m_nUsed += nBytes;
+	return pMem;
+}
+
+KeyValues *CKeyValuesArena::AllocNode( const char *setName )
+{
+	char *pMem = (char *)Alloc( KEYVALUES_ARENA_NODE_HEADER + sizeof( KeyValues ) );
+	*(CKeyValuesArena **)( pMem + KEYVALUES_ARENA_NODE_HEADER - sizeof( CKeyValuesArena * ) ) = this;
+
+	KeyValues *pNode = new ( pMem + KEYVALUES_ARENA_NODE_HEADER ) KeyValues( setName );
+	pNode->m_bArenaNode = true;
+	++s_nKVArenaNodes;
+	return pNode;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Creates the root of an arena-backed tree. See the comment in the header.
+//-----------------------------------------------------------------------------
+KeyValues *KeyValues::CreateArenaBacked( const char *setName, int nInitialBlockSize )
+{
+	CKeyValuesArena *pArena = CKeyValuesArena::Create( nInitialBlockSize );
+	KeyValues *pRoot = pArena->AllocNode( setName );
+	pArena->SetRoot( pRoot );
+	++s_nKVArenaTrees;
+	return pRoot;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Allocates a node from the given arena, or from the heap if pArena is NULL
+//-----------------------------------------------------------------------------
+KeyValues *KeyValues::AllocNode( CKeyValuesArena *pArena, const char *setName )
+{
+	if ( pArena )
+		return pArena->AllocNode( setName );
+
+	return new KeyValues( setName );
+}
+
+CKeyValuesArena *KeyValues::GetArena() const
+{
+	if ( !m_bArenaNode )
+		return NULL;
+
+	return *( (CKeyValuesArena * const *)this - 1 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Allocates storage for m_sValue/m_wsValue from whatever owns this node
+//-----------------------------------------------------------------------------
+char *KeyValues::AllocValueString( int nBytes )
+{
+	if ( m_bArenaNode )
+	{
+		++s_nKVArenaValues;
+		return (char *)GetArena()->Alloc( nBytes );
+	}
+
+	++s_nKVHeapValues;
+	return new char[nBytes];
+}
+
+wchar_t *KeyValues::AllocValueWString( int nChars )
+{
+	if ( m_bArenaNode )
+	{
+		++s_nKVArenaValues;
+		return (wchar_t *)GetArena()->Alloc( nChars * sizeof( wchar_t ) );
+	}
+
+	++s_nKVHeapValues;
+	return new wchar_t[nChars];
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Frees m_sValue and m_wsValue. Arena storage is only reclaimed with the tree.
+//-----------------------------------------------------------------------------
+void KeyValues::FreeAllocatedValue()
+{
+	if ( !m_bArenaNode )
+	{
+		delete [] m_sValue;
+		delete [] m_wsValue;
+	}
+
+	m_sValue = NULL;
+	m_wsValue = NULL;
+}
+
+// Nodes of one tree must share an owner: the heap, or a single arena
+#define KV_ASSERT_SAME_OWNER( pA, pB ) \
+	AssertMsg( !(pB) || (pA)->GetArena() == (pB)->GetArena(), "KeyValues: linking nodes with different owners (heap/arena)\n" )
+
 
 
 //-----------------------------------------------------------------------------
@@ -462,8 +690,7 @@ void KeyValues::Init()
 	m_bHasEscapeSequences = false;
 	m_bEvaluateConditionals = true;
 
-	// for future proof
-	memset( unused, 0, sizeof(unused) );
+	m_bArenaNode = false;
 }
 
 //-----------------------------------------------------------------------------
@@ -481,6 +708,15 @@ KeyValues::~KeyValues()
 //-----------------------------------------------------------------------------
 void KeyValues::RemoveEverything()
 {
+	if ( m_bArenaNode )
+	{
+		// children, peers and values all live in the arena and are reclaimed with it
+		m_pSub = NULL;
+		m_pPeer = NULL;
+		FreeAllocatedValue();
+		return;
+	}
+
 	KeyValues *dat;
 	KeyValues *datNext = NULL;
 	for ( dat = m_pSub; dat != NULL; dat = datNext )
@@ -497,10 +733,7 @@ void KeyValues::RemoveEverything()
 		delete dat;
 	}
 
-	delete [] m_sValue;
-	m_sValue = NULL;
-	delete [] m_wsValue;
-	m_wsValue = NULL;
+	FreeAllocatedValue();
 }
 
 //-----------------------------------------------------------------------------
@@ -1034,7 +1267,7 @@ KeyValues *KeyValues::FindKey(const char *keyName, bool bCreate)
 		if (bCreate)
 		{
 			// we need to create a new key
-			dat = new KeyValues( searchStr );
+			dat = AllocNode( GetArena(), searchStr );
 //			Assert(dat != NULL);
 
 			dat->UsesEscapeSequences( m_bHasEscapeSequences != 0 );	// use same format as parent
@@ -1114,7 +1347,7 @@ KeyValues* KeyValues::CreateKey( const char *keyName )
 KeyValues* KeyValues::CreateKeyUsingKnownLastChild( const char *keyName, KeyValues *pLastChild )
 {
 	// Create a new key
-	KeyValues* dat = new KeyValues( keyName );
+	KeyValues* dat = AllocNode( GetArena(), keyName );
 
 	dat->UsesEscapeSequences( m_bHasEscapeSequences != 0 ); // use same format as parent does
 	dat->UsesConditionals( m_bEvaluateConditionals != 0 );
@@ -1131,6 +1364,7 @@ void KeyValues::AddSubkeyUsingKnownLastChild( KeyValues *pSubkey, KeyValues *pLa
 	// Make sure the subkey isn't a child of some other keyvalues
 	Assert( pSubkey != NULL );
 	Assert( pSubkey->m_pPeer == NULL );
+	KV_ASSERT_SAME_OWNER( this, pSubkey );
 
 	// Empty child list?
 	if ( pLastChild == NULL )
@@ -1166,6 +1400,7 @@ void KeyValues::AddSubKey( KeyValues *pSubkey )
 	// Make sure the subkey isn't a child of some other keyvalues
 	Assert( pSubkey != NULL );
 	Assert( pSubkey->m_pPeer == NULL );
+	KV_ASSERT_SAME_OWNER( this, pSubkey );
 
 	// add into subkey list
 	if ( m_pSub == NULL )
@@ -1242,6 +1477,7 @@ KeyValues *KeyValues::FindLastSubKey()
 //-----------------------------------------------------------------------------
 void KeyValues::SetNextKey( KeyValues *pDat )
 {
+	KV_ASSERT_SAME_OWNER( this, pDat );
 	m_pPeer = pDat;
 }
 
@@ -1595,11 +1831,8 @@ void KeyValues::SetColor( const char *keyName, Color value)
 
 void KeyValues::SetStringValue( char const *strValue )
 {
-	// delete the old value
-	delete [] m_sValue;
-	// make sure we're not storing the WSTRING  - as we're converting over to STRING
-	delete [] m_wsValue;
-	m_wsValue = NULL;
+	// delete the old value, make sure we're not storing the WSTRING  - as we're converting over to STRING
+	FreeAllocatedValue();
 
 	if (!strValue)
 	{
@@ -1609,7 +1842,7 @@ void KeyValues::SetStringValue( char const *strValue )
 
 	// allocate memory for the new value and copy it in
 	int len = Q_strlen( strValue );
-	m_sValue = new char[len + 1];
+	m_sValue = AllocValueString( len + 1 );
 	Q_memcpy( m_sValue, strValue, len+1 );
 
 	m_iDataType = TYPE_STRING;
@@ -1629,11 +1862,8 @@ void KeyValues::SetString( const char *keyName, const char *value )
 			return;
 		}
 
-		// delete the old value
-		delete [] dat->m_sValue;
-		// make sure we're not storing the WSTRING  - as we're converting over to STRING
-		delete [] dat->m_wsValue;
-		dat->m_wsValue = NULL;
+		// delete the old value, make sure we're not storing the WSTRING  - as we're converting over to STRING
+		dat->FreeAllocatedValue();
 
 		if (!value)
 		{
@@ -1643,7 +1873,7 @@ void KeyValues::SetString( const char *keyName, const char *value )
 
 		// allocate memory for the new value and copy it in
 		int len = Q_strlen( value );
-		dat->m_sValue = new char[len + 1];
+		dat->m_sValue = dat->AllocValueString( len + 1 );
 		Q_memcpy( dat->m_sValue, value, len+1 );
 
 		dat->m_iDataType = TYPE_STRING;
@@ -1658,11 +1888,8 @@ void KeyValues::SetWString( const char *keyName, const wchar_t *value )
 	KeyValues *dat = FindKey( keyName, true );
 	if ( dat )
 	{
-		// delete the old value
-		delete [] dat->m_wsValue;
-		// make sure we're not storing the STRING  - as we're converting over to WSTRING
-		delete [] dat->m_sValue;
-		dat->m_sValue = NULL;
+		// delete the old value, make sure we're not storing the STRING  - as we're converting over to WSTRING
+		dat->FreeAllocatedValue();
 
 		if (!value)
 		{
@@ -1672,7 +1899,7 @@ void KeyValues::SetWString( const char *keyName, const wchar_t *value )
 
 		// allocate memory for the new value and copy it in
 		int len = Q_wcslen( value );
-		dat->m_wsValue = new wchar_t[len + 1];
+		dat->m_wsValue = dat->AllocValueWString( len + 1 );
 		Q_memcpy( dat->m_wsValue, value, (len+1) * sizeof(wchar_t) );
 
 		dat->m_iDataType = TYPE_WSTRING;
@@ -1702,13 +1929,10 @@ void KeyValues::SetUint64( const char *keyName, uint64 value )
 
 	if ( dat )
 	{
-		// delete the old value
-		delete [] dat->m_sValue;
-		// make sure we're not storing the WSTRING  - as we're converting over to STRING
-		delete [] dat->m_wsValue;
-		dat->m_wsValue = NULL;
+		// delete the old value, make sure we're not storing the WSTRING  - as we're converting over to STRING
+		dat->FreeAllocatedValue();
 
-		dat->m_sValue = new char[sizeof(uint64)];
+		dat->m_sValue = dat->AllocValueString( sizeof(uint64) );
 		*((uint64 *)dat->m_sValue) = value;
 		dat->m_iDataType = TYPE_UINT64;
 	}
@@ -1783,13 +2007,13 @@ void KeyValues::CopyKeyValuesFromRecursive( const KeyValues& rootSrc )
 
 			// Add children to the queue to process later. 
 			if (cs.src->m_pSub) {
-				cs.dst->m_pSub = localDst = new KeyValues( NULL );
+				cs.dst->m_pSub = localDst = AllocNode( GetArena(), NULL );
 				nodeQ.Insert({ localDst, cs.src->m_pSub });
 			}
 
 			// Process siblings until we hit the end of the line. 
 			if (cs.src->m_pPeer) {
-				cs.dst->m_pPeer = new KeyValues( NULL );
+				cs.dst->m_pPeer = AllocNode( GetArena(), NULL );
 			}
 			else {
 				cs.dst->m_pPeer = NULL;
@@ -1823,7 +2047,7 @@ void KeyValues::CopyKeyValue( const KeyValues& src, size_t tmpBufferSizeB, char*
 		if( src.m_sValue )
 		{
 			int len = Q_strlen(src.m_sValue) + 1;
-			m_sValue = new char[len];
+			m_sValue = AllocValueString( len );
 			Q_strncpy( m_sValue, src.m_sValue, len );
 		}
 		break;
@@ -1832,7 +2056,7 @@ void KeyValues::CopyKeyValue( const KeyValues& src, size_t tmpBufferSizeB, char*
 			m_iValue = src.m_iValue;
 			Q_snprintf( tmpBuffer, (int)tmpBufferSizeB, "%d", m_iValue );
 			int len = Q_strlen(tmpBuffer) + 1;
-			m_sValue = new char[len];
+			m_sValue = AllocValueString( len );
 			Q_strncpy( m_sValue, tmpBuffer, len  );
 		}
 		break;
@@ -1841,7 +2065,7 @@ void KeyValues::CopyKeyValue( const KeyValues& src, size_t tmpBufferSizeB, char*
 			m_flValue = src.m_flValue;
 			Q_snprintf( tmpBuffer, (int)tmpBufferSizeB, "%f", m_flValue );
 			int len = Q_strlen(tmpBuffer) + 1;
-			m_sValue = new char[len];
+			m_sValue = AllocValueString( len );
 			Q_strncpy( m_sValue, tmpBuffer, len );
 		}
 		break;
@@ -1852,7 +2076,7 @@ void KeyValues::CopyKeyValue( const KeyValues& src, size_t tmpBufferSizeB, char*
 		break;
 	case TYPE_UINT64:
 		{
-			m_sValue = new char[sizeof(uint64)];
+			m_sValue = AllocValueString( sizeof(uint64) );
 			Q_memcpy( m_sValue, src.m_sValue, sizeof(uint64) );
 		}
 		break;
@@ -1876,8 +2100,10 @@ void KeyValues::CopyKeyValue( const KeyValues& src, size_t tmpBufferSizeB, char*
 
 KeyValues& KeyValues::operator=( const KeyValues& src )
 {
+	char bArenaNode = m_bArenaNode;
 	RemoveEverything();
 	Init();	// reset all values
+	m_bArenaNode = bArenaNode;
 	CopyKeyValuesFromRecursive( src );
 	return *this;
 }
@@ -1893,8 +2119,8 @@ void KeyValues::CopySubkeys( KeyValues *pParent ) const
 	KeyValues *pPrev = NULL;
 	for ( KeyValues *sub = m_pSub; sub != NULL; sub = sub->m_pPeer )
 	{
-		// take a copy of the subkey
-		KeyValues *dat = sub->MakeCopy();
+		// take a copy of the subkey, owned like the parent
+		KeyValues *dat = sub->MakeCopyInArena( pParent->GetArena() );
 		 
 		// add into subkey list
 		if (pPrev)
@@ -1916,7 +2142,16 @@ void KeyValues::CopySubkeys( KeyValues *pParent ) const
 //-----------------------------------------------------------------------------
 KeyValues *KeyValues::MakeCopy( void ) const
 {
-	KeyValues *newKeyValue = new KeyValues(GetName());
+	return MakeCopyInArena( NULL );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Makes a copy of the whole key-value pair set, allocated from pArena
+//			(or from the heap if pArena is NULL)
+//-----------------------------------------------------------------------------
+KeyValues *KeyValues::MakeCopyInArena( CKeyValuesArena *pArena ) const
+{
+	KeyValues *newKeyValue = AllocNode( pArena, GetName() );
 
 	newKeyValue->UsesEscapeSequences( m_bHasEscapeSequences != 0 );
 	newKeyValue->UsesConditionals( m_bEvaluateConditionals != 0 );
@@ -1931,7 +2166,7 @@ KeyValues *KeyValues::MakeCopy( void ) const
 			{
 				int len = Q_strlen( m_sValue );
 				Assert( !newKeyValue->m_sValue );
-				newKeyValue->m_sValue = new char[len + 1];
+				newKeyValue->m_sValue = newKeyValue->AllocValueString( len + 1 );
 				Q_memcpy( newKeyValue->m_sValue, m_sValue, len+1 );
 			}
 		}
@@ -1941,7 +2176,7 @@ KeyValues *KeyValues::MakeCopy( void ) const
 			if ( m_wsValue )
 			{
 				int len = Q_wcslen( m_wsValue );
-				newKeyValue->m_wsValue = new wchar_t[len+1];
+				newKeyValue->m_wsValue = newKeyValue->AllocValueWString( len + 1 );
 				Q_memcpy( newKeyValue->m_wsValue, m_wsValue, (len+1)*sizeof(wchar_t));
 			}
 		}
@@ -1967,7 +2202,7 @@ KeyValues *KeyValues::MakeCopy( void ) const
 		break;
 
 	case TYPE_UINT64:
-		newKeyValue->m_sValue = new char[sizeof(uint64)];
+		newKeyValue->m_sValue = newKeyValue->AllocValueString( sizeof(uint64) );
 		Q_memcpy( newKeyValue->m_sValue, m_sValue, sizeof(uint64) );
 		break;
 	};
@@ -2017,7 +2252,10 @@ bool KeyValues::IsEmpty(const char *keyName)
 //-----------------------------------------------------------------------------
 void KeyValues::Clear( void )
 {
-	delete m_pSub;
+	if ( m_pSub )
+	{
+		m_pSub->deleteThis();
+	}
 	m_pSub = NULL;
 	m_iDataType = TYPE_NONE;
 }
@@ -2039,6 +2277,17 @@ KeyValues::types_t KeyValues::GetDataType(const char *keyName)
 //-----------------------------------------------------------------------------
 void KeyValues::deleteThis()
 {
+	if ( m_bArenaNode )
+	{
+		// Only the root owns the arena, any other node is reclaimed along with it
+		CKeyValuesArena *pArena = GetArena();
+		if ( pArena->GetRoot() == this )
+		{
+			pArena->Release();
+		}
+		return;
+	}
+
 	delete this;
 }
 
@@ -2105,7 +2354,7 @@ void KeyValues::ParseIncludedKeys( char const *resourceName, const char *filetoi
 	// Append included file
 	Q_strncat( fullpath, filetoinclude, sizeof( fullpath ), COPY_ALL_CHARACTERS );
 
-	KeyValues *newKV = new KeyValues( fullpath );
+	KeyValues *newKV = AllocNode( GetArena(), fullpath );
 
 	// CUtlSymbol save = s_CurrentFileSymbol;	// did that had any use ???
 
@@ -2172,7 +2421,7 @@ void KeyValues::RecursiveMergeKeyValues( KeyValues *baseKV )
 		// If not merged, append this key
 		if ( !bFoundMatch )
 		{
-			KeyValues *dat = baseChild->MakeCopy();
+			KeyValues *dat = baseChild->MakeCopyInArena( GetArena() );
 			Assert( dat );
 			AddSubKey( dat );
 		}
@@ -2310,7 +2559,7 @@ bool KeyValues::LoadFromBuffer( char const *resourceName, CUtlBuffer &buf, IBase
 
 		if ( !pCurrentKey )
 		{
-			pCurrentKey = new KeyValues( s );
+			pCurrentKey = AllocNode( GetArena(), s );
 			Assert( pCurrentKey );
 
 			pCurrentKey->UsesEscapeSequences( m_bHasEscapeSequences != 0 ); // same format has parent use
@@ -2508,11 +2757,7 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 				break;
 			}
 			
-			if (dat->m_sValue)
-			{
-				delete[] dat->m_sValue;
-				dat->m_sValue = NULL;
-			}
+			dat->FreeAllocatedValue();
 
 			int len = Q_strlen( value );
 
@@ -2552,7 +2797,7 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 							digit -= 'A' - ( '9' + 1 );
 					retVal = ( retVal * 16 ) + ( digit - '0' );
 				}
-				dat->m_sValue = new char[sizeof(uint64)];
+				dat->m_sValue = dat->AllocValueString( sizeof(uint64) );
 				*((uint64 *)dat->m_sValue) = retVal;
 				dat->m_iDataType = TYPE_UINT64;
 			}
@@ -2574,7 +2819,7 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 			if (dat->m_iDataType == TYPE_STRING)
 			{
 				// copy in the string information
-				dat->m_sValue = new char[len+1];
+				dat->m_sValue = dat->AllocValueString( len + 1 );
 				Q_memcpy( dat->m_sValue, value, len+1 );
 			}
 
@@ -2726,8 +2971,10 @@ bool KeyValues::ReadAsBinary( CUtlBuffer &buffer, int nStackDepth )
 	if ( !buffer.IsValid() ) // must be valid, no overflows etc
 		return false;
 
+	char bArenaNode = m_bArenaNode;
 	RemoveEverything(); // remove current content
 	Init();	// reset
+	m_bArenaNode = bArenaNode;
 	
 	if ( nStackDepth > 100 )
 	{
@@ -2757,7 +3004,7 @@ bool KeyValues::ReadAsBinary( CUtlBuffer &buffer, int nStackDepth )
 		{
 		case TYPE_NONE:
 			{
-				dat->m_pSub = new KeyValues("");
+				dat->m_pSub = AllocNode( GetArena(), "" );
 				if ( !dat->m_pSub->ReadAsBinary( buffer, nStackDepth + 1 ) )
 					return false;
 				break;
@@ -2769,7 +3016,7 @@ bool KeyValues::ReadAsBinary( CUtlBuffer &buffer, int nStackDepth )
 				token[KEYVALUES_TOKEN_SIZE-1] = 0;
 
 				int len = Q_strlen( token );
-				dat->m_sValue = new char[len + 1];
+				dat->m_sValue = dat->AllocValueString( len + 1 );
 				Q_memcpy( dat->m_sValue, token, len+1 );
 								
 				break;
@@ -2788,7 +3035,7 @@ bool KeyValues::ReadAsBinary( CUtlBuffer &buffer, int nStackDepth )
 
 		case TYPE_UINT64:
 			{
-				dat->m_sValue = new char[sizeof(uint64)];
+				dat->m_sValue = dat->AllocValueString( sizeof(uint64) );
 				*((uint64 *)dat->m_sValue) = buffer.GetInt64();
 				break;
 			}
@@ -2831,7 +3078,7 @@ bool KeyValues::ReadAsBinary( CUtlBuffer &buffer, int nStackDepth )
 			break;
 
 		// new peer follows
-		dat->m_pPeer = new KeyValues("");
+		dat->m_pPeer = AllocNode( GetArena(), "" );
 		dat = dat->m_pPeer;
 	}
 
@@ -2846,12 +3093,14 @@ bool KeyValues::ReadAsBinary( CUtlBuffer &buffer, int nStackDepth )
 void *KeyValues::operator new( size_t iAllocSize )
 {
 	MEM_ALLOC_CREDIT();
+	++s_nKVHeapNodes;
 	return KeyValuesSystem()->AllocKeyValuesMemory( (int)iAllocSize );
 }
 
 void *KeyValues::operator new( size_t iAllocSize, int nBlockUse, const char *pFileName, int nLine )
 {
 	MemAlloc_PushAllocDbgInfo( pFileName, nLine );
+	++s_nKVHeapNodes;
 	void *p = KeyValuesSystem()->AllocKeyValuesMemory( (int)iAllocSize );
 	MemAlloc_PopAllocDbgInfo();
 	return p;
@@ -119,6 +119,86 @@ public:
 static CBitWriteMasksInit g_BitWriteMasksInit;
 
 
+//-----------------------------------------------------------------------------
+// Collects small fields LSB-first in a 64-bit word and hands them to
+// WriteUBitLong 32 bits at a time, so composite encodings (coords, normals,
+// varints) cost one or two masked stores instead of one per field. The
+// resulting bit stream is identical to writing each field separately.
+//-----------------------------------------------------------------------------
+class CBitWriteAccumulator
+{
+public:
+	CBitWriteAccumulator( bf_write *pBuf ) : m_pBuf( pBuf ), m_nAccum( 0 ), m_nAccumBits( 0 ) {}
+
+	BITBUF_INLINE void Add( uint32 nValue, int nBits )
+	{
+		Assert( nBits >= 0 && nBits <= 32 );
+		Assert( nBits == 32 || nValue < ( 1u << nBits ) );
+
+		m_nAccum |= (uint64)nValue << m_nAccumBits;
+		m_nAccumBits += nBits;
+		if ( m_nAccumBits >= 32 )
+		{
+			m_pBuf->WriteUBitLong( (uint32)m_nAccum, 32, false );
+			m_nAccum >>= 32;
+			m_nAccumBits -= 32;
+		}
+	}
+
+	BITBUF_INLINE void Flush()
+	{
+		if ( m_nAccumBits )
+		{
+			m_pBuf->WriteUBitLong( (uint32)m_nAccum, m_nAccumBits, false );
+			m_nAccum = 0;
+			m_nAccumBits = 0;
+		}
+	}
+
+private:
+	bf_write *m_pBuf;
+	uint64 m_nAccum;
+	int m_nAccumBits;
+};
+
+//-----------------------------------------------------------------------------
+// Branch-free BitCoord encoding: integer flag, fraction flag, then (if either
+// is set) sign bit, optional integer-1 and optional fraction, LSB first.
+// Returns the packed bits (at most 22) and their count.
+//-----------------------------------------------------------------------------
+static BITBUF_INLINE uint32 EncodeBitCoord( const float f, int &nBits )
+{
+	int		signbit = (f <= -COORD_RESOLUTION);
+	int		intval = (int)abs(f);
+	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
+
+	uint32	hasInt = ( intval != 0 );
+	uint32	hasFract = ( fractval != 0 );
+	uint32	hasAny = hasInt | hasFract;
+
+	// Adjust the integers from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1]
+	uint32	intbits = (uint32)( intval - 1 ) & ( ( 1 << COORD_INTEGER_BITS ) - 1 ) & ( 0 - hasInt );
+
+	nBits = 2 + hasAny + hasInt * COORD_INTEGER_BITS + hasFract * COORD_FRACTIONAL_BITS;
+	return hasInt | ( hasFract << 1 ) | ( ( signbit & hasAny ) << 2 ) | ( intbits << 3 ) | ( (uint32)fractval << ( 3 + hasInt * COORD_INTEGER_BITS ) );
+}
+
+// Sign bit followed by NORMAL_FRACTIONAL_BITS of fraction
+static BITBUF_INLINE uint32 EncodeBitNormal( float f )
+{
+	int	signbit = (f <= -NORMAL_RESOLUTION);
+
+	// NOTE: Since +/-1 are valid values for a normal, I'm going to encode that as all ones
+	unsigned int fractval = abs( (int)(f*NORMAL_DENOMINATOR) );
+
+	// clamp..
+	if (fractval > NORMAL_DENOMINATOR)
+		fractval = NORMAL_DENOMINATOR;
+
+	return signbit | ( fractval << 1 );
+}
+
+
 // ---------------------------------------------------------------------------------------- //
 // bf_write
 // ---------------------------------------------------------------------------------------- //
@@ -273,12 +353,14 @@ void bf_write::WriteVarInt32( uint32 data )
 	}
 	else // Slow path
 	{
+		CBitWriteAccumulator accum( this );
 		while ( data > 0x7F ) 
 		{
-			WriteUBitLong( (data & 0x7F) | 0x80, 8 );
+			accum.Add( (data & 0x7F) | 0x80, 8 );
 			data >>= 7;
 		}
-		WriteUBitLong( data & 0x7F, 8 );
+		accum.Add( data & 0x7F, 8 );
+		accum.Flush();
 	}
 }
 
@@ -387,12 +469,14 @@ void bf_write::WriteVarInt64( uint64 data )
 	}
 	else // slow path
 	{
+		CBitWriteAccumulator accum( this );
 		while ( data > 0x7F ) 
 		{
-			WriteUBitLong( (data & 0x7F) | 0x80, 8 );
+			accum.Add( (uint32)( (data & 0x7F) | 0x80 ), 8 );
 			data >>= 7;
 		}
-		WriteUBitLong( data & 0x7F, 8 );
+		accum.Add( (uint32)( data & 0x7F ), 8 );
+		accum.Flush();
 	}
 }
 
@@ -536,7 +620,42 @@ bool bf_write::WriteBits(const void *pInData, int nBits)
 
 bool bf_write::WriteBitsFromBuffer( bf_read *pIn, int nBits )
 {
-	// This could be optimized a little by
+	// The fast paths need both spans in bounds; otherwise the loop below sets the overflow flags
+	if ( IsPC() && nBits >= 64 && nBits <= GetNumBitsLeft() && nBits <= pIn->GetNumBitsLeft() )
+	{
+		if ( ( ( m_iCurBit | pIn->m_iCurBit ) & 7 ) == 0 )
+		{
+			// Both sides byte aligned, WriteBits does block copies of the whole bytes
+			int nByteBits = nBits & ~7;
+			WriteBits( pIn->m_pData + ( pIn->m_iCurBit >> 3 ), nByteBits );
+			pIn->SeekRelative( nByteBits );
+			nBits -= nByteBits;
+		}
+		else
+		{
+			// Bring the destination to a dword boundary, then store whole dwords
+			// straight from the reader instead of masking them in
+			int nHeadBits = ( 32 - ( m_iCurBit & 31 ) ) & 31;
+			if ( nHeadBits )
+			{
+				WriteUBitLong( pIn->ReadUBitLong( nHeadBits ), nHeadBits, false );
+				nBits -= nHeadBits;
+			}
+
+			uint32 * RESTRICT pOut = &m_pData[m_iCurBit >> 5];
+			while ( nBits >= 32 )
+			{
+				StoreLittleDWord( pOut, 0, pIn->ReadUBitLong( 32 ) );
+				++pOut;
+				m_iCurBit += 32;
+				nBits -= 32;
+			}
+		}
+
+		if ( nBits == 0 )
+			return !IsOverflowed() && !pIn->IsOverflowed();
+	}
+
 	while ( nBits > 32 )
 	{
 		WriteUBitLong( pIn->ReadUBitLong( 32 ), 32 );
@@ -621,34 +740,10 @@ void bf_write::WriteBitCoord (const float f)
 #if defined( BB_PROFILING )
 	VPROF( "bf_write::WriteBitCoord" );
 #endif
-	int		signbit = (f <= -COORD_RESOLUTION);
-	int		intval = (int)abs(f);
-	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
-
-
-	// Send the bit flags that indicate whether we have an integer part and/or a fraction part.
-	WriteOneBit( intval );
-	WriteOneBit( fractval );
-
-	if ( intval || fractval )
-	{
-		// Send the sign bit
-		WriteOneBit( signbit );
-
-		// Send the integer if we have one.
-		if ( intval )
-		{
-			// Adjust the integers from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1]
-			intval--;
-			WriteUBitLong( (unsigned int)intval, COORD_INTEGER_BITS );
-		}
-		
-		// Send the fraction if we have one
-		if ( fractval )
-		{
-			WriteUBitLong( (unsigned int)fractval, COORD_FRACTIONAL_BITS );
-		}
-	}
+	// Flags, sign, integer and fraction all go out in one store
+	int nBits;
+	uint32 bits = EncodeBitCoord( f, nBits );
+	WriteUBitLong( bits, nBits, false );
 }
 
 void bf_write::WriteBitVec3Coord( const Vector& fa )
@@ -659,34 +754,34 @@ void bf_write::WriteBitVec3Coord( const Vector& fa )
 	yflag = (fa[1] >= COORD_RESOLUTION) || (fa[1] <= -COORD_RESOLUTION);
 	zflag = (fa[2] >= COORD_RESOLUTION) || (fa[2] <= -COORD_RESOLUTION);
 
-	WriteOneBit( xflag );
-	WriteOneBit( yflag );
-	WriteOneBit( zflag );
+	CBitWriteAccumulator accum( this );
+	accum.Add( xflag | ( yflag << 1 ) | ( zflag << 2 ), 3 );
 
+	int nBits;
+	uint32 bits;
 	if ( xflag )
-		WriteBitCoord( fa[0] );
+	{
+		bits = EncodeBitCoord( fa[0], nBits );
+		accum.Add( bits, nBits );
+	}
 	if ( yflag )
-		WriteBitCoord( fa[1] );
+	{
+		bits = EncodeBitCoord( fa[1], nBits );
+		accum.Add( bits, nBits );
+	}
 	if ( zflag )
-		WriteBitCoord( fa[2] );
+	{
+		bits = EncodeBitCoord( fa[2], nBits );
+		accum.Add( bits, nBits );
+	}
+
+	accum.Flush();
 }
 
 void bf_write::WriteBitNormal( float f )
 {
-	int	signbit = (f <= -NORMAL_RESOLUTION);
-
-	// NOTE: Since +/-1 are valid values for a normal, I'm going to encode that as all ones
-	unsigned int fractval = abs( (int)(f*NORMAL_DENOMINATOR) );
-
-	// clamp..
-	if (fractval > NORMAL_DENOMINATOR)
-		fractval = NORMAL_DENOMINATOR;
-
-	// Send the sign bit
-	WriteOneBit( signbit );
-
-	// Send the fractional component
-	WriteUBitLong( fractval, NORMAL_FRACTIONAL_BITS );
+	// Sign bit and fractional component in one store
+	WriteUBitLong( EncodeBitNormal( f ), 1 + NORMAL_FRACTIONAL_BITS, false );
 }
 
 void bf_write::WriteBitVec3Normal( const Vector& fa )
@@ -696,17 +791,19 @@ void bf_write::WriteBitVec3Normal( const Vector& fa )
 	xflag = (fa[0] >= NORMAL_RESOLUTION) || (fa[0] <= -NORMAL_RESOLUTION);
 	yflag = (fa[1] >= NORMAL_RESOLUTION) || (fa[1] <= -NORMAL_RESOLUTION);
 
-	WriteOneBit( xflag );
-	WriteOneBit( yflag );
+	CBitWriteAccumulator accum( this );
+	accum.Add( xflag | ( yflag << 1 ), 2 );
 
 	if ( xflag )
-		WriteBitNormal( fa[0] );
+		accum.Add( EncodeBitNormal( fa[0] ), 1 + NORMAL_FRACTIONAL_BITS );
 	if ( yflag )
-		WriteBitNormal( fa[1] );
+		accum.Add( EncodeBitNormal( fa[1] ), 1 + NORMAL_FRACTIONAL_BITS );
 	
 	// Write z sign bit
 	int	signbit = (fa[2] <= -NORMAL_RESOLUTION);
-	WriteOneBit( signbit );
+	accum.Add( signbit, 1 );
+
+	accum.Flush();
 }
 
 void bf_write::WriteBitAngles( const QAngle& fa )
@@ -892,6 +989,18 @@ void bf_read::ReadBits(void *pOutData, int nBits)
 		nBitsLeft -= 8;
 	}
 
+	if ( IsPC() && nBitsLeft >= 32 && (m_iCurBit & 7) == 0 && GetNumBitsLeft() >= nBitsLeft )
+	{
+		// current bit is byte aligned, do block copy
+		int numbytes = nBitsLeft >> 3;
+		int numbits = numbytes << 3;
+
+		Q_memcpy( pOut, m_pData + (m_iCurBit >> 3), numbytes );
+		pOut += numbytes;
+		nBitsLeft -= numbits;
+		m_iCurBit += numbits;
+	}
+
 	// X360TBD: Can't read dwords in ReadBits because they'll get swapped
 	if ( IsPC() )
 	{
@@ -1024,6 +1133,21 @@ uint32 bf_read::ReadVarInt32()
 	int count = 0;
 	uint32 b;
 
+	// Byte aligned with room for the longest encoding, decode straight from memory
+	if ( (m_iCurBit & 7) == 0 && GetNumBitsLeft() >= bitbuf::kMaxVarint32Bytes * 8 )
+	{
+		const uint8 *pIn = m_pData + (m_iCurBit >> 3);
+		do
+		{
+			b = pIn[count];
+			result |= (b & 0x7F) << (7 * count);
+			++count;
+		} while ( (b & 0x80) && count < bitbuf::kMaxVarint32Bytes );
+
+		m_iCurBit += count * 8;
+		return result;
+	}
+
 	do 
 	{
 		if ( count == bitbuf::kMaxVarint32Bytes ) 
@@ -1088,29 +1212,34 @@ float bf_read::ReadBitCoord (void)
 	int		intval=0,fractval=0,signbit=0;
 	float	value = 0.0;
 
-
 	// Read the required integer and fraction flags
-	intval = ReadOneBit();
-	fractval = ReadOneBit();
+	unsigned int flags = ReadUBitLong( 2 );
 
 	// If we got either parse them, otherwise it's a zero.
-	if ( intval || fractval )
+	if ( flags )
 	{
-		// Read the sign bit
-		signbit = ReadOneBit();
+		// Sign bit, integer and fraction come in with a single read
+		static const int numbits_table[3] =
+		{
+			1 + COORD_INTEGER_BITS,
+			1 + COORD_FRACTIONAL_BITS,
+			1 + COORD_INTEGER_BITS + COORD_FRACTIONAL_BITS
+		};
+		unsigned int bits = ReadUBitLong( numbits_table[ flags-1 ] );
 
-		// If there's an integer, read it in
-		if ( intval )
+		signbit = bits & 1;
+		bits >>= 1;
+
+		// If there's an integer, take it
+		if ( flags & 1 )
 		{
 			// Adjust the integers from [0..MAX_COORD_VALUE-1] to [1..MAX_COORD_VALUE]
-			intval = ReadUBitLong( COORD_INTEGER_BITS ) + 1;
+			intval = ( bits & ( ( 1 << COORD_INTEGER_BITS ) - 1 ) ) + 1;
+			bits >>= COORD_INTEGER_BITS;
 		}
 
-		// If there's a fraction, read it in
-		if ( fractval )
-		{
-			fractval = ReadUBitLong( COORD_FRACTIONAL_BITS );
-		}
+		// Whatever is left is the fraction
+		fractval = bits;
 
 		// Calculate the correct floating point value
 		value = intval + ((float)fractval * COORD_RESOLUTION);
@@ -1276,9 +1405,10 @@ void bf_read::ReadBitVec3Coord( Vector& fa )
 	// the corresponding component will not be read and will be stack garbage.
 	fa.Init( 0, 0, 0 );
 
-	xflag = ReadOneBit();
-	yflag = ReadOneBit(); 
-	zflag = ReadOneBit();
+	unsigned int flags = ReadUBitLong( 3 );
+	xflag = flags & 1;
+	yflag = flags & 2;
+	zflag = flags & 4;
 
 	if ( xflag )
 		fa[0] = ReadBitCoord();
@@ -1290,11 +1420,10 @@ void bf_read::ReadBitVec3Coord( Vector& fa )
 
 float bf_read::ReadBitNormal (void)
 {
-	// Read the sign bit
-	int	signbit = ReadOneBit();
-
-	// Read the fractional part
-	unsigned int fractval = ReadUBitLong( NORMAL_FRACTIONAL_BITS );
+	// Read the sign bit and the fractional part
+	unsigned int bits = ReadUBitLong( 1 + NORMAL_FRACTIONAL_BITS );
+	int	signbit = bits & 1;
+	unsigned int fractval = bits >> 1;
 
 	// Calculate the correct floating point value
 	float value = (float)fractval * NORMAL_RESOLUTION;
@@ -1308,8 +1437,9 @@ float bf_read::ReadBitNormal (void)
 
 void bf_read::ReadBitVec3Normal( Vector& fa )
 {
-	int xflag = ReadOneBit();
-	int yflag = ReadOneBit(); 
+	unsigned int flags = ReadUBitLong( 2 );
+	int xflag = flags & 1;
+	int yflag = flags & 2;
 
 	if (xflag)
 		fa[0] = ReadBitNormal();
@@ -0,0 +1,651 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Checks the bf_write/bf_read coordinate, normal, varint and bulk
+//			copy routines against the straightforward bit-at-a-time versions
+//			they replaced, and times both.  The bit layout of these routines
+//			is a wire format shared with the engine, so the fuzz pass must
+//			report zero mismatches before a change to bitbuf.cpp ships.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include <stdio.h>
+#include "tier1/bitbuf.h"
+#include "tier0/icommandline.h"
+#include "tier0/dbg.h"
+#include "vstdlib/random.h"
+#include "mathlib/mathlib.h"
+#include "coordsize.h"
+
+
+#define FUZZ_BUFFER_DWORDS	128
+#define FUZZ_MAX_OPS		8
+#define FUZZ_MAX_COPY_BITS	700
+
+static int s_nIterations = 100000;
+static int s_nBenchIterations = 20000;
+
+
+//-----------------------------------------------------------------------------
+// Reference implementations.  These are the bitbuf.cpp bodies from before the
+// word-sized packing, built only on WriteOneBit/WriteUBitLong and
+// ReadOneBit/ReadUBitLong, so they encode exactly what the old code did.
+//-----------------------------------------------------------------------------
+static void Ref_WriteVarInt32( bf_write &buf, uint32 data )
+{
+	// The old aligned fast path stored these same bytes directly
+	while ( data > 0x7F )
+	{
+		buf.WriteUBitLong( (data & 0x7F) | 0x80, 8 );
+		data >>= 7;
+	}
+	buf.WriteUBitLong( data & 0x7F, 8 );
+}
+
+static void Ref_WriteVarInt64( bf_write &buf, uint64 data )
+{
+	while ( data > 0x7F )
+	{
+		buf.WriteUBitLong( (data & 0x7F) | 0x80, 8 );
+		data >>= 7;
+	}
+	buf.WriteUBitLong( data & 0x7F, 8 );
+}
+
+static bool Ref_WriteBitsFromBuffer( bf_write &buf, bf_read *pIn, int nBits )
+{
+	while ( nBits > 32 )
+	{
+		buf.WriteUBitLong( pIn->ReadUBitLong( 32 ), 32 );
+		nBits -= 32;
+	}
+
+	buf.WriteUBitLong( pIn->ReadUBitLong( nBits ), nBits );
+	return !buf.IsOverflowed() && !pIn->IsOverflowed();
+}
+
+static void Ref_WriteBitCoord( bf_write &buf, const float f )
+{
+	int		signbit = (f <= -COORD_RESOLUTION);
+	int		intval = (int)abs(f);
+	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
+
+	buf.WriteOneBit( intval );
+	buf.WriteOneBit( fractval );
+
+	if ( intval || fractval )
+	{
+		buf.WriteOneBit( signbit );
+
+		if ( intval )
+		{
+			intval--;
+			buf.WriteUBitLong( (unsigned int)intval, COORD_INTEGER_BITS );
+		}
+
+		if ( fractval )
+		{
+			buf.WriteUBitLong( (unsigned int)fractval, COORD_FRACTIONAL_BITS );
+		}
+	}
+}
+
+static void Ref_WriteBitVec3Coord( bf_write &buf, const Vector& fa )
+{
+	int		xflag, yflag, zflag;
+
+	xflag = (fa[0] >= COORD_RESOLUTION) || (fa[0] <= -COORD_RESOLUTION);
+	yflag = (fa[1] >= COORD_RESOLUTION) || (fa[1] <= -COORD_RESOLUTION);
+	zflag = (fa[2] >= COORD_RESOLUTION) || (fa[2] <= -COORD_RESOLUTION);
+
+	buf.WriteOneBit( xflag );
+	buf.WriteOneBit( yflag );
+	buf.WriteOneBit( zflag );
+
+	if ( xflag )
+		Ref_WriteBitCoord( buf, fa[0] );
+	if ( yflag )
+		Ref_WriteBitCoord( buf, fa[1] );
+	if ( zflag )
+		Ref_WriteBitCoord( buf, fa[2] );
+}
+
+static void Ref_WriteBitNormal( bf_write &buf, float f )
+{
+	int	signbit = (f <= -NORMAL_RESOLUTION);
+
+	unsigned int fractval = abs( (int)(f*NORMAL_DENOMINATOR) );
+	if (fractval > NORMAL_DENOMINATOR)
+		fractval = NORMAL_DENOMINATOR;
+
+	buf.WriteOneBit( signbit );
+	buf.WriteUBitLong( fractval, NORMAL_FRACTIONAL_BITS );
+}
+
+static void Ref_WriteBitVec3Normal( bf_write &buf, const Vector& fa )
+{
+	int		xflag, yflag;
+
+	xflag = (fa[0] >= NORMAL_RESOLUTION) || (fa[0] <= -NORMAL_RESOLUTION);
+	yflag = (fa[1] >= NORMAL_RESOLUTION) || (fa[1] <= -NORMAL_RESOLUTION);
+
+	buf.WriteOneBit( xflag );
+	buf.WriteOneBit( yflag );
+
+	if ( xflag )
+		Ref_WriteBitNormal( buf, fa[0] );
+	if ( yflag )
+		Ref_WriteBitNormal( buf, fa[1] );
+
+	int	signbit = (fa[2] <= -NORMAL_RESOLUTION);
+	buf.WriteOneBit( signbit );
+}
+
+static void Ref_ReadBits( bf_read &buf, void *pOutData, int nBits )
+{
+	unsigned char *pOut = (unsigned char*)pOutData;
+	int nBitsLeft = nBits;
+
+	while( ((uintp)pOut & 3) != 0 && nBitsLeft >= 8 )
+	{
+		*pOut = (unsigned char)buf.ReadUBitLong(8);
+		++pOut;
+		nBitsLeft -= 8;
+	}
+
+	if ( IsPC() )
+	{
+		while ( nBitsLeft >= 32 )
+		{
+			*((uint32*)pOut) = buf.ReadUBitLong(32);
+			pOut += sizeof(uint32);
+			nBitsLeft -= 32;
+		}
+	}
+
+	while ( nBitsLeft >= 8 )
+	{
+		*pOut = buf.ReadUBitLong(8);
+		++pOut;
+		nBitsLeft -= 8;
+	}
+
+	if ( nBitsLeft )
+	{
+		*pOut = buf.ReadUBitLong(nBitsLeft);
+	}
+}
+
+static uint32 Ref_ReadVarInt32( bf_read &buf )
+{
+	uint32 result = 0;
+	int count = 0;
+	uint32 b;
+
+	do
+	{
+		if ( count == bitbuf::kMaxVarint32Bytes )
+		{
+			return result;
+		}
+		b = buf.ReadUBitLong( 8 );
+		result |= (b & 0x7F) << (7 * count);
+		++count;
+	} while (b & 0x80);
+
+	return result;
+}
+
+static float Ref_ReadBitCoord( bf_read &buf )
+{
+	int		intval=0,fractval=0,signbit=0;
+	float	value = 0.0;
+
+	intval = buf.ReadOneBit();
+	fractval = buf.ReadOneBit();
+
+	if ( intval || fractval )
+	{
+		signbit = buf.ReadOneBit();
+
+		if ( intval )
+		{
+			intval = buf.ReadUBitLong( COORD_INTEGER_BITS ) + 1;
+		}
+
+		if ( fractval )
+		{
+			fractval = buf.ReadUBitLong( COORD_FRACTIONAL_BITS );
+		}
+
+		value = intval + ((float)fractval * COORD_RESOLUTION);
+
+		if ( signbit )
+			value = -value;
+	}
+
+	return value;
+}
+
+static void Ref_ReadBitVec3Coord( bf_read &buf, Vector& fa )
+{
+	int		xflag, yflag, zflag;
+
+	fa.Init( 0, 0, 0 );
+
+	xflag = buf.ReadOneBit();
+	yflag = buf.ReadOneBit();
+	zflag = buf.ReadOneBit();
+
+	if ( xflag )
+		fa[0] = Ref_ReadBitCoord( buf );
+	if ( yflag )
+		fa[1] = Ref_ReadBitCoord( buf );
+	if ( zflag )
+		fa[2] = Ref_ReadBitCoord( buf );
+}
+
+static float Ref_ReadBitNormal( bf_read &buf )
+{
+	int	signbit = buf.ReadOneBit();
+	unsigned int fractval = buf.ReadUBitLong( NORMAL_FRACTIONAL_BITS );
+	float value = (float)fractval * NORMAL_RESOLUTION;
+
+	if ( signbit )
+		value = -value;
+
+	return value;
+}
+
+static void Ref_ReadBitVec3Normal( bf_read &buf, Vector& fa )
+{
+	int xflag = buf.ReadOneBit();
+	int yflag = buf.ReadOneBit();
+
+	if (xflag)
+		fa[0] = Ref_ReadBitNormal( buf );
+	else
+		fa[0] = 0.0f;
+
+	if (yflag)
+		fa[1] = Ref_ReadBitNormal( buf );
+	else
+		fa[1] = 0.0f;
+
+	int znegative = buf.ReadOneBit();
+
+	float fafafbfb = fa[0] * fa[0] + fa[1] * fa[1];
+	if (fafafbfb < 1.0f)
+		fa[2] = sqrt( 1.0f - fafafbfb );
+	else
+		fa[2] = 0.0f;
+
+	if (znegative)
+		fa[2] = -fa[2];
+}
+
+
+//-----------------------------------------------------------------------------
+// Fuzz operations.  Each op is written and read back with both the current
+// and the reference code; the buffers, bit positions, decoded values and
+// overflow flags must all match.
+//-----------------------------------------------------------------------------
+enum BitBufOp_t
+{
+	OP_COORD = 0,
+	OP_VEC3COORD,
+	OP_NORMAL,
+	OP_VEC3NORMAL,
+	OP_VARINT32,
+	OP_VARINT64,
+	OP_BITSFROMBUFFER,
+
+	OP_COUNT
+};
+
+static const char *s_pOpNames[OP_COUNT] =
+{
+	"BitCoord",
+	"BitVec3Coord",
+	"BitNormal",
+	"BitVec3Normal",
+	"VarInt32",
+	"VarInt64",
+	"BitsFromBuffer",
+};
+
+struct FuzzOp_t
+{
+	int		m_nOp;
+	bool	m_bAlign;		// seek to a byte boundary first so the aligned paths get hit
+	Vector	m_vec;
+	uint64	m_nValue;
+	int		m_nSrcBit;
+	int		m_nBits;
+	int		m_nOutOffset;	// misaligns the ReadBits destination
+};
+
+struct ReadResult_t
+{
+	Vector	m_vec;
+	uint64	m_nValue;
+	int		m_nBit;
+	bool	m_bOverflowed;
+	uint8	m_Bits[FUZZ_MAX_COPY_BITS / 8 + 8];
+};
+
+static uint32 s_SrcData[FUZZ_BUFFER_DWORDS];
+
+static float RandomCoord( CUniformRandomStream &rand )
+{
+	float flUnit = rand.RandomFloat( -1.0f, 1.0f );
+	switch ( rand.RandomInt( 0, 5 ) )
+	{
+	case 0:	return flUnit * MAX_COORD_INTEGER;
+	case 1:	return flUnit;
+	case 2:	return 0.0f;
+	case 3:	return flUnit * COORD_RESOLUTION * 2.0f;		// straddles the zero flag threshold
+	case 4:	return (float)rand.RandomInt( -MAX_COORD_INTEGER, MAX_COORD_INTEGER );
+	default: return flUnit * 100.0f;
+	}
+}
+
+static void RandomOp( CUniformRandomStream &rand, FuzzOp_t &op )
+{
+	op.m_nOp = rand.RandomInt( 0, OP_COUNT - 1 );
+	op.m_bAlign = ( rand.RandomInt( 0, 2 ) == 0 );
+	op.m_vec.Init( RandomCoord( rand ), RandomCoord( rand ), RandomCoord( rand ) );
+	if ( op.m_nOp == OP_NORMAL || op.m_nOp == OP_VEC3NORMAL )
+	{
+		op.m_vec.Init( rand.RandomFloat( -1.1f, 1.1f ), rand.RandomFloat( -1.0f, 1.0f ), rand.RandomFloat( -1.0f, 1.0f ) );
+		if ( rand.RandomInt( 0, 3 ) == 0 )
+		{
+			op.m_vec.x = rand.RandomFloat( -NORMAL_RESOLUTION, NORMAL_RESOLUTION ) * 2.0f;
+		}
+	}
+	op.m_nValue = ( (uint64)rand.RandomInt( 0, 0x7fffffff ) << 33 ) ^ ( (uint64)rand.RandomInt( 0, 0x7fffffff ) << 11 ) ^ (uint64)rand.RandomInt( 0, 0x7fffffff );
+	op.m_nValue >>= rand.RandomInt( 0, 63 );
+	op.m_nSrcBit = rand.RandomInt( 0, 199 );
+	op.m_nBits = rand.RandomInt( 1, FUZZ_MAX_COPY_BITS );
+	op.m_nOutOffset = rand.RandomInt( 0, 3 );
+}
+
+static void WriteOp( bf_write &buf, const FuzzOp_t &op, bool bReference )
+{
+	if ( op.m_bAlign )
+	{
+		buf.SeekToBit( ( buf.GetNumBitsWritten() + 7 ) & ~7 );
+	}
+
+	switch ( op.m_nOp )
+	{
+	case OP_COORD:
+		bReference ? Ref_WriteBitCoord( buf, op.m_vec.x ) : buf.WriteBitCoord( op.m_vec.x );
+		break;
+	case OP_VEC3COORD:
+		bReference ? Ref_WriteBitVec3Coord( buf, op.m_vec ) : buf.WriteBitVec3Coord( op.m_vec );
+		break;
+	case OP_NORMAL:
+		bReference ? Ref_WriteBitNormal( buf, op.m_vec.x ) : buf.WriteBitNormal( op.m_vec.x );
+		break;
+	case OP_VEC3NORMAL:
+		bReference ? Ref_WriteBitVec3Normal( buf, op.m_vec ) : buf.WriteBitVec3Normal( op.m_vec );
+		break;
+	case OP_VARINT32:
+		bReference ? Ref_WriteVarInt32( buf, (uint32)op.m_nValue ) : buf.WriteVarInt32( (uint32)op.m_nValue );
+		break;
+	case OP_VARINT64:
+		bReference ? Ref_WriteVarInt64( buf, op.m_nValue ) : buf.WriteVarInt64( op.m_nValue );
+		break;
+	case OP_BITSFROMBUFFER:
+		{
+			bf_read src( s_SrcData, sizeof( s_SrcData ) );
+			src.Seek( op.m_nSrcBit );
+			bReference ? Ref_WriteBitsFromBuffer( buf, &src, op.m_nBits ) : buf.WriteBitsFromBuffer( &src, op.m_nBits );
+		}
+		break;
+	}
+}
+
+static void ReadOp( bf_read &buf, const FuzzOp_t &op, bool bReference, ReadResult_t &result )
+{
+	memset( &result, 0, sizeof( result ) );
+
+	if ( op.m_bAlign )
+	{
+		buf.Seek( ( buf.GetNumBitsRead() + 7 ) & ~7 );
+	}
+
+	switch ( op.m_nOp )
+	{
+	case OP_COORD:
+		result.m_vec.x = bReference ? Ref_ReadBitCoord( buf ) : buf.ReadBitCoord();
+		break;
+	case OP_VEC3COORD:
+		bReference ? Ref_ReadBitVec3Coord( buf, result.m_vec ) : buf.ReadBitVec3Coord( result.m_vec );
+		break;
+	case OP_NORMAL:
+		result.m_vec.x = bReference ? Ref_ReadBitNormal( buf ) : buf.ReadBitNormal();
+		break;
+	case OP_VEC3NORMAL:
+		bReference ? Ref_ReadBitVec3Normal( buf, result.m_vec ) : buf.ReadBitVec3Normal( result.m_vec );
+		break;
+	case OP_VARINT32:
+		result.m_nValue = bReference ? Ref_ReadVarInt32( buf ) : buf.ReadVarInt32();
+		break;
+	case OP_VARINT64:
+		result.m_nValue = buf.ReadVarInt64();
+		break;
+	case OP_BITSFROMBUFFER:
+		bReference ? Ref_ReadBits( buf, result.m_Bits + op.m_nOutOffset, op.m_nBits ) : buf.ReadBits( result.m_Bits + op.m_nOutOffset, op.m_nBits );
+		break;
+	}
+
+	result.m_nBit = buf.GetNumBitsRead();
+	result.m_bOverflowed = buf.IsOverflowed();
+}
+
+static int s_nMismatches = 0;
+
+static void ReportMismatch( int nIteration, const FuzzOp_t &op, const char *pszWhat )
+{
+	if ( s_nMismatches++ < 20 )
+	{
+		Warning( "iteration %d: %s %s differs (value %f %f %f / %llu, start %d, bits %d)\n",
+			nIteration, s_pOpNames[op.m_nOp], pszWhat, op.m_vec.x, op.m_vec.y, op.m_vec.z,
+			(unsigned long long)op.m_nValue, op.m_nSrcBit, op.m_nBits );
+	}
+}
+
+static void FuzzSequence( CUniformRandomStream &rand, int nIteration )
+{
+	uint32 newData[FUZZ_BUFFER_DWORDS], refData[FUZZ_BUFFER_DWORDS];
+
+	// Random contents so stores that don't mask the neighbouring bits show up
+	for ( int i = 0; i < FUZZ_BUFFER_DWORDS; i++ )
+	{
+		newData[i] = refData[i] = (uint32)rand.RandomInt( 0, 0x7fffffff ) * 2654435761u;
+		s_SrcData[i] = (uint32)rand.RandomInt( 0, 0x7fffffff ) * 40503u ^ (uint32)rand.RandomInt( 0, 0x7fffffff );
+	}
+
+	FuzzOp_t ops[FUZZ_MAX_OPS];
+	int nOps = rand.RandomInt( 1, FUZZ_MAX_OPS );
+	int nStartBit = rand.RandomInt( 0, 63 );
+
+	bf_write newBuf( newData, sizeof( newData ) ), refBuf( refData, sizeof( refData ) );
+	newBuf.SetAssertOnOverflow( false );
+	refBuf.SetAssertOnOverflow( false );
+	newBuf.SeekToBit( nStartBit );
+	refBuf.SeekToBit( nStartBit );
+
+	for ( int i = 0; i < nOps; i++ )
+	{
+		RandomOp( rand, ops[i] );
+		WriteOp( newBuf, ops[i], false );
+		WriteOp( refBuf, ops[i], true );
+
+		if ( newBuf.GetNumBitsWritten() != refBuf.GetNumBitsWritten() || newBuf.IsOverflowed() != refBuf.IsOverflowed() )
+		{
+			ReportMismatch( nIteration, ops[i], "write position" );
+			return;
+		}
+	}
+
+	if ( memcmp( newData, refData, sizeof( newData ) ) )
+	{
+		ReportMismatch( nIteration, ops[nOps - 1], "written bits" );
+		return;
+	}
+
+	// Read the same stream back both ways
+	bf_read newRead( newData, sizeof( newData ) ), refRead( refData, sizeof( refData ) );
+	newRead.SetAssertOnOverflow( false );
+	refRead.SetAssertOnOverflow( false );
+	newRead.Seek( nStartBit );
+	refRead.Seek( nStartBit );
+
+	for ( int i = 0; i < nOps; i++ )
+	{
+		ReadResult_t newResult, refResult;
+		ReadOp( newRead, ops[i], false, newResult );
+		ReadOp( refRead, ops[i], true, refResult );
+		if ( memcmp( &newResult, &refResult, sizeof( newResult ) ) )
+		{
+			ReportMismatch( nIteration, ops[i], "read back" );
+			return;
+		}
+	}
+}
+
+static void FuzzOverflow( CUniformRandomStream &rand, int nIteration )
+{
+	// Buffers too small for the op; only the overflow flags have to agree
+	uint32 newData[2] = { 0, 0 }, refData[2] = { 0, 0 };
+	int nMaxBits = rand.RandomInt( 1, 64 );
+	int nStartBit = rand.RandomInt( 0, nMaxBits - 1 );
+
+	FuzzOp_t op;
+	RandomOp( rand, op );
+	op.m_bAlign = false;
+	if ( op.m_nOp == OP_BITSFROMBUFFER )
+	{
+		op.m_nOp = OP_VEC3COORD;
+	}
+
+	bf_write newBuf( newData, sizeof( newData ), nMaxBits ), refBuf( refData, sizeof( refData ), nMaxBits );
+	newBuf.SetAssertOnOverflow( false );
+	refBuf.SetAssertOnOverflow( false );
+	newBuf.SeekToBit( nStartBit );
+	refBuf.SeekToBit( nStartBit );
+	WriteOp( newBuf, op, false );
+	WriteOp( refBuf, op, true );
+	if ( newBuf.IsOverflowed() != refBuf.IsOverflowed() )
+	{
+		ReportMismatch( nIteration, op, "write overflow" );
+		return;
+	}
+
+	// What lands in the buffer before the overflow isn't part of the format,
+	// so both readers walk the reference output
+	bf_read newRead( refData, sizeof( refData ), nMaxBits ), refRead( refData, sizeof( refData ), nMaxBits );
+	newRead.SetAssertOnOverflow( false );
+	refRead.SetAssertOnOverflow( false );
+	newRead.Seek( nStartBit );
+	refRead.Seek( nStartBit );
+
+	ReadResult_t newResult, refResult;
+	ReadOp( newRead, op, false, newResult );
+	ReadOp( refRead, op, true, refResult );
+	if ( newResult.m_bOverflowed != refResult.m_bOverflowed )
+	{
+		ReportMismatch( nIteration, op, "read overflow" );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Throughput: the same encode/decode loop through either implementation
+//-----------------------------------------------------------------------------
+static double RunBench( bool bReference )
+{
+	static uint32 data[16384];
+	static uint8 copy[8192];
+
+	double flStart = Plat_FloatTime();
+	for ( int nIter = 0; nIter < s_nBenchIterations; nIter++ )
+	{
+		bf_write buf( data, sizeof( data ) );
+		buf.SeekToBit( nIter & 31 );
+		for ( int i = 0; i < 200; i++ )
+		{
+			Vector vec( i * 3.7f, -i * 1.3f, i * 0.21f );
+			Vector normal( 0.36f, -0.48f, 0.8f );
+			bReference ? Ref_WriteBitVec3Coord( buf, vec ) : buf.WriteBitVec3Coord( vec );
+			bReference ? Ref_WriteBitVec3Normal( buf, normal ) : buf.WriteBitVec3Normal( normal );
+			bReference ? Ref_WriteBitCoord( buf, vec.x ) : buf.WriteBitCoord( vec.x );
+			bReference ? Ref_WriteVarInt32( buf, i * 977 ) : buf.WriteVarInt32( i * 977 );
+		}
+
+		bf_read read( data, sizeof( data ) );
+		read.Seek( nIter & 31 );
+		for ( int i = 0; i < 200; i++ )
+		{
+			Vector vec, normal;
+			bReference ? Ref_ReadBitVec3Coord( read, vec ) : read.ReadBitVec3Coord( vec );
+			bReference ? Ref_ReadBitVec3Normal( read, normal ) : read.ReadBitVec3Normal( normal );
+			bReference ? Ref_ReadBitCoord( read ) : read.ReadBitCoord();
+			bReference ? Ref_ReadVarInt32( read ) : read.ReadVarInt32();
+		}
+
+		// Unaligned bulk copy, as done when relaying entity deltas
+		bf_read src( data, sizeof( data ) );
+		src.Seek( 3 );
+		bf_write dest( data + 8192, sizeof( data ) / 2 );
+		dest.SeekToBit( 5 );
+		bReference ? Ref_WriteBitsFromBuffer( dest, &src, 60000 ) : dest.WriteBitsFromBuffer( &src, 60000 );
+
+		bf_read readBack( data + 8192, sizeof( data ) / 2 );
+		readBack.Seek( 5 );
+		bReference ? Ref_ReadBits( readBack, copy, 60000 ) : readBack.ReadBits( copy, 60000 );
+	}
+	return Plat_FloatTime() - flStart;
+}
+
+
+void PrintUsage()
+{
+	Msg( "usage: bitbuftest [-iterations <count>] [-benchiterations <count>] [-seed <n>] [-nobench]\n" );
+}
+
+int main( int argc, char **argv )
+{
+	CommandLine()->CreateCmdLine( argc, argv );
+
+	if ( CommandLine()->FindParm( "-?" ) || CommandLine()->FindParm( "-help" ) )
+	{
+		PrintUsage();
+		return 0;
+	}
+
+	s_nIterations = max( CommandLine()->ParmValue( "-iterations", s_nIterations ), 1 );
+	s_nBenchIterations = max( CommandLine()->ParmValue( "-benchiterations", s_nBenchIterations ), 1 );
+
+	CUniformRandomStream rand;
+	rand.SetSeed( CommandLine()->ParmValue( "-seed", 1234 ) );
+
+	for ( int i = 0; i < s_nIterations; i++ )
+	{
+		FuzzSequence( rand, i );
+		FuzzOverflow( rand, i );
+	}
+	Msg( "%d fuzz iterations, %d mismatches\n", s_nIterations, s_nMismatches );
+
+	if ( !CommandLine()->FindParm( "-nobench" ) )
+	{
+		double flRef = RunBench( true );
+		double flNew = RunBench( false );
+		Msg( "reference %.3f s   current %.3f s   (%.2fx)\n", flRef, flNew, flRef / max( flNew, 1.0e-6 ) );
+	}
+
+	return s_nMismatches ? 1 : 0;
+}
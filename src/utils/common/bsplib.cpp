@@ -6,6 +6,20 @@
 // $NoKeywords: $
 //=============================================================================//
 
+#include "tier0/platform.h"
+#ifdef IS_WINDOWS_PC
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef _LINUX
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
 #include "cmdlib.h"
 #include "mathlib/mathlib.h"
 #include "bsplib.h"
@@ -703,6 +717,7 @@ template <class T> static void WriteData( T *pData, int count = 1 );
 template <class T> static void WriteData( int fieldType, T *pData, int count = 1 );
 template< class T > static void AddLump( int lumpnum, T *pData, int count, int version = 0 );
 template< class T > static void AddLump( int lumpnum, CUtlVector<T> &data, int version = 0 );
+static void AddPassThroughLump( int lumpnum );
 
 dheader_t		*g_pBSPHeader;
 FileHandle_t	g_hBSPFile;
@@ -717,6 +732,156 @@ struct Lump_t
 CGameLump	g_GameLumps;
 
 static IZip *s_pakFile = 0;
+static bool s_bPakFileDirty = true;		// changed since LoadBSPFile parsed it
+
+//-----------------------------------------------------------------------------
+// LoadBSPFile maps the BSP instead of reading it into memory. Afterwards it stays
+// mapped if any lumps were left in it: the unknown lumps, and the pakfile until
+// something changes it. WriteBSPFile copies those file to file instead of
+// through memory, so they are never read by the tool at all.
+//-----------------------------------------------------------------------------
+struct BSPFileMapping_t
+{
+	byte		*m_pBase;			// NULL when nothing is mapped
+	int64		m_nSize;
+#ifdef IS_WINDOWS_PC
+	HANDLE		m_hFile;
+	HANDLE		m_hMapping;
+#else
+	int			m_nFile;
+#endif
+};
+
+static BSPFileMapping_t s_OpenMapping;				// backs g_pBSPHeader between OpenBSPFile and CloseBSPFile
+static BSPFileMapping_t s_SourceMapping;			// the last loaded BSP, while lumps are left in it
+static lump_t s_SourceLumps[HEADER_LUMPS];
+static bool s_bSourcePassThrough[HEADER_LUMPS];	// left in the source and copied from there on write
+
+// A pass-through lump WriteBSPFile left a hole for, filled once the file is closed
+struct DeferredLumpCopy_t
+{
+	int		m_nLump;
+	int		m_nSrcOffset;
+	int		m_nDstOffset;
+	int		m_nLength;
+};
+
+static CUtlVector<DeferredLumpCopy_t> s_DeferredLumpCopies;
+
+// Time spent reading and writing each lump, printed in verbose mode
+static double s_flLumpLoadTime[HEADER_LUMPS];
+static double s_flLumpWriteTime[HEADER_LUMPS];
+
+static bool MapBSPFile( const char *filename, BSPFileMapping_t &mapping )
+{
+	memset( &mapping, 0, sizeof( mapping ) );
+
+#ifdef IS_WINDOWS_PC
+	HANDLE hFile = ::CreateFile( filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER size;
+	if ( !::GetFileSizeEx( hFile, &size ) || size.QuadPart < (LONGLONG)sizeof( dheader_t ) )
+	{
+		::CloseHandle( hFile );
+		return false;
+	}
+
+	// Copy on write, swapping on load changes the data in place
+	HANDLE hMapping = ::CreateFileMapping( hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+	if ( !hMapping )
+	{
+		::CloseHandle( hFile );
+		return false;
+	}
+
+	void *pBase = ::MapViewOfFile( hMapping, FILE_MAP_COPY, 0, 0, 0 );
+	if ( !pBase )
+	{
+		::CloseHandle( hMapping );
+		::CloseHandle( hFile );
+		return false;
+	}
+
+	mapping.m_hFile = hFile;
+	mapping.m_hMapping = hMapping;
+	mapping.m_nSize = size.QuadPart;
+#else
+	int nFile = open( filename, O_RDONLY );
+	if ( nFile < 0 )
+		return false;
+
+	struct stat st;
+	if ( fstat( nFile, &st ) != 0 || st.st_size < (off_t)sizeof( dheader_t ) )
+	{
+		close( nFile );
+		return false;
+	}
+
+	// Copy on write, swapping on load changes the data in place
+	void *pBase = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, nFile, 0 );
+	if ( pBase == MAP_FAILED )
+	{
+		close( nFile );
+		return false;
+	}
+
+	mapping.m_nFile = nFile;
+	mapping.m_nSize = st.st_size;
+#endif
+
+	mapping.m_pBase = (byte *)pBase;
+	return true;
+}
+
+static void UnmapBSPFile( BSPFileMapping_t &mapping )
+{
+	if ( !mapping.m_pBase )
+		return;
+
+#ifdef IS_WINDOWS_PC
+	::UnmapViewOfFile( mapping.m_pBase );
+	::CloseHandle( mapping.m_hMapping );
+	::CloseHandle( mapping.m_hFile );
+#else
+	munmap( mapping.m_pBase, mapping.m_nSize );
+	close( mapping.m_nFile );
+#endif
+
+	memset( &mapping, 0, sizeof( mapping ) );
+}
+
+static void ReleaseSourceBSP( void )
+{
+	UnmapBSPFile( s_SourceMapping );
+	memset( s_bSourcePassThrough, 0, sizeof( s_bSourcePassThrough ) );
+}
+
+static bool HasPassThroughLumps( void )
+{
+	if ( !s_SourceMapping.m_pBase )
+		return false;
+
+	for ( int i = 0; i < HEADER_LUMPS; i++ )
+	{
+		if ( s_bSourcePassThrough[i] && ( i != LUMP_PAKFILE || !s_bPakFileDirty ) )
+			return true;
+	}
+	return false;
+}
+
+static void ReportLumpTimes( const char *pAction, const char *filename, const double *pLumpTimes, double flTotal )
+{
+	qprintf( "%s %s in %.2f seconds\n", pAction, filename, flTotal );
+	for ( int i = 0; i < HEADER_LUMPS; i++ )
+	{
+		if ( pLumpTimes[i] >= 0.001 )
+		{
+			qprintf( "  %-40s %8.3f seconds\n", GetLumpName( i ), pLumpTimes[i] );
+		}
+	}
+}
 
 //-----------------------------------------------------------------------------
 // Keep the file position aligned to an arbitrary boundary.
@@ -779,6 +944,7 @@ void ReleasePakFileLumps( void )
 	// Release the pak files
 	IZip::ReleaseZip( s_pakFile );
 	s_pakFile = NULL;
+	s_bPakFileDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -787,6 +953,7 @@ void ReleasePakFileLumps( void )
 void ForceAlignment( IZip *pak, bool bAlign, bool bCompatibleFormat, unsigned int alignmentSize )
 {
 	pak->ForceAlignment( bAlign, bCompatibleFormat, alignmentSize );
+	s_bPakFileDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -794,6 +961,16 @@ void ForceAlignment( IZip *pak, bool bAlign, bool bCompatibleFormat, unsigned in
 //-----------------------------------------------------------------------------
 static void WritePakFileLump( void )
 {
+	// Nothing changed it since it was loaded, copy it across from the source
+	if ( !s_bPakFileDirty && s_bSourcePassThrough[LUMP_PAKFILE] && s_SourceMapping.m_pBase )
+	{
+		AlignFilePosition( g_hBSPFile, GetPakFile()->GetAlignment() );
+		AddPassThroughLump( LUMP_PAKFILE );
+		return;
+	}
+
+	double flStart = Plat_FloatTime();
+
 	CUtlBuffer buf( 0, 0 );
 	GetPakFile()->ActivateByteSwapping( IsX360() );
 	GetPakFile()->SaveToBuffer( buf );
@@ -804,6 +981,8 @@ static void WritePakFileLump( void )
 	
 	// Now store final buffers out to file
 	AddLump( LUMP_PAKFILE, (byte*)buf.Base(), buf.TellPut() );
+
+	s_flLumpWriteTime[LUMP_PAKFILE] += Plat_FloatTime() - flStart;
 }
 
 //-----------------------------------------------------------------------------
@@ -812,6 +991,7 @@ static void WritePakFileLump( void )
 void ClearPakFile( IZip *pak )
 {
 	pak->Reset();
+	s_bPakFileDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -823,6 +1003,7 @@ void AddFileToPak( IZip *pak, const char *relativename, const char *fullpath, IZ
 {
 	DevMsg( "Adding file to pakfile [ %s ]\n", fullpath );
 	pak->AddFileToZip( relativename, fullpath, compressionType );
+	s_bPakFileDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -834,6 +1015,7 @@ void AddFileToPak( IZip *pak, const char *relativename, const char *fullpath, IZ
 void AddBufferToPak( IZip *pak, const char *pRelativeName, void *data, int length, bool bTextMode, IZip::eCompressionType compressionType )
 {
 	pak->AddBufferToZip( pRelativeName, data, length, bTextMode, compressionType );
+	s_bPakFileDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -918,6 +1100,7 @@ bool ReadFileFromPak( IZip *pak, const char *pRelativeName, bool bTextMode, CUtl
 void RemoveFileFromPak( IZip *pak, const char *relativename )
 {
 	pak->RemoveFileFromZip( relativename );
+	s_bPakFileDirty = true;
 }
 
 
@@ -1507,6 +1690,230 @@ void DecompressVis (byte *in, byte *decompressed)
 	} while (out - decompressed < row);
 }
 
+//-----------------------------------------------------------------------------
+// CVisBitmap
+//-----------------------------------------------------------------------------
+CVisBitmap g_VisBitmap;
+
+static inline int CountBits64( uint64 n )
+{
+	n = n - ( ( n >> 1 ) & 0x5555555555555555ull );
+	n = ( n & 0x3333333333333333ull ) + ( ( n >> 2 ) & 0x3333333333333333ull );
+	n = ( n + ( n >> 4 ) ) & 0x0f0f0f0f0f0f0f0full;
+	return (int)( ( n * 0x0101010101010101ull ) >> 56 );
+}
+
+static inline int LowestBit64( uint64 n )
+{
+	return CountBits64( ( n & ( 0 - n ) ) - 1 );
+}
+
+CVisBitmap::CVisBitmap()
+{
+	m_nClusters = 0;
+	m_nWordsPerRow = 0;
+	m_nSummaryWords = 0;
+}
+
+void CVisBitmap::Purge()
+{
+	m_nClusters = 0;
+	m_nWordsPerRow = 0;
+	m_nSummaryWords = 0;
+	m_RowStart.Purge();
+	m_Summary.Purge();
+	m_Rank.Purge();
+	m_Words.Purge();
+}
+
+void CVisBitmap::BuildFromVisLump()
+{
+	Purge();
+
+	if ( !visdatasize || dvis->numclusters <= 0 )
+		return;
+
+	m_nClusters = dvis->numclusters;
+	m_nWordsPerRow = ( m_nClusters + 63 ) >> 6;
+	m_nSummaryWords = ( m_nWordsPerRow + 63 ) >> 6;
+
+	int nRows = m_nClusters * 2;
+	m_RowStart.SetCount( nRows );
+	m_Summary.SetCount( nRows * m_nSummaryWords );
+	m_Rank.SetCount( nRows * m_nSummaryWords );
+	memset( m_Summary.Base(), 0, m_Summary.Count() * sizeof( uint64 ) );
+
+	byte *pRow = (byte *)malloc( m_nWordsPerRow * 8 );
+	for ( int iRow = 0; iRow < nRows; iRow++ )
+	{
+		uint64 *pSummary = &m_Summary[ iRow * m_nSummaryWords ];
+		int *pRank = &m_Rank[ iRow * m_nSummaryWords ];
+
+		int nOffset = dvis->bitofs[ iRow >> 1 ][ iRow & 1 ];
+		if ( nOffset < 0 )
+		{
+			m_RowStart[iRow] = -1;
+			memset( pRank, 0, m_nSummaryWords * sizeof( int ) );
+			continue;
+		}
+
+		memset( pRow, 0, m_nWordsPerRow * 8 );
+		DecompressVis( &dvisdata[nOffset], pRow );
+
+		m_RowStart[iRow] = m_Words.Count();
+		for ( int w = 0; w < m_nWordsPerRow; w++ )
+		{
+			uint64 nWord = 0;
+			for ( int b = 0; b < 8; b++ )
+			{
+				nWord |= (uint64)pRow[ w * 8 + b ] << ( b * 8 );
+			}
+
+			if ( !nWord )
+				continue;
+
+			pSummary[ w >> 6 ] |= 1ull << ( w & 63 );
+			m_Words.AddToTail( nWord );
+		}
+
+		int nRank = 0;
+		for ( int s = 0; s < m_nSummaryWords; s++ )
+		{
+			pRank[s] = nRank;
+			nRank += CountBits64( pSummary[s] );
+		}
+	}
+	free( pRow );
+}
+
+bool CVisBitmap::IsVisible( int nType, int iFrom, int iTo ) const
+{
+	int iRow = iFrom * 2 + nType;
+	int w = iTo >> 6;
+	int iSummary = iRow * m_nSummaryWords + ( w >> 6 );
+
+	uint64 nSummary = m_Summary[iSummary];
+	uint64 nBit = 1ull << ( w & 63 );
+	if ( !( nSummary & nBit ) )
+		return false;
+
+	uint64 nWord = m_Words[ m_RowStart[iRow] + m_Rank[iSummary] + CountBits64( nSummary & ( nBit - 1 ) ) ];
+	return ( ( nWord >> ( iTo & 63 ) ) & 1 ) != 0;
+}
+
+void CVisBitmap::OrRow( int nType, int iCluster, byte *pDest ) const
+{
+	int iRow = iCluster * 2 + nType;
+	if ( m_RowStart[iRow] < 0 )
+		return;
+
+	int nRowBytes = ( m_nClusters + 7 ) >> 3;
+	const uint64 *pSummary = &m_Summary[ iRow * m_nSummaryWords ];
+	const uint64 *pWord = m_Words.Base() + m_RowStart[iRow];
+	for ( int s = 0; s < m_nSummaryWords; s++ )
+	{
+		for ( uint64 nSummary = pSummary[s]; nSummary; nSummary &= nSummary - 1 )
+		{
+			int nByte = ( ( s << 6 ) + LowestBit64( nSummary ) ) << 3;
+			int nBytes = min( 8, nRowBytes - nByte );
+			uint64 nWord = *pWord++;
+			for ( int b = 0; b < nBytes; b++ )
+			{
+				pDest[ nByte + b ] |= (byte)( nWord >> ( b * 8 ) );
+			}
+		}
+	}
+}
+
+void CVisBitmap::DecompressRow( int nType, int iCluster, byte *pDest ) const
+{
+	memset( pDest, 0, ( m_nClusters + 7 ) >> 3 );
+	OrRow( nType, iCluster, pDest );
+}
+
+int CVisBitmap::GetVisibleClusters( int nType, int iCluster, int *pClusters ) const
+{
+	int iRow = iCluster * 2 + nType;
+	if ( m_RowStart[iRow] < 0 )
+		return 0;
+
+	int nCount = 0;
+	const uint64 *pSummary = &m_Summary[ iRow * m_nSummaryWords ];
+	const uint64 *pWord = m_Words.Base() + m_RowStart[iRow];
+	for ( int s = 0; s < m_nSummaryWords; s++ )
+	{
+		for ( uint64 nSummary = pSummary[s]; nSummary; nSummary &= nSummary - 1 )
+		{
+			int nFirst = ( ( s << 6 ) + LowestBit64( nSummary ) ) << 6;
+			for ( uint64 nWord = *pWord++; nWord; nWord &= nWord - 1 )
+			{
+				int iVisible = nFirst + LowestBit64( nWord );
+				if ( iVisible < m_nClusters )
+				{
+					pClusters[nCount++] = iVisible;
+				}
+			}
+		}
+	}
+	return nCount;
+}
+
+int CVisBitmap::WriteVisLump( byte *pDest, int nMaxSize ) const
+{
+	// CompressVis takes the row length from dvis
+	Assert( m_nClusters == dvis->numclusters );
+
+	dvis_t *pVis = (dvis_t *)pDest;
+	byte *pOut = (byte *)&pVis->bitofs[m_nClusters];
+	if ( pOut - pDest > nMaxSize )
+	{
+		Error( "CVisBitmap::WriteVisLump: lump overflow" );
+	}
+	pVis->numclusters = m_nClusters;
+
+	int nRowBytes = ( m_nClusters + 7 ) >> 3;
+	byte *pRow = (byte *)malloc( nRowBytes );
+	byte *pCompressed = (byte *)malloc( nRowBytes * 2 );
+	for ( int nType = DVIS_PVS; nType <= DVIS_PAS; nType++ )
+	{
+		for ( int iCluster = 0; iCluster < m_nClusters; iCluster++ )
+		{
+			if ( !HasRow( nType, iCluster ) )
+			{
+				pVis->bitofs[iCluster][nType] = -1;
+				continue;
+			}
+
+			DecompressRow( nType, iCluster, pRow );
+			int nBytes = CompressVis( pRow, pCompressed );
+			if ( pOut + nBytes - pDest > nMaxSize )
+			{
+				Error( "CVisBitmap::WriteVisLump: lump overflow" );
+			}
+
+			pVis->bitofs[iCluster][nType] = pOut - pDest;
+			memcpy( pOut, pCompressed, nBytes );
+			pOut += nBytes;
+		}
+	}
+	free( pCompressed );
+	free( pRow );
+
+	return pOut - pDest;
+}
+
+bool CVisBitmap::VerifyRoundTrip() const
+{
+	if ( !IsBuilt() )
+		return !visdatasize;
+
+	byte *pLump = (byte *)malloc( MAX_MAP_VISIBILITY );
+	int nSize = WriteVisLump( pLump, MAX_MAP_VISIBILITY );
+	bool bMatch = ( nSize == visdatasize ) && !memcmp( pLump, dvisdata, nSize );
+	free( pLump );
+	return bMatch;
+}
+
 //-----------------------------------------------------------------------------
 //	Lump-specific swap functions
 //-----------------------------------------------------------------------------
@@ -1819,6 +2226,7 @@ static void SwapVisibilityLump( byte *pDest, byte *pSrc, int count )
 void Lumps_Init( void )
 {
 	memset( &g_Lumps, 0, sizeof(g_Lumps) );
+	ReleaseSourceBSP();
 }
 
 int LumpVersion( int lump )
@@ -1851,6 +2259,7 @@ template< class T >
 int CopyLumpInternal( int fieldType, int lump, T *dest, int forceVersion )
 {
 	g_Lumps.bLumpParsed[lump] = true;
+	double flStart = Plat_FloatTime();
 
 	// Vectors are passed in as floats
 	int fieldSize = ( fieldType == FIELD_VECTOR ) ? sizeof(Vector) : sizeof(T);
@@ -1890,6 +2299,8 @@ int CopyLumpInternal( int fieldType, int lump, T *dest, int forceVersion )
 		memcpy( dest, (byte*)g_pBSPHeader + ofs, length );
 	}
 
+	s_flLumpLoadTime[lump] += Plat_FloatTime() - flStart;
+
 	// Return actual count of elements
 	return length / fieldSize;
 }
@@ -1935,6 +2346,7 @@ template< class T >
 int CopyLumpInternal( int lump, T *dest, int forceVersion )
 {
 	g_Lumps.bLumpParsed[lump] = true;
+	double flStart = Plat_FloatTime();
 
 	unsigned int length = g_pBSPHeader->lumps[lump].filelen;
 	unsigned int ofs = g_pBSPHeader->lumps[lump].fileofs;
@@ -1951,6 +2363,8 @@ int CopyLumpInternal( int lump, T *dest, int forceVersion )
 		memcpy( dest, (byte*)g_pBSPHeader + ofs, length );
 	}
 
+	s_flLumpLoadTime[lump] += Plat_FloatTime() - flStart;
+
 	return count;
 }
 
@@ -1998,6 +2412,14 @@ void Lumps_Parse( void )
 	{
 		if ( !g_Lumps.bLumpParsed[i] && g_pBSPHeader->lumps[i].filelen )
 		{
+			if ( s_OpenMapping.m_pBase && !g_bSwapOnLoad )
+			{
+				// Nothing reads it, leave it in the file until it's written back
+				s_bSourcePassThrough[i] = true;
+				Msg( "Keeping unknown lump #%d (%d bytes)\n", i, g_pBSPHeader->lumps[i].filelen );
+				continue;
+			}
+
 			g_Lumps.size[i] = CopyVariableLump<byte>( FIELD_CHARACTER, i, &g_Lumps.pLumps[i], -1 );
 			Msg( "Reading unknown lump #%d (%d bytes)\n", i, g_Lumps.size[i] );
 		}
@@ -2020,6 +2442,11 @@ void Lumps_Write( void )
 			free( g_Lumps.pLumps[i] );
 			g_Lumps.pLumps[i] = NULL;
 		}
+		if ( s_bSourcePassThrough[i] && i != LUMP_PAKFILE && s_SourceMapping.m_pBase )
+		{
+			Msg( "Copying unknown lump #%d (%d bytes)\n", i, s_SourceLumps[i].filelen );
+			AddPassThroughLump( i );
+		}
 	}
 }
 
@@ -2179,12 +2606,24 @@ void ValidateHeader( const char *filename, const dheader_t *pHeader )
 //	Low level BSP opener for external parsing. Parses headers, but nothing else.
 //	You must close the BSP, via CloseBSPFile().
 //-----------------------------------------------------------------------------
-void OpenBSPFile( const char *filename )
+static void OpenBSPFileInternal( const char *filename, bool bMapFile )
 {
 	Lumps_Init();
+	memset( s_flLumpLoadTime, 0, sizeof( s_flLumpLoadTime ) );
 
-	// load the file header
-	LoadFile( filename, (void **)&g_pBSPHeader );
+	// Map the file if it's the one the filesystem would read, otherwise load it
+	int64 nLength;
+	if ( bMapFile && g_pFileSystem->FileExists( filename ) && MapBSPFile( filename, s_OpenMapping ) &&
+		 s_OpenMapping.m_nSize == g_pFileSystem->Size( filename ) )
+	{
+		g_pBSPHeader = (dheader_t *)s_OpenMapping.m_pBase;
+		nLength = s_OpenMapping.m_nSize;
+	}
+	else
+	{
+		UnmapBSPFile( s_OpenMapping );
+		nLength = LoadFile( filename, (void **)&g_pBSPHeader );
+	}
 
 	if ( g_bSwapOnLoad )
 	{
@@ -2194,15 +2633,36 @@ void OpenBSPFile( const char *filename )
 
 	ValidateHeader( filename, g_pBSPHeader );
 
+	for ( int i = 0; i < HEADER_LUMPS; i++ )
+	{
+		const lump_t &lump = g_pBSPHeader->lumps[i];
+		if ( lump.filelen && ( lump.fileofs < 0 || lump.filelen < 0 || (int64)lump.fileofs + lump.filelen > nLength ) )
+		{
+			Error( "%s is truncated, lump %d (%s) is past the end of the file", filename, i, GetLumpName( i ) );
+		}
+	}
+
 	g_MapRevision = g_pBSPHeader->mapRevision;
 }
 
+void OpenBSPFile( const char *filename )
+{
+	OpenBSPFileInternal( filename, true );
+}
+
 //-----------------------------------------------------------------------------
 //	CloseBSPFile
 //-----------------------------------------------------------------------------
 void CloseBSPFile( void )
 {
-	free( g_pBSPHeader );
+	if ( s_OpenMapping.m_pBase )
+	{
+		UnmapBSPFile( s_OpenMapping );
+	}
+	else
+	{
+		free( g_pBSPHeader );
+	}
 	g_pBSPHeader = NULL;
 }
 
@@ -2211,6 +2671,8 @@ void CloseBSPFile( void )
 //-----------------------------------------------------------------------------
 void LoadBSPFile( const char *filename )
 {
+	double flStart = Plat_FloatTime();
+
 	OpenBSPFile( filename );
 
 	nummodels = CopyLump( LUMP_MODELS, dmodels );
@@ -2289,7 +2751,9 @@ void LoadBSPFile( const char *filename )
 
 	g_LevelFlags = flags_lump.m_LevelFlags;
 
+	double flOcclusionStart = Plat_FloatTime();
 	LoadOcclusionLump();
+	s_flLumpLoadTime[LUMP_OCCLUSION] += Plat_FloatTime() - flOcclusionStart;
 
 	CopyLump( FIELD_SHORT, LUMP_LEAFMINDISTTOWATER, g_LeafMinDistToWater );
 
@@ -2305,8 +2769,23 @@ void LoadBSPFile( const char *filename )
 	*/
 		
 	// Load PAK file lump into appropriate data structure
+	double flPakStart = Plat_FloatTime();
 	byte *pakbuffer = NULL;
-	int paksize = CopyVariableLump<byte>( FIELD_CHARACTER, LUMP_PAKFILE, ( void ** )&pakbuffer );
+	int paksize;
+	bool bPakInPlace = ( s_OpenMapping.m_pBase && !g_bSwapOnLoad );
+	if ( bPakInPlace )
+	{
+		// parse it straight out of the mapped file, which keeps it for writing back
+		g_Lumps.bLumpParsed[LUMP_PAKFILE] = true;
+		paksize = g_pBSPHeader->lumps[LUMP_PAKFILE].filelen;
+		pakbuffer = (byte *)g_pBSPHeader + g_pBSPHeader->lumps[LUMP_PAKFILE].fileofs;
+		s_bSourcePassThrough[LUMP_PAKFILE] = ( paksize > 0 );
+	}
+	else
+	{
+		paksize = CopyVariableLump<byte>( FIELD_CHARACTER, LUMP_PAKFILE, ( void ** )&pakbuffer );
+	}
+
 	if ( paksize > 0 )
 	{
 		GetPakFile()->ActivateByteSwapping( IsX360() );
@@ -2317,18 +2796,43 @@ void LoadBSPFile( const char *filename )
 		GetPakFile()->Reset();
 	}
 
-	free( pakbuffer );
+	if ( !bPakInPlace )
+	{
+		free( pakbuffer );
+	}
+	s_bPakFileDirty = false;
+	s_flLumpLoadTime[LUMP_PAKFILE] += Plat_FloatTime() - flPakStart;
 
+	double flGameLumpStart = Plat_FloatTime();
 	g_GameLumps.ParseGameLump( g_pBSPHeader );
+	s_flLumpLoadTime[LUMP_GAME_LUMP] += Plat_FloatTime() - flGameLumpStart;
 
 	// NOTE: Do NOT call CopyLump after Lumps_Parse() it parses all un-Copied lumps
 	// parse any additional lumps
 	Lumps_Parse();
 
-	// everything has been copied out
-	CloseBSPFile();
+	// everything else has been copied out, keep the file if lumps were left in it
+	bool bLumpsLeftInFile = false;
+	for ( int i = 0; i < HEADER_LUMPS; i++ )
+	{
+		bLumpsLeftInFile = bLumpsLeftInFile || s_bSourcePassThrough[i];
+	}
+
+	if ( bLumpsLeftInFile )
+	{
+		memcpy( s_SourceLumps, g_pBSPHeader->lumps, sizeof( s_SourceLumps ) );
+		s_SourceMapping = s_OpenMapping;
+		memset( &s_OpenMapping, 0, sizeof( s_OpenMapping ) );
+		g_pBSPHeader = NULL;
+	}
+	else
+	{
+		CloseBSPFile();
+	}
 
 	g_Swap.ActivateByteSwapping( false );
+
+	ReportLumpTimes( "Loaded", filename, s_flLumpLoadTime, Plat_FloatTime() - flStart );
 }
 
 //-----------------------------------------------------------------------------
@@ -2436,6 +2940,7 @@ void UnloadBSPFile()
 		}
 	}
 
+	ReleaseSourceBSP();
 	ReleasePakFileLumps();
 }
 
@@ -2545,6 +3050,9 @@ static void AddLumpInternal( int lumpnum, void *data, int len, int version )
 	lump_t *lump;
 
 	g_Lumps.size[lumpnum] = 0;	// mark it written
+	s_bSourcePassThrough[lumpnum] = false;
+
+	double flStart = Plat_FloatTime();
 
 	lump = &g_pBSPHeader->lumps[lumpnum];
 
@@ -2557,6 +3065,150 @@ static void AddLumpInternal( int lumpnum, void *data, int len, int version )
 
 	// pad out to the next dword
 	AlignFilePosition( g_hBSPFile, 4 );
+
+	s_flLumpWriteTime[lumpnum] += Plat_FloatTime() - flStart;
+}
+
+//-----------------------------------------------------------------------------
+// Leaves room for a lump that is copied from the source BSP once the file is
+// closed, see CopyDeferredLumps
+//-----------------------------------------------------------------------------
+static void AddPassThroughLump( int lumpnum )
+{
+	lump_t *lump = &g_pBSPHeader->lumps[lumpnum];
+	const lump_t &source = s_SourceLumps[lumpnum];
+
+	lump->fileofs = g_pFileSystem->Tell( g_hBSPFile );
+	lump->filelen = source.filelen;
+	lump->version = source.version;
+	lump->uncompressedSize = source.uncompressedSize;
+
+	DeferredLumpCopy_t &copy = s_DeferredLumpCopies[ s_DeferredLumpCopies.AddToTail() ];
+	copy.m_nLump = lumpnum;
+	copy.m_nSrcOffset = source.fileofs;
+	copy.m_nDstOffset = lump->fileofs;
+	copy.m_nLength = source.filelen;
+
+	g_pFileSystem->Seek( g_hBSPFile, source.filelen, FILESYSTEM_SEEK_CURRENT );
+
+	// pad out to the next dword
+	AlignFilePosition( g_hBSPFile, 4 );
+}
+
+#ifdef _LINUX
+//-----------------------------------------------------------------------------
+// Copies a range between files without it passing through the tool.
+// copy_file_range lets network filesystems copy on the server and local ones
+// share extents, sendfile at least keeps the copy in the kernel.
+//-----------------------------------------------------------------------------
+static bool CopyFileRange( int nSrcFile, int nDstFile, int64 nSrcOffset, int64 nDstOffset, int64 nLength )
+{
+#ifdef __NR_copy_file_range
+	while ( nLength > 0 )
+	{
+		int64 nSrc = nSrcOffset;
+		int64 nDst = nDstOffset;
+		ssize_t nCopied = syscall( __NR_copy_file_range, nSrcFile, &nSrc, nDstFile, &nDst, (size_t)nLength, 0 );
+		if ( nCopied <= 0 )
+			break;
+
+		nSrcOffset += nCopied;
+		nDstOffset += nCopied;
+		nLength -= nCopied;
+	}
+
+	if ( nLength == 0 )
+		return true;
+#endif
+
+	// sendfile writes at the destination's file position
+	if ( lseek( nDstFile, nDstOffset, SEEK_SET ) != nDstOffset )
+		return false;
+
+	off_t nSendOffset = nSrcOffset;
+	while ( nLength > 0 )
+	{
+		ssize_t nCopied = sendfile( nDstFile, nSrcFile, &nSendOffset, (size_t)nLength );
+		if ( nCopied <= 0 )
+			return false;
+
+		nLength -= nCopied;
+	}
+	return true;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Fills the holes AddPassThroughLump left in the closed file
+//-----------------------------------------------------------------------------
+static void CopyDeferredLumps( const char *filename )
+{
+	if ( !s_DeferredLumpCopies.Count() )
+		return;
+
+#ifdef _LINUX
+	int nFile = open( filename, O_WRONLY );
+	if ( nFile < 0 )
+		Error( "Error opening %s! (Check for write enable)\n", filename );
+#else
+	FILE *fp = fopen( filename, "r+b" );
+	if ( !fp )
+		Error( "Error opening %s! (Check for write enable)\n", filename );
+#endif
+
+	for ( int i = 0; i < s_DeferredLumpCopies.Count(); i++ )
+	{
+		const DeferredLumpCopy_t &copy = s_DeferredLumpCopies[i];
+		const byte *pSrc = s_SourceMapping.m_pBase + copy.m_nSrcOffset;
+		double flStart = Plat_FloatTime();
+
+#ifdef _LINUX
+		if ( !CopyFileRange( s_SourceMapping.m_nFile, nFile, copy.m_nSrcOffset, copy.m_nDstOffset, copy.m_nLength ) &&
+			 pwrite( nFile, pSrc, copy.m_nLength, copy.m_nDstOffset ) != copy.m_nLength )
+		{
+			Error( "File write failure" );
+		}
+#else
+		fseek( fp, copy.m_nDstOffset, SEEK_SET );
+		if ( fwrite( pSrc, 1, copy.m_nLength, fp ) != (size_t)copy.m_nLength )
+		{
+			Error( "File write failure" );
+		}
+#endif
+
+		s_flLumpWriteTime[copy.m_nLump] += Plat_FloatTime() - flStart;
+	}
+
+#ifdef _LINUX
+	close( nFile );
+#else
+	fclose( fp );
+#endif
+
+	s_DeferredLumpCopies.RemoveAll();
+}
+
+//-----------------------------------------------------------------------------
+// Moves the finished file over the real one. Nothing stays mapped afterwards,
+// the tools don't unload the BSP and the next compile may replace the file.
+//-----------------------------------------------------------------------------
+static void ReplaceBSPFile( const char *pTempFilename, const char *filename )
+{
+	// The source is often the file being replaced
+	ReleaseSourceBSP();
+
+	// Later writes save the pakfile from memory
+	s_bPakFileDirty = true;
+
+#ifdef IS_WINDOWS_PC
+	bool bMoved = ::MoveFileEx( pTempFilename, filename, MOVEFILE_REPLACE_EXISTING ) != 0;
+#else
+	bool bMoved = rename( pTempFilename, filename ) == 0;
+#endif
+	if ( !bMoved )
+	{
+		Error( "Error replacing %s with %s! (Check for write enable)\n", filename, pTempFilename );
+	}
 }
 
 template< class T >
@@ -2632,6 +3284,37 @@ void WriteBSPFile( const char *filename, char *pUnused )
 		return;
 	}
 
+	double flStart = Plat_FloatTime();
+	memset( s_flLumpWriteTime, 0, sizeof( s_flLumpWriteTime ) );
+	s_DeferredLumpCopies.RemoveAll();
+
+	// Lumps left in the loaded BSP are copied from it after the new file is closed,
+	// so the new file is written alongside and moved over the old one at the end
+	char szFilename[MAX_PATH];
+	char szOutFilename[MAX_PATH];
+	bool bPassThrough = ( HasPassThroughLumps() && !g_bSwapOnWrite );
+	if ( bPassThrough )
+	{
+		V_MakeAbsolutePath( szFilename, sizeof( szFilename ), filename );
+		V_snprintf( szOutFilename, sizeof( szOutFilename ), "%s.tmp", szFilename );
+	}
+	else
+	{
+		// Unknown lumps have to be written from memory, then let go of the
+		// source before it's overwritten
+		for ( int i = 0; i < HEADER_LUMPS; i++ )
+		{
+			if ( s_bSourcePassThrough[i] && i != LUMP_PAKFILE && s_SourceMapping.m_pBase && !g_Lumps.pLumps[i] )
+			{
+				g_Lumps.size[i] = s_SourceLumps[i].filelen;
+				g_Lumps.pLumps[i] = malloc( g_Lumps.size[i] );
+				memcpy( g_Lumps.pLumps[i], s_SourceMapping.m_pBase + s_SourceLumps[i].fileofs, g_Lumps.size[i] );
+			}
+		}
+		ReleaseSourceBSP();
+		V_strncpy( szOutFilename, filename, sizeof( szOutFilename ) );
+	}
+
 	dheader_t outHeader;
 	g_pBSPHeader = &outHeader;
 	memset( g_pBSPHeader, 0, sizeof( dheader_t ) );
@@ -2640,7 +3323,7 @@ void WriteBSPFile( const char *filename, char *pUnused )
 	g_pBSPHeader->version = BSPVERSION;
 	g_pBSPHeader->mapRevision = g_MapRevision;
 
-	g_hBSPFile = SafeOpenWrite( filename );
+	g_hBSPFile = SafeOpenWrite( szOutFilename );
 	WriteData( g_pBSPHeader );	// overwritten later
 
 	AddLump( LUMP_PLANES, dplanes, numplanes );
@@ -2726,7 +3409,9 @@ void WriteBSPFile( const char *filename, char *pUnused )
 
 	AddLump( LUMP_LEAFMINDISTTOWATER, g_LeafMinDistToWater, numleafs );
 
+	double flGameLumpStart = Plat_FloatTime();
 	AddGameLumps();
+	s_flLumpWriteTime[LUMP_GAME_LUMP] += Plat_FloatTime() - flGameLumpStart;
 
 	// Write pakfile lump to disk
 	WritePakFileLump();
@@ -2738,6 +3423,14 @@ void WriteBSPFile( const char *filename, char *pUnused )
 	g_pFileSystem->Seek( g_hBSPFile, 0, FILESYSTEM_SEEK_HEAD );
 	WriteData( g_pBSPHeader );
 	g_pFileSystem->Close( g_hBSPFile );
+
+	if ( bPassThrough )
+	{
+		CopyDeferredLumps( szOutFilename );
+		ReplaceBSPFile( szOutFilename, szFilename );
+	}
+
+	ReportLumpTimes( "Wrote", filename, s_flLumpWriteTime, Plat_FloatTime() - flStart );
 }
 
 // Generate the next clear lump filename for the bsp file
@@ -4071,6 +4764,7 @@ void ConvertPakFileContents( const char *pInFilename )
 	// discard old pak in favor of new pak
 	IZip::ReleaseZip( s_pakFile );
 	s_pakFile = newPakFile;
+	s_bPakFileDirty = true;
 }
 
 void SetAlignedLumpPosition( int lumpnum, int alignment = LUMP_ALIGNMENT )
@@ -4770,6 +5464,9 @@ bool SwapBSPFile( const char *pInFilename, const char *pOutFilename, bool bSwapO
 		return false;
 	}
 
+	// A BSP loaded earlier may still be mapped, and may be the output
+	ReleaseSourceBSP();
+
 	g_hBSPFile = SafeOpenWrite( pOutFilename );
 	if ( !g_hBSPFile )
 	{
@@ -5086,7 +5783,8 @@ bool SetPakFileLump( const char *pBSPFilename, const char *pNewFilename, void *p
 	g_bSwapOnLoad = bSwap;
 	g_bSwapOnWrite = bSwap;
 
-	OpenBSPFile( pBSPFilename );
+	// The new file may be the same file, which mustn't be mapped while it's rewritten
+	OpenBSPFileInternal( pBSPFilename, false );
 
 	// save a copy of the old header
 	// generating a new bsp is a destructive operation
@@ -287,6 +287,51 @@ int					TexDataStringTable_AddOrFindString( const char *pString );
 void	DecompressVis (byte *in, byte *decompressed);
 int		CompressVis (byte *vis, byte *dest);
 
+//-----------------------------------------------------------------------------
+// Two-level bitmap index over the visibility lump. Every row keeps a summary
+// bit per 64 clusters and only the 64 cluster words the summary marks, so a
+// cluster pair is a couple of bit tests and row ORs skip the empty stretches,
+// neither has to run-length decode the row.
+//-----------------------------------------------------------------------------
+class CVisBitmap
+{
+public:
+	CVisBitmap();
+
+	// Converts the classic run-length lump in dvis/dvisdata
+	void	BuildFromVisLump();
+	void	Purge();
+
+	// Writes the classic lump back out the way vvis lays it out, the header and
+	// then every PVS row followed by every PAS row. Returns the lump size.
+	int		WriteVisLump( byte *pDest, int nMaxSize ) const;
+
+	// True if WriteVisLump reproduces dvisdata byte for byte
+	bool	VerifyRoundTrip() const;
+
+	bool	IsBuilt() const { return m_nClusters > 0; }
+	bool	HasRow( int nType, int iCluster ) const { return m_RowStart[ iCluster * 2 + nType ] >= 0; }
+
+	// nType is DVIS_PVS or DVIS_PAS, rows are (numclusters+7)/8 bytes
+	bool	IsVisible( int nType, int iFrom, int iTo ) const;
+	void	OrRow( int nType, int iCluster, byte *pDest ) const;
+	void	DecompressRow( int nType, int iCluster, byte *pDest ) const;
+
+	// Fills pClusters with the clusters the row has set, ascending. Returns the count.
+	int		GetVisibleClusters( int nType, int iCluster, int *pClusters ) const;
+
+private:
+	int					m_nClusters;
+	int					m_nWordsPerRow;
+	int					m_nSummaryWords;
+	CUtlVector<int>		m_RowStart;		// [cluster*2+type] first word in m_Words, -1 if the lump has no row
+	CUtlVector<uint64>	m_Summary;		// [row][m_nSummaryWords] a bit per word that has anything set
+	CUtlVector<int>		m_Rank;			// [row][m_nSummaryWords] words the row stores before each summary word
+	CUtlVector<uint64>	m_Words;
+};
+
+extern CVisBitmap g_VisBitmap;
+
 void	OpenBSPFile( const char *filename );
 void	CloseBSPFile(void);
 void	LoadBSPFile( const char *filename );
@@ -255,3 +255,74 @@ void RunThreadsOn( int workcnt, qboolean showpacifier, RunThreadsFn fn, void *pU
 }
 
 
+/*
+=============
+RunThreadsOnIndividualNested
+=============
+*/
+class CNestedThreadsData
+{
+public:
+	ThreadWorkerFn m_Fn;
+	int m_iThread;
+	int m_nWorkCount;
+	volatile LONG *m_pNextWork;
+};
+
+DWORD WINAPI InternalNestedThreadsFn( LPVOID pParameter )
+{
+	CNestedThreadsData *pData = (CNestedThreadsData*)pParameter;
+	while ( 1 )
+	{
+		int work = InterlockedIncrement( pData->m_pNextWork ) - 1;
+		if ( work >= pData->m_nWorkCount )
+			break;
+
+		pData->m_Fn( pData->m_iThread, work );
+	}
+	return 0;
+}
+
+void RunThreadsOnIndividualNested( int workcnt, int numThreads, ThreadWorkerFn fn )
+{
+	if ( numThreads > MAX_TOOL_THREADS )
+		numThreads = MAX_TOOL_THREADS;
+	if ( numThreads > workcnt )
+		numThreads = workcnt;
+
+	if ( numThreads <= 1 )
+	{
+		for ( int i=0; i < workcnt; i++ )
+			fn( 0, i );
+		return;
+	}
+
+	// The caller may or may not already be running threaded, make sure
+	// ThreadLock is live while our threads are
+	qboolean bWasThreaded = threaded;
+	threaded = true;
+
+	volatile LONG nextWork = 0;
+	CNestedThreadsData data[MAX_TOOL_THREADS];
+	HANDLE handles[MAX_TOOL_THREADS];
+
+	for ( int i=0; i < numThreads; i++ )
+	{
+		data[i].m_Fn = fn;
+		data[i].m_iThread = i;
+		data[i].m_nWorkCount = workcnt;
+		data[i].m_pNextWork = &nextWork;
+
+		DWORD dwDummy;
+		handles[i] = CreateThread( NULL, 0, InternalNestedThreadsFn, &data[i], 0, &dwDummy );
+
+		if( g_bLowPriorityThreads )
+			SetThreadPriority( handles[i], THREAD_PRIORITY_LOWEST );
+	}
+
+	WaitForMultipleObjects( numThreads, handles, TRUE, INFINITE );
+	for ( int i=0; i < numThreads; i++ )
+		CloseHandle( handles[i] );
+
+	threaded = bWasThreaded;
+}
@@ -53,6 +53,11 @@ void RunThreadsOn ( int workcnt, qboolean showpacifier, RunThreadsFn fn, void *p
 void RunThreads_Start( RunThreadsFn fn, void *pUserData, ERunThreadsPriority ePriority=k_eRunThreadsPriority_UseGlobalState );
 void RunThreads_End();
 
+// Runs fn on every work item across numThreads threads of its own, leaving the
+// RunThreadsOn state alone so it can be called from inside a RunThreadsOn worker.
+// Returns once all the items are done. No pacifier.
+void RunThreadsOnIndividualNested( int workcnt, int numThreads, ThreadWorkerFn fn );
+
 void ThreadLock (void);
 void ThreadUnlock (void);
 
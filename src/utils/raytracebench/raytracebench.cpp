@@ -0,0 +1,240 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Loads a BSP into a RayTracingEnvironment the way the map tools
+//			do and times the tree build and a few fixed sets of rays, so
+//			changes to raytrace can be measured outside of a full vrad run.
+//			The ray sets are generated from Halton sequences, so every run
+//			on a map fires the same rays and the hit checksums must match.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include <stdio.h>
+#include "cmdlib.h"
+#include "bsplib.h"
+#include "raytrace.h"
+#include "mathlib/halton.h"
+#include "tier0/icommandline.h"
+#include "tools_minidump.h"
+
+
+#define RAYS_PER_ORIGIN 64									// like one patch shooting at its visible patches
+
+static int s_nRays = 1000000;
+
+
+//-----------------------------------------------------------------------------
+// Adds the triangles of the world model's opaque faces
+//-----------------------------------------------------------------------------
+static Vector FaceVert( const dface_t &face, int vnum )
+{
+	int eIndex = dsurfedges[face.firstedge + vnum];
+	int point = ( eIndex < 0 ) ? dedges[-eIndex].v[1] : dedges[eIndex].v[0];
+	return dvertexes[point].point;
+}
+
+static void AddWorldFaces( RayTracingEnvironment &env )
+{
+	const dmodel_t &world = dmodels[0];
+	Vector color( 1, 1, 1 );
+	for ( int i = 0; i < world.numfaces; i++ )
+	{
+		const dface_t &face = dfaces[world.firstface + i];
+		if ( face.dispinfo != -1 || face.texinfo < 0 )
+			continue;
+		if ( texinfo[face.texinfo].flags & ( SURF_SKY | SURF_SKY2D | SURF_NODRAW | SURF_TRANS ) )
+			continue;
+
+		for ( int v = 2; v < face.numedges; v++ )
+		{
+			env.AddTriangle( i, FaceVert( face, 0 ), FaceVert( face, v - 1 ), FaceVert( face, v ), color );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Ray sets
+//-----------------------------------------------------------------------------
+class CBenchPoints
+{
+public:
+	CBenchPoints( const Vector &mins, const Vector &maxs ) : m_X( 2 ), m_Y( 3 ), m_Z( 5 ), m_vecMins( mins ), m_vecSize( maxs - mins )
+	{
+	}
+
+	Vector NextValue()
+	{
+		return m_vecMins + Vector( m_X.NextValue() * m_vecSize.x, m_Y.NextValue() * m_vecSize.y, m_Z.NextValue() * m_vecSize.z );
+	}
+
+private:
+	HaltonSequenceGenerator_t m_X, m_Y, m_Z;
+	Vector m_vecMins;
+	Vector m_vecSize;
+};
+
+struct BenchResult_t
+{
+	double m_flSeconds;
+	int m_nHits;
+	uint32 m_nChecksum;
+};
+
+static void AddHit( BenchResult_t &result, int32 nHitID )
+{
+	if ( nHitID == -1 )
+		return;
+
+	result.m_nHits++;
+	result.m_nChecksum = result.m_nChecksum * 31 + (uint32)nHitID;
+}
+
+// Each origin shoots RAYS_PER_ORIGIN rays at random points through a ray stream, the vismat pattern
+static void BenchStream( RayTracingEnvironment &env, BenchResult_t &result )
+{
+	CBenchPoints origins( env.m_MinBound, env.m_MaxBound );
+	CBenchPoints targets( env.m_MinBound, env.m_MaxBound );
+	RayTracingSingleResult *pResults = new RayTracingSingleResult[RAYS_PER_ORIGIN];
+
+	double flStart = Plat_FloatTime();
+	for ( int nRay = 0; nRay < s_nRays; nRay += RAYS_PER_ORIGIN )
+	{
+		RayStream stream;
+		Vector start = origins.NextValue();
+		for ( int i = 0; i < RAYS_PER_ORIGIN; i++ )
+		{
+			env.AddToRayStream( stream, start, targets.NextValue(), &pResults[i] );
+		}
+		env.FinishRayStream( stream );
+
+		for ( int i = 0; i < RAYS_PER_ORIGIN; i++ )
+		{
+			AddHit( result, pResults[i].HitID );
+		}
+	}
+	result.m_flSeconds = Plat_FloatTime() - flStart;
+
+	delete[] pResults;
+}
+
+// Unrelated start and end points four at a time, the worst case for the packet tracer
+static void BenchIncoherent( RayTracingEnvironment &env, BenchResult_t &result )
+{
+	CBenchPoints origins( env.m_MinBound, env.m_MaxBound );
+	CBenchPoints targets( env.m_MinBound, env.m_MaxBound );
+
+	double flStart = Plat_FloatTime();
+	for ( int nRay = 0; nRay < s_nRays; nRay += 4 )
+	{
+		FourRays rays;
+		for ( int i = 0; i < 4; i++ )
+		{
+			Vector start = origins.NextValue();
+			Vector dir = targets.NextValue() - start;
+			VectorNormalize( dir );
+			rays.origin.X( i ) = start.x;
+			rays.origin.Y( i ) = start.y;
+			rays.origin.Z( i ) = start.z;
+			rays.direction.X( i ) = dir.x;
+			rays.direction.Y( i ) = dir.y;
+			rays.direction.Z( i ) = dir.z;
+		}
+
+		RayTracingResult rslt;
+		env.Trace4Rays( rays, Four_Zeros, ReplicateX4( 1.0e6f ), &rslt );
+		for ( int i = 0; i < 4; i++ )
+		{
+			AddHit( result, rslt.HitIds[i] );
+		}
+	}
+	result.m_flSeconds = Plat_FloatTime() - flStart;
+}
+
+// Parallel rays towards a sun, the direct lighting shadow test
+static void BenchSun( RayTracingEnvironment &env, BenchResult_t &result )
+{
+	CBenchPoints origins( env.m_MinBound, env.m_MaxBound );
+	Vector sunDir( 0.3f, 0.2f, 1.0f );
+	VectorNormalize( sunDir );
+
+	FourRays rays;
+	rays.direction.DuplicateVector( sunDir );
+
+	double flStart = Plat_FloatTime();
+	for ( int nRay = 0; nRay < s_nRays; nRay += 4 )
+	{
+		for ( int i = 0; i < 4; i++ )
+		{
+			Vector start = origins.NextValue();
+			rays.origin.X( i ) = start.x;
+			rays.origin.Y( i ) = start.y;
+			rays.origin.Z( i ) = start.z;
+		}
+
+		RayTracingResult rslt;
+		env.Trace4Rays( rays, Four_Zeros, ReplicateX4( 1.0e6f ), &rslt );
+		for ( int i = 0; i < 4; i++ )
+		{
+			AddHit( result, rslt.HitIds[i] );
+		}
+	}
+	result.m_flSeconds = Plat_FloatTime() - flStart;
+}
+
+static void RunBench( const char *pszName, void (*pfnBench)( RayTracingEnvironment &, BenchResult_t & ), RayTracingEnvironment &env )
+{
+	BenchResult_t result;
+	memset( &result, 0, sizeof( result ) );
+	pfnBench( env, result );
+
+	Msg( "%-12s %10.0f rays/s   %9d hits   checksum %08x\n", pszName,
+		s_nRays / max( result.m_flSeconds, 1.0e-6 ), result.m_nHits, result.m_nChecksum );
+}
+
+
+void PrintUsage()
+{
+	Msg( "usage: raytracebench [-rays <count>] <bspfile>\n" );
+}
+
+int main( int argc, char **argv )
+{
+	CommandLine()->CreateCmdLine( argc, argv );
+	MathLib_Init( 2.2f, 2.2f, 0.0f, 1.0f, false, false, false, false );
+	InstallSpewFunction();
+	SetupDefaultToolsMinidumpHandler();
+
+	if ( argc < 2 )
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	s_nRays = max( CommandLine()->ParmValue( "-rays", s_nRays ), 4 );
+
+	char mapFile[MAX_PATH];
+	V_strncpy( mapFile, argv[argc - 1], sizeof( mapFile ) );
+	V_DefaultExtension( mapFile, ".bsp", sizeof( mapFile ) );
+
+	CmdLib_InitFileSystem( mapFile );
+	LoadBSPFile( mapFile );
+
+	RayTracingEnvironment env;
+	env.Flags |= RTE_FLAGS_DONT_STORE_TRIANGLE_COLORS | RTE_FLAGS_DONT_STORE_TRIANGLE_MATERIALS;
+	AddWorldFaces( env );
+
+	double flStart = Plat_FloatTime();
+	env.SetupAccelerationStructure();
+	Msg( "%d triangles, %d kd nodes, %d leaf references, built in %.3f seconds\n",
+		env.OptimizedTriangleList.Count(), env.OptimizedKDTree.Count(), env.TriangleIndexList.Count(),
+		Plat_FloatTime() - flStart );
+
+	Msg( "%d rays per set\n", s_nRays );
+	RunBench( "stream", BenchStream, env );
+	RunBench( "incoherent", BenchIncoherent, env );
+	RunBench( "sun", BenchSun, env );
+
+	CmdLib_Cleanup();
+	return 0;
+}
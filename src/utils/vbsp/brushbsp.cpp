@@ -7,8 +7,10 @@
 //=============================================================================//
 
 #include "vbsp.h"
+#include "tier0/threadtools.h"
 
 
+// Node and brush counts are bumped from the parallel tree build
 int		c_nodes;
 int		c_nonvis;
 int		c_active_brushes;
@@ -316,11 +318,9 @@ node_t *AllocNode (void)
 
 	node = (node_t*)malloc(sizeof(*node));
 	memset (node, 0, sizeof(*node));
-	node->id = s_NodeCount;
+	node->id = ThreadInterlockedIncrement( (int32 volatile *)&s_NodeCount ) - 1;
 	node->diskId = -1;
 
-	s_NodeCount++;
-
 	return node;
 }
 
@@ -340,9 +340,9 @@ bspbrush_t *AllocBrush (int numsides)
 	c = (int)&(((bspbrush_t *)0)->sides[numsides]);
 	bb = (bspbrush_t*)malloc(c);
 	memset (bb, 0, c);
-	bb->id = s_BrushId++;
+	bb->id = ThreadInterlockedIncrement( (int32 volatile *)&s_BrushId ) - 1;
 	if (numthreads == 1)
-		c_active_brushes++;
+		ThreadInterlockedIncrement( (int32 volatile *)&c_active_brushes );
 	return bb;
 }
 
@@ -360,7 +360,7 @@ void FreeBrush (bspbrush_t *brushes)
 			FreeWinding(brushes->sides[i].winding);
 	free (brushes);
 	if (numthreads == 1)
-		c_active_brushes--;
+		ThreadInterlockedDecrement( (int32 volatile *)&c_active_brushes );
 }
 
 
@@ -978,7 +978,7 @@ side_t *SelectSplitSide (bspbrush_t *brushes, node_t *node)
 			if (pass > 0)
 			{
 				if (numthreads == 1)
-					c_nonvis++;
+					ThreadInterlockedIncrement( (int32 volatile *)&c_nonvis );
 			}
 			break;
 		}
@@ -1326,20 +1326,20 @@ void SplitBrushList (bspbrush_t *brushes,
 
 /*
 ================
-BuildTree_r
+SplitNode
+
+Picks the split plane for node and divides brushes between two new
+children. Returns false if node became a leaf instead.
 ================
 */
-
-
-node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
+static bool SplitNode (node_t *node, bspbrush_t *brushes, bspbrush_t *children[2])
 {
 	node_t		*newnode;
 	side_t		*bestside;
 	int			i;
-	bspbrush_t	*children[2];
 
 	if (numthreads == 1)
-		c_nodes++;
+		ThreadInterlockedIncrement( (int32 volatile *)&c_nodes );
 
 	// find the best plane to use as a splitter
 	bestside = SelectSplitSide (brushes, node);
@@ -1350,7 +1350,7 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 		node->side = NULL;
 		node->planenum = -1;
 		LeafNode (node, brushes);
-		return node;
+		return false;
 	}
 			 
 	// this is a splitplane node
@@ -1371,6 +1371,25 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 	SplitBrush (node->volume, node->planenum, &node->children[0]->volume,
 		&node->children[1]->volume);
 
+	return true;
+}
+
+
+/*
+================
+BuildTree_r
+================
+*/
+
+
+node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
+{
+	int			i;
+	bspbrush_t	*children[2];
+
+	if (!SplitNode (node, brushes, children))
+		return node;
+
 	// recursively process children
 	for (i=0 ; i<2 ; i++)
 	{
@@ -1379,6 +1398,78 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 
 	return node;
 }
+
+
+/*
+================
+BuildTreeParallel
+
+Splits the top of the tree on the calling thread until the brush lists
+get small, then builds the subtrees under those nodes on g_numTreeThreads
+threads. Subtrees share nothing but the winding pool, so the finished
+tree is the same one BuildTree_r would have made.
+================
+*/
+#define PARALLEL_TREE_MIN_BRUSHES	64
+
+struct subtreetask_t
+{
+	node_t		*node;
+	bspbrush_t	*brushes;
+	int			numbrushes;
+};
+
+static CUtlVector<subtreetask_t> g_SubtreeTasks;
+
+static void BuildTreeTop_r (node_t *node, bspbrush_t *brushes, int splitBrushes)
+{
+	int			i;
+	bspbrush_t	*children[2];
+
+	int numbrushes = CountBrushList (brushes);
+	if (numbrushes < splitBrushes)
+	{
+		subtreetask_t &task = g_SubtreeTasks[g_SubtreeTasks.AddToTail()];
+		task.node = node;
+		task.brushes = brushes;
+		task.numbrushes = numbrushes;
+		return;
+	}
+
+	if (!SplitNode (node, brushes, children))
+		return;
+
+	for (i=0 ; i<2 ; i++)
+	{
+		BuildTreeTop_r (node->children[i], children[i], splitBrushes);
+	}
+}
+
+static int SubtreeTaskCompare (const subtreetask_t *a, const subtreetask_t *b)
+{
+	// biggest first so a large subtree doesn't start last
+	return b->numbrushes - a->numbrushes;
+}
+
+static void BuildSubtree_Thread (int iThread, int iWorkItem)
+{
+	subtreetask_t &task = g_SubtreeTasks[iWorkItem];
+	BuildTree_r (task.node, task.brushes);
+}
+
+static void BuildTreeParallel (node_t *node, bspbrush_t *brushes)
+{
+	int splitBrushes = CountBrushList (brushes) / (g_numTreeThreads * 8);
+	if (splitBrushes < PARALLEL_TREE_MIN_BRUSHES)
+		splitBrushes = PARALLEL_TREE_MIN_BRUSHES;
+
+	g_SubtreeTasks.RemoveAll();
+	BuildTreeTop_r (node, brushes, splitBrushes);
+	g_SubtreeTasks.Sort (SubtreeTaskCompare);
+
+	RunThreadsOnIndividualNested (g_SubtreeTasks.Count(), g_numTreeThreads, BuildSubtree_Thread);
+	g_SubtreeTasks.Purge();
+}
 	  
 
 //===========================================================
@@ -1447,7 +1538,14 @@ tree_t *BrushBSP (bspbrush_t *brushlist, Vector& mins, Vector& maxs)
 
 	tree->headnode = node;
 
-	node = BuildTree_r (node, brushlist);
+	if (g_numTreeThreads > 1)
+	{
+		BuildTreeParallel (node, brushlist);
+	}
+	else
+	{
+		node = BuildTree_r (node, brushlist);
+	}
 	qprintf ("%5i visible nodes\n", c_nodes/2 - c_nonvis);
 	qprintf ("%5i nonvis nodes\n", c_nonvis);
 	qprintf ("%5i leafs\n", (c_nodes+1)/2);
@@ -651,6 +651,173 @@ qboolean BrushGE (bspbrush_t *b1, bspbrush_t *b2)
 	return false;
 }
 
+/*
+=================
+CChopBrushGrid
+
+XY grid over the ChopBrushes working list, so each brush is only tested
+against the brushes whose bounds can touch it instead of every brush after
+it. Candidates come back in list order, so pairs are tried in the same
+order as the plain pairwise loop and the output doesn't change.
+=================
+*/
+#define CHOP_GRID_CELL_SIZE			512.0f
+#define CHOP_GRID_MAX_DIM			256
+#define CHOP_GRID_MAX_BRUSH_CELLS	64		// brushes covering more cells than this skip the grid
+
+class CChopBrushGrid
+{
+public:
+	void Build (bspbrush_t *head);
+
+	int Count () const { return m_Brushes.Count(); }
+	bspbrush_t *Brush (int i) { return m_Brushes[i]; }
+
+	// Fills candidates with the indices after i that might overlap brush i, ascending
+	void GetCandidates (int i, CUtlVector<int> &candidates);
+
+private:
+	void GetCellRange (bspbrush_t *b, int &x0, int &y0, int &x1, int &y1) const;
+
+	CUtlVector<bspbrush_t *>	m_Brushes;
+	CUtlVector<bool>			m_bOversized;
+	CUtlVector<int>				m_Oversized;
+	CUtlVector<int>				m_CellStart;		// cols*rows+1 offsets into m_CellBrushes
+	CUtlVector<int>				m_CellBrushes;
+	CUtlVector<int>				m_Stamp;			// last brush that gathered each index
+
+	float	m_flMins[2];
+	float	m_flCellSize;
+	int		m_nCols;
+	int		m_nRows;
+};
+
+void CChopBrushGrid::GetCellRange (bspbrush_t *b, int &x0, int &y0, int &x1, int &y1) const
+{
+	x0 = clamp ((int)((b->mins[0] - m_flMins[0]) / m_flCellSize), 0, m_nCols - 1);
+	y0 = clamp ((int)((b->mins[1] - m_flMins[1]) / m_flCellSize), 0, m_nRows - 1);
+	x1 = clamp ((int)((b->maxs[0] - m_flMins[0]) / m_flCellSize), 0, m_nCols - 1);
+	y1 = clamp ((int)((b->maxs[1] - m_flMins[1]) / m_flCellSize), 0, m_nRows - 1);
+}
+
+void CChopBrushGrid::Build (bspbrush_t *head)
+{
+	bspbrush_t	*b;
+	int			i, x, y, x0, y0, x1, y1;
+	float		flMaxs[2];
+
+	m_Brushes.RemoveAll();
+	m_Oversized.RemoveAll();
+
+	m_flMins[0] = m_flMins[1] = 99999;
+	flMaxs[0] = flMaxs[1] = -99999;
+	for (b=head ; b ; b=b->next)
+	{
+		m_Brushes.AddToTail (b);
+		for (i=0 ; i<2 ; i++)
+		{
+			m_flMins[i] = min (m_flMins[i], b->mins[i]);
+			flMaxs[i] = max (flMaxs[i], b->maxs[i]);
+		}
+	}
+
+	int nBrushes = m_Brushes.Count();
+	m_bOversized.SetCount (nBrushes);
+	m_Stamp.SetCount (nBrushes);
+	for (i=0 ; i<nBrushes ; i++)
+		m_Stamp[i] = -1;
+
+	float flExtent = max (flMaxs[0] - m_flMins[0], flMaxs[1] - m_flMins[1]);
+	m_flCellSize = max (CHOP_GRID_CELL_SIZE, flExtent / CHOP_GRID_MAX_DIM);
+	m_nCols = clamp ((int)((flMaxs[0] - m_flMins[0]) / m_flCellSize) + 1, 1, CHOP_GRID_MAX_DIM + 1);
+	m_nRows = clamp ((int)((flMaxs[1] - m_flMins[1]) / m_flCellSize) + 1, 1, CHOP_GRID_MAX_DIM + 1);
+
+	int nCells = m_nCols * m_nRows;
+	m_CellStart.SetCount (nCells + 1);
+	for (i=0 ; i<=nCells ; i++)
+		m_CellStart[i] = 0;
+
+	// count, then lay the cells out back to back
+	for (i=0 ; i<nBrushes ; i++)
+	{
+		GetCellRange (m_Brushes[i], x0, y0, x1, y1);
+		m_bOversized[i] = (x1 - x0 + 1) * (y1 - y0 + 1) > CHOP_GRID_MAX_BRUSH_CELLS;
+		if (m_bOversized[i])
+		{
+			m_Oversized.AddToTail (i);
+			continue;
+		}
+
+		for (y=y0 ; y<=y1 ; y++)
+			for (x=x0 ; x<=x1 ; x++)
+				m_CellStart[y * m_nCols + x + 1]++;
+	}
+
+	for (i=0 ; i<nCells ; i++)
+		m_CellStart[i+1] += m_CellStart[i];
+
+	m_CellBrushes.SetCount (m_CellStart[nCells]);
+	CUtlVector<int> cursor;
+	cursor.CopyArray (m_CellStart.Base(), nCells);
+
+	// brushes go in by index, so every cell ends up sorted
+	for (i=0 ; i<nBrushes ; i++)
+	{
+		if (m_bOversized[i])
+			continue;
+
+		GetCellRange (m_Brushes[i], x0, y0, x1, y1);
+		for (y=y0 ; y<=y1 ; y++)
+			for (x=x0 ; x<=x1 ; x++)
+				m_CellBrushes[cursor[y * m_nCols + x]++] = i;
+	}
+}
+
+static int CompareBrushIndex (const int *a, const int *b)
+{
+	return *a - *b;
+}
+
+void CChopBrushGrid::GetCandidates (int i, CUtlVector<int> &candidates)
+{
+	int		j, k, x, y, x0, y0, x1, y1;
+
+	candidates.RemoveAll();
+
+	if (m_bOversized[i])
+	{
+		for (j=i+1 ; j<m_Brushes.Count() ; j++)
+			candidates.AddToTail (j);
+		return;
+	}
+
+	GetCellRange (m_Brushes[i], x0, y0, x1, y1);
+	for (y=y0 ; y<=y1 ; y++)
+	{
+		for (x=x0 ; x<=x1 ; x++)
+		{
+			int cell = y * m_nCols + x;
+			for (k=m_CellStart[cell] ; k<m_CellStart[cell+1] ; k++)
+			{
+				j = m_CellBrushes[k];
+				if (j <= i || m_Stamp[j] == i)
+					continue;
+				m_Stamp[j] = i;
+				candidates.AddToTail (j);
+			}
+		}
+	}
+
+	for (k=0 ; k<m_Oversized.Count() ; k++)
+	{
+		if (m_Oversized[k] > i)
+			candidates.AddToTail (m_Oversized[k]);
+	}
+
+	candidates.Sort (CompareBrushIndex);
+}
+
+
 /*
 =================
 ChopBrushes
@@ -661,11 +828,14 @@ of non-intersecting brushes.
 */
 bspbrush_t *ChopBrushes (bspbrush_t *head)
 {
-	bspbrush_t	*b1, *b2, *next;
+	bspbrush_t	*b1, *b2;
 	bspbrush_t	*tail;
 	bspbrush_t	*keep;
 	bspbrush_t	*sub, *sub2;
 	int			c1, c2;
+	int			i, j;
+	CChopBrushGrid		grid;
+	CUtlVector<int>		candidates;
 
 	qprintf ("---- ChopBrushes ----\n");
 	qprintf ("original brushes: %i\n", CountBrushList (head));
@@ -683,11 +853,15 @@ newlist:
 	for (tail=head ; tail->next ; tail=tail->next)
 	;
 
-	for (b1=head ; b1 ; b1=next)
+	grid.Build (head);
+
+	for (i=0 ; i<grid.Count() ; i++)
 	{
-		next = b1->next;
-		for (b2=b1->next ; b2 ; b2 = b2->next)
+		b1 = grid.Brush (i);
+		grid.GetCandidates (i, candidates);
+		for (j=0 ; j<candidates.Count() ; j++)
 		{
+			b2 = grid.Brush (candidates[j]);
 			if (BrushesDisjoint (b1, b2))
 				continue;
 
@@ -763,7 +937,7 @@ newlist:
 			}
 		}
 
-		if (!b2)
+		if (j == candidates.Count())
 		{	// b1 is no longer intersecting anything, so keep it
 			b1->next = keep;
 			keep = b1;
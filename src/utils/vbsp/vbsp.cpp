@@ -56,6 +56,7 @@ bool		g_NodrawTriggers = false;
 bool		g_DisableWaterLighting = false;
 bool		g_bAllowDetailCracks = false;
 bool		g_bNoVirtualMesh = false;
+int			g_numTreeThreads = 1;
 
 float		g_defaultLuxelSize = DEFAULT_LUXEL_SIZE;
 float		g_luxelScale = 1.0f;
@@ -1277,6 +1278,7 @@ int RunVBSP( int argc, char **argv )
 	}
 
 	ThreadSetDefault ();
+	g_numTreeThreads = numthreads;	// the tree build does scale, it runs its own threads
 	numthreads = 1;		// multiple threads aren't helping...
 
 	// Setup the logfile.
@@ -365,6 +365,7 @@ extern	bool		g_NodrawTriggers;
 extern	bool		g_DisableWaterLighting;
 extern	bool		g_bAllowDetailCracks;
 extern	bool		g_bNoVirtualMesh;
+extern	int			g_numTreeThreads;		// threads BrushBSP builds subtrees on
 extern	char		outbase[32];
 
 extern	char	source[1024];
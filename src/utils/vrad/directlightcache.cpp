@@ -0,0 +1,345 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: On-disk cache of each face's direct lighting between vrad runs.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "vrad.h"
+#include "lightmap.h"
+#include "directlightcache.h"
+#include "tier1/checksum_md5.h"
+#include "tier1/utlbuffer.h"
+#include "tier0/threadtools.h"
+
+
+#define DIRECTLIGHTCACHE_ID			MAKEID( 'V', 'D', 'L', 'C' )
+#define DIRECTLIGHTCACHE_VERSION	1
+
+bool g_bDirectLightCache = false;
+
+static char s_szCacheFile[MAX_PATH];
+
+// Everything that feeds direct lighting but isn't a light or a face: settings and shadow casters
+static MD5Value_t s_GlobalKey;
+
+// Hash of every light that can see each cluster, and of all lights for samples outside the world
+static CUtlVector<MD5Value_t> s_ClusterLightKeys;
+static MD5Value_t s_AllLightsKey;
+
+// Keys made this run, written out by DirectLightCache_Save
+static CUtlVector<MD5Value_t> s_FaceKeys;
+static CUtlVector<bool> s_bFaceKeyed;
+
+// The loaded file and where each face's entry starts in it, -1 if it has none
+static CUtlBuffer s_CacheFile;
+static CUtlVector<int> s_CacheFaceOffsets;
+
+static CInterlockedInt s_nRestoredFaces;
+static CInterlockedInt s_nKeyedFaces;
+
+
+struct DirectLightCacheFace_t
+{
+	MD5Value_t	m_Key;
+	int			m_nSamples;
+	int			m_nNormals;
+	byte		m_Styles[MAXLIGHTMAPS];
+	// followed by m_nSamples sample normals, then for each style m_nNormals * m_nSamples LightingValue_t
+};
+
+
+//-----------------------------------------------------------------------------
+// Keys
+//-----------------------------------------------------------------------------
+static void HashLight( MD5Context_t &ctx, directlight_t *dl )
+{
+	MD5Update( &ctx, (unsigned char const *)&dl->light, sizeof( dl->light ) );
+	MD5Update( &ctx, (unsigned char const *)&dl->m_flStartFadeDistance, sizeof( dl->m_flStartFadeDistance ) );
+	MD5Update( &ctx, (unsigned char const *)&dl->m_flEndFadeDistance, sizeof( dl->m_flEndFadeDistance ) );
+	MD5Update( &ctx, (unsigned char const *)&dl->m_flCapDist, sizeof( dl->m_flCapDist ) );
+}
+
+static void ComputeGlobalKey()
+{
+	MD5Context_t ctx;
+	MD5Init( &ctx );
+
+	int nVersion = DIRECTLIGHTCACHE_VERSION;
+	MD5Update( &ctx, (unsigned char const *)&nVersion, sizeof( nVersion ) );
+
+	int settings[] = { g_bHDR, do_extra, extrapasses, do_fast, do_centersamples, g_bTextureShadows, g_bLargeDispSampleRadius, dlight_map };
+	float flSettings[] = { g_flSkySampleScale, g_SunAngularExtent, g_flMaxDispSampleSize };
+	MD5Update( &ctx, (unsigned char const *)settings, sizeof( settings ) );
+	MD5Update( &ctx, (unsigned char const *)flSettings, sizeof( flSettings ) );
+
+	// The shadow casters. Moving any brush, displacement or prop changes every face.
+	for ( int i = 0; i < g_RtEnv.OptimizedTriangleList.Count(); i++ )
+	{
+		MD5Update( &ctx, (unsigned char const *)&g_RtEnv.OptimizedTriangleList[i], sizeof( CacheOptimizedTriangle ) );
+	}
+	if ( g_bTextureShadows )
+	{
+		MD5Update( &ctx, (unsigned char const *)g_RtEnv.TriangleMaterials.Base(), g_RtEnv.TriangleMaterials.Count() * sizeof( int32 ) );
+	}
+
+	MD5Final( s_GlobalKey.bits, &ctx );
+}
+
+static void ComputeLightKeys()
+{
+	CUtlVector<MD5Value_t> lightKeys;
+	MD5Context_t allCtx;
+	MD5Init( &allCtx );
+	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
+	{
+		MD5Context_t ctx;
+		MD5Init( &ctx );
+		HashLight( ctx, dl );
+
+		MD5Value_t &key = lightKeys[lightKeys.AddToTail()];
+		MD5Final( key.bits, &ctx );
+		MD5Update( &allCtx, key.bits, sizeof( key.bits ) );
+	}
+	MD5Final( s_AllLightsKey.bits, &allCtx );
+
+	// Same cull the gather does: a light only reaches samples in clusters its PVS has
+	s_ClusterLightKeys.SetCount( dvis->numclusters );
+	for ( int iCluster = 0; iCluster < dvis->numclusters; iCluster++ )
+	{
+		MD5Context_t ctx;
+		MD5Init( &ctx );
+
+		int iLight = 0;
+		for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next, iLight++ )
+		{
+			if ( PVSCheck( dl->pvs, iCluster ) )
+			{
+				MD5Update( &ctx, lightKeys[iLight].bits, sizeof( lightKeys[iLight].bits ) );
+			}
+		}
+		MD5Final( s_ClusterLightKeys[iCluster].bits, &ctx );
+	}
+}
+
+static int CompareClusters( const int *a, const int *b )
+{
+	return *a - *b;
+}
+
+static void ComputeFaceKey( int facenum, int numnormals, MD5Value_t &key )
+{
+	facelight_t *fl = &facelight[facenum];
+	dface_t *f = &g_pFaces[facenum];
+
+	MD5Context_t ctx;
+	MD5Init( &ctx );
+	MD5Update( &ctx, s_GlobalKey.bits, sizeof( s_GlobalKey.bits ) );
+
+	int header[] = { fl->numsamples, numnormals, texinfo[f->texinfo].flags, f->dispinfo };
+	MD5Update( &ctx, (unsigned char const *)header, sizeof( header ) );
+
+	CUtlVector<int> clusters;
+	for ( int i = 0; i < fl->numsamples; i++ )
+	{
+		sample_t &sample = fl->sample[i];
+		MD5Update( &ctx, (unsigned char const *)&sample.pos, sizeof( sample.pos ) );
+		MD5Update( &ctx, (unsigned char const *)&sample.normal, sizeof( sample.normal ) );
+		MD5Update( &ctx, (unsigned char const *)&sample.area, sizeof( sample.area ) );
+
+		int iCluster = ClusterFromPoint( sample.pos );
+		if ( clusters.Find( iCluster ) == clusters.InvalidIndex() )
+		{
+			clusters.AddToTail( iCluster );
+		}
+	}
+
+	clusters.Sort( CompareClusters );
+	for ( int i = 0; i < clusters.Count(); i++ )
+	{
+		int iCluster = clusters[i];
+		const MD5Value_t &lights = ( iCluster >= 0 && iCluster < s_ClusterLightKeys.Count() ) ? s_ClusterLightKeys[iCluster] : s_AllLightsKey;
+		MD5Update( &ctx, (unsigned char const *)&iCluster, sizeof( iCluster ) );
+		MD5Update( &ctx, lights.bits, sizeof( lights.bits ) );
+	}
+
+	MD5Final( key.bits, &ctx );
+}
+
+
+//-----------------------------------------------------------------------------
+// File
+//-----------------------------------------------------------------------------
+static bool LoadCacheFile()
+{
+	s_CacheFaceOffsets.SetCount( numfaces );
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		s_CacheFaceOffsets[i] = -1;
+	}
+
+	if ( !g_pFileSystem->FileExists( s_szCacheFile ) || !g_pFileSystem->ReadFile( s_szCacheFile, NULL, s_CacheFile ) )
+		return false;
+
+	if ( s_CacheFile.GetInt() != DIRECTLIGHTCACHE_ID || s_CacheFile.GetInt() != DIRECTLIGHTCACHE_VERSION || s_CacheFile.GetInt() != numfaces )
+	{
+		Warning( "Direct light cache %s is from another map or vrad version, ignoring it\n", s_szCacheFile );
+		s_CacheFile.Purge();
+		return false;
+	}
+
+	while ( s_CacheFile.GetBytesRemaining() >= (int)( sizeof( int ) + sizeof( DirectLightCacheFace_t ) ) )
+	{
+		int facenum = s_CacheFile.GetInt();
+		if ( facenum < 0 || facenum >= numfaces )
+			break;
+
+		int nOffset = s_CacheFile.TellGet();
+		const DirectLightCacheFace_t *pFace = (const DirectLightCacheFace_t *)s_CacheFile.PeekGet();
+
+		// a truncated or corrupt entry ends the file rather than pointing faces at garbage
+		if ( pFace->m_nSamples < 0 || ( pFace->m_nNormals != 1 && pFace->m_nNormals != NUM_BUMP_VECTS + 1 ) )
+			break;
+
+		int nStyles = 0;
+		while ( nStyles < MAXLIGHTMAPS && pFace->m_Styles[nStyles] != 255 )
+		{
+			nStyles++;
+		}
+
+		int64 nSize = (int64)sizeof( DirectLightCacheFace_t ) + (int64)pFace->m_nSamples * sizeof( Vector ) +
+			(int64)nStyles * pFace->m_nNormals * pFace->m_nSamples * sizeof( LightingValue_t );
+		if ( nSize <= 0 || s_CacheFile.GetBytesRemaining() < nSize )
+			break;
+
+		s_CacheFaceOffsets[facenum] = nOffset;
+		s_CacheFile.SeekGet( CUtlBuffer::SEEK_CURRENT, (int)nSize );
+	}
+	return true;
+}
+
+void DirectLightCache_Init( const char *pFilename )
+{
+	V_strncpy( s_szCacheFile, pFilename, sizeof( s_szCacheFile ) );
+
+	double flStart = Plat_FloatTime();
+	ComputeGlobalKey();
+	ComputeLightKeys();
+
+	s_FaceKeys.SetCount( numfaces );
+	s_bFaceKeyed.SetCount( numfaces );
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		s_bFaceKeyed[i] = false;
+	}
+	s_nRestoredFaces = 0;
+	s_nKeyedFaces = 0;
+
+	if ( LoadCacheFile() )
+	{
+		Msg( "Loaded direct light cache %s (%.2f seconds)\n", s_szCacheFile, Plat_FloatTime() - flStart );
+	}
+	else
+	{
+		Msg( "No direct light cache yet, lighting every face\n" );
+	}
+}
+
+bool DirectLightCache_RestoreFace( int facenum, int numnormals )
+{
+	facelight_t *fl = &facelight[facenum];
+	dface_t *f = &g_pFaces[facenum];
+
+	MD5Value_t &key = s_FaceKeys[facenum];
+	ComputeFaceKey( facenum, numnormals, key );
+	s_bFaceKeyed[facenum] = true;
+	++s_nKeyedFaces;
+
+	if ( s_CacheFaceOffsets.Count() <= facenum || s_CacheFaceOffsets[facenum] < 0 )
+		return false;
+
+	const byte *pData = (const byte *)s_CacheFile.Base() + s_CacheFaceOffsets[facenum];
+	const DirectLightCacheFace_t *pFace = (const DirectLightCacheFace_t *)pData;
+	if ( pFace->m_Key != key || pFace->m_nSamples != fl->numsamples || pFace->m_nNormals != numnormals )
+		return false;
+
+	pData += sizeof( DirectLightCacheFace_t );
+	const Vector *pNormals = (const Vector *)pData;
+	for ( int i = 0; i < fl->numsamples; i++ )
+	{
+		fl->sample[i].normal = pNormals[i];
+	}
+	pData += fl->numsamples * sizeof( Vector );
+
+	int nBytes = fl->numsamples * sizeof( LightingValue_t );
+	for ( int k = 0; k < MAXLIGHTMAPS; k++ )
+	{
+		f->styles[k] = pFace->m_Styles[k];
+		if ( f->styles[k] == 255 )
+			break;
+
+		// style 0 was already allocated by BuildFacelights
+		for ( int n = 0; n < numnormals; n++ )
+		{
+			if ( !fl->light[k][n] )
+			{
+				fl->light[k][n] = (LightingValue_t *)calloc( fl->numsamples, sizeof( LightingValue_t ) );
+			}
+			memcpy( fl->light[k][n], pData, nBytes );
+			pData += nBytes;
+		}
+	}
+
+	++s_nRestoredFaces;
+	return true;
+}
+
+void DirectLightCache_Save()
+{
+	Msg( "Direct light cache: reused %d of %d lit faces\n", (int)s_nRestoredFaces, (int)s_nKeyedFaces );
+
+	CUtlBuffer buf;
+	buf.PutInt( DIRECTLIGHTCACHE_ID );
+	buf.PutInt( DIRECTLIGHTCACHE_VERSION );
+	buf.PutInt( numfaces );
+
+	for ( int facenum = 0; facenum < numfaces; facenum++ )
+	{
+		if ( !s_bFaceKeyed[facenum] )
+			continue;
+
+		facelight_t *fl = &facelight[facenum];
+		dface_t *f = &g_pFaces[facenum];
+
+		DirectLightCacheFace_t face;
+		face.m_Key = s_FaceKeys[facenum];
+		face.m_nSamples = fl->numsamples;
+		face.m_nNormals = ( texinfo[f->texinfo].flags & SURF_BUMPLIGHT ) ? NUM_BUMP_VECTS + 1 : 1;
+		memcpy( face.m_Styles, f->styles, sizeof( face.m_Styles ) );
+
+		buf.PutInt( facenum );
+		buf.Put( &face, sizeof( face ) );
+		for ( int i = 0; i < fl->numsamples; i++ )
+		{
+			buf.Put( &fl->sample[i].normal, sizeof( Vector ) );
+		}
+		for ( int k = 0; k < MAXLIGHTMAPS && f->styles[k] != 255; k++ )
+		{
+			for ( int n = 0; n < face.m_nNormals; n++ )
+			{
+				buf.Put( fl->light[k][n], fl->numsamples * sizeof( LightingValue_t ) );
+			}
+		}
+	}
+	buf.PutInt( -1 );
+
+	if ( !g_pFileSystem->WriteFile( s_szCacheFile, NULL, buf ) )
+	{
+		Warning( "Couldn't write direct light cache %s\n", s_szCacheFile );
+	}
+
+	s_CacheFile.Purge();
+	s_CacheFaceOffsets.Purge();
+	s_FaceKeys.Purge();
+	s_bFaceKeyed.Purge();
+}
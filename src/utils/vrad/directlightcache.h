@@ -0,0 +1,37 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: On-disk cache of each face's direct lighting between vrad runs.
+//
+//			Every lit face is keyed by a hash of its samples, the settings and
+//			shadow casters that feed direct lighting, and every light that can
+//			see one of the clusters its samples are in. A rerun restores the
+//			faces whose key didn't change and only gathers the rest, so moving
+//			one light relights the faces that light can reach and then bounces
+//			as usual.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef DIRECTLIGHTCACHE_H
+#define DIRECTLIGHTCACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+extern bool g_bDirectLightCache;
+
+
+// Loads the cache file and hashes the lights. Call once the direct lights exist.
+void DirectLightCache_Init( const char *pFilename );
+
+// Keys the face from its samples (CalcPoints must have run). If the file has the
+// same key for it, fills in its styles, sample normals and facelight and returns true.
+// Thread safe.
+bool DirectLightCache_RestoreFace( int facenum, int numnormals );
+
+// Writes every keyed face's current facelight to the cache file.
+void DirectLightCache_Save();
+
+
+#endif // DIRECTLIGHTCACHE_H
@@ -22,6 +22,8 @@
 #include "mathlib/quantize.h"
 #include "bitmap/imageformat.h"
 #include "coordsize.h"
+#include "directlightcache.h"
+#include "tier0/fasttimer.h"
 
 enum
 {
@@ -1025,16 +1027,18 @@ void MergeDLightVis( directlight_t *dl, int cluster )
 	{
 		SetDLightVis( dl, cluster );
 	}
-	else
+	else if ( visdatasize && cluster >= 0 )
 	{
-		byte		pvs[MAX_MAP_CLUSTERS/8];
-		GetVisCache( -1, cluster, pvs );
-
 		// merge both vis graphs
-		for (int i = 0; i < (dvis->numclusters / 8) + 1; i++)
+		if ( !g_VisBitmap.HasRow( DVIS_PVS, cluster ) )
 		{
-			dl->pvs[i] |= pvs[i];
+			Error ("visofs == -1");
 		}
+		g_VisBitmap.OrRow( DVIS_PVS, cluster, dl->pvs );
+	}
+	else
+	{
+		memset( dl->pvs, 255, (dvis->numclusters+7)/8 );
 	}
 }
 
@@ -1372,8 +1376,6 @@ void BuildVisForLightEnvironment( void )
 
 	// Second pass to set flags on leaves that don't contain sky, but touch leaves that
 	// contain sky.
-	byte pvs[MAX_MAP_CLUSTERS / 8];
-
 	int nLeafBytes = (numleafs >> 3) + 1;
 	unsigned char *pLeafBits = (unsigned char *)stackalloc( nLeafBytes * sizeof(unsigned char) );
 	unsigned char *pLeaf2DBits = (unsigned char *)stackalloc( nLeafBytes * sizeof(unsigned char) );
@@ -1390,9 +1392,6 @@ void BuildVisForLightEnvironment( void )
 		if ( dleafs[iLeaf].contents & CONTENTS_SOLID )
 			continue;
 
-		// See what other leaves are visible from this leaf
-		GetVisCache( -1, dleafs[iLeaf].cluster, pvs );
-
 		// Now check out all other leaves
 		int nByte = iLeaf >> 3;
 		int nBit = 1 << ( iLeaf & 0x7 );
@@ -1405,7 +1404,7 @@ void BuildVisForLightEnvironment( void )
 				continue;
 
 			// Can this leaf see into the leaf with the sky in it?
-			if ( !PVSCheck( pvs, dleafs[iLeaf2].cluster ) )
+			if ( !ClusterInPVS( dleafs[iLeaf].cluster, dleafs[iLeaf2].cluster ) )
 				continue;
 
 			if ( dleafs[iLeaf2].flags & LEAF_FLAGS_SKY2D )
@@ -1537,6 +1536,8 @@ static void ParseLightPoint( entity_t* e, directlight_t* dl )
   CreateDirectLights
   =============
 */
+static void InitSkySampleDirections();
+
 #define DIRECT_SCALE (100.0*100.0)
 void CreateDirectLights (void)
 {
@@ -1615,6 +1616,8 @@ void CreateDirectLights (void)
 
 	qprintf ("%i direct lights\n", numdlights);
 	// exit(1);
+
+	InitSkySampleDirections();
 }
 
 /*
@@ -1669,26 +1672,54 @@ void ExportDirectLightsToWorldLights()
 #define NSAMPLES_SUN_AREA_LIGHT 30							// number of samples to take for an
                                                             // non-point sun light
 
-// Helper function - gathers light from sun (emit_skylight)
-void GatherSampleSkyLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
-							 FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
-							 int nLFlags, int static_prop_index_to_ignore,
-							 float flEpsilon )
-{
-	bool bIgnoreNormals = ( nLFlags & GATHERLFLAGS_IGNORE_NORMALS ) != 0;
-	bool force_fast = ( nLFlags & GATHERLFLAGS_FORCE_FAST ) != 0;
+// Sky lights trace this many groups of samples along one direction before
+// moving on to the next, so consecutive traces run parallel through the tree
+#define SKY_GATHER_GROUP_BATCH	16
 
-	fltx4 dot;
+// The sun jitter and ambient sky directions. DirectionalSampler_t always produces
+// the same sequence, so it's made once instead of for every group of samples.
+static CUtlVector<Vector> s_SkySampleDirections;
 
-	if ( bIgnoreNormals )
-		dot = ReplicateX4( CONSTANT_DOT );
+static int NumAmbientSkySamples( bool bFast )
+{
+	int nsky_samples = NUMVERTEXNORMALS;
+	if ( bFast )
+		nsky_samples /= 4;
 	else
-		dot = NegSIMD( pNormals[0] * dl->light.normal );
+		nsky_samples *= g_flSkySampleScale;
+	return nsky_samples;
+}
 
-	dot = MaxSIMD( dot, Four_Zeros );
-	int zeroMask = TestSignSIMD ( CmpEqSIMD( dot, Four_Zeros ) );
-	if (zeroMask == 0xF)
-		return;
+static void InitSkySampleDirections()
+{
+	// Fast gathers (forced for static props) use NUMVERTEXNORMALS/4 directions,
+	// which is more than the scaled count when -extrasky is small
+	int nDirections = max( max( NumAmbientSkySamples( false ), NumAmbientSkySamples( true ) ), NSAMPLES_SUN_AREA_LIGHT );
+	s_SkySampleDirections.SetCount( nDirections );
+
+	DirectionalSampler_t sampler;
+	for ( int i = 0; i < nDirections; i++ )
+	{
+		s_SkySampleDirections[i] = sampler.NextValue();
+	}
+}
+
+// Four samples' lighting points and normals, the unit the gather works on
+struct SSE_SampleGroup_t
+{
+	FourVectors	m_Points;
+	FourVectors	m_PointNormals[ NUM_BUMP_VECTS + 1 ];
+	int			m_Clusters[4];
+	int			m_nSamples;
+};
+
+// Helper function - gathers light from sun (emit_skylight)
+static void GatherSampleSkyLightSSE( SSE_sampleLightOutput_t *pOut, directlight_t *dl, 
+									SSE_SampleGroup_t * const *ppGroups, int nGroups, int normalCount,
+									int nLFlags, int static_prop_index_to_ignore )
+{
+	bool bIgnoreNormals = ( nLFlags & GATHERLFLAGS_IGNORE_NORMALS ) != 0;
+	bool force_fast = ( nLFlags & GATHERLFLAGS_FORCE_FAST ) != 0;
 
 	int nsamples = 1;
 	if ( g_SunAngularExtent > 0.0f )
@@ -1698,138 +1729,188 @@ void GatherSampleSkyLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, i
 			nsamples /= 4;
 	}
 
-	fltx4 totalFractionVisible = Four_Zeros;
-	fltx4 fractionVisible = Four_Zeros;
+	for ( int nFirst = 0; nFirst < nGroups; nFirst += SKY_GATHER_GROUP_BATCH )
+	{
+		int nBatch = min( nGroups - nFirst, SKY_GATHER_GROUP_BATCH );
+		SSE_SampleGroup_t * const *ppBatch = ppGroups + nFirst;
 
-	DirectionalSampler_t sampler;
+		fltx4 dot[SKY_GATHER_GROUP_BATCH];
+		fltx4 totalFractionVisible[SKY_GATHER_GROUP_BATCH];
+		int facingGroups[SKY_GATHER_GROUP_BATCH];
+		int nFacing = 0;
 
-	for ( int d = 0; d < nsamples; d++ )
-	{
-		// determine visibility of skylight
-		// serach back to see if we can hit a sky brush
-		Vector delta;
-		VectorScale( dl->light.normal, -MAX_TRACE_LENGTH, delta );
-		if ( d )
+		for ( int g = 0; g < nBatch; g++ )
 		{
-			// jitter light source location
-			Vector ofs = sampler.NextValue();
-			ofs *= MAX_TRACE_LENGTH * g_SunAngularExtent;
-			delta += ofs;
+			if ( bIgnoreNormals )
+				dot[g] = ReplicateX4( CONSTANT_DOT );
+			else
+				dot[g] = NegSIMD( ppBatch[g]->m_PointNormals[0] * dl->light.normal );
+
+			dot[g] = MaxSIMD( dot[g], Four_Zeros );
+			int zeroMask = TestSignSIMD ( CmpEqSIMD( dot[g], Four_Zeros ) );
+			if (zeroMask == 0xF)
+				continue;
+
+			totalFractionVisible[g] = Four_Zeros;
+			facingGroups[nFacing++] = g;
 		}
-		FourVectors delta4;
-		delta4.DuplicateVector ( delta );
-		delta4 += pos;
 
-		TestLine_DoesHitSky ( pos, delta4, &fractionVisible, true, static_prop_index_to_ignore );
+		for ( int d = 0; d < nsamples; d++ )
+		{
+			// determine visibility of skylight
+			// serach back to see if we can hit a sky brush
+			Vector delta;
+			VectorScale( dl->light.normal, -MAX_TRACE_LENGTH, delta );
+			if ( d )
+			{
+				// jitter light source location
+				Vector ofs = s_SkySampleDirections[d - 1];
+				ofs *= MAX_TRACE_LENGTH * g_SunAngularExtent;
+				delta += ofs;
+			}
 
-		totalFractionVisible = AddSIMD ( totalFractionVisible, fractionVisible );
-	}
+			for ( int f = 0; f < nFacing; f++ )
+			{
+				int g = facingGroups[f];
+				FourVectors const &pos = ppBatch[g]->m_Points;
 
-	fltx4 seeAmount = MulSIMD ( totalFractionVisible, ReplicateX4 ( 1.0f / nsamples ) );
-	out.m_flDot[0] = MulSIMD ( dot, seeAmount );
-	out.m_flFalloff = Four_Ones;
-	out.m_flSunAmount = MulSIMD ( seeAmount, ReplicateX4( 10000.0f ) );
-	for ( int i = 1; i < normalCount; i++ )
-	{
-		if ( bIgnoreNormals )
-			out.m_flDot[i] = ReplicateX4 ( CONSTANT_DOT );
-		else
+				FourVectors delta4;
+				delta4.DuplicateVector ( delta );
+				delta4 += pos;
+
+				fltx4 fractionVisible = Four_Zeros;
+				TestLine_DoesHitSky ( pos, delta4, &fractionVisible, true, static_prop_index_to_ignore );
+
+				totalFractionVisible[g] = AddSIMD ( totalFractionVisible[g], fractionVisible );
+			}
+		}
+
+		for ( int f = 0; f < nFacing; f++ )
 		{
-			out.m_flDot[i] = NegSIMD( pNormals[i] * dl->light.normal );
-			out.m_flDot[i] = MulSIMD( out.m_flDot[i], seeAmount );
+			int g = facingGroups[f];
+			SSE_sampleLightOutput_t &out = pOut[nFirst + g];
+			FourVectors *pNormals = ppBatch[g]->m_PointNormals;
+
+			fltx4 seeAmount = MulSIMD ( totalFractionVisible[g], ReplicateX4 ( 1.0f / nsamples ) );
+			out.m_flDot[0] = MulSIMD ( dot[g], seeAmount );
+			out.m_flFalloff = Four_Ones;
+			out.m_flSunAmount = MulSIMD ( seeAmount, ReplicateX4( 10000.0f ) );
+			for ( int i = 1; i < normalCount; i++ )
+			{
+				if ( bIgnoreNormals )
+					out.m_flDot[i] = ReplicateX4 ( CONSTANT_DOT );
+				else
+				{
+					out.m_flDot[i] = NegSIMD( pNormals[i] * dl->light.normal );
+					out.m_flDot[i] = MulSIMD( out.m_flDot[i], seeAmount );
+				}
+			}
 		}
 	}
 }
 
 // Helper function - gathers light from ambient sky light
-void GatherSampleAmbientSkySSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
-							   FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
-							   int nLFlags, int static_prop_index_to_ignore,
-							   float flEpsilon )
+static void GatherSampleAmbientSkySSE( SSE_sampleLightOutput_t *pOut, directlight_t *dl, 
+									  SSE_SampleGroup_t * const *ppGroups, int nGroups, int normalCount,
+									  int nLFlags, int static_prop_index_to_ignore,
+									  float flEpsilon )
 {
-
 	bool bIgnoreNormals = ( nLFlags & GATHERLFLAGS_IGNORE_NORMALS ) != 0;
 	bool force_fast = ( nLFlags & GATHERLFLAGS_FORCE_FAST ) != 0;
 
-	fltx4 sumdot = Four_Zeros;
-	fltx4 ambient_intensity[NUM_BUMP_VECTS+1];
-	fltx4 possibleHitCount[NUM_BUMP_VECTS+1];
-	fltx4 dots[NUM_BUMP_VECTS+1];
+	int nsky_samples = NumAmbientSkySamples( do_fast || force_fast );
 
-	for ( int i = 0; i < normalCount; i++ )
+	for ( int nFirst = 0; nFirst < nGroups; nFirst += SKY_GATHER_GROUP_BATCH )
 	{
-		ambient_intensity[i] = Four_Zeros;
-		possibleHitCount[i] = Four_Zeros;
-	}
+		int nBatch = min( nGroups - nFirst, SKY_GATHER_GROUP_BATCH );
+		SSE_SampleGroup_t * const *ppBatch = ppGroups + nFirst;
 
-	DirectionalSampler_t sampler;
-	int nsky_samples = NUMVERTEXNORMALS;
-	if (do_fast || force_fast )
-		nsky_samples /= 4;
-	else
-		nsky_samples *= g_flSkySampleScale;
+		fltx4 sumdot[SKY_GATHER_GROUP_BATCH];
+		fltx4 ambient_intensity[SKY_GATHER_GROUP_BATCH][NUM_BUMP_VECTS+1];
+		fltx4 possibleHitCount[SKY_GATHER_GROUP_BATCH][NUM_BUMP_VECTS+1];
+		fltx4 dots[NUM_BUMP_VECTS+1];
 
-	for (int j = 0; j < nsky_samples; j++)
-	{
-		FourVectors anorm;
-		anorm.DuplicateVector( sampler.NextValue() );
+		for ( int g = 0; g < nBatch; g++ )
+		{
+			sumdot[g] = Four_Zeros;
+			for ( int i = 0; i < normalCount; i++ )
+			{
+				ambient_intensity[g][i] = Four_Zeros;
+				possibleHitCount[g][i] = Four_Zeros;
+			}
+		}
 
-		if ( bIgnoreNormals )
-			dots[0] = ReplicateX4( CONSTANT_DOT );
-		else
-			dots[0] = NegSIMD( pNormals[0] * anorm );
+		for (int j = 0; j < nsky_samples; j++)
+		{
+			FourVectors anorm;
+			anorm.DuplicateVector( s_SkySampleDirections[j] );
 
-		fltx4 validity = CmpGtSIMD( dots[0], ReplicateX4( EQUAL_EPSILON ) );
+			FourVectors offset = anorm;
+			offset *= -flEpsilon;
 
-		// No possibility of anybody getting lit
-		if ( !TestSignSIMD( validity ) )
-			continue;
+			for ( int g = 0; g < nBatch; g++ )
+			{
+				FourVectors const &pos = ppBatch[g]->m_Points;
+				FourVectors *pNormals = ppBatch[g]->m_PointNormals;
 
-		dots[0] = AndSIMD( validity, dots[0] );
-		sumdot = AddSIMD( dots[0], sumdot );
-		possibleHitCount[0] = AddSIMD( AndSIMD( validity, Four_Ones ), possibleHitCount[0] );
+				if ( bIgnoreNormals )
+					dots[0] = ReplicateX4( CONSTANT_DOT );
+				else
+					dots[0] = NegSIMD( pNormals[0] * anorm );
 
-		for ( int i = 1; i < normalCount; i++ )
-		{
-			if ( bIgnoreNormals )
-				dots[i] = ReplicateX4( CONSTANT_DOT );
-			else
-				dots[i] = NegSIMD( pNormals[i] * anorm );
-			fltx4 validity2 = CmpGtSIMD( dots[i], ReplicateX4 ( EQUAL_EPSILON ) );
-			dots[i] = AndSIMD( validity2, dots[i] );
-			possibleHitCount[i] = AddSIMD( AndSIMD( AndSIMD( validity, validity2 ), Four_Ones ), possibleHitCount[i] );
-		}
+				fltx4 validity = CmpGtSIMD( dots[0], ReplicateX4( EQUAL_EPSILON ) );
 
-		// search back to see if we can hit a sky brush
-		FourVectors delta = anorm;
-		delta *= -MAX_TRACE_LENGTH;
-		delta += pos;
-		FourVectors surfacePos = pos;
-		FourVectors offset = anorm;
-		offset *= -flEpsilon;
-		surfacePos -= offset;
+				// No possibility of anybody getting lit
+				if ( !TestSignSIMD( validity ) )
+					continue;
 
-		fltx4 fractionVisible = Four_Ones;
-		TestLine_DoesHitSky( surfacePos, delta, &fractionVisible, true, static_prop_index_to_ignore );
-		for ( int i = 0; i < normalCount; i++ )
-		{
-			fltx4 addedAmount = MulSIMD( fractionVisible, dots[i] );
-			ambient_intensity[i] = AddSIMD( ambient_intensity[i], addedAmount );
-		}
+				dots[0] = AndSIMD( validity, dots[0] );
+				sumdot[g] = AddSIMD( dots[0], sumdot[g] );
+				possibleHitCount[g][0] = AddSIMD( AndSIMD( validity, Four_Ones ), possibleHitCount[g][0] );
 
-	}
+				for ( int i = 1; i < normalCount; i++ )
+				{
+					if ( bIgnoreNormals )
+						dots[i] = ReplicateX4( CONSTANT_DOT );
+					else
+						dots[i] = NegSIMD( pNormals[i] * anorm );
+					fltx4 validity2 = CmpGtSIMD( dots[i], ReplicateX4 ( EQUAL_EPSILON ) );
+					dots[i] = AndSIMD( validity2, dots[i] );
+					possibleHitCount[g][i] = AddSIMD( AndSIMD( AndSIMD( validity, validity2 ), Four_Ones ), possibleHitCount[g][i] );
+				}
 
-	out.m_flFalloff = Four_Ones;
-	for ( int i = 0; i < normalCount; i++ )
-	{
-		// now scale out the missing parts of the hemisphere of this bump basis vector
-		fltx4 factor = ReciprocalSIMD( possibleHitCount[0] );
-		factor = MulSIMD( factor, possibleHitCount[i] );
-		out.m_flDot[i] = MulSIMD( factor, sumdot );
-		out.m_flDot[i] = ReciprocalSIMD( out.m_flDot[i] );
-		out.m_flDot[i] = MulSIMD( ambient_intensity[i], out.m_flDot[i] );
-	}
+				// search back to see if we can hit a sky brush
+				FourVectors delta = anorm;
+				delta *= -MAX_TRACE_LENGTH;
+				delta += pos;
+				FourVectors surfacePos = pos;
+				surfacePos -= offset;
 
+				fltx4 fractionVisible = Four_Ones;
+				TestLine_DoesHitSky( surfacePos, delta, &fractionVisible, true, static_prop_index_to_ignore );
+				for ( int i = 0; i < normalCount; i++ )
+				{
+					fltx4 addedAmount = MulSIMD( fractionVisible, dots[i] );
+					ambient_intensity[g][i] = AddSIMD( ambient_intensity[g][i], addedAmount );
+				}
+			}
+		}
+
+		for ( int g = 0; g < nBatch; g++ )
+		{
+			SSE_sampleLightOutput_t &out = pOut[nFirst + g];
+			out.m_flFalloff = Four_Ones;
+			for ( int i = 0; i < normalCount; i++ )
+			{
+				// now scale out the missing parts of the hemisphere of this bump basis vector
+				fltx4 factor = ReciprocalSIMD( possibleHitCount[g][0] );
+				factor = MulSIMD( factor, possibleHitCount[g][i] );
+				out.m_flDot[i] = MulSIMD( factor, sumdot[g] );
+				out.m_flDot[i] = ReciprocalSIMD( out.m_flDot[i] );
+				out.m_flDot[i] = MulSIMD( ambient_intensity[g][i], out.m_flDot[i] );
+			}
+		}
+	}
 }
 
 // Helper function - gathers light from area lights, spot lights, and point lights
@@ -1994,40 +2075,40 @@ void GatherSampleStandardLightSSE( SSE_sampleLightOutput_t &out, directlight_t *
 	}
 }
 
-// returns dot product with normal and delta
-// dl - light
-// pos - position of sample
-// normal - surface normal of sample
-// out.m_flDot[] - returned dot products with light vector and each normal
-// out.m_flFalloff - amount of light falloff
-void GatherSampleLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
-					   FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
-					   int nLFlags,
-					   int static_prop_index_to_ignore,
-					   float flEpsilon )
+// Gathers one light at nGroups groups of four samples
+// pOut[g] - returned dot products and falloff for ppGroups[g], see GatherSampleLightSSE
+static void GatherSampleLightGroupsSSE( SSE_sampleLightOutput_t *pOut, directlight_t *dl, int facenum, 
+									   SSE_SampleGroup_t * const *ppGroups, int nGroups, int normalCount, int iThread,
+									   int nLFlags, int static_prop_index_to_ignore, float flEpsilon )
 {
-	for ( int b = 0; b < normalCount; b++ )
-		out.m_flDot[b] = Four_Zeros;
-	out.m_flFalloff = Four_Zeros;
-	out.m_flSunAmount = Four_Zeros;
 	Assert( normalCount <= (NUM_BUMP_VECTS+1) );
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		for ( int b = 0; b < normalCount; b++ )
+			pOut[g].m_flDot[b] = Four_Zeros;
+		pOut[g].m_flFalloff = Four_Zeros;
+		pOut[g].m_flSunAmount = Four_Zeros;
+	}
 
 	// skylights work fundamentally differently than normal lights
 	switch( dl->light.type )
 	{
 	case emit_skylight:
-		GatherSampleSkyLightSSE( out, dl, facenum, pos, pNormals, normalCount,
-		                         iThread, nLFlags, static_prop_index_to_ignore, flEpsilon );
+		GatherSampleSkyLightSSE( pOut, dl, ppGroups, nGroups, normalCount,
+		                         nLFlags, static_prop_index_to_ignore );
 		break;
 	case emit_skyambient:
-		GatherSampleAmbientSkySSE( out, dl, facenum, pos, pNormals, normalCount,
-		                           iThread, nLFlags, static_prop_index_to_ignore, flEpsilon );
+		GatherSampleAmbientSkySSE( pOut, dl, ppGroups, nGroups, normalCount,
+		                           nLFlags, static_prop_index_to_ignore, flEpsilon );
 		break;
 	case emit_point:
 	case emit_surface:
 	case emit_spotlight:
-		GatherSampleStandardLightSSE( out, dl, facenum, pos, pNormals, normalCount,
-		                              iThread, nLFlags, static_prop_index_to_ignore, flEpsilon );
+		for ( int g = 0; g < nGroups; g++ )
+		{
+			GatherSampleStandardLightSSE( pOut[g], dl, facenum, ppGroups[g]->m_Points, ppGroups[g]->m_PointNormals, normalCount,
+			                              iThread, nLFlags, static_prop_index_to_ignore, flEpsilon );
+		}
 		break;
 	default:
 		Error ("Bad dl->light.type");
@@ -2038,14 +2119,41 @@ void GatherSampleLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int
 	// (tested by checking the dot product of the face normal and the light position)
 	// we don't want it to contribute to *any* of the bumped lightmaps. It glows
 	// in disturbing ways if we don't do this.
-	out.m_flDot[0] = MaxSIMD ( out.m_flDot[0], Four_Zeros );
-	fltx4 notZero = CmpGtSIMD( out.m_flDot[0], Four_Zeros );
-	for ( int n = 1; n < normalCount; n++ )
+	for ( int g = 0; g < nGroups; g++ )
 	{
-		out.m_flDot[n] = MaxSIMD( out.m_flDot[n], Four_Zeros );
-		out.m_flDot[n] = AndSIMD( out.m_flDot[n], notZero );
+		SSE_sampleLightOutput_t &out = pOut[g];
+		out.m_flDot[0] = MaxSIMD ( out.m_flDot[0], Four_Zeros );
+		fltx4 notZero = CmpGtSIMD( out.m_flDot[0], Four_Zeros );
+		for ( int n = 1; n < normalCount; n++ )
+		{
+			out.m_flDot[n] = MaxSIMD( out.m_flDot[n], Four_Zeros );
+			out.m_flDot[n] = AndSIMD( out.m_flDot[n], notZero );
+		}
 	}
+}
 
+// returns dot product with normal and delta
+// dl - light
+// pos - position of sample
+// normal - surface normal of sample
+// out.m_flDot[] - returned dot products with light vector and each normal
+// out.m_flFalloff - amount of light falloff
+void GatherSampleLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
+					   FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
+					   int nLFlags,
+					   int static_prop_index_to_ignore,
+					   float flEpsilon )
+{
+	Assert( normalCount <= (NUM_BUMP_VECTS+1) );
+
+	SSE_SampleGroup_t group;
+	group.m_Points = pos;
+	for ( int b = 0; b < normalCount; b++ )
+		group.m_PointNormals[b] = pNormals[b];
+
+	SSE_SampleGroup_t *pGroup = &group;
+	GatherSampleLightGroupsSSE( &out, dl, facenum, &pGroup, 1, normalCount, iThread,
+	                            nLFlags, static_prop_index_to_ignore, flEpsilon );
 }
 
 /*
@@ -2332,7 +2440,7 @@ int GetVisCache( int lastoffset, int cluster, byte *pvs )
 					Error ("visofs == -1");
 				}
 
-				DecompressVis (&dvisdata[thisoffset], pvs);
+				g_VisBitmap.DecompressRow( DVIS_PVS, cluster, pvs );
 			}
 			lastoffset = thisoffset;
 		}
@@ -2486,81 +2594,169 @@ static void ComputeIlluminationPointAndNormalsSSE( lightinfo_t const& l, FourVec
 }
 
 //-----------------------------------------------------------------------------
-// Iterates over all lights and computes lighting at up to 4 sample points
+// Per thread storage for the face gather, kept between faces
 //-----------------------------------------------------------------------------
-static void GatherSampleLightAt4Points( SSE_SampleInfo_t& info, int sampleIdx, int numSamples )
+struct FaceGatherScratch_t
 {
-	SSE_sampleLightOutput_t out;
+	CUtlVector< SSE_SampleGroup_t, CUtlMemoryAligned< SSE_SampleGroup_t, 16 > >				m_Groups;
+	CUtlVector< SSE_sampleLightOutput_t, CUtlMemoryAligned< SSE_sampleLightOutput_t, 16 > >	m_Outputs;
+	CUtlVector< SSE_SampleGroup_t * >	m_pLitGroups;		// groups the current light's PVS reaches
+	CUtlVector< int >					m_LitGroupIndices;
+};
 
-	// Iterate over all direct lights and add them to the particular sample
-	for (directlight_t *dl = activelights; dl != NULL; dl = dl->next)
-	{	    
-		// is this lights cluster visible?
-		fltx4 dotMask = Four_Zeros;
-		bool skipLight = true;
-		for( int s = 0; s < numSamples; s++ )
+static FaceGatherScratch_t s_FaceGatherScratch[MAX_TOOL_THREADS+1];
+
+// Time spent in the face gather and samples gathered, by light type
+#define NUM_EMIT_TYPES	( emit_skyambient + 1 )
+
+static CCycleCount s_LightTypeTime[MAX_TOOL_THREADS+1][NUM_EMIT_TYPES];
+static int64 s_LightTypeSamples[MAX_TOOL_THREADS+1][NUM_EMIT_TYPES];
+
+void ReportDirectLightingTimes()
+{
+	static const char *s_pTypeNames[NUM_EMIT_TYPES] = { "surface", "point", "spotlight", "sky", "quake", "ambient sky" };
+
+	int nLights[NUM_EMIT_TYPES];
+	memset( nLights, 0, sizeof( nLights ) );
+	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
+	{
+		nLights[dl->light.type]++;
+	}
+
+	Msg( "Direct lighting by light type (summed over threads):\n" );
+	for ( int nType = 0; nType < NUM_EMIT_TYPES; nType++ )
+	{
+		CCycleCount total;
+		int64 nSamples = 0;
+		for ( int iThread = 0; iThread <= MAX_TOOL_THREADS; iThread++ )
 		{
-			if( PVSCheck( dl->pvs, info.m_Clusters[s] ) )
-			{
-				dotMask = SetComponentSIMD( dotMask, s, 1.0f );
-				skipLight = false;
-			}
+			total += s_LightTypeTime[iThread][nType];
+			nSamples += s_LightTypeSamples[iThread][nType];
 		}
-		if ( skipLight )
+		if ( !nLights[nType] )
 			continue;
 
-		GatherSampleLightSSE( out, dl, info.m_FaceNum, info.m_Points, info.m_PointNormals, info.m_NormalCount, info.m_iThread );
-		
-		// Apply the PVS check filter and compute falloff x dot
-		fltx4 fxdot[NUM_BUMP_VECTS + 1];
-		skipLight = true;
-		for ( int b = 0; b < info.m_NormalCount; b++ )
+		Msg( "  %-12s %6d lights %10.2f seconds %14.0f samples\n", s_pTypeNames[nType], nLights[nType], total.GetSeconds(), (double)nSamples );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Adds one light's contribution to the lightmap samples of a group
+//-----------------------------------------------------------------------------
+static void AddSampleLightToGroup( SSE_SampleInfo_t& info, directlight_t *dl, SSE_SampleGroup_t const &group, 
+								  SSE_sampleLightOutput_t const &out, int sampleIdx )
+{
+	int numSamples = group.m_nSamples;
+
+	// is this lights cluster visible?
+	fltx4 dotMask = Four_Zeros;
+	for( int s = 0; s < numSamples; s++ )
+	{
+		if( PVSCheck( dl->pvs, group.m_Clusters[s] ) )
 		{
-			fxdot[b] = MulSIMD( out.m_flDot[b], dotMask );
-			fxdot[b] = MulSIMD( fxdot[b], out.m_flFalloff );
-			if ( !IsAllZeros( fxdot[b] ) )
-			{
-				skipLight = false;
-			}
+			dotMask = SetComponentSIMD( dotMask, s, 1.0f );
 		}
-		if ( skipLight )
-			continue;
+	}
 
-		// Figure out the lightstyle for this particular sample
-		int lightStyleIndex = FindOrAllocateLightstyleSamples( info.m_pFace, info.m_pFaceLight, 
-			dl->light.style, info.m_NormalCount );
-		if (lightStyleIndex < 0)
+	// Apply the PVS check filter and compute falloff x dot
+	fltx4 fxdot[NUM_BUMP_VECTS + 1];
+	bool skipLight = true;
+	for ( int b = 0; b < info.m_NormalCount; b++ )
+	{
+		fxdot[b] = MulSIMD( out.m_flDot[b], dotMask );
+		fxdot[b] = MulSIMD( fxdot[b], out.m_flFalloff );
+		if ( !IsAllZeros( fxdot[b] ) )
 		{
-			if (info.m_WarnFace != info.m_FaceNum)
-			{
-				Warning ("\nWARNING: Too many light styles on a face at (%f, %f, %f)\n",
-					info.m_Points.x.m128_f32[0], info.m_Points.y.m128_f32[0], info.m_Points.z.m128_f32[0] );
-				info.m_WarnFace = info.m_FaceNum;
-			}
-			continue;
+			skipLight = false;
 		}
+	}
+	if ( skipLight )
+		return;
 
-		// pLightmaps is an array of the lightmaps for each normal direction,
-		// here's where the result of the sample gathering goes
-		LightingValue_t** pLightmaps = info.m_pFaceLight->light[lightStyleIndex];
+	// Figure out the lightstyle for this particular sample
+	int lightStyleIndex = FindOrAllocateLightstyleSamples( info.m_pFace, info.m_pFaceLight, 
+		dl->light.style, info.m_NormalCount );
+	if (lightStyleIndex < 0)
+	{
+		if (info.m_WarnFace != info.m_FaceNum)
+		{
+			Warning ("\nWARNING: Too many light styles on a face at (%f, %f, %f)\n",
+				group.m_Points.x.m128_f32[0], group.m_Points.y.m128_f32[0], group.m_Points.z.m128_f32[0] );
+			info.m_WarnFace = info.m_FaceNum;
+		}
+		return;
+	}
+
+	// pLightmaps is an array of the lightmaps for each normal direction,
+	// here's where the result of the sample gathering goes
+	LightingValue_t** pLightmaps = info.m_pFaceLight->light[lightStyleIndex];
 
-		// Incremental lighting only cares about lightstyle zero
-		if( g_pIncremental && (dl->light.style == 0) )
+	// Incremental lighting only cares about lightstyle zero
+	if( g_pIncremental && (dl->light.style == 0) )
+	{
+		for ( int i = 0; i < numSamples; i++ )
 		{
-			for ( int i = 0; i < numSamples; i++ )
+			g_pIncremental->AddLightToFace( dl->m_IncrementalID, info.m_FaceNum, sampleIdx + i, 
+				info.m_LightmapSize, SubFloat( fxdot[0], i ), info.m_iThread );
+		}
+	}
+
+	for( int n = 0; n < info.m_NormalCount; ++n )
+	{
+		for ( int i = 0; i < numSamples; i++ )
+		{
+			pLightmaps[n][sampleIdx + i].AddLight( SubFloat( fxdot[n], i ), dl->light.intensity, SubFloat( out.m_flSunAmount, i ) );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Iterates over all lights and computes lighting at every sample group of the
+// face. Each light is gathered at all the groups it can reach before moving on
+// to the next one, so its setup and sky directions are shared by the whole face.
+//-----------------------------------------------------------------------------
+static void GatherFaceLightsSSE( SSE_SampleInfo_t& info, FaceGatherScratch_t& scratch )
+{
+	int nGroups = scratch.m_Groups.Count();
+	scratch.m_Outputs.SetCount( nGroups );
+
+	for (directlight_t *dl = activelights; dl != NULL; dl = dl->next)
+	{
+		CFastTimer timer;
+		timer.Start();
+
+		// Only the groups with a sample in a cluster this light can see
+		scratch.m_pLitGroups.RemoveAll();
+		scratch.m_LitGroupIndices.RemoveAll();
+		for ( int g = 0; g < nGroups; g++ )
+		{
+			SSE_SampleGroup_t &group = scratch.m_Groups[g];
+			for( int s = 0; s < group.m_nSamples; s++ )
 			{
-				g_pIncremental->AddLightToFace( dl->m_IncrementalID, info.m_FaceNum, sampleIdx + i, 
-					info.m_LightmapSize, SubFloat( fxdot[0], i ), info.m_iThread );
+				if( PVSCheck( dl->pvs, group.m_Clusters[s] ) )
+				{
+					scratch.m_pLitGroups.AddToTail( &group );
+					scratch.m_LitGroupIndices.AddToTail( g );
+					break;
+				}
 			}
 		}
 
-		for( int n = 0; n < info.m_NormalCount; ++n )
+		int nLitGroups = scratch.m_pLitGroups.Count();
+		if ( nLitGroups )
 		{
-			for ( int i = 0; i < numSamples; i++ )
+			GatherSampleLightGroupsSSE( scratch.m_Outputs.Base(), dl, info.m_FaceNum, scratch.m_pLitGroups.Base(), nLitGroups,
+				info.m_NormalCount, info.m_iThread, 0, -1, 0.0f );
+
+			for ( int i = 0; i < nLitGroups; i++ )
 			{
-				pLightmaps[n][sampleIdx + i].AddLight( SubFloat( fxdot[n], i ), dl->light.intensity, SubFloat( out.m_flSunAmount, i ) );
+				AddSampleLightToGroup( info, dl, *scratch.m_pLitGroups[i], scratch.m_Outputs[i], 4 * scratch.m_LitGroupIndices[i] );
 			}
 		}
+
+		timer.End();
+		s_LightTypeTime[info.m_iThread][dl->light.type] += timer.GetDuration();
+		s_LightTypeSamples[info.m_iThread][dl->light.type] += 4 * nLitGroups;
 	}
 }
 
@@ -3056,6 +3252,28 @@ static void InitSampleInfo( lightinfo_t const& l, int iThread, SSE_SampleInfo_t&
 	}
 }
 
+static void FinishFacelights( int facenum, facelight_t *fl )
+{
+#ifdef MPI
+	if (!g_bUseMPI) 
+#endif
+	{
+		//
+		// This is done on the master node when MPI is used
+		//
+		BuildPatchLights( facenum );
+	}
+
+	if( g_bDumpPatches )
+	{
+		DumpSamples( facenum, fl );
+	}
+	else
+	{
+		FreeSampleWindings( fl );
+	}
+}
+
 void BuildFacelights (int iThread, int facenum)
 {
 	int	i, j;
@@ -3106,13 +3324,23 @@ void BuildFacelights (int iThread, int facenum)
 	CalcPoints( &l, fl, facenum );
 	InitSampleInfo( l, iThread, sampleInfo );
 
-	// Allocate sample positions/normals to SSE
-	int numGroups = ( fl->numsamples & 0x3) ? ( fl->numsamples / 4 ) + 1 : ( fl->numsamples / 4 );
-
 	// always allocate style 0 lightmap
 	f->styles[0] = 0;
 	AllocateLightstyleSamples( fl, 0, sampleInfo.m_NormalCount );
 
+	// Nothing that lights this face changed since the cached run, skip the gather
+	if ( g_bDirectLightCache && DirectLightCache_RestoreFace( facenum, sampleInfo.m_NormalCount ) )
+	{
+		FinishFacelights( facenum, fl );
+		return;
+	}
+
+	// Allocate sample positions/normals to SSE
+	int numGroups = ( fl->numsamples & 0x3) ? ( fl->numsamples / 4 ) + 1 : ( fl->numsamples / 4 );
+
+	FaceGatherScratch_t &scratch = s_FaceGatherScratch[iThread];
+	scratch.m_Groups.SetCount( numGroups );
+
 	// sample the lights at each sample location
 	for ( int grp = 0; grp < numGroups; ++grp )
 	{
@@ -3141,9 +3369,17 @@ void BuildFacelights (int iThread, int facenum)
 				sample[i].normal = sampleInfo.m_PointNormals[0].Vec( i );
 		}
 
-		// Iterate over all the lights and add their contribution to this group of spots
-		GatherSampleLightAt4Points( sampleInfo, nSample, numSamples );
+		SSE_SampleGroup_t &group = scratch.m_Groups[grp];
+		group.m_Points = sampleInfo.m_Points;
+		for ( int b = 0; b < sampleInfo.m_NormalCount; b++ )
+			group.m_PointNormals[b] = sampleInfo.m_PointNormals[b];
+		for ( int i = 0; i < 4; i++ )
+			group.m_Clusters[i] = sampleInfo.m_Clusters[i];
+		group.m_nSamples = numSamples;
 	}
+
+	// Iterate over all the lights and add their contribution to every group of spots
+	GatherFaceLightsSSE( sampleInfo, scratch );
 	
 	// Tell the incremental light manager that we're done with this face.
 	if( g_pIncremental )
@@ -3174,25 +3410,7 @@ void BuildFacelights (int iThread, int facenum)
 		}
 	}
 
-#ifdef MPI
-	if (!g_bUseMPI) 
-#endif
-	{
-		//
-		// This is done on the master node when MPI is used
-		//
-		BuildPatchLights( facenum );
-	}
-
-	if( g_bDumpPatches )
-	{
-		DumpSamples( facenum, fl );
-	}
-	else
-	{
-		FreeSampleWindings( fl );
-	}
-
+	FinishFacelights( facenum, fl );
 }
 
 void BuildPatchLights( int facenum )
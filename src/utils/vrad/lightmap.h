@@ -137,5 +137,8 @@ void FreeDLights();
 
 void ExportDirectLightsToWorldLights();
 
+// Prints the time BuildFacelights spent gathering each type of light
+void ReportDirectLightingTimes();
+
 
 #endif // LIGHTMAP_H
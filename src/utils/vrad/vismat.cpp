@@ -151,7 +151,7 @@ void PvsForOrigin (Vector& org, byte *pvs)
 	if (visofs == -1)
 		Error ("visofs == -1");
 
-	DecompressVis (&dvisdata[visofs], pvs);
+	g_VisBitmap.DecompressRow( DVIS_PVS, cluster, pvs );
 }
 
 
@@ -303,9 +303,9 @@ BuildVisRow
 Calc vis bits from a single patch
 ==============
 */
-void BuildVisRow (int patchnum, byte *pvs, int head, transfer_t *transfers, CTransferMaker &transferMaker, int iThread )
+void BuildVisRow (int patchnum, const int *pVisibleClusters, int nVisibleClusters, int head, transfer_t *transfers, CTransferMaker &transferMaker, int iThread )
 {
-	int		j, k, l, leafIndex;
+	int		i, j, k, l, leafIndex;
 	CPatch	*patch;
 	dleaf_t	*leaf;
 	byte	face_tested[MAX_MAP_FACES];
@@ -316,12 +316,9 @@ void BuildVisRow (int patchnum, byte *pvs, int head, transfer_t *transfers, CTra
 	memset( face_tested, 0, numfaces ) ;
 	memset( disp_tested, 0, numfaces );
 
-	for (j=0; j<dvis->numclusters; j++)
+	for (i=0; i<nVisibleClusters; i++)
 	{
-		if ( ! ( pvs[(j)>>3] & (1<<((j)&7)) ) )
-		{
-			continue;		// not in pvs
-		}
+		j = pVisibleClusters[i];
 
 		for ( leafIndex = 0; leafIndex < g_ClusterLeaves[j].leafCount; leafIndex++ )
 		{
@@ -390,12 +387,14 @@ void BuildVisLeafs_Cluster(
 	void (*PatchCB)(int iThread, int patchnum, CPatch *patch)
 	)
 {
-	byte	pvs[(MAX_MAP_CLUSTERS+7)/8];
 	CPatch	*patch;
 	int		head;
 	unsigned	patchnum;
-	
-	DecompressVis( &dvisdata[ dvis->bitofs[ iCluster ][DVIS_PVS] ], pvs);
+
+	// Every patch in the cluster walks the same clusters, pull them out of the bitmap once
+	CUtlVector<int> visibleClusters;
+	visibleClusters.SetCount( dvis->numclusters );
+	int nVisibleClusters = g_VisBitmap.GetVisibleClusters( DVIS_PVS, iCluster, visibleClusters.Base() );
 	head = 0;
 
 	CTransferMaker transferMaker( transfers );
@@ -418,7 +417,7 @@ void BuildVisLeafs_Cluster(
 			patchnum = patch - g_Patches.Base();
 
 			// build to all other world clusters
-			BuildVisRow (patchnum, pvs, head, transfers, transferMaker, threadnum );
+			BuildVisRow (patchnum, visibleClusters.Base(), nVisibleClusters, head, transfers, transferMaker, threadnum );
 			transferMaker.Finish();
 			
 			// do the transfers
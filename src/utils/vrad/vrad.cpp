@@ -19,6 +19,7 @@
 #include "tools_minidump.h"
 #include "loadcmdline.h"
 #include "byteswap.h"
+#include "directlightcache.h"
 
 #define ALLOWDEBUGOPTIONS (0 || _DEBUG)
 
@@ -80,6 +81,7 @@ char		level_lights[MAX_PATH] = "";
 
 char		vismatfile[_MAX_PATH] = "";
 char		incrementfile[_MAX_PATH] = "";
+char		directlightcachefile[_MAX_PATH] = "";
 
 IIncremental *g_pIncremental = 0;
 bool		g_bInterrupt = false;	// Wsed with background lighting in WC. Tells VRAD
@@ -2029,7 +2031,20 @@ bool RadWorld_Go()
 	else 
 #endif
 	{
-		RunThreadsOnIndividual (numfaces, true, BuildFacelights);
+		// The cache is only kept for full single machine compiles
+		if ( g_bDirectLightCache && !g_pIncremental )
+		{
+			DirectLightCache_Init( directlightcachefile );
+			RunThreadsOnIndividual (numfaces, true, BuildFacelights);
+			DirectLightCache_Save();
+		}
+		else
+		{
+			g_bDirectLightCache = false;
+			RunThreadsOnIndividual (numfaces, true, BuildFacelights);
+		}
+
+		ReportDirectLightingTimes();
 	}
 
 	// Was the process interrupted?
@@ -2188,6 +2203,9 @@ void VRAD_LoadBSP( char const *pFilename )
 
 	strcpy(incrementfile, source);
 	Q_DefaultExtension(incrementfile, ".r0", sizeof(incrementfile));
+	// -both runs an LDR and an HDR pass, and every face key includes the mode
+	strcpy(directlightcachefile, source);
+	Q_DefaultExtension(directlightcachefile, g_bHDR ? ".hdr.vradcache" : ".ldr.vradcache", sizeof(directlightcachefile));
 	Q_DefaultExtension(source, ".bsp", sizeof( source ));
 
 	Msg( "Loading %s\n", source );
@@ -2250,6 +2268,8 @@ void VRAD_LoadBSP( char const *pFilename )
 		dvis->numclusters = CountClusters();
 	}
 
+	g_VisBitmap.BuildFromVisLump();
+
 	//
 	// patches and referencing data (ensure capacity)
 	//
@@ -2412,6 +2432,10 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		{
 			g_bTextureShadows = true;
 		}
+		else if ( !Q_stricmp( argv[i], "-directlightcache" ) )
+		{
+			g_bDirectLightCache = true;
+		}
 		else if ( !strcmp(argv[i], "-dump") )
 		{
 			g_bDumpPatches = true;
@@ -2874,6 +2898,8 @@ void PrintUsage( int argc, char **argv )
         "  -OnlyStaticProps   : Only perform direct static prop lighting (vrad debug option)\n"
 		"  -StaticPropNormals : when lighting static props, just show their normal vector\n"
 		"  -textureshadows : Allows texture alpha channels to block light - rays intersecting alpha surfaces will sample the texture\n"
+		"  -directlightcache : Keep each face's direct lighting in <mapname>.ldr/.hdr.vradcache and reuse it\n"
+		"                      on the next compile for faces that no changed light or geometry reaches\n"
 		"  -noskyboxrecurse : Turn off recursion into 3d skybox (skybox shadows on world)\n"
 		"  -nossprops      : Globally disable self-shadowing on static props\n"
 		"\n"
@@ -369,6 +369,16 @@ void ConvertRGBExp32ToLinear(const ColorRGBExp32 *pSrc, Vector* pDst);
 void ConvertLinearToRGBA8888( const Vector *pSrc, unsigned char *pDst );
 
 
+// Single cluster pair PVS test straight from the vis bitmap, with GetVisCache's
+// fallbacks: no vis data or a point outside the world sees everything.
+inline bool ClusterInPVS( int iFrom, int iTo )
+{
+	if ( iFrom < 0 || iTo < 0 || !g_VisBitmap.IsBuilt() )
+		return true;
+
+	return g_VisBitmap.IsVisible( DVIS_PVS, iFrom, iTo );
+}
+
 inline byte PVSCheck( const byte *pvs, int iCluster )
 {
 	if ( iCluster >= 0 )
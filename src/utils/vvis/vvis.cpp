@@ -46,6 +46,7 @@ int			portalbytes, portallongs;
 
 bool		fastvis;
 bool		nosort;
+bool		g_bVerifyVis = false;
 
 int			totalvis;
 
@@ -953,6 +954,10 @@ int ParseCommandLine( int argc, char **argv )
 			Msg ("nosort = true\n");
 			nosort = true;
 		}
+		else if (!Q_stricmp (argv[i],"-verifyvis"))
+		{
+			g_bVerifyVis = true;
+		}
 		else if (!Q_stricmp (argv[i],"-tmpin"))
 			strcpy (inbase, "/tmp");
 		else if( !Q_stricmp( argv[i], "-low" ) )
@@ -1042,6 +1047,7 @@ void PrintUsage( int argc, char **argv )
 		"  -threads        : Control the number of threads vbsp uses (defaults to the #\n"
 		"                    or processors on your machine).\n"
 		"  -nosort         : Don't sort portals (sorting is an optimization).\n"
+		"  -verifyvis      : Check the vis lump converts to vrad's vis bitmap and back unchanged.\n"
 		"  -tmpin          : Make portals come from \\tmp\\<mapname>.\n"
 		"  -tmpout         : Make portals come from \\tmp\\<mapname>.\n"
 		"  -trace <start cluster> <end cluster> : Writes a linefile that traces the vis from one cluster to another for debugging map vis.\n"
@@ -1191,6 +1197,19 @@ int RunVVis( int argc, char **argv )
 		visdatasize = vismap_p - dvisdata;
 		Msg ("visdatasize:%i  compressed from %i\n", visdatasize, originalvismapsize*2);
 
+		// vrad answers its visibility queries from the bitmap index, so the
+		// conversion has to give back exactly what was just compressed
+		if ( g_bVerifyVis )
+		{
+			g_VisBitmap.BuildFromVisLump();
+			if ( !g_VisBitmap.VerifyRoundTrip() )
+			{
+				Error( "Visibility bitmap doesn't round trip to the vis lump!\n" );
+			}
+			g_VisBitmap.Purge();
+			Msg ("vis bitmap round trip ok\n");
+		}
+
 		Msg ("writing %s\n", mapFile);
 		WriteBSPFile (mapFile);
 	}